@@ -0,0 +1,121 @@
+#include "animated_transform.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace naga::rt {
+
+  namespace {
+    /// Max rotation angle of a slice of motion bounds
+    constexpr float_t maxSliceAngle = 3.14159265358979f / 64;
+
+    /// Angle of rotation between unit quaternions
+    float_t getRotationAngle(const Quat& a, const Quat& b) {
+      auto d = std::min<float_t>(std::abs(glm::dot(a, b)), 1);
+      return 2 * std::acos(d);
+    }
+  } // namespace
+
+  AnimatedTransform::AnimatedTransform(
+    const Transform& start,
+    float_t startTime,
+    const Transform& end,
+    float_t endTime)
+    : m_transforms{start, end}
+    , m_keyframes{decompose(start.getMatrix()), decompose(end.getMatrix())}
+    , m_startTime{startTime}
+    , m_endTime{endTime}
+    , m_animated{start != end && endTime > startTime} {
+    // interpolate along shorter arc
+    auto& r0 = m_keyframes[0].rotation;
+    auto& r1 = m_keyframes[1].rotation;
+    if (glm::dot(r0, r1) < 0) r1 = -r1;
+    m_rotating = m_animated && getRotationAngle(r0, r1) > 0;
+  }
+
+  AnimatedTransform::Keyframe AnimatedTransform::decompose(const Mat4& m) {
+    Keyframe k;
+    k.translation = Vec3(m[3]);
+
+    // polar decomposition: average matrix with its inverse transpose until
+    // it converges to rotation
+    Mat3 linear(m);
+    Mat3 r = linear;
+    for (auto i = 0; i < 100; ++i) {
+      Mat3 next = (r + glm::inverse(glm::transpose(r))) * float_t(0.5);
+      float_t norm = 0;
+      for (auto c = 0; c < 3; ++c)
+        for (auto j = 0; j < 3; ++j)
+          norm = std::max(norm, std::abs(next[c][j] - r[c][j]));
+      r = next;
+      if (norm < 1e-6f) break;
+    }
+    // reflection: keep rotation proper, flip scale
+    if (glm::determinant(r) < 0) r = -r;
+    k.rotation = glm::normalize(glm::quat_cast(r));
+    k.scale = glm::transpose(r) * linear;
+    return k;
+  }
+
+  AnimatedTransform::Keyframe AnimatedTransform::lerp(float_t u) const {
+    const auto& [k0, k1] = m_keyframes;
+    Keyframe k;
+    k.translation = k0.translation * (1 - u) + k1.translation * u;
+    k.rotation = glm::slerp(k0.rotation, k1.rotation, u);
+    k.scale = k0.scale * (1 - u) + k1.scale * u;
+    return k;
+  }
+
+  Transform AnimatedTransform::compose(const Keyframe& k) {
+    Mat3 rotation = glm::mat3_cast(k.rotation);
+    Mat4 m(rotation * k.scale);
+    m[3] = Vec4(k.translation, 1);
+    // inverse of T R S is S^-1 R^T T^-1
+    Mat3 linearInv = glm::inverse(k.scale) * glm::transpose(rotation);
+    Mat4 inv(linearInv);
+    inv[3] = Vec4(-(linearInv * k.translation), 1);
+    return {m, inv};
+  }
+
+  Transform AnimatedTransform::interpolate(float_t time) const {
+    if (!m_animated || time <= m_startTime) return m_transforms[0];
+    if (time >= m_endTime) return m_transforms[1];
+    return compose(lerp((time - m_startTime) / (m_endTime - m_startTime)));
+  }
+
+  Bounds3 AnimatedTransform::motionBounds(const Bounds3& b) const {
+    if (b.empty()) return b;
+    auto b0 = m_transforms[0].transformBounds(b);
+    if (!m_animated) return b0;
+    auto b1 = m_transforms[1].transformBounds(b);
+    // without rotation, every point moves linearly
+    if (!m_rotating) return Bounds3::merge(b0, b1);
+
+    auto angle =
+      getRotationAngle(m_keyframes[0].rotation, m_keyframes[1].rotation);
+    auto n = std::max(1, static_cast<int>(std::ceil(angle / maxSliceAngle)));
+    Bounds3 ret = Bounds3::merge(b0, b1);
+    for (auto s = 0; s < n; ++s) {
+      auto ka = lerp(static_cast<float_t>(s) / n);
+      auto kb = lerp(static_cast<float_t>(s + 1) / n);
+      // with rotation fixed to start of slice, points move linearly
+      auto kbFixed = kb;
+      kbFixed.rotation = ka.rotation;
+      auto slice = Bounds3::merge(
+        transformBounds(compose(ka).getMatrix(), b),
+        transformBounds(compose(kbFixed).getMatrix(), b));
+      // rotating by up to `delta` moves a point at distance r by at most
+      // 2 r sin(delta / 2)
+      float_t r = 0;
+      for (unsigned char c = 0; c < 8; ++c) {
+        r = std::max(r, glm::length(ka.scale * b.corner(c)));
+        r = std::max(r, glm::length(kb.scale * b.corner(c)));
+      }
+      auto delta = getRotationAngle(ka.rotation, kb.rotation);
+      Vec3 pad(2 * r * std::sin(delta / 2));
+      ret = Bounds3::merge(
+        ret, Bounds3(slice.min() - pad, slice.max() + pad));
+    }
+    return ret;
+  }
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include "bounds.hpp"
+#include "geometry.hpp"
+#include "transform.hpp"
+
+/// \file Animated transform
+
+namespace naga::rt {
+
+  /** \brief Transform interpolated between two keyframes (motion blur).
+   * Keyframe matrices are decomposed into translation T, rotation R and
+   * scale S (polar decomposition, M = T R S). At time t, T and S are
+   * interpolated linearly and R by slerp. Times outside
+   * [startTime, endTime] are clamped.
+   */
+  class AnimatedTransform {
+  public:
+    /// Ctor (keyframes should be affine)
+    AnimatedTransform(
+      const Transform& start,
+      float_t startTime,
+      const Transform& end,
+      float_t endTime);
+
+    /// Check if keyframes differ
+    bool isAnimated() const {
+      return m_animated;
+    }
+    /// Get start time
+    float_t getStartTime() const {
+      return m_startTime;
+    }
+    /// Get end time
+    float_t getEndTime() const {
+      return m_endTime;
+    }
+
+    /// Get transform at time
+    Transform interpolate(float_t time) const;
+    /** \brief Get bounds of `b` transformed at any time in shutter interval.
+     * Conservative: each slice of the rotation is bounded by the bounds at
+     * its ends with fixed rotation, expanded by the largest chord deviation
+     * of rotating corners.
+     */
+    Bounds3 motionBounds(const Bounds3& b) const;
+
+  private:
+    /// Decomposed keyframe
+    struct Keyframe {
+      /// Translation
+      Vec3 translation;
+      /// Rotation
+      Quat rotation;
+      /// Scale (symmetric stretch matrix)
+      Mat3 scale;
+    };
+
+    /// Decompose affine matrix
+    static Keyframe decompose(const Mat4& m);
+    /// Get interpolated keyframe at parameter `u` in [0, 1]
+    Keyframe lerp(float_t u) const;
+    /// Compose matrix and inverse of keyframe
+    static Transform compose(const Keyframe& k);
+
+    /// Keyframe transforms
+    Transform m_transforms[2];
+    /// Decomposed keyframes
+    Keyframe m_keyframes[2];
+    /// Start time
+    float_t m_startTime;
+    /// End time
+    float_t m_endTime;
+    /// Keyframes differ?
+    bool m_animated;
+    /// Keyframes have different rotations?
+    bool m_rotating;
+  };
+}
@@ -6,15 +6,33 @@
 #include <thread>
 #include <functional>
 #include <type_traits>
+#include <utility>
 
 #include "image.hpp"
 #include "scene.hpp"
 #include "camera.hpp"
+#include "memory.hpp"
 #include "renderer.hpp"
 
 namespace naga::rt {
 
-  /// Basic renderer
+  /// Check if pixel renderer accepts per-thread memory arena
+  template <class PixelRendererType, class = void>
+  struct AcceptsMemoryArena : std::false_type {};
+
+  /// Check if pixel renderer accepts per-thread memory arena
+  template <class PixelRendererType>
+  struct AcceptsMemoryArena<
+    PixelRendererType,
+    std::void_t<decltype(std::declval<PixelRendererType&>().render(
+      PixelIndex(), PixelIndex(), std::declval<MemoryArena&>()))>>
+    : std::true_type {};
+
+  /** \brief Basic renderer.
+   * PixelRendererType may provide `render(x, y, MemoryArena& arena)` to
+   * create BSDFs and BSSRDFs in the arena of the rendering thread, which is
+   * reset after each pixel. Otherwise `render(x, y)` is called.
+   */
   template <class PixelRendererType>
   class BasicRenderer : Renderer {
   public:
@@ -48,7 +66,7 @@ namespace naga::rt {
         m_scene, m_camera, img.width(), img.height());
 
       // render tasks
-      std::deque<std::function<void()>> tasks;
+      std::deque<std::function<void(MemoryArena&)>> tasks;
 
       // set tasks
       for (auto&& sub_x : ranges::view::ints({0}, m_n_subimage_x)) {
@@ -67,13 +85,18 @@ namespace naga::rt {
             subimage_size.y = img.height() - subimage_pos.y;
 
           // push tasks
-          tasks.push_back([=, &img, &pixel_renderer]() {
+          tasks.push_back([=, &img, &pixel_renderer](MemoryArena& arena) {
             for (std::size_t sx = 0; sx < subimage_size.x; ++sx) {
               for (std::size_t sy = 0; sy < subimage_size.y; ++sy) {
                 auto x = PixelIndex(sx + subimage_pos.x);
                 auto y = PixelIndex(sy + subimage_pos.y);
                 assert(x < img.width() && y < img.height());
-                img(x, y) = pixel_renderer.render(x, y);
+                if constexpr (AcceptsMemoryArena<PixelRendererType>::value) {
+                  img(x, y) = pixel_renderer.render(x, y, arena);
+                  arena.reset();
+                } else {
+                  img(x, y) = pixel_renderer.render(x, y);
+                }
               }
             }
             return;
@@ -89,8 +112,10 @@ namespace naga::rt {
       // create threads
       for (auto nt : ranges::view::ints({0}, m_n_threads)) {
         threads.emplace_back([&, nt]() {
+          // per-thread memory arena
+          MemoryArena arena;
           while (true) {
-            std::function<void()> task;
+            std::function<void(MemoryArena&)> task;
             { // lock task queue
               std::lock_guard<std::mutex> lock(tq_mtx);
               if (tasks.empty()) return;
@@ -98,7 +123,7 @@ namespace naga::rt {
               tasks.pop_front();
             }
             // execute task
-            task();
+            task(arena);
           }
         });
       }
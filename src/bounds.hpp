@@ -1,6 +1,7 @@
 #pragma once
 
 #include "geometry.hpp"
+#include "ray.hpp"
 
 #include <cstddef>
 #include <cassert>
@@ -80,8 +81,44 @@ namespace naga::rt {
       return {glm::min(box.m_min, point), glm::max(box.m_max, point)};
     }
 
+    /// Get intersection of 2 bounding boxes (empty when disjoint)
+    static /*constexpr*/ Bounds3 overlap(const Bounds3& b1, const Bounds3& b2) {
+      Bounds3 ret;
+      ret.m_min = glm::max(b1.min(), b2.min());
+      ret.m_max = glm::min(b1.max(), b2.max());
+      return ret;
+    }
+    /// Check if min corner is above max corner on any axis
+    /*constexpr*/ bool empty() const {
+      return m_min.x > m_max.x || m_min.y > m_max.y || m_min.z > m_max.z;
+    }
+
+    /// Get diagonal vector
+    /*constexpr*/ Vec3 diagonal() const {
+      return m_max - m_min;
+    }
+    /// Get surface area
+    /*constexpr*/ float_t surfaceArea() const {
+      auto d = diagonal();
+      return 2 * (d.x * d.y + d.y * d.z + d.z * d.x);
+    }
+    /// Get index of the longest axis
+    /*constexpr*/ int maxExtent() const {
+      auto d = diagonal();
+      if (d.x > d.y && d.x > d.z) return 0;
+      return d.y > d.z ? 1 : 2;
+    }
+    /// Get relative position of point in the box ([0, 1] inside)
+    /*constexpr*/ Vec3 offset(const Vec3& p) const {
+      Vec3 o = p - m_min;
+      auto d = diagonal();
+      for (auto i = 0; i < 3; ++i)
+        if (d[i] > 0) o[i] /= d[i];
+      return o;
+    }
+
     /// Compute intersection
-    bool intersect(const Ray& ray, float_t tMin, float_t tMax) {
+    bool intersect(const Ray& ray, float_t tMin, float_t tMax) const {
       // calculate Ray/Plane intersections.
       Vec3 d = Vec3(1) / ray.dir();
       Vec3 Near = (m_min - ray.origin()) * d;
@@ -91,6 +128,7 @@ namespace naga::rt {
       float_t t1 = tMax;
       for (auto i = 0; i < 3; ++i) {
         if (Near[i] > Far[i]) std::swap(Near[i], Far[i]);
+        Far[i] *= slabFarScale;
         t0 = Near[i] > t0 ? Near[i] : t0;
         t1 = Far[i] < t1 ? Far[i] : t1;
         if (t0 > t1) return false;
@@ -98,6 +136,28 @@ namespace naga::rt {
       return true;
     }
 
+    /** \brief Compute intersection with precomputed reciprocal direction.
+     * Selects near/far slabs by sign of direction instead of swapping, so
+     * traversal loops can compute `invDir` and `dirIsNeg` once per ray.
+     */
+    bool intersect(
+      const Vec3& origin,
+      const Vec3& invDir,
+      const int dirIsNeg[3],
+      float_t tMin,
+      float_t tMax) const {
+      const Vec3* b[2] = {&m_min, &m_max};
+      for (auto i = 0; i < 3; ++i) {
+        float_t Near = ((*b[dirIsNeg[i]])[i] - origin[i]) * invDir[i];
+        float_t Far = ((*b[1 - dirIsNeg[i]])[i] - origin[i]) * invDir[i] *
+                      slabFarScale;
+        tMin = Near > tMin ? Near : tMin;
+        tMax = Far < tMax ? Far : tMax;
+        if (tMin > tMax) return false;
+      }
+      return true;
+    }
+
   private:
     Vec3 m_min;
     Vec3 m_max;
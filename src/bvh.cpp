@@ -0,0 +1,1840 @@
+#include "bvh.hpp"
+#include "morton.hpp"
+#include "parallel.hpp"
+
+#include <algorithm>
+#include <array>
+#include <functional>
+#include <limits>
+#include <typeindex>
+#include <typeinfo>
+#include <unordered_map>
+
+namespace naga::rt {
+
+  /// Intermediate BVH node used while building
+  struct BVHAccel::BuildNode {
+    /// Initialize as leaf
+    void initLeaf(std::size_t first, std::size_t n, const Bounds3& b) {
+      firstPrimOffset = first;
+      nPrimitives = n;
+      bounds = b;
+      children[0] = children[1] = nullptr;
+    }
+    /// Initialize as interior node
+    void initInterior(int axis, BuildNode* c0, BuildNode* c1) {
+      children[0] = c0;
+      children[1] = c1;
+      bounds = Bounds3::merge(c0->bounds, c1->bounds);
+      splitAxis = axis;
+      nPrimitives = 0;
+    }
+
+    /// Bounding box
+    Bounds3 bounds;
+    /// Children
+    BuildNode* children[2];
+    /// Split axis
+    int splitAxis;
+    /// Offset of first primitive
+    std::size_t firstPrimOffset;
+    /// Number of primitives
+    std::size_t nPrimitives;
+  };
+
+  /// Primitive information used while building
+  struct BVHAccel::PrimitiveInfo {
+    /// Index of primitive
+    std::size_t primitiveNumber;
+    /// Bounding box
+    Bounds3 bounds;
+    /// Center of bounding box
+    Vec3 centroid;
+  };
+
+  /// Primitive index with Morton code of its centroid
+  struct BVHAccel::MortonPrimitive {
+    /// Index of primitive
+    std::uint32_t primitiveIndex;
+    /// 30-bit Morton code
+    std::uint32_t mortonCode;
+  };
+
+  /// Sub-hierarchy of primitives which share upper bits of Morton code
+  struct BVHAccel::Treelet {
+    /// First index in sorted Morton primitives
+    std::size_t start;
+    /// Number of primitives
+    std::size_t nPrimitives;
+    /// Morton code of first primitive
+    std::uint32_t mortonCode;
+    /// Nodes
+    std::deque<BuildNode> buildNodes;
+    /// Root node
+    BuildNode* root;
+    /// Offset of root in linear node array
+    std::uint32_t nodeOffset;
+    /// Offset of first primitive in depth-first ordered primitives
+    std::size_t primitivesOffset;
+    /// Max depth of leaves in treelet
+    int depth = 0;
+  };
+
+  namespace {
+
+    /// Number of SAH buckets
+    constexpr std::size_t nBuckets = 12;
+    /// Traversal cost relative to primitive intersection
+    constexpr float_t traversalCost = 0.125f;
+
+    /// Number of treelet bits in Morton code
+    constexpr int treeletBits = 12;
+
+    /// Number of spatial split bins
+    constexpr std::size_t nSpatialBins = 32;
+
+    /// Get number of levels of binary tree over `n` leaves
+    int ceilLog2(std::size_t n) {
+      int levels = 0;
+      while ((std::size_t(1) << levels) < n)
+        ++levels;
+      return levels;
+    }
+
+    /** \brief Get levels kept below equal splits for splitting leaves by
+     * shape type. A leaf has at most maxPrimsInNode types, which are split
+     * in halves.
+     */
+    int getReservedDepth(const BVHBuildOptions& options) {
+      return options.homogeneousLeaves ? ceilLog2(options.maxPrimsInNode) : 0;
+    }
+
+    /// Check if `n` primitives at `depth` should be split into equal halves,
+    /// so that their leaves stay within BVHAccel::maxDepth
+    bool needsEqualSplit(
+      int depth, std::size_t n, const BVHBuildOptions& options) {
+      return depth + ceilLog2(n) + getReservedDepth(options) >=
+             BVHAccel::maxDepth;
+    }
+
+    /// Get type which selects intersection kernel of homogeneous leaves
+    /// (type of shape for GeometricPrimitive, type of primitive otherwise)
+    std::type_index getLeafType(Primitive& primitive) {
+      if (typeid(primitive) == typeid(GeometricPrimitive))
+        if (auto shape = primitive.getShape()) return typeid(*shape);
+      return typeid(primitive);
+    }
+
+    /** \brief Move items whose primitive has one of the first half of leaf
+     * types (in order of occurrence) to the front (stable), so that k types
+     * are split into homogeneous leaves within ceil(log2(k)) levels.
+     * \returns End of items of the first half of types (`last` if leaf is
+     * homogeneous)
+     */
+    template <class Iter, class GetPrimitive>
+    Iter partitionByLeafType(Iter first, Iter last, GetPrimitive getPrimitive) {
+      std::vector<std::type_index> types;
+      for (auto it = first; it != last; ++it) {
+        auto type = getLeafType(getPrimitive(*it));
+        if (std::find(types.begin(), types.end(), type) == types.end())
+          types.push_back(type);
+      }
+      if (types.size() == 1) return last;
+      types.erase(types.begin() + types.size() / 2, types.end());
+      return std::stable_partition(first, last, [&](const auto& item) {
+        auto type = getLeafType(getPrimitive(item));
+        return std::find(types.begin(), types.end(), type) != types.end();
+      });
+    }
+
+    /// Get SAH bucket of centroid
+    std::size_t bucketIndex(
+      const Bounds3& centroidBounds, int dim, const Vec3& centroid) {
+      auto b = static_cast<std::size_t>(
+        nBuckets * centroidBounds.offset(centroid)[dim]);
+      return std::min(b, nBuckets - 1);
+    }
+
+    /// SAH split
+    struct SAHSplit {
+      /// Last bucket of lower side
+      std::size_t bucket;
+      /// Cost (sum of count * area, not normalized)
+      float_t cost;
+    };
+
+    /// Find minimum cost SAH split over buckets
+    template <class Iterator, class GetBounds, class GetCentroid>
+    SAHSplit findSAHSplit(
+      Iterator first,
+      Iterator last,
+      const Bounds3& centroidBounds,
+      int dim,
+      GetBounds getBounds,
+      GetCentroid getCentroid) {
+
+      struct Bucket {
+        std::size_t count = 0;
+        Bounds3 bounds;
+      };
+      std::array<Bucket, nBuckets> buckets;
+
+      for (auto it = first; it != last; ++it) {
+        auto& bucket = buckets[bucketIndex(centroidBounds, dim, getCentroid(*it))];
+        bucket.bounds = bucket.count == 0
+                          ? getBounds(*it)
+                          : Bounds3::merge(bucket.bounds, getBounds(*it));
+        ++bucket.count;
+      }
+
+      // sweep from right to compute costs of upper side
+      std::array<float_t, nBuckets - 1> areaAbove;
+      std::array<std::size_t, nBuckets - 1> countAbove;
+      {
+        Bounds3 b;
+        std::size_t count = 0;
+        for (auto i = nBuckets - 1; i > 0; --i) {
+          if (buckets[i].count != 0)
+            b = count == 0 ? buckets[i].bounds
+                           : Bounds3::merge(b, buckets[i].bounds);
+          count += buckets[i].count;
+          areaAbove[i - 1] = count == 0 ? 0 : b.surfaceArea();
+          countAbove[i - 1] = count;
+        }
+      }
+
+      // sweep from left and find minimum cost split
+      SAHSplit split = {0, std::numeric_limits<float_t>::infinity()};
+      {
+        Bounds3 b;
+        std::size_t count = 0;
+        for (std::size_t i = 0; i < nBuckets - 1; ++i) {
+          if (buckets[i].count != 0)
+            b = count == 0 ? buckets[i].bounds
+                           : Bounds3::merge(b, buckets[i].bounds);
+          count += buckets[i].count;
+          float_t belowCost = count == 0 ? 0 : count * b.surfaceArea();
+          float_t cost = belowCost + countAbove[i] * areaAbove[i];
+          if (cost < split.cost) split = {i, cost};
+        }
+      }
+      return split;
+    }
+
+    /// Spatial split
+    struct SpatialSplit {
+      /// Last bin of lower side
+      std::size_t bin;
+      /// Cost (sum of count * area, not normalized)
+      float_t cost;
+      /// Bounds of lower and upper side
+      Bounds3 bounds[2];
+      /// Number of references on lower and upper side
+      std::size_t count[2];
+    };
+
+    /// Get spatial split bin of coordinate
+    std::size_t spatialBinIndex(float_t min, float_t binWidth, float_t x) {
+      auto b = std::floor((x - min) / binWidth);
+      return static_cast<std::size_t>(
+        std::clamp<float_t>(b, 0, nSpatialBins - 1));
+    }
+
+    /** \brief Find minimum cost spatial split over bins.
+     * References are clipped against each bin they overlap by
+     * `clip(ref, box)`, so references straddling a plane are counted on
+     * both sides.
+     */
+    template <class Ref, class Clip>
+    SpatialSplit findSpatialSplit(
+      const std::vector<Ref>& refs, const Bounds3& bounds, int dim, Clip clip) {
+      SpatialSplit split = {
+        0, std::numeric_limits<float_t>::infinity(), {}, {}};
+
+      float_t min = bounds.min()[dim];
+      float_t binWidth = bounds.diagonal()[dim] / nSpatialBins;
+      if (!(binWidth > 0)) return split;
+
+      struct Bin {
+        std::size_t nEntries = 0;
+        std::size_t nExits = 0;
+        Bounds3 bounds;
+        bool empty = true;
+      };
+      std::array<Bin, nSpatialBins> bins;
+
+      for (auto& ref : refs) {
+        auto first = spatialBinIndex(min, binWidth, ref.bounds.min()[dim]);
+        auto last = spatialBinIndex(min, binWidth, ref.bounds.max()[dim]);
+        for (auto b = first; b <= last; ++b) {
+          auto slab = ref.bounds;
+          auto lo = slab.min();
+          auto hi = slab.max();
+          if (b != first) lo[dim] = min + b * binWidth;
+          if (b != last) hi[dim] = min + (b + 1) * binWidth;
+          slab.setMin(lo);
+          slab.setMax(hi);
+          auto c = clip(ref, slab);
+          if (c.empty()) continue;
+          auto& bin = bins[b];
+          bin.bounds = bin.empty ? c : Bounds3::merge(bin.bounds, c);
+          bin.empty = false;
+        }
+        ++bins[first].nEntries;
+        ++bins[last].nExits;
+      }
+
+      // sweep from right to compute upper sides
+      std::array<Bounds3, nSpatialBins - 1> boundsAbove;
+      std::array<std::size_t, nSpatialBins - 1> countAbove;
+      std::array<bool, nSpatialBins - 1> emptyAbove;
+      {
+        Bounds3 b;
+        bool empty = true;
+        std::size_t count = 0;
+        for (auto i = nSpatialBins - 1; i > 0; --i) {
+          if (!bins[i].empty) {
+            b = empty ? bins[i].bounds : Bounds3::merge(b, bins[i].bounds);
+            empty = false;
+          }
+          count += bins[i].nExits;
+          boundsAbove[i - 1] = b;
+          countAbove[i - 1] = count;
+          emptyAbove[i - 1] = empty;
+        }
+      }
+
+      // sweep from left and find minimum cost split
+      {
+        Bounds3 b;
+        bool empty = true;
+        std::size_t count = 0;
+        for (std::size_t i = 0; i < nSpatialBins - 1; ++i) {
+          if (!bins[i].empty) {
+            b = empty ? bins[i].bounds : Bounds3::merge(b, bins[i].bounds);
+            empty = false;
+          }
+          count += bins[i].nEntries;
+          if (count == 0 || countAbove[i] == 0 || empty || emptyAbove[i])
+            continue;
+          float_t cost = count * b.surfaceArea() +
+                         countAbove[i] * boundsAbove[i].surfaceArea();
+          if (cost < split.cost)
+            split = {i, cost, {b, boundsAbove[i]}, {count, countAbove[i]}};
+        }
+      }
+      return split;
+    }
+
+    /// Parallel LSD radix sort of Morton codes
+    template <class MortonPrimitive>
+    void radixSort(std::vector<MortonPrimitive>& v, std::size_t nThreads) {
+      constexpr int bitsPerPass = 6;
+      constexpr int nBits = 3 * mortonBits;
+      constexpr int nPasses = nBits / bitsPerPass;
+      constexpr std::size_t nRadixBuckets = 1 << bitsPerPass;
+      constexpr std::uint32_t bitMask = (1 << bitsPerPass) - 1;
+      static_assert(nBits % bitsPerPass == 0);
+
+      // do not create chunks smaller than this
+      constexpr std::size_t minChunkSize = 4096;
+      std::size_t nChunks =
+        std::max<std::size_t>(1, std::min(nThreads, v.size() / minChunkSize));
+
+      std::vector<MortonPrimitive> temp(v.size());
+      std::vector<std::array<std::size_t, nRadixBuckets>> counts(nChunks);
+
+      for (int pass = 0; pass < nPasses; ++pass) {
+        int lowBit = pass * bitsPerPass;
+        auto& in = (pass & 1) ? temp : v;
+        auto& out = (pass & 1) ? v : temp;
+
+        // count per chunk
+        parallelForChunks(
+          in.size(), nChunks,
+          [&](std::size_t chunk, std::size_t begin, std::size_t end) {
+            auto& c = counts[chunk];
+            c.fill(0);
+            for (auto i = begin; i < end; ++i)
+              ++c[(in[i].mortonCode >> lowBit) & bitMask];
+          });
+
+        // exclusive prefix sum in (bucket, chunk) order
+        std::size_t sum = 0;
+        for (std::size_t b = 0; b < nRadixBuckets; ++b) {
+          for (auto& c : counts) {
+            auto n = c[b];
+            c[b] = sum;
+            sum += n;
+          }
+        }
+
+        // scatter
+        parallelForChunks(
+          in.size(), nChunks,
+          [&](std::size_t chunk, std::size_t begin, std::size_t end) {
+            auto& c = counts[chunk];
+            for (auto i = begin; i < end; ++i)
+              out[c[(in[i].mortonCode >> lowBit) & bitMask]++] = in[i];
+          });
+      }
+      if (nPasses & 1) v.swap(temp);
+    }
+
+    /// Grid step of quantized bounds.
+    /// Grid is one step larger than the box, so that the last step
+    /// always covers max corner regardless of rounding.
+    Vec3 quantizationStep(const Bounds3& b) {
+      return b.diagonal() * (1.f / 254);
+    }
+
+    /// Dequantize coordinate
+    float_t dequantize(float_t min, float_t step, std::uint8_t q) {
+      return min + q * step;
+    }
+
+    /// Dequantize child bounds of quantized node
+    Bounds3 dequantize(
+      const QuantizedBVHNode& node, int child, const Bounds3& bounds) {
+      auto step = quantizationStep(bounds);
+      Vec3 min, max;
+      for (auto a = 0; a < 3; ++a) {
+        min[a] = dequantize(bounds.min()[a], step[a], node.qMin[child][a]);
+        max[a] = dequantize(bounds.min()[a], step[a], node.qMax[child][a]);
+      }
+      return {min, max};
+    }
+
+    /// Margin to keep dequantized bounds conservative under rounding
+    float_t quantizationMargin(float_t x, float_t step) {
+      return step * 0.01f +
+             std::abs(x) * 4 * std::numeric_limits<float_t>::epsilon();
+    }
+
+    /// Quantize min coordinate (rounded down)
+    std::uint8_t quantizeMin(float_t min, float_t step, float_t x) {
+      if (!(step > 0)) return 0;
+      auto q = std::clamp<float_t>(std::floor((x - min) / step), 0, 255);
+      auto ret = static_cast<std::uint8_t>(q);
+      while (ret > 0 &&
+             dequantize(min, step, ret) > x - quantizationMargin(x, step))
+        --ret;
+      return ret;
+    }
+
+    /// Quantize max coordinate (rounded up)
+    std::uint8_t quantizeMax(float_t min, float_t step, float_t x) {
+      if (!(step > 0)) return 0;
+      auto q = std::clamp<float_t>(std::ceil((x - min) / step), 0, 255);
+      auto ret = static_cast<std::uint8_t>(q);
+      while (ret < 255 &&
+             dequantize(min, step, ret) < x + quantizationMargin(x, step))
+        ++ret;
+      return ret;
+    }
+  } // namespace
+
+  BVHAccel::BVHAccel(
+    std::vector<std::shared_ptr<Primitive>> primitives,
+    const BVHBuildOptions& options)
+    : m_options{options}, m_primitives{std::move(primitives)} {
+    m_options.maxPrimsInNode =
+      std::clamp<std::size_t>(m_options.maxPrimsInNode, 1, 255);
+    m_options.nThreads = std::max<std::size_t>(m_options.nThreads, 1);
+    if (m_options.encoding == BVHNodeEncoding::Quantized8)
+      m_options.maxPrimsInNode = std::min<std::size_t>(
+        m_options.maxPrimsInNode, QuantizedBVHNode::maxPrimitives);
+
+    if (m_primitives.empty()) return;
+
+    // collect bounding boxes
+    std::vector<PrimitiveInfo> primitiveInfo(m_primitives.size());
+    parallelForChunks(
+      m_primitives.size(), m_options.nThreads,
+      [&](std::size_t, std::size_t begin, std::size_t end) {
+        for (auto i = begin; i < end; ++i) {
+          auto b = m_primitives[i]->getBoundingBox();
+          primitiveInfo[i] = {i, b, b.center()};
+        }
+      });
+
+    if (m_options.method == BVHBuildMethod::HLBVH) {
+      hlbvhBuild(primitiveInfo);
+    } else if (m_options.method == BVHBuildMethod::SBVH) {
+      // build tree with spatial splits
+      Bounds3 bounds = primitiveInfo[0].bounds;
+      for (auto& pi : primitiveInfo)
+        bounds = Bounds3::merge(bounds, pi.bounds);
+      auto budget = static_cast<std::size_t>(
+        std::max<float_t>(0, m_options.spatialSplitBudget) *
+        m_primitives.size());
+      std::deque<BuildNode> buildNodes;
+      std::vector<std::shared_ptr<Primitive>> orderedPrims;
+      orderedPrims.reserve(m_primitives.size() + budget);
+      BuildNode* root = spatialSplitBuild(
+        std::move(primitiveInfo),
+        m_options.spatialSplitAlpha * bounds.surfaceArea(), &budget, 0,
+        orderedPrims, buildNodes);
+      m_primitives.swap(orderedPrims);
+
+      // flatten
+      std::uint32_t offset = 0;
+      m_nodes.resize(buildNodes.size());
+      flattenTree(root, &offset);
+    } else {
+      // build tree
+      std::deque<BuildNode> buildNodes;
+      std::vector<std::shared_ptr<Primitive>> orderedPrims;
+      orderedPrims.reserve(m_primitives.size());
+      BuildNode* root = recursiveBuild(
+        primitiveInfo, 0, m_primitives.size(), 0, orderedPrims, buildNodes);
+      m_primitives.swap(orderedPrims);
+
+      // flatten
+      std::uint32_t offset = 0;
+      m_nodes.resize(buildNodes.size());
+      flattenTree(root, &offset);
+    }
+
+    if (m_options.encoding == BVHNodeEncoding::Quantized8) {
+      assert(m_primitives.size() <= QuantizedBVHNode::maxPrimitivesOffset);
+      m_bounds = m_nodes[0].bounds;
+      m_rootReference = quantize(0, m_bounds);
+      // float nodes are no longer needed
+      decltype(m_nodes)().swap(m_nodes);
+    }
+    updateNodeViews();
+    packLeaves();
+  }
+
+  BVHAccel::BVHAccel(
+    std::vector<std::shared_ptr<Primitive>> primitives,
+    BVHNodeStorage storage,
+    const BVHBuildOptions& options)
+    : m_options{options}
+    , m_primitives{std::move(primitives)}
+    , m_bounds{storage.bounds}
+    , m_rootReference{storage.rootReference}
+    , m_nodeView{storage.nodes}
+    , m_quantizedNodeView{storage.quantizedNodes}
+    , m_storage{std::move(storage.owner)} {
+    m_options.nThreads = std::max<std::size_t>(m_options.nThreads, 1);
+    packLeaves();
+  }
+
+  void BVHAccel::updateNodeViews() {
+    m_nodeView = m_nodes;
+    m_quantizedNodeView = m_quantizedNodes;
+    m_storage.reset();
+  }
+
+  void BVHAccel::packLeaves() {
+    if (m_options.packTriangles)
+      m_packedTriangles = PackedTriangles(m_primitives);
+    if (!m_options.homogeneousLeaves) return;
+
+    // shapes are only set for leaves of GeometricPrimitives whose shapes
+    // have one type and are not packed (nodes may come from a build
+    // without type partition, and packed triangles are already tested)
+    m_leafShapes.assign(m_primitives.size(), nullptr);
+    bool packed = !m_packedTriangles.empty();
+    auto addLeaf = [&](std::uint32_t offset, std::uint32_t n) {
+      const std::type_info* type = nullptr;
+      for (auto i = offset; i < offset + n; ++i) {
+        auto& p = *m_primitives[i];
+        // subclasses may override intersection of GeometricPrimitive
+        if (typeid(p) != typeid(GeometricPrimitive)) return;
+        if (packed && m_packedTriangles.isPacked(i)) return;
+        auto shape = p.getShape();
+        if (!shape || (type && typeid(*shape) != *type)) return;
+        type = &typeid(*shape);
+      }
+      for (auto i = offset; i < offset + n; ++i)
+        m_leafShapes[i] = m_primitives[i]->getShape().get();
+    };
+    for (const auto& node : m_nodeView)
+      if (node.nPrimitives > 0)
+        addLeaf(node.primitivesOffset, node.nPrimitives);
+    auto addReference = [&](std::uint32_t reference) {
+      if (reference & QuantizedBVHNode::leafFlag)
+        addLeaf(
+          reference & QuantizedBVHNode::maxPrimitivesOffset,
+          (reference >> 27) & 0xf);
+    };
+    if (
+      m_options.encoding == BVHNodeEncoding::Quantized8 &&
+      !m_primitives.empty())
+      addReference(m_rootReference);
+    for (const auto& node : m_quantizedNodeView)
+      for (auto reference : node.children)
+        addReference(reference);
+  }
+
+  BVHAccel::BuildNode* BVHAccel::recursiveBuild(
+    std::vector<PrimitiveInfo>& primitiveInfo,
+    std::size_t start,
+    std::size_t end,
+    int depth,
+    std::vector<std::shared_ptr<Primitive>>& orderedPrims,
+    std::deque<BuildNode>& buildNodes) {
+
+    BuildNode* node = &buildNodes.emplace_back();
+
+    // bounds of all primitives
+    Bounds3 bounds = primitiveInfo[start].bounds;
+    for (auto i = start + 1; i < end; ++i)
+      bounds = Bounds3::merge(bounds, primitiveInfo[i].bounds);
+
+    std::size_t nPrimitives = end - start;
+
+    auto createLeaf = [&]() {
+      if (m_options.homogeneousLeaves) {
+        // split off primitives of other types
+        auto first = primitiveInfo.begin() + start;
+        auto last = primitiveInfo.begin() + end;
+        auto pmid = partitionByLeafType(
+          first, last, [&](const PrimitiveInfo& pi) -> Primitive& {
+            return *m_primitives[pi.primitiveNumber];
+          });
+        if (pmid != last) {
+          std::size_t mid = pmid - primitiveInfo.begin();
+          node->initInterior(
+            bounds.maxExtent(),
+            recursiveBuild(
+              primitiveInfo, start, mid, depth + 1, orderedPrims, buildNodes),
+            recursiveBuild(
+              primitiveInfo, mid, end, depth + 1, orderedPrims, buildNodes));
+          return node;
+        }
+      }
+      std::size_t first = orderedPrims.size();
+      for (auto i = start; i < end; ++i)
+        orderedPrims.push_back(
+          m_primitives[primitiveInfo[i].primitiveNumber]);
+      node->initLeaf(first, nPrimitives, bounds);
+      return node;
+    };
+
+    if (nPrimitives == 1) return createLeaf();
+
+    // bounds of centroids
+    Bounds3 centroidBounds = primitiveInfo[start].centroid;
+    for (auto i = start + 1; i < end; ++i)
+      centroidBounds = Bounds3::merge(centroidBounds, primitiveInfo[i].centroid);
+    int dim = centroidBounds.maxExtent();
+
+    std::size_t mid = (start + end) / 2;
+    bool equalSplit = needsEqualSplit(depth, nPrimitives, m_options);
+
+    if (equalSplit || centroidBounds.max()[dim] == centroidBounds.min()[dim]) {
+      // all centroids are at the same position, or SAH splits could exceed
+      // max depth
+      if (nPrimitives <= m_options.maxPrimsInNode) return createLeaf();
+      // split in the middle to keep leaves small
+    } else {
+      // binned SAH
+      auto first = primitiveInfo.begin() + start;
+      auto last = primitiveInfo.begin() + end;
+      auto split = findSAHSplit(
+        first, last, centroidBounds, dim,
+        [](const PrimitiveInfo& pi) -> const Bounds3& { return pi.bounds; },
+        [](const PrimitiveInfo& pi) -> const Vec3& { return pi.centroid; });
+
+      float_t leafCost = nPrimitives;
+      float_t splitCost = traversalCost + split.cost / bounds.surfaceArea();
+
+      if (nPrimitives <= m_options.maxPrimsInNode && leafCost <= splitCost)
+        return createLeaf();
+
+      auto pmid =
+        std::partition(first, last, [&](const PrimitiveInfo& pi) {
+          return bucketIndex(centroidBounds, dim, pi.centroid) <= split.bucket;
+        });
+      mid = pmid - primitiveInfo.begin();
+    }
+
+    if (equalSplit || mid == start || mid == end) {
+      // failed to partition: split in the middle
+      mid = (start + end) / 2;
+      std::nth_element(
+        primitiveInfo.begin() + start, primitiveInfo.begin() + mid,
+        primitiveInfo.begin() + end,
+        [dim](const PrimitiveInfo& a, const PrimitiveInfo& b) {
+          return a.centroid[dim] < b.centroid[dim];
+        });
+    }
+
+    node->initInterior(
+      dim,
+      recursiveBuild(
+        primitiveInfo, start, mid, depth + 1, orderedPrims, buildNodes),
+      recursiveBuild(
+        primitiveInfo, mid, end, depth + 1, orderedPrims, buildNodes));
+    return node;
+  }
+
+  BVHAccel::BuildNode* BVHAccel::spatialSplitBuild(
+    std::vector<PrimitiveInfo> refs,
+    float_t minOverlap,
+    std::size_t* budget,
+    int depth,
+    std::vector<std::shared_ptr<Primitive>>& orderedPrims,
+    std::deque<BuildNode>& buildNodes) {
+
+    BuildNode* node = &buildNodes.emplace_back();
+
+    // bounds of all references
+    Bounds3 bounds = refs[0].bounds;
+    for (auto& ref : refs)
+      bounds = Bounds3::merge(bounds, ref.bounds);
+
+    std::size_t nRefs = refs.size();
+
+    auto createLeaf = [&]() {
+      if (m_options.homogeneousLeaves) {
+        // split off references to primitives of other types
+        auto mid = partitionByLeafType(
+          refs.begin(), refs.end(),
+          [&](const PrimitiveInfo& ref) -> Primitive& {
+            return *m_primitives[ref.primitiveNumber];
+          });
+        if (mid != refs.end()) {
+          std::vector<PrimitiveInfo> others(mid, refs.end());
+          refs.erase(mid, refs.end());
+          auto axis = bounds.maxExtent();
+          auto c0 = spatialSplitBuild(
+            std::move(refs), minOverlap, budget, depth + 1, orderedPrims,
+            buildNodes);
+          auto c1 = spatialSplitBuild(
+            std::move(others), minOverlap, budget, depth + 1, orderedPrims,
+            buildNodes);
+          node->initInterior(axis, c0, c1);
+          return node;
+        }
+      }
+      std::size_t first = orderedPrims.size();
+      for (auto& ref : refs)
+        orderedPrims.push_back(m_primitives[ref.primitiveNumber]);
+      node->initLeaf(first, nRefs, bounds);
+      return node;
+    };
+
+    if (nRefs == 1) return createLeaf();
+
+    // bounds of centroids
+    Bounds3 centroidBounds = refs[0].centroid;
+    for (auto& ref : refs)
+      centroidBounds = Bounds3::merge(centroidBounds, ref.centroid);
+    int dim = centroidBounds.maxExtent();
+    // below max depth for SAH splits, only split references in the middle
+    bool equalSplit = needsEqualSplit(depth, nRefs, m_options);
+    bool splitCentroids =
+      !equalSplit && centroidBounds.max()[dim] > centroidBounds.min()[dim];
+
+    // object split
+    SAHSplit objectSplit = {0, std::numeric_limits<float_t>::infinity()};
+    float_t objectOverlap = 0;
+    if (splitCentroids) {
+      objectSplit = findSAHSplit(
+        refs.begin(), refs.end(), centroidBounds, dim,
+        [](const PrimitiveInfo& pi) -> const Bounds3& { return pi.bounds; },
+        [](const PrimitiveInfo& pi) -> const Vec3& { return pi.centroid; });
+
+      Bounds3 b[2];
+      bool empty[2] = {true, true};
+      for (auto& ref : refs) {
+        int side =
+          bucketIndex(centroidBounds, dim, ref.centroid) > objectSplit.bucket;
+        b[side] =
+          empty[side] ? ref.bounds : Bounds3::merge(b[side], ref.bounds);
+        empty[side] = false;
+      }
+      auto o = Bounds3::overlap(b[0], b[1]);
+      if (!empty[0] && !empty[1] && !o.empty())
+        objectOverlap = o.surfaceArea();
+    }
+
+    // spatial split, only when children of object split overlap
+    int spatialDim = bounds.maxExtent();
+    auto clip = [&](const PrimitiveInfo& ref, const Bounds3& box) {
+      return Bounds3::overlap(
+        m_primitives[ref.primitiveNumber]->getClippedBoundingBox(box), box);
+    };
+    SpatialSplit spatialSplit = {
+      0, std::numeric_limits<float_t>::infinity(), {}, {}};
+    if (
+      !equalSplit && *budget > 0 &&
+      (!splitCentroids || objectOverlap > minOverlap)) {
+      for (auto a = 0; a < 3; ++a) {
+        auto split = findSpatialSplit(refs, bounds, a, clip);
+        // references duplicated by the split should fit in budget
+        if (split.count[0] + split.count[1] - nRefs > *budget) continue;
+        if (split.cost < spatialSplit.cost) {
+          spatialSplit = split;
+          spatialDim = a;
+        }
+      }
+    }
+
+    float_t leafCost = nRefs;
+    float_t splitCost =
+      traversalCost +
+      std::min(objectSplit.cost, spatialSplit.cost) / bounds.surfaceArea();
+
+    if (nRefs <= m_options.maxPrimsInNode && leafCost <= splitCost)
+      return createLeaf();
+
+    std::vector<PrimitiveInfo> children[2];
+
+    if (spatialSplit.cost < objectSplit.cost) {
+      float_t min = bounds.min()[spatialDim];
+      float_t binWidth = bounds.diagonal()[spatialDim] / nSpatialBins;
+      float_t plane = min + (spatialSplit.bin + 1) * binWidth;
+      auto& b = spatialSplit.bounds;
+      auto& n = spatialSplit.count;
+      for (auto& ref : refs) {
+        auto first =
+          spatialBinIndex(min, binWidth, ref.bounds.min()[spatialDim]);
+        auto last =
+          spatialBinIndex(min, binWidth, ref.bounds.max()[spatialDim]);
+        if (last <= spatialSplit.bin) {
+          children[0].push_back(ref);
+          continue;
+        }
+        if (first > spatialSplit.bin) {
+          children[1].push_back(ref);
+          continue;
+        }
+        // unsplit reference when it is cheaper to put it on one side
+        float_t bothCost =
+          n[0] * b[0].surfaceArea() + n[1] * b[1].surfaceArea();
+        float_t lowerCost =
+          n[0] * Bounds3::merge(b[0], ref.bounds).surfaceArea() +
+          (n[1] - 1) * b[1].surfaceArea();
+        float_t upperCost =
+          (n[0] - 1) * b[0].surfaceArea() +
+          n[1] * Bounds3::merge(b[1], ref.bounds).surfaceArea();
+        if (lowerCost < bothCost && lowerCost <= upperCost) {
+          children[0].push_back(ref);
+          continue;
+        }
+        if (upperCost < bothCost) {
+          children[1].push_back(ref);
+          continue;
+        }
+        // split reference
+        auto lower = ref.bounds;
+        auto upper = ref.bounds;
+        auto hi = lower.max();
+        auto lo = upper.min();
+        hi[spatialDim] = plane;
+        lo[spatialDim] = plane;
+        lower.setMax(hi);
+        upper.setMin(lo);
+        lower = clip(ref, lower);
+        upper = clip(ref, upper);
+        if (!lower.empty())
+          children[0].push_back({ref.primitiveNumber, lower, lower.center()});
+        if (!upper.empty())
+          children[1].push_back({ref.primitiveNumber, upper, upper.center()});
+      }
+
+      if (children[0].empty() || children[1].empty()) {
+        // clipping removed one side: fall back to object split
+        children[0].clear();
+        children[1].clear();
+      } else {
+        *budget -= std::min(
+          *budget, children[0].size() + children[1].size() - nRefs);
+        dim = spatialDim;
+      }
+    }
+
+    if (children[0].empty()) {
+      auto mid = refs.begin() + nRefs / 2;
+      if (splitCentroids) {
+        mid = std::partition(
+          refs.begin(), refs.end(), [&](const PrimitiveInfo& pi) {
+            return bucketIndex(centroidBounds, dim, pi.centroid) <=
+                   objectSplit.bucket;
+          });
+      }
+      if (equalSplit || mid == refs.begin() || mid == refs.end()) {
+        // failed to partition: split in the middle
+        mid = refs.begin() + nRefs / 2;
+        std::nth_element(
+          refs.begin(), mid, refs.end(),
+          [dim](const PrimitiveInfo& a, const PrimitiveInfo& b) {
+            return a.centroid[dim] < b.centroid[dim];
+          });
+      }
+      children[0].assign(refs.begin(), mid);
+      children[1].assign(mid, refs.end());
+    }
+
+    // release references before recursion
+    decltype(refs)().swap(refs);
+
+    BuildNode* c0 = spatialSplitBuild(
+      std::move(children[0]), minOverlap, budget, depth + 1, orderedPrims,
+      buildNodes);
+    BuildNode* c1 = spatialSplitBuild(
+      std::move(children[1]), minOverlap, budget, depth + 1, orderedPrims,
+      buildNodes);
+    node->initInterior(dim, c0, c1);
+    return node;
+  }
+
+  void BVHAccel::hlbvhBuild(const std::vector<PrimitiveInfo>& primitiveInfo) {
+    const auto nThreads = m_options.nThreads;
+
+    // bounds of centroids
+    Bounds3 centroidBounds = primitiveInfo[0].centroid;
+    for (auto& pi : primitiveInfo)
+      centroidBounds = Bounds3::merge(centroidBounds, pi.centroid);
+
+    // compute Morton codes
+    std::vector<MortonPrimitive> mortonPrims(primitiveInfo.size());
+    parallelForChunks(
+      primitiveInfo.size(), nThreads,
+      [&](std::size_t, std::size_t begin, std::size_t end) {
+        constexpr float_t mortonScale = 1 << mortonBits;
+        for (auto i = begin; i < end; ++i) {
+          auto o = centroidBounds.offset(primitiveInfo[i].centroid);
+          mortonPrims[i] = {static_cast<std::uint32_t>(i),
+                            encodeMorton3(o * mortonScale)};
+        }
+      });
+
+    // sort
+    radixSort(mortonPrims, nThreads);
+
+    // find treelets
+    std::vector<Treelet> treelets;
+    {
+      constexpr std::uint32_t mask =
+        ((1u << treeletBits) - 1) << (3 * mortonBits - treeletBits);
+      std::size_t start = 0;
+      for (std::size_t end = 1; end <= mortonPrims.size(); ++end) {
+        if (
+          end == mortonPrims.size() ||
+          (mortonPrims[start].mortonCode & mask) !=
+            (mortonPrims[end].mortonCode & mask)) {
+          auto& t = treelets.emplace_back();
+          t.start = start;
+          t.nPrimitives = end - start;
+          t.mortonCode = mortonPrims[start].mortonCode;
+          start = end;
+        }
+      }
+    }
+
+    // build treelets
+    parallelFor(treelets.size(), nThreads, [&](std::size_t i) {
+      auto& t = treelets[i];
+      constexpr int firstBitIndex = 3 * mortonBits - 1 - treeletBits;
+      t.root = emitLBVH(
+        primitiveInfo, mortonPrims, t.start, t.start + t.nPrimitives,
+        firstBitIndex, 0, &t.depth, t.buildNodes);
+    });
+
+    // build upper levels
+    std::deque<BuildNode> upperNodes;
+    BuildNode* root = buildUpper(
+      treelets, 0, treelets.size(), 3 * mortonBits - 1, 0, upperNodes);
+
+    // lay out upper levels, leaving space for treelets
+    std::unordered_map<const BuildNode*, Treelet*> treeletRoots;
+    std::size_t nNodes = upperNodes.size();
+    for (auto& t : treelets) {
+      treeletRoots[t.root] = &t;
+      nNodes += t.buildNodes.size();
+    }
+    m_nodes.resize(nNodes);
+
+    std::uint32_t offset = 0;
+    std::size_t primitivesOffset = 0;
+    std::function<std::uint32_t(const BuildNode*)> layoutUpper =
+      [&](const BuildNode* node) {
+        auto current = offset;
+        if (auto it = treeletRoots.find(node); it != treeletRoots.end()) {
+          auto& t = *it->second;
+          t.nodeOffset = current;
+          t.primitivesOffset = primitivesOffset;
+          offset += static_cast<std::uint32_t>(t.buildNodes.size());
+          primitivesOffset += t.nPrimitives;
+          return current;
+        }
+        ++offset;
+        auto& n = m_nodes[current];
+        n.bounds = node->bounds;
+        n.nPrimitives = 0;
+        n.axis = static_cast<std::uint8_t>(node->splitAxis);
+        n.pad = 0;
+        layoutUpper(node->children[0]);
+        n.secondChildOffset = layoutUpper(node->children[1]);
+        return current;
+      };
+    layoutUpper(root);
+
+    // flatten treelets and reorder primitives in depth-first order
+    std::vector<std::shared_ptr<Primitive>> orderedPrims(m_primitives.size());
+    parallelFor(treelets.size(), nThreads, [&](std::size_t i) {
+      auto& t = treelets[i];
+      for (std::size_t j = 0; j < t.nPrimitives; ++j)
+        orderedPrims[t.primitivesOffset + j] =
+          m_primitives[mortonPrims[t.start + j].primitiveIndex];
+      for (auto& node : t.buildNodes)
+        if (node.nPrimitives > 0)
+          node.firstPrimOffset += t.primitivesOffset - t.start;
+      auto offset = t.nodeOffset;
+      flattenTree(t.root, &offset);
+    });
+    m_primitives.swap(orderedPrims);
+  }
+
+  BVHAccel::BuildNode* BVHAccel::emitLBVH(
+    const std::vector<PrimitiveInfo>& primitiveInfo,
+    std::vector<MortonPrimitive>& mortonPrims,
+    std::size_t start,
+    std::size_t end,
+    int bitIndex,
+    int depth,
+    int* treeletDepth,
+    std::deque<BuildNode>& buildNodes) {
+
+    std::size_t nPrimitives = end - start;
+
+    if (nPrimitives <= m_options.maxPrimsInNode) {
+      if (m_options.homogeneousLeaves) {
+        // split off primitives of other types
+        auto first = mortonPrims.begin() + start;
+        auto last = mortonPrims.begin() + end;
+        auto pmid = partitionByLeafType(
+          first, last, [&](const MortonPrimitive& mp) -> Primitive& {
+            return *m_primitives[mp.primitiveIndex];
+          });
+        if (pmid != last) {
+          std::size_t mid = pmid - mortonPrims.begin();
+          BuildNode* node = &buildNodes.emplace_back();
+          BuildNode* c0 = emitLBVH(
+            primitiveInfo, mortonPrims, start, mid, bitIndex, depth + 1,
+            treeletDepth, buildNodes);
+          BuildNode* c1 = emitLBVH(
+            primitiveInfo, mortonPrims, mid, end, bitIndex, depth + 1,
+            treeletDepth, buildNodes);
+          node->initInterior(0, c0, c1);
+          return node;
+        }
+      }
+      // create leaf
+      *treeletDepth = std::max(*treeletDepth, depth);
+      BuildNode* node = &buildNodes.emplace_back();
+      Bounds3 bounds = primitiveInfo[mortonPrims[start].primitiveIndex].bounds;
+      for (auto i = start + 1; i < end; ++i)
+        bounds = Bounds3::merge(
+          bounds, primitiveInfo[mortonPrims[i].primitiveIndex].bounds);
+      node->initLeaf(start, nPrimitives, bounds);
+      return node;
+    }
+
+    std::size_t mid;
+    int axis;
+    // upper levels over treelets take up to treeletBits levels when split
+    // in the middle
+    if (
+      bitIndex < 0 ||
+      needsEqualSplit(depth + treeletBits, nPrimitives, m_options)) {
+      // identical codes (or too deep): split in the middle
+      mid = (start + end) / 2;
+      axis = 0;
+    } else {
+      std::uint32_t mask = 1u << bitIndex;
+      // all primitives are on the same side of this split plane
+      if (
+        (mortonPrims[start].mortonCode & mask) ==
+        (mortonPrims[end - 1].mortonCode & mask))
+        return emitLBVH(
+          primitiveInfo, mortonPrims, start, end, bitIndex - 1, depth,
+          treeletDepth, buildNodes);
+
+      // find first primitive with bit set
+      mid = std::partition_point(
+              mortonPrims.begin() + start, mortonPrims.begin() + end,
+              [mask](const MortonPrimitive& mp) {
+                return (mp.mortonCode & mask) == 0;
+              }) -
+            mortonPrims.begin();
+      axis = bitIndex % 3;
+    }
+
+    BuildNode* node = &buildNodes.emplace_back();
+    BuildNode* c0 = emitLBVH(
+      primitiveInfo, mortonPrims, start, mid, bitIndex - 1, depth + 1,
+      treeletDepth, buildNodes);
+    BuildNode* c1 = emitLBVH(
+      primitiveInfo, mortonPrims, mid, end, bitIndex - 1, depth + 1,
+      treeletDepth, buildNodes);
+    node->initInterior(axis, c0, c1);
+    return node;
+  }
+
+  BVHAccel::BuildNode* BVHAccel::buildUpper(
+    std::vector<Treelet>& treelets,
+    std::size_t start,
+    std::size_t end,
+    int bitIndex,
+    int depth,
+    std::deque<BuildNode>& buildNodes) {
+
+    if (end - start == 1) return treelets[start].root;
+
+    std::size_t mid;
+    int axis;
+
+    int treeletDepth = 0;
+    for (auto i = start; i < end; ++i)
+      treeletDepth = std::max(treeletDepth, treelets[i].depth);
+
+    if (needsEqualSplit(depth + treeletDepth, end - start, m_options)) {
+      // SAH splits could exceed max depth: split in the middle
+      mid = (start + end) / 2;
+      axis = 0;
+    } else if (m_options.sahTreelets) {
+      Bounds3 bounds = treelets[start].root->bounds;
+      Bounds3 centroidBounds = bounds.center();
+      for (auto i = start + 1; i < end; ++i) {
+        bounds = Bounds3::merge(bounds, treelets[i].root->bounds);
+        centroidBounds =
+          Bounds3::merge(centroidBounds, treelets[i].root->bounds.center());
+      }
+      axis = centroidBounds.maxExtent();
+
+      auto first = treelets.begin() + start;
+      auto last = treelets.begin() + end;
+      auto getBounds = [](const Treelet& t) -> const Bounds3& {
+        return t.root->bounds;
+      };
+      auto getCentroid = [](const Treelet& t) { return t.root->bounds.center(); };
+      auto split = findSAHSplit(
+        first, last, centroidBounds, axis, getBounds, getCentroid);
+
+      mid = std::partition(
+              first, last,
+              [&](const Treelet& t) {
+                return bucketIndex(centroidBounds, axis, getCentroid(t)) <=
+                       split.bucket;
+              }) -
+            treelets.begin();
+
+      if (mid == start || mid == end) mid = (start + end) / 2;
+    } else {
+      // split by Morton code (treelets are sorted by code)
+      std::uint32_t mask = 1u << bitIndex;
+      if (
+        (treelets[start].mortonCode & mask) ==
+        (treelets[end - 1].mortonCode & mask))
+        return buildUpper(
+          treelets, start, end, bitIndex - 1, depth, buildNodes);
+
+      mid = std::partition_point(
+              treelets.begin() + start, treelets.begin() + end,
+              [mask](const Treelet& t) { return (t.mortonCode & mask) == 0; }) -
+            treelets.begin();
+      axis = bitIndex % 3;
+    }
+
+    BuildNode* node = &buildNodes.emplace_back();
+    node->initInterior(
+      axis,
+      buildUpper(treelets, start, mid, bitIndex - 1, depth + 1, buildNodes),
+      buildUpper(treelets, mid, end, bitIndex - 1, depth + 1, buildNodes));
+    return node;
+  }
+
+  std::uint32_t BVHAccel::flattenTree(
+    const BuildNode* node, std::uint32_t* offset) {
+    auto current = (*offset)++;
+    auto& n = m_nodes[current];
+    n.bounds = node->bounds;
+    n.pad = 0;
+    if (node->nPrimitives > 0) {
+      n.primitivesOffset = static_cast<std::uint32_t>(node->firstPrimOffset);
+      n.nPrimitives = static_cast<std::uint16_t>(node->nPrimitives);
+      n.axis = 0;
+    } else {
+      n.axis = static_cast<std::uint8_t>(node->splitAxis);
+      n.nPrimitives = 0;
+      flattenTree(node->children[0], offset);
+      n.secondChildOffset = flattenTree(node->children[1], offset);
+    }
+    return current;
+  }
+
+  std::size_t BVHAccel::refit() {
+    if (
+      m_nodeView.empty() || m_options.encoding != BVHNodeEncoding::Float32)
+      return 0;
+
+    // copy external nodes before modifying them
+    if (m_storage) {
+      m_nodes.assign(m_nodeView.begin(), m_nodeView.end());
+      updateNodeViews();
+    }
+
+    std::vector<std::uint32_t> roots, upper;
+    std::vector<std::uint64_t> keys;
+    collectSubtrees(&roots, &keys, &upper);
+
+    // costs at build time of subtrees not seen before
+    for (std::size_t i = 0; i < roots.size(); ++i)
+      if (!m_subtreeCosts.count(keys[i]))
+        m_subtreeCosts[keys[i]] = subtreeCost(roots[i]);
+
+    // refit subtrees
+    std::vector<float_t> costs(roots.size());
+    parallelFor(roots.size(), m_options.nThreads, [&](std::size_t i) {
+      costs[i] = refitSubtree(roots[i]);
+    });
+
+    // rebuild degraded subtrees. start from the last one, since rebuilding
+    // subtree only moves nodes after it.
+    std::size_t nRebuilt = 0;
+    for (auto i = roots.size(); i-- > 0;) {
+      auto& baseline = m_subtreeCosts[keys[i]];
+      if (costs[i] > m_options.rebuildThreshold * baseline) {
+        baseline = rebuildSubtree(roots[i]);
+        ++nRebuilt;
+      }
+    }
+    if (nRebuilt > 0) collectSubtrees(&roots, &keys, &upper);
+
+    // refit upper nodes bottom-up
+    for (auto it = upper.rbegin(); it != upper.rend(); ++it) {
+      auto& node = m_nodes[*it];
+      node.bounds = Bounds3::merge(
+        m_nodes[*it + 1].bounds, m_nodes[node.secondChildOffset].bounds);
+    }
+    updateNodeViews();
+    // triangles moved, and rebuilt subtrees reorder primitives
+    packLeaves();
+    return nRebuilt;
+  }
+
+  std::uint32_t BVHAccel::subtreeEnd(std::uint32_t root) const {
+    // last node of subtree is the last node on the path of second children
+    while (m_nodes[root].nPrimitives == 0)
+      root = m_nodes[root].secondChildOffset;
+    return root + 1;
+  }
+
+  int BVHAccel::nodeDepth(std::uint32_t index) const {
+    int depth = 0;
+    std::uint32_t current = 0;
+    while (current != index) {
+      const auto& node = m_nodes[current];
+      // first child is next node, second child starts after its subtree
+      current =
+        index < node.secondChildOffset ? current + 1 : node.secondChildOffset;
+      ++depth;
+    }
+    return depth;
+  }
+
+  void BVHAccel::collectSubtrees(
+    std::vector<std::uint32_t>* roots,
+    std::vector<std::uint64_t>* keys,
+    std::vector<std::uint32_t>* upper) const {
+    roots->clear();
+    keys->clear();
+    upper->clear();
+
+    // depth where there are enough subtrees for each thread
+    int maxDepth = 0;
+    while ((std::size_t(1) << maxDepth) < 4 * m_options.nThreads)
+      ++maxDepth;
+
+    // depth-first (pre-order) walk of nodes, depths and heap indices
+    struct Entry {
+      std::uint32_t index;
+      int depth;
+      std::uint64_t key;
+    };
+    std::vector<Entry> stack = {{0, 0, 1}};
+    while (!stack.empty()) {
+      auto [index, depth, key] = stack.back();
+      stack.pop_back();
+      const auto& node = m_nodes[index];
+      if (node.nPrimitives > 0 || depth == maxDepth) {
+        roots->push_back(index);
+        keys->push_back(key);
+      } else {
+        upper->push_back(index);
+        stack.push_back({node.secondChildOffset, depth + 1, 2 * key + 1});
+        stack.push_back({index + 1, depth + 1, 2 * key});
+      }
+    }
+  }
+
+  float_t BVHAccel::subtreeCost(std::uint32_t root) const {
+    float_t cost = 0;
+    auto end = subtreeEnd(root);
+    for (auto i = root; i < end; ++i) {
+      const auto& node = m_nodes[i];
+      cost += node.bounds.surfaceArea() *
+              (node.nPrimitives > 0 ? node.nPrimitives : traversalCost);
+    }
+    auto area = m_nodes[root].bounds.surfaceArea();
+    return area > 0 ? cost / area : 0;
+  }
+
+  float_t BVHAccel::refitSubtree(std::uint32_t root) {
+    float_t cost = 0;
+    // children are always after their parent
+    for (auto i = subtreeEnd(root); i-- > root;) {
+      auto& node = m_nodes[i];
+      if (node.nPrimitives > 0) {
+        auto first = m_primitives.begin() + node.primitivesOffset;
+        node.bounds = (*first)->getBoundingBox();
+        for (auto p = first + 1; p != first + node.nPrimitives; ++p)
+          node.bounds = Bounds3::merge(node.bounds, (*p)->getBoundingBox());
+        cost += node.nPrimitives * node.bounds.surfaceArea();
+      } else {
+        node.bounds = Bounds3::merge(
+          m_nodes[i + 1].bounds, m_nodes[node.secondChildOffset].bounds);
+        cost += traversalCost * node.bounds.surfaceArea();
+      }
+    }
+    auto area = m_nodes[root].bounds.surfaceArea();
+    return area > 0 ? cost / area : 0;
+  }
+
+  float_t BVHAccel::rebuildSubtree(std::uint32_t root) {
+    auto end = subtreeEnd(root);
+
+    // range of primitives
+    std::size_t primBegin = m_primitives.size();
+    std::size_t primEnd = 0;
+    for (auto i = root; i < end; ++i) {
+      const auto& node = m_nodes[i];
+      if (node.nPrimitives == 0) continue;
+      primBegin = std::min<std::size_t>(primBegin, node.primitivesOffset);
+      primEnd = std::max<std::size_t>(
+        primEnd, node.primitivesOffset + node.nPrimitives);
+    }
+
+    std::vector<PrimitiveInfo> primitiveInfo;
+    primitiveInfo.reserve(primEnd - primBegin);
+    for (auto i = primBegin; i < primEnd; ++i) {
+      auto b = m_primitives[i]->getBoundingBox();
+      primitiveInfo.push_back({i, b, b.center()});
+    }
+
+    // build
+    std::deque<BuildNode> buildNodes;
+    std::vector<std::shared_ptr<Primitive>> orderedPrims;
+    orderedPrims.reserve(primitiveInfo.size());
+    BuildNode* node = recursiveBuild(
+      primitiveInfo, 0, primitiveInfo.size(), nodeDepth(root), orderedPrims,
+      buildNodes);
+    for (auto& n : buildNodes)
+      if (n.nPrimitives > 0) n.firstPrimOffset += primBegin;
+    std::move(
+      orderedPrims.begin(), orderedPrims.end(),
+      m_primitives.begin() + primBegin);
+
+    // resize node range of the subtree
+    auto delta = static_cast<std::int64_t>(buildNodes.size()) -
+                 static_cast<std::int64_t>(end - root);
+    if (delta != 0) {
+      for (std::size_t i = 0; i < m_nodes.size(); ++i) {
+        auto& n = m_nodes[i];
+        if ((i < root || i >= end) && n.nPrimitives == 0 &&
+            n.secondChildOffset >= end)
+          n.secondChildOffset = static_cast<std::uint32_t>(
+            n.secondChildOffset + delta);
+      }
+      if (delta > 0)
+        m_nodes.insert(m_nodes.begin() + end, delta, BVHNode{});
+      else
+        m_nodes.erase(m_nodes.begin() + root, m_nodes.begin() + root - delta);
+    }
+
+    auto offset = root;
+    flattenTree(node, &offset);
+    return subtreeCost(root);
+  }
+
+  std::uint32_t BVHAccel::quantize(
+    std::uint32_t index, const Bounds3& bounds) {
+    const auto& node = m_nodes[index];
+    if (node.nPrimitives > 0) {
+      return QuantizedBVHNode::leafFlag |
+             static_cast<std::uint32_t>(node.nPrimitives) << 27 |
+             node.primitivesOffset;
+    }
+
+    auto qIndex = static_cast<std::uint32_t>(m_quantizedNodes.size());
+    m_quantizedNodes.emplace_back();
+
+    std::uint32_t children[2] = {index + 1, node.secondChildOffset};
+    Bounds3 childBounds[2];
+    auto step = quantizationStep(bounds);
+    for (auto c = 0; c < 2; ++c) {
+      auto& qNode = m_quantizedNodes[qIndex];
+      const auto& b = m_nodes[children[c]].bounds;
+      for (auto a = 0; a < 3; ++a) {
+        qNode.qMin[c][a] = quantizeMin(bounds.min()[a], step[a], b.min()[a]);
+        qNode.qMax[c][a] = quantizeMax(bounds.min()[a], step[a], b.max()[a]);
+      }
+      // children are quantized relative to dequantized bounds
+      childBounds[c] = dequantize(qNode, c, bounds);
+    }
+    for (auto c = 0; c < 2; ++c) {
+      auto reference = quantize(children[c], childBounds[c]);
+      m_quantizedNodes[qIndex].children[c] = reference;
+    }
+    return qIndex;
+  }
+
+  bool BVHAccel::intersectLeaf(
+    const Ray& ray,
+    const WatertightRay& wray,
+    float_t tMin,
+    float_t* tMax,
+    HitRecord* hit,
+    std::uint32_t offset,
+    std::uint32_t n) const {
+    bool found = false;
+    bool packed = !m_packedTriangles.empty();
+    if (packed) {
+      float_t t;
+      float_t b[3];
+      auto i = m_packedTriangles.intersect(wray, offset, n, tMin, *tMax, &t, b);
+      if (i >= 0) {
+        hit->t = t;
+        hit->uv = Vec2(b[1], b[2]);
+        hit->primitive = static_cast<std::uint32_t>(i);
+        hit->instance = HitRecord::none;
+        *tMax = t;
+        found = true;
+      }
+      if (m_packedTriangles.allPacked(offset, n)) return found;
+    }
+    if (!m_leafShapes.empty() && m_leafShapes[offset]) {
+      // homogeneous leaf (no packed triangles): one call into kernel of
+      // its shape type
+      HitRecord h;
+      if (!m_leafShapes[offset]->intersectBatch(
+            {&m_leafShapes[offset], n}, ray, tMin, *tMax, &h))
+        return found;
+      h.primitive += offset;
+      *hit = h;
+      *tMax = h.t;
+      return true;
+    }
+    for (auto i = offset; i < offset + n; ++i) {
+      if (packed && m_packedTriangles.isPacked(i)) continue;
+      if (intersectChild(*m_primitives[i], i, ray, tMin, *tMax, hit)) {
+        found = true;
+        *tMax = hit->t;
+      }
+    }
+    return found;
+  }
+
+  bool BVHAccel::intersectLeafP(
+    const Ray& ray,
+    const WatertightRay& wray,
+    float_t tMin,
+    float_t tMax,
+    std::uint32_t offset,
+    std::uint32_t n) const {
+    bool packed = !m_packedTriangles.empty();
+    if (packed) {
+      if (m_packedTriangles.intersectP(wray, offset, n, tMin, tMax))
+        return true;
+      if (m_packedTriangles.allPacked(offset, n)) return false;
+    }
+    if (!m_leafShapes.empty() && m_leafShapes[offset])
+      return m_leafShapes[offset]->intersectBatchP(
+        {&m_leafShapes[offset], n}, ray, tMin, tMax);
+    for (auto i = offset; i < offset + n; ++i) {
+      if (packed && m_packedTriangles.isPacked(i)) continue;
+      if (m_primitives[i]->intersectP(ray, tMin, tMax)) return true;
+    }
+    return false;
+  }
+
+  bool BVHAccel::intersectQuantized(
+    const Ray& ray,
+    float_t tMin,
+    float_t tMax,
+    HitRecord* hit,
+    std::size_t* nodeVisits) const {
+    if (m_primitives.empty()) return false;
+
+    Vec3 invDir = Vec3(1) / ray.dir();
+    int dirIsNeg[3] = {invDir.x < 0, invDir.y < 0, invDir.z < 0};
+    WatertightRay wray(ray);
+
+    if (!m_bounds.intersect(ray.origin(), invDir, dirIsNeg, tMin, tMax))
+      return false;
+
+    /// node reference with its dequantized bounds
+    struct Item {
+      std::uint32_t reference;
+      Bounds3 bounds;
+    };
+
+    bool found = false;
+    // nodes to visit
+    Item toVisit[maxDepth];
+    std::size_t toVisitOffset = 0;
+    Item current = {m_rootReference, m_bounds};
+
+    while (true) {
+      if (current.reference & QuantizedBVHNode::leafFlag) {
+        // leaf
+        auto nPrimitives = (current.reference >> 27) & 0xf;
+        auto offset =
+          current.reference & QuantizedBVHNode::maxPrimitivesOffset;
+        found |=
+          intersectLeaf(ray, wray, tMin, &tMax, hit, offset, nPrimitives);
+      } else {
+        // interior
+        if (nodeVisits) ++*nodeVisits;
+        const auto& node = m_quantizedNodeView[current.reference];
+        Item children[2];
+        bool hits[2];
+        for (auto c = 0; c < 2; ++c) {
+          children[c] = {node.children[c], dequantize(node, c, current.bounds)};
+          hits[c] = children[c].bounds.intersect(
+            ray.origin(), invDir, dirIsNeg, tMin, tMax);
+        }
+        if (hits[0] && hits[1]) {
+          // visit near child first
+          auto d = children[1].bounds.center() - children[0].bounds.center();
+          int near = glm::dot(d, ray.dir()) < 0 ? 1 : 0;
+          assert(toVisitOffset < maxDepth);
+          toVisit[toVisitOffset++] = children[1 - near];
+          current = children[near];
+          continue;
+        }
+        if (hits[0] || hits[1]) {
+          current = children[hits[0] ? 0 : 1];
+          continue;
+        }
+      }
+      if (toVisitOffset == 0) break;
+      current = toVisit[--toVisitOffset];
+    }
+    return found;
+  }
+
+  bool BVHAccel::intersect(
+    const Ray& ray, float_t tMin, float_t tMax, Interaction* isec) const {
+    return intersect(ray, tMin, tMax, isec, nullptr);
+  }
+
+  bool BVHAccel::intersect(
+    const Ray& ray,
+    float_t tMin,
+    float_t tMax,
+    Interaction* isec,
+    std::size_t* nodeVisits) const {
+    // build interaction of closest hit only
+    HitRecord hit;
+    if (!intersect(ray, tMin, tMax, &hit, nodeVisits)) return false;
+    *isec = getInteraction(ray, hit);
+    return true;
+  }
+
+  bool BVHAccel::intersect(
+    const Ray& ray, float_t tMin, float_t tMax, HitRecord* hit) const {
+    return intersect(ray, tMin, tMax, hit, nullptr);
+  }
+
+  bool BVHAccel::intersect(
+    const Ray& ray,
+    float_t tMin,
+    float_t tMax,
+    HitRecord* hit,
+    std::size_t* nodeVisits) const {
+    if (m_options.encoding == BVHNodeEncoding::Quantized8)
+      return intersectQuantized(ray, tMin, tMax, hit, nodeVisits);
+    if (m_nodeView.empty()) return false;
+    return intersectSubtree(ray, tMin, tMax, hit, 0, nodeVisits);
+  }
+
+  Interaction
+    BVHAccel::getInteraction(const Ray& ray, const HitRecord& hit) const {
+    HitRecord h;
+    auto i = getChildIndex(hit, &h);
+    if (!m_packedTriangles.empty() && m_packedTriangles.isPacked(i)) {
+      float_t b[3] = {1 - hit.uv[0] - hit.uv[1], hit.uv[0], hit.uv[1]};
+      return m_packedTriangles.getTriangle(i)->getInteraction(ray, hit.t, b);
+    }
+    return m_primitives[i]->getInteraction(ray, h);
+  }
+
+  bool BVHAccel::intersectSubtree(
+    const Ray& ray,
+    float_t tMin,
+    float_t tMax,
+    HitRecord* hit,
+    std::uint32_t root,
+    std::size_t* nodeVisits) const {
+    Vec3 invDir = Vec3(1) / ray.dir();
+    int dirIsNeg[3] = {invDir.x < 0, invDir.y < 0, invDir.z < 0};
+    WatertightRay wray(ray);
+
+    bool found = false;
+    // nodes to visit
+    std::uint32_t toVisit[maxDepth];
+    std::size_t toVisitOffset = 0;
+    std::uint32_t current = root;
+
+    while (true) {
+      const BVHNode& node = m_nodeView[current];
+      if (nodeVisits) ++*nodeVisits;
+      if (node.bounds.intersect(ray.origin(), invDir, dirIsNeg, tMin, tMax)) {
+        if (node.nPrimitives > 0) {
+          // leaf
+          found |= intersectLeaf(
+            ray, wray, tMin, &tMax, hit, node.primitivesOffset,
+            node.nPrimitives);
+          if (toVisitOffset == 0) break;
+          current = toVisit[--toVisitOffset];
+        } else {
+          // interior: visit near child first
+          if (dirIsNeg[node.axis]) {
+            assert(toVisitOffset < maxDepth);
+            toVisit[toVisitOffset++] = current + 1;
+            current = node.secondChildOffset;
+          } else {
+            assert(toVisitOffset < maxDepth);
+            toVisit[toVisitOffset++] = node.secondChildOffset;
+            current = current + 1;
+          }
+        }
+      } else {
+        if (toVisitOffset == 0) break;
+        current = toVisit[--toVisitOffset];
+      }
+    }
+    return found;
+  }
+
+  template <std::size_t N>
+  std::uint32_t BVHAccel::intersect(
+    RayPacket<N>& packet, Interaction* isecs) const {
+    HitRecord hits[N];
+    auto hit = intersect(packet, hits);
+    for (std::size_t i = 0; i < N; ++i)
+      if (hit & (1u << i))
+        isecs[i] = getInteraction(packet.getRay(i), hits[i]);
+    return hit;
+  }
+
+  template <std::size_t N>
+  std::uint32_t BVHAccel::intersect(
+    RayPacket<N>& packet, HitRecord* hits) const {
+    std::uint32_t hit = 0;
+
+    // trace active rays of `mask` one by one from `root`
+    auto traceSingle = [&](std::uint32_t mask, std::uint32_t root) {
+      for (std::size_t i = 0; i < N; ++i) {
+        if (!(mask & (1u << i))) continue;
+        auto ray = packet.getRay(i);
+        bool h = root == 0 ? intersect(
+                               ray, packet.tMin[i], packet.tMax[i], &hits[i])
+                           : intersectSubtree(
+                               ray, packet.tMin[i], packet.tMax[i], &hits[i],
+                               root, nullptr);
+        if (h) {
+          packet.tMax[i] = hits[i].t;
+          hit |= 1u << i;
+        }
+      }
+    };
+
+    int octant = packet.getOctant();
+    if (
+      m_options.encoding != BVHNodeEncoding::Float32 || m_nodeView.empty() ||
+      octant == -1) {
+      traceSingle(packet.active, 0);
+      return hit;
+    }
+    int dirIsNeg[3] = {octant & 1, (octant >> 1) & 1, (octant >> 2) & 1};
+    // below this number of active rays, packet is not worth tracing (N / 4
+    // breaks even with single rays on divergent packets in bench_bvh, while
+    // lower limits lose up to 20% there)
+    constexpr int minActive = N / 4;
+
+    /// node with active rays
+    struct Item {
+      std::uint32_t node;
+      std::uint32_t mask;
+    };
+
+    // rays are built once per packet
+    Ray rays[N];
+    for (std::size_t i = 0; i < N; ++i)
+      if (packet.active & (1u << i)) rays[i] = packet.getRay(i);
+
+    // nodes to visit
+    Item toVisit[maxDepth];
+    std::size_t toVisitOffset = 0;
+    Item current = {0, packet.active};
+
+    while (true) {
+      const BVHNode& node = m_nodeView[current.node];
+      auto mask = naga::rt::intersect(node.bounds, packet, current.mask);
+      if (mask != 0) {
+        if (countActive(mask) < minActive && node.nPrimitives == 0) {
+          traceSingle(mask, current.node);
+        } else if (node.nPrimitives > 0) {
+          // leaf: each primitive is tested against the rays of the packet
+          // in turn, so it is loaded once per packet
+          auto offset = node.primitivesOffset;
+          if (
+            !m_packedTriangles.empty() ||
+            (!m_leafShapes.empty() && m_leafShapes[offset])) {
+            // leaf kernels take one ray
+            for (std::size_t i = 0; i < N; ++i) {
+              if (!(mask & (1u << i))) continue;
+              if (intersectLeaf(
+                    rays[i], WatertightRay(rays[i]), packet.tMin[i],
+                    &packet.tMax[i], &hits[i], offset, node.nPrimitives))
+                hit |= 1u << i;
+            }
+          } else {
+            for (auto p = offset; p < offset + node.nPrimitives; ++p) {
+              for (std::size_t i = 0; i < N; ++i) {
+                if (!(mask & (1u << i))) continue;
+                if (intersectChild(
+                      *m_primitives[p], p, rays[i], packet.tMin[i],
+                      packet.tMax[i], &hits[i])) {
+                  packet.tMax[i] = hits[i].t;
+                  hit |= 1u << i;
+                }
+              }
+            }
+          }
+        } else {
+          // interior: visit near child first
+          if (dirIsNeg[node.axis]) {
+            assert(toVisitOffset < maxDepth);
+            toVisit[toVisitOffset++] = {current.node + 1, mask};
+            current = {node.secondChildOffset, mask};
+          } else {
+            assert(toVisitOffset < maxDepth);
+            toVisit[toVisitOffset++] = {node.secondChildOffset, mask};
+            current = {current.node + 1, mask};
+          }
+          continue;
+        }
+      }
+      if (toVisitOffset == 0) break;
+      current = toVisit[--toVisitOffset];
+    }
+    return hit;
+  }
+
+  bool BVHAccel::intersectP(
+    const Ray& ray, float_t tMin, float_t tMax) const {
+    Vec3 invDir = Vec3(1) / ray.dir();
+    int dirIsNeg[3] = {invDir.x < 0, invDir.y < 0, invDir.z < 0};
+    WatertightRay wray(ray);
+
+    if (m_options.encoding == BVHNodeEncoding::Quantized8) {
+      if (
+        m_primitives.empty() ||
+        !m_bounds.intersect(ray.origin(), invDir, dirIsNeg, tMin, tMax))
+        return false;
+
+      /// node reference with its dequantized bounds
+      struct Item {
+        std::uint32_t reference;
+        Bounds3 bounds;
+      };
+
+      // nodes to visit (hit by ray)
+      // (popping a node pushes at most both children)
+      Item toVisit[maxDepth + 1];
+      std::size_t toVisitOffset = 0;
+      toVisit[toVisitOffset++] = {m_rootReference, m_bounds};
+
+      while (toVisitOffset != 0) {
+        auto current = toVisit[--toVisitOffset];
+        if (current.reference & QuantizedBVHNode::leafFlag) {
+          auto nPrimitives = (current.reference >> 27) & 0xf;
+          auto offset =
+            current.reference & QuantizedBVHNode::maxPrimitivesOffset;
+          if (intersectLeafP(ray, wray, tMin, tMax, offset, nPrimitives))
+            return true;
+          continue;
+        }
+        const auto& node = m_quantizedNodeView[current.reference];
+        for (auto c = 0; c < 2; ++c) {
+          auto b = dequantize(node, c, current.bounds);
+          if (b.intersect(ray.origin(), invDir, dirIsNeg, tMin, tMax)) {
+            assert(toVisitOffset < maxDepth + 1);
+            toVisit[toVisitOffset++] = {node.children[c], b};
+          }
+        }
+      }
+      return false;
+    }
+
+    if (m_nodeView.empty()) return false;
+
+    // nodes to visit
+    std::uint32_t toVisit[maxDepth];
+    std::size_t toVisitOffset = 0;
+    std::uint32_t current = 0;
+
+    while (true) {
+      const BVHNode& node = m_nodeView[current];
+      if (node.bounds.intersect(ray.origin(), invDir, dirIsNeg, tMin, tMax)) {
+        if (node.nPrimitives > 0) {
+          // leaf: stop at first hit
+          if (intersectLeafP(
+                ray, wray, tMin, tMax, node.primitivesOffset,
+                node.nPrimitives))
+            return true;
+        } else {
+          // interior: order of children does not matter
+          assert(toVisitOffset < maxDepth);
+          toVisit[toVisitOffset++] = node.secondChildOffset;
+          current = current + 1;
+          continue;
+        }
+      }
+      if (toVisitOffset == 0) break;
+      current = toVisit[--toVisitOffset];
+    }
+    return false;
+  }
+
+  template std::uint32_t
+    BVHAccel::intersect<4>(RayPacket<4>&, Interaction*) const;
+  template std::uint32_t
+    BVHAccel::intersect<8>(RayPacket<8>&, Interaction*) const;
+  template std::uint32_t
+    BVHAccel::intersect<16>(RayPacket<16>&, Interaction*) const;
+  template std::uint32_t
+    BVHAccel::intersect<4>(RayPacket<4>&, HitRecord*) const;
+  template std::uint32_t
+    BVHAccel::intersect<8>(RayPacket<8>&, HitRecord*) const;
+  template std::uint32_t
+    BVHAccel::intersect<16>(RayPacket<16>&, HitRecord*) const;
+
+  Bounds3 BVHAccel::getBoundingBox() const {
+    if (m_options.encoding == BVHNodeEncoding::Quantized8) return m_bounds;
+    return m_nodeView.empty() ? Bounds3() : m_nodeView[0].bounds;
+  }
+
+  BVHAccel::~BVHAccel() {}
+}
@@ -0,0 +1,378 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "memory.hpp"
+#include "primitive.hpp"
+#include "ray_packet.hpp"
+#include "triangle_leaf.hpp"
+
+/// \file Bounding volume hierarchy
+
+namespace naga::rt {
+
+  /** \brief Linear BVH node.
+   * Nodes are stored in depth-first order: first child of an interior node
+   * immediately follows its parent, so only offset of the second child is
+   * stored. Primitives are ordered in the same way, so every subtree covers
+   * contiguous ranges of nodes and primitives.
+   */
+  struct alignas(32) BVHNode {
+    /// Bounding box
+    Bounds3 bounds;
+    union {
+      /// (leaf) Offset of first primitive
+      std::uint32_t primitivesOffset;
+      /// (interior) Offset of second child
+      std::uint32_t secondChildOffset;
+    };
+    /// Number of primitives (0 for interior nodes)
+    std::uint16_t nPrimitives;
+    /// Split axis of interior node
+    std::uint8_t axis;
+    /// Padding
+    std::uint8_t pad;
+  };
+
+  static_assert(sizeof(BVHNode) == 32, "BVHNode should be 32 bytes");
+
+  /** \brief Quantized BVH node.
+   * Only interior nodes are stored. Bounds of both children are stored as
+   * 8-bit coordinates on a 255 step grid spanning the (dequantized) bounds
+   * of the node, rounded outward so that they always contain the children.
+   */
+  struct QuantizedBVHNode {
+    /// Min corner of child bounds
+    std::uint8_t qMin[2][3];
+    /// Max corner of child bounds
+    std::uint8_t qMax[2][3];
+    /** \brief Child references.
+     * (interior child) Index of node  
+     * (leaf child) `leafFlag | nPrimitives << 27 | primitivesOffset`
+     */
+    std::uint32_t children[2];
+
+    /// Flag of leaf reference
+    static constexpr std::uint32_t leafFlag = 1u << 31;
+    /// Max number of primitives in leaf
+    static constexpr std::uint32_t maxPrimitives = 15;
+    /// Max number of primitives in BVH
+    static constexpr std::uint32_t maxPrimitivesOffset = (1u << 27) - 1;
+  };
+
+  static_assert(
+    sizeof(QuantizedBVHNode) == 20, "QuantizedBVHNode should be 20 bytes");
+
+  /// BVH build method
+  enum class BVHBuildMethod {
+    /// Top-down binned SAH (best quality)
+    SAH,
+    /// Linear BVH from Morton codes (fast, parallel)
+    HLBVH,
+    /// Binned SAH with spatial splits (less overlap, duplicates references)
+    SBVH,
+  };
+
+  /// BVH node encoding
+  enum class BVHNodeEncoding {
+    /// 32 byte nodes with float bounds
+    Float32,
+    /// 20 byte interior nodes with 8-bit child bounds (no refit)
+    Quantized8,
+  };
+
+  /// BVH build options
+  struct BVHBuildOptions {
+    /// Build method
+    BVHBuildMethod method = BVHBuildMethod::SAH;
+    /// Max number of primitives in leaf node
+    std::size_t maxPrimsInNode = 4;
+    /// Number of build threads
+    std::size_t nThreads = 1;
+    /// (HLBVH) Build upper levels over treelets with SAH
+    bool sahTreelets = true;
+    /// (refit) Growth of subtree SAH cost which triggers rebuild of subtree
+    float_t rebuildThreshold = 1.5f;
+    /// Node encoding
+    BVHNodeEncoding encoding = BVHNodeEncoding::Float32;
+    /// (SBVH) Max number of references added by spatial splits, relative to
+    /// number of primitives
+    float_t spatialSplitBudget = 0.3f;
+    /// (SBVH) Min overlap area of object split children, relative to root
+    /// area, to try spatial split
+    float_t spatialSplitAlpha = 1e-5f;
+    /// Pack triangles of leaves for SIMD intersection (PackedTriangles)
+    bool packTriangles = false;
+    /// Split leaves by type of shape, so each leaf is intersected by one
+    /// call of kernel of its shape type (Shape::intersectBatch)
+    bool homogeneousLeaves = false;
+  };
+
+  /** \brief Prebuilt BVH nodes in external storage.
+   * Used to create BVHAccel from memory-mapped cache file without copying
+   * nodes.
+   */
+  struct BVHNodeStorage {
+    /// Linear nodes (Float32 encoding)
+    ArrayView<const BVHNode> nodes;
+    /// Quantized nodes (Quantized8 encoding)
+    ArrayView<const QuantizedBVHNode> quantizedNodes;
+    /// Bounding box of quantized BVH
+    Bounds3 bounds;
+    /// Reference to root of quantized BVH
+    std::uint32_t rootReference = 0;
+    /// Owner of the storage, kept alive while BVH is alive
+    std::shared_ptr<const void> owner;
+  };
+
+  /// BVH aggregate
+  class BVHAccel : public Aggregate {
+  public:
+    /// Max depth of nodes (size of traversal stacks). Builders split
+    /// primitives into equal halves where SAH splits could exceed it.
+    static constexpr int maxDepth = 64;
+
+    /// Ctor
+    BVHAccel(
+      std::vector<std::shared_ptr<Primitive>> primitives,
+      const BVHBuildOptions& options = {});
+    /** \brief Ctor from prebuilt nodes.
+     * `primitives` should be ordered as referenced by leaf nodes, and
+     * `options` should be the ones used to build the nodes.
+     */
+    BVHAccel(
+      std::vector<std::shared_ptr<Primitive>> primitives,
+      BVHNodeStorage storage,
+      const BVHBuildOptions& options);
+
+    /// Calculate Ray-BVH intersection (closest hit)
+    virtual bool intersect(
+      const Ray& ray,
+      float_t tMin,
+      float_t tMax,
+      Interaction* isec) const override;
+    /// Calculate Ray-BVH intersection and add number of visited nodes to
+    /// `nodeVisits`
+    bool intersect(
+      const Ray& ray,
+      float_t tMin,
+      float_t tMax,
+      Interaction* isec,
+      std::size_t* nodeVisits) const;
+    /// Find closest hit without building interaction
+    virtual bool intersect(
+      const Ray& ray,
+      float_t tMin,
+      float_t tMax,
+      HitRecord* hit) const override;
+    /// Find closest hit and add number of visited nodes to `nodeVisits`
+    bool intersect(
+      const Ray& ray,
+      float_t tMin,
+      float_t tMax,
+      HitRecord* hit,
+      std::size_t* nodeVisits) const;
+    /// Build interaction of hit
+    virtual Interaction
+      getInteraction(const Ray& ray, const HitRecord& hit) const override;
+    /** \brief Calculate closest hits of active rays of packet.
+     * Nodes are tested against the whole packet while rays share direction
+     * octant, and leaves primitive by primitive against the rays which hit
+     * them. Packets whose rays diverge, and rays left alone in a subtree,
+     * fall back to single ray traversal.
+     * Writes interaction of i-th ray to `isecs[i]` and shortens its `tMax`.
+     * \returns Mask of rays which hit
+     */
+    template <std::size_t N>
+    std::uint32_t intersect(RayPacket<N>& packet, Interaction* isecs) const;
+    /// Calculate closest hits of active rays of packet without building
+    /// interactions (writes hit of i-th ray to `hits[i]`)
+    template <std::size_t N>
+    std::uint32_t intersect(RayPacket<N>& packet, HitRecord* hits) const;
+    /// Check if ray hits any primitive (occlusion test, any hit)
+    virtual bool intersectP(
+      const Ray& ray, float_t tMin, float_t tMax) const override;
+    /// Get bounding box
+    virtual Bounds3 getBoundingBox() const override;
+
+    /** \brief Refit node bounds to current bounds of primitives.
+     * Subtrees are refitted in parallel, then subtrees whose SAH cost grew
+     * beyond `rebuildThreshold` times the cost at build time (or at their
+     * last rebuild) are rebuilt.
+     * Aggregates derived from this BVH (e.g. WideBVHAccel) should be
+     * recreated after refit. Quantized BVHs can not be refitted.
+     * Leaves of SBVH are refitted to unclipped bounds of primitives.
+     * \returns Number of rebuilt subtrees
+     */
+    std::size_t refit();
+
+    /// Get nodes (empty for quantized BVH)
+    ArrayView<const BVHNode> getNodes() const {
+      return m_nodeView;
+    }
+    /// Get quantized nodes (empty for float BVH)
+    ArrayView<const QuantizedBVHNode> getQuantizedNodes() const {
+      return m_quantizedNodeView;
+    }
+    /// Get bounding box and root reference of quantized BVH
+    std::pair<Bounds3, std::uint32_t> getQuantizedRoot() const {
+      return {m_bounds, m_rootReference};
+    }
+    /// Get size of nodes in bytes
+    std::size_t getNodeMemory() const {
+      return m_nodeView.size() * sizeof(BVHNode) +
+             m_quantizedNodeView.size() * sizeof(QuantizedBVHNode);
+    }
+    /// Get build options
+    const BVHBuildOptions& getOptions() const {
+      return m_options;
+    }
+    /// Get primitives (ordered as referenced by leaf nodes).
+    /// SBVH may reference primitive from more than one leaf.
+    const auto& getPrimitives() const {
+      return m_primitives;
+    }
+
+    /// Dtor
+    virtual ~BVHAccel() override;
+
+  private:
+    struct BuildNode;
+    struct PrimitiveInfo;
+    struct MortonPrimitive;
+    struct Treelet;
+
+    /// Build BVH recursively
+    BuildNode* recursiveBuild(
+      std::vector<PrimitiveInfo>& primitiveInfo,
+      std::size_t start,
+      std::size_t end,
+      int depth,
+      std::vector<std::shared_ptr<Primitive>>& orderedPrims,
+      std::deque<BuildNode>& buildNodes);
+    /// Build SBVH recursively.
+    /// `refs` are primitive references whose bounds are clipped by splits.
+    BuildNode* spatialSplitBuild(
+      std::vector<PrimitiveInfo> refs,
+      float_t minOverlap,
+      std::size_t* budget,
+      int depth,
+      std::vector<std::shared_ptr<Primitive>>& orderedPrims,
+      std::deque<BuildNode>& buildNodes);
+    /// Build HLBVH and flatten it
+    void hlbvhBuild(const std::vector<PrimitiveInfo>& primitiveInfo);
+    /// Build LBVH treelet from sorted Morton codes.
+    /// Writes max depth of leaves in treelet to `treeletDepth`.
+    BuildNode* emitLBVH(
+      const std::vector<PrimitiveInfo>& primitiveInfo,
+      std::vector<MortonPrimitive>& mortonPrims,
+      std::size_t start,
+      std::size_t end,
+      int bitIndex,
+      int depth,
+      int* treeletDepth,
+      std::deque<BuildNode>& buildNodes);
+    /// Build upper levels over treelet roots
+    BuildNode* buildUpper(
+      std::vector<Treelet>& treelets,
+      std::size_t start,
+      std::size_t end,
+      int bitIndex,
+      int depth,
+      std::deque<BuildNode>& buildNodes);
+    /// Flatten BVH tree into depth-first linear array starting at `offset`
+    std::uint32_t flattenTree(const BuildNode* node, std::uint32_t* offset);
+
+    /// Get index one past the last node of subtree
+    std::uint32_t subtreeEnd(std::uint32_t root) const;
+    /// Get depth of node (0 for root)
+    int nodeDepth(std::uint32_t index) const;
+    /** \brief Collect roots of subtrees refitted in parallel and nodes
+     * above them. Keys identify roots by their path from the root of BVH
+     * (heap index), which rebuilding other subtrees does not change.
+     */
+    void collectSubtrees(
+      std::vector<std::uint32_t>* roots,
+      std::vector<std::uint64_t>* keys,
+      std::vector<std::uint32_t>* upper) const;
+    /// SAH cost of subtree relative to its root
+    float_t subtreeCost(std::uint32_t root) const;
+    /// Refit subtree and return its SAH cost
+    float_t refitSubtree(std::uint32_t root);
+    /// Rebuild subtree with SAH and return its SAH cost
+    float_t rebuildSubtree(std::uint32_t root);
+
+    /// Point node views to owned nodes
+    void updateNodeViews();
+    /// Pack triangles and collect shapes of leaves (if enabled by options)
+    void packLeaves();
+
+    /// Encode float nodes into quantized nodes
+    std::uint32_t quantize(std::uint32_t index, const Bounds3& bounds);
+    /// Closest hit traversal of subtree rooted at `root`
+    bool intersectSubtree(
+      const Ray& ray,
+      float_t tMin,
+      float_t tMax,
+      HitRecord* hit,
+      std::uint32_t root,
+      std::size_t* nodeVisits) const;
+    /// Closest hit among primitives [offset, offset + n) of leaf.
+    /// Shortens `tMax` on hit.
+    bool intersectLeaf(
+      const Ray& ray,
+      const WatertightRay& wray,
+      float_t tMin,
+      float_t* tMax,
+      HitRecord* hit,
+      std::uint32_t offset,
+      std::uint32_t n) const;
+    /// Check if any primitive of leaf is hit
+    bool intersectLeafP(
+      const Ray& ray,
+      const WatertightRay& wray,
+      float_t tMin,
+      float_t tMax,
+      std::uint32_t offset,
+      std::uint32_t n) const;
+    /// Closest hit traversal of quantized nodes
+    bool intersectQuantized(
+      const Ray& ray,
+      float_t tMin,
+      float_t tMax,
+      HitRecord* hit,
+      std::size_t* nodeVisits) const;
+
+  private:
+    /// Build options
+    BVHBuildOptions m_options;
+    /// Primitives
+    std::vector<std::shared_ptr<Primitive>> m_primitives;
+    /// Linear nodes
+    std::vector<BVHNode, AlignedAllocator<BVHNode>> m_nodes;
+    /// SAH costs of subtrees at build time by key of subtree (refit)
+    std::unordered_map<std::uint64_t, float_t> m_subtreeCosts;
+    /// Quantized nodes
+    std::vector<QuantizedBVHNode> m_quantizedNodes;
+    /// Bounding box of quantized BVH
+    Bounds3 m_bounds;
+    /// Reference to root of quantized BVH
+    std::uint32_t m_rootReference = 0;
+    /// Nodes used by traversal (owned or external)
+    ArrayView<const BVHNode> m_nodeView;
+    /// Quantized nodes used by traversal (owned or external)
+    ArrayView<const QuantizedBVHNode> m_quantizedNodeView;
+    /// Owner of external nodes
+    std::shared_ptr<const void> m_storage;
+    /// Packed triangles of leaves (parallel to m_primitives)
+    PackedTriangles m_packedTriangles;
+    /// Shapes of primitives of homogeneous leaves, nullptr for primitives
+    /// of other leaves (parallel to m_primitives)
+    std::vector<const Shape*> m_leafShapes;
+  };
+}
@@ -0,0 +1,288 @@
+#include "bvh_cache.hpp"
+#include "hash.hpp"
+#include "mapped_file.hpp"
+#include "triangle.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace naga::rt {
+
+  namespace {
+
+    /// Magic number of cache file
+    constexpr char cacheMagic[8] = {'N', 'A', 'G', 'A', 'B', 'V', 'H', '\0'};
+    /// Version of cache file layout
+    constexpr std::uint32_t cacheVersion = 2;
+    /// Size of header (nodes start at this offset)
+    constexpr std::size_t headerSize = 128;
+
+    /** \brief Header of cache file.
+     * Followed by nodes, quantized nodes and primitive indices, stored as
+     * raw arrays.
+     */
+    struct CacheHeader {
+      /// Magic number
+      char magic[8];
+      /// Version of layout
+      std::uint32_t version;
+      /// sizeof(BVHNode) (detects different float_t)
+      std::uint32_t nodeSize;
+      /// Node encoding
+      std::uint32_t encoding;
+      /// Reference to root of quantized BVH
+      std::uint32_t rootReference;
+      /// Hash of primitives and options
+      std::uint64_t inputHash;
+      /// Checksum of data after header
+      std::uint64_t checksum;
+      /// Size of file
+      std::uint64_t fileSize;
+      /// Number of input primitives
+      std::uint64_t nInputPrimitives;
+      /// Number of nodes
+      std::uint64_t nNodes;
+      /// Number of quantized nodes
+      std::uint64_t nQuantizedNodes;
+      /// Number of primitive indices (ordered as referenced by leaves)
+      std::uint64_t nIndices;
+      /// Bounding box of quantized BVH
+      float_t bounds[6];
+    };
+
+    static_assert(sizeof(CacheHeader) <= headerSize);
+    static_assert(headerSize % alignof(BVHNode) == 0);
+    static_assert(sizeof(BVHNode) % 4 == 0);
+    static_assert(sizeof(QuantizedBVHNode) % 4 == 0);
+
+    /// Set status if requested
+    void setStatus(BVHCacheStatus* status, BVHCacheStatus s) {
+      if (status) *status = s;
+    }
+  } // namespace
+
+  std::uint64_t hashBVHInput(
+    const std::vector<std::shared_ptr<Primitive>>& primitives,
+    const BVHBuildOptions& options) {
+    Hasher hasher;
+    hasher.add(static_cast<std::uint64_t>(primitives.size()));
+    hasher.add(static_cast<std::uint32_t>(options.method));
+    hasher.add(static_cast<std::uint32_t>(options.encoding));
+    hasher.add(static_cast<std::uint32_t>(options.maxPrimsInNode));
+    hasher.add(static_cast<std::uint32_t>(options.sahTreelets));
+    hasher.add(options.spatialSplitBudget);
+    hasher.add(options.spatialSplitAlpha);
+    hasher.add(static_cast<std::uint32_t>(options.homogeneousLeaves));
+    // meshes are hashed once, when first referenced
+    std::unordered_set<const TriangleMesh*> meshes;
+    for (auto& p : primitives) {
+      auto b = p->getBoundingBox();
+      float_t v[6] = {b.min().x, b.min().y, b.min().z,
+                      b.max().x, b.max().y, b.max().z};
+      hasher.add(v);
+      // geometry within bounds (spatial splits clip it)
+      std::shared_ptr<Shape> shape;
+      if (dynamic_cast<const GeometricPrimitive*>(p.get()))
+        shape = p->getShape();
+      if (auto t = dynamic_cast<const Triangle*>(shape.get())) {
+        hasher.add(t->getIndex());
+        auto& mesh = t->getMesh();
+        if (!meshes.insert(mesh.get()).second) continue;
+        auto positions = mesh->getPositions();
+        auto indices = mesh->getIndices();
+        hasher.add(static_cast<std::uint64_t>(positions.size()));
+        hasher.add(positions.data(), positions.size() * sizeof(Vec3));
+        hasher.add(static_cast<std::uint64_t>(indices.size()));
+        hasher.add(indices.data(), indices.size() * sizeof(std::uint32_t));
+      }
+    }
+    return hasher.get();
+  }
+
+  bool saveBVHCache(
+    const std::string& path,
+    const BVHAccel& bvh,
+    const std::vector<std::shared_ptr<Primitive>>& primitives,
+    const BVHBuildOptions& options) {
+
+    // indices of primitives in input order
+    std::unordered_map<const Primitive*, std::uint32_t> inputIndices;
+    inputIndices.reserve(primitives.size());
+    for (std::size_t i = 0; i < primitives.size(); ++i)
+      inputIndices.emplace(primitives[i].get(), static_cast<std::uint32_t>(i));
+    std::vector<std::uint32_t> indices;
+    indices.reserve(bvh.getPrimitives().size());
+    for (auto& p : bvh.getPrimitives()) {
+      auto it = inputIndices.find(p.get());
+      if (it == inputIndices.end()) return false;
+      indices.push_back(it->second);
+    }
+
+    auto nodes = bvh.getNodes();
+    auto quantizedNodes = bvh.getQuantizedNodes();
+    auto [bounds, rootReference] = bvh.getQuantizedRoot();
+
+    // header
+    CacheHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, cacheMagic, sizeof(cacheMagic));
+    header.version = cacheVersion;
+    header.nodeSize = sizeof(BVHNode);
+    header.encoding = static_cast<std::uint32_t>(options.encoding);
+    header.rootReference = rootReference;
+    header.inputHash = hashBVHInput(primitives, options);
+    header.nInputPrimitives = primitives.size();
+    header.nNodes = nodes.size();
+    header.nQuantizedNodes = quantizedNodes.size();
+    header.nIndices = indices.size();
+    for (auto a = 0; a < 3; ++a) {
+      header.bounds[a] = bounds.min()[a];
+      header.bounds[3 + a] = bounds.max()[a];
+    }
+    header.fileSize = headerSize + nodes.size() * sizeof(BVHNode) +
+                      quantizedNodes.size() * sizeof(QuantizedBVHNode) +
+                      indices.size() * sizeof(std::uint32_t);
+
+    Hasher checksum;
+    checksum.add(nodes.data(), nodes.size() * sizeof(BVHNode));
+    checksum.add(
+      quantizedNodes.data(), quantizedNodes.size() * sizeof(QuantizedBVHNode));
+    checksum.add(indices.data(), indices.size() * sizeof(std::uint32_t));
+    header.checksum = checksum.get();
+
+    // write to temporary file
+    auto tmpPath = path + ".tmp";
+    {
+      std::ofstream out(tmpPath, std::ios::binary | std::ios::trunc);
+      if (!out) return false;
+      char padding[headerSize] = {};
+      out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+      out.write(padding, headerSize - sizeof(header));
+      out.write(
+        reinterpret_cast<const char*>(nodes.data()),
+        nodes.size() * sizeof(BVHNode));
+      out.write(
+        reinterpret_cast<const char*>(quantizedNodes.data()),
+        quantizedNodes.size() * sizeof(QuantizedBVHNode));
+      out.write(
+        reinterpret_cast<const char*>(indices.data()),
+        indices.size() * sizeof(std::uint32_t));
+      out.close();
+      if (!out) {
+        std::remove(tmpPath.c_str());
+        return false;
+      }
+    }
+
+    // replace cache file (rename is atomic on POSIX, but does not replace
+    // existing file on Windows)
+#if defined(_WIN32)
+    std::remove(path.c_str());
+#endif
+    if (std::rename(tmpPath.c_str(), path.c_str()) != 0) {
+      std::remove(tmpPath.c_str());
+      return false;
+    }
+    return true;
+  }
+
+  std::shared_ptr<BVHAccel> loadBVHCache(
+    const std::string& path,
+    const std::vector<std::shared_ptr<Primitive>>& primitives,
+    const BVHBuildOptions& options,
+    BVHCacheStatus* status) {
+
+    auto file = std::make_shared<MappedFile>(path);
+    if (!file->isOpen()) {
+      setStatus(status, BVHCacheStatus::Missing);
+      return nullptr;
+    }
+    if (file->size() < headerSize) {
+      setStatus(status, BVHCacheStatus::Corrupt);
+      return nullptr;
+    }
+
+    CacheHeader header;
+    std::memcpy(&header, file->data(), sizeof(header));
+    if (std::memcmp(header.magic, cacheMagic, sizeof(cacheMagic)) != 0) {
+      setStatus(status, BVHCacheStatus::Corrupt);
+      return nullptr;
+    }
+    if (
+      header.version != cacheVersion || header.nodeSize != sizeof(BVHNode) ||
+      header.encoding != static_cast<std::uint32_t>(options.encoding) ||
+      header.nInputPrimitives != primitives.size() ||
+      header.inputHash != hashBVHInput(primitives, options)) {
+      setStatus(status, BVHCacheStatus::Stale);
+      return nullptr;
+    }
+
+    // sizes (checked one by one to avoid overflow)
+    std::size_t size = file->size();
+    std::size_t nodesSize = header.nNodes * sizeof(BVHNode);
+    std::size_t quantizedNodesSize =
+      header.nQuantizedNodes * sizeof(QuantizedBVHNode);
+    std::size_t indicesSize = header.nIndices * sizeof(std::uint32_t);
+    if (
+      header.fileSize != size || header.nNodes > size / sizeof(BVHNode) ||
+      header.nQuantizedNodes > size / sizeof(QuantizedBVHNode) ||
+      header.nIndices > size / sizeof(std::uint32_t) ||
+      headerSize + nodesSize + quantizedNodesSize + indicesSize != size) {
+      setStatus(status, BVHCacheStatus::Corrupt);
+      return nullptr;
+    }
+
+    const std::byte* data = file->data() + headerSize;
+    Hasher checksum;
+    checksum.add(data, size - headerSize);
+    if (checksum.get() != header.checksum) {
+      setStatus(status, BVHCacheStatus::Corrupt);
+      return nullptr;
+    }
+
+    // primitives ordered as referenced by leaves
+    std::vector<std::uint32_t> indices(header.nIndices);
+    std::memcpy(
+      indices.data(), data + nodesSize + quantizedNodesSize, indicesSize);
+    std::vector<std::shared_ptr<Primitive>> orderedPrims;
+    orderedPrims.reserve(indices.size());
+    for (auto i : indices) {
+      if (i >= primitives.size()) {
+        setStatus(status, BVHCacheStatus::Corrupt);
+        return nullptr;
+      }
+      orderedPrims.push_back(primitives[i]);
+    }
+
+    BVHNodeStorage storage;
+    storage.nodes = {
+      reinterpret_cast<const BVHNode*>(data), header.nNodes};
+    storage.quantizedNodes = {
+      reinterpret_cast<const QuantizedBVHNode*>(data + nodesSize),
+      header.nQuantizedNodes};
+    storage.bounds = {
+      Vec3(header.bounds[0], header.bounds[1], header.bounds[2]),
+      Vec3(header.bounds[3], header.bounds[4], header.bounds[5])};
+    storage.rootReference = header.rootReference;
+    storage.owner = std::move(file);
+
+    setStatus(status, BVHCacheStatus::Hit);
+    return std::make_shared<BVHAccel>(
+      std::move(orderedPrims), std::move(storage), options);
+  }
+
+  std::shared_ptr<BVHAccel> loadOrBuildBVH(
+    const std::string& path,
+    const std::vector<std::shared_ptr<Primitive>>& primitives,
+    const BVHBuildOptions& options,
+    BVHCacheStatus* status) {
+    if (auto bvh = loadBVHCache(path, primitives, options, status)) return bvh;
+
+    auto bvh = std::make_shared<BVHAccel>(primitives, options);
+    saveBVHCache(path, *bvh, primitives, options);
+    return bvh;
+  }
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "bvh.hpp"
+
+/// \file BVH cache file
+
+namespace naga::rt {
+
+  /// Result of BVH cache lookup
+  enum class BVHCacheStatus {
+    /// Loaded from cache file
+    Hit,
+    /// Cache file does not exist
+    Missing,
+    /// Cache file was written for other geometry, options or version
+    Stale,
+    /// Cache file is truncated or corrupt
+    Corrupt,
+  };
+
+  /** \brief Hash of input of BVH build.
+   * Combines bounding boxes of primitives with options which affect the
+   * structure of BVH. Positions and indices of triangle meshes are also
+   * hashed, since spatial splits depend on geometry within bounds; other
+   * shapes with same bounds but different geometry can not be
+   * distinguished.
+   */
+  std::uint64_t hashBVHInput(
+    const std::vector<std::shared_ptr<Primitive>>& primitives,
+    const BVHBuildOptions& options);
+
+  /** \brief Write BVH to cache file.
+   * `primitives` and `options` should be the ones used to build `bvh`.
+   * File is written to temporary file and renamed, so concurrent readers
+   * never see partially written file.
+   * \returns false when failed to write file
+   */
+  bool saveBVHCache(
+    const std::string& path,
+    const BVHAccel& bvh,
+    const std::vector<std::shared_ptr<Primitive>>& primitives,
+    const BVHBuildOptions& options);
+
+  /** \brief Load BVH from memory-mapped cache file.
+   * Nodes are used in place from mapped memory. Only checksum and primitive
+   * indices are checked on load.
+   * \returns nullptr when cache file is missing, stale or corrupt
+   */
+  std::shared_ptr<BVHAccel> loadBVHCache(
+    const std::string& path,
+    const std::vector<std::shared_ptr<Primitive>>& primitives,
+    const BVHBuildOptions& options,
+    BVHCacheStatus* status = nullptr);
+
+  /// Load BVH from cache file, or build BVH and write cache file when cache
+  /// file is missing, stale or corrupt.
+  std::shared_ptr<BVHAccel> loadOrBuildBVH(
+    const std::string& path,
+    const std::vector<std::shared_ptr<Primitive>>& primitives,
+    const BVHBuildOptions& options,
+    BVHCacheStatus* status = nullptr);
+}
@@ -0,0 +1,74 @@
+#include "flat_scene.hpp"
+
+#include <cassert>
+#include <type_traits>
+#include <unordered_map>
+#include <variant>
+
+namespace naga::rt {
+
+  namespace {
+    /// Get index of object in pool, adding new objects
+    template <class T>
+    std::uint32_t getPoolIndex(
+      const std::shared_ptr<T>& p,
+      std::vector<std::shared_ptr<T>>* pool,
+      std::unordered_map<const T*, std::uint32_t>* indices) {
+      if (!p) return FlatScene::none;
+      auto [it, added] = indices->emplace(
+        p.get(), static_cast<std::uint32_t>(pool->size()));
+      if (added) pool->push_back(p);
+      return it->second;
+    }
+  } // namespace
+
+  FlatScene::FlatScene(std::vector<std::shared_ptr<Primitive>> primitives)
+    : m_primitives{std::move(primitives)} {
+    auto n = m_primitives.size();
+    m_shapeTypes.reserve(n);
+    m_shapeIndices.reserve(n);
+    m_materialIndices.reserve(n);
+    m_areaLightIndices.reserve(n);
+
+    std::unordered_map<const Material*, std::uint32_t> materials;
+    std::unordered_map<const AreaLight*, std::uint32_t> lights;
+    for (auto& p : m_primitives) {
+      // shapes of other primitives (e.g. instances) are not in world space
+      std::shared_ptr<Shape> shape;
+      if (dynamic_cast<const GeometricPrimitive*>(p.get()))
+        shape = p->getShape();
+      if (auto t = dynamic_cast<const Triangle*>(shape.get())) {
+        m_shapeTypes.push_back(FlatShapeType::Triangle);
+        m_shapeIndices.push_back(
+          static_cast<std::uint32_t>(m_triangles.size()));
+        m_triangles.push_back(t);
+      } else if (shape) {
+        m_shapeTypes.push_back(FlatShapeType::Other);
+        m_shapeIndices.push_back(static_cast<std::uint32_t>(m_shapes.size()));
+        m_shapes.push_back(shape.get());
+      } else {
+        m_shapeTypes.push_back(FlatShapeType::None);
+        m_shapeIndices.push_back(none);
+      }
+      m_materialIndices.push_back(
+        getPoolIndex(p->getMaterial(), &m_materials, &materials));
+      m_areaLightIndices.push_back(
+        getPoolIndex(p->getAreaLight(), &m_areaLights, &lights));
+    }
+  }
+
+  Interaction
+    FlatScene::getInteraction(const Ray& ray, const HitRecord& hit) const {
+    if (hit.instance != HitRecord::none)
+      return m_primitives[hit.instance]->getInteraction(
+        ray, {hit.t, hit.uv, hit.primitive, HitRecord::none});
+    assert(hit.primitive < size());
+    return visitShape(hit.primitive, [&](const auto& shape) -> Interaction {
+      using T = std::decay_t<decltype(shape)>;
+      if constexpr (std::is_same_v<T, std::monostate>)
+        return m_primitives[hit.primitive]->getInteraction(ray, hit);
+      else
+        return shape.getInteraction(ray, hit);
+    });
+  }
+}
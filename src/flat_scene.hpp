@@ -0,0 +1,121 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <variant>
+#include <vector>
+
+#include "interaction.hpp"
+#include "primitive.hpp"
+#include "triangle.hpp"
+
+/// \file Flat scene representation for shading lookups
+
+namespace naga::rt {
+
+  /// Type of shape in FlatScene
+  enum class FlatShapeType : std::uint8_t {
+    /// No shape (e.g. instanced aggregate)
+    None,
+    /// Triangle
+    Triangle,
+    /// Any other shape (dispatched by virtual call)
+    Other,
+  };
+
+  /** \brief Flat representation of primitives of an aggregate.
+   * Primitives are stored as structure-of-arrays of shape type, and
+   * indices of shape, material and area light into typed pools, so
+   * shading looks up hits by index (e.g. HitRecord::primitive of BVHAccel)
+   * without virtual calls or reference counting. Built once from the
+   * primitives of scene-building API (e.g. BVHAccel::getPrimitives()).
+   * Primitives other than GeometricPrimitive (aggregates, instances) are
+   * recorded without shape, and their hits are built by the primitive.
+   */
+  class FlatScene {
+  public:
+    /// No index
+    static constexpr std::uint32_t none = ~std::uint32_t(0);
+
+    /// Ctor
+    explicit FlatScene(std::vector<std::shared_ptr<Primitive>> primitives);
+
+    /// Get number of primitives
+    std::size_t size() const {
+      return m_shapeTypes.size();
+    }
+    /// Get shape type of i-th primitive
+    FlatShapeType getShapeType(std::uint32_t i) const {
+      return m_shapeTypes[i];
+    }
+    /// Get index of material of i-th primitive (`none` if no material).
+    /// Primitives sharing material have the same index.
+    std::uint32_t getMaterialIndex(std::uint32_t i) const {
+      return m_materialIndices[i];
+    }
+    /// Get index of area light of i-th primitive (`none` if no light)
+    std::uint32_t getAreaLightIndex(std::uint32_t i) const {
+      return m_areaLightIndices[i];
+    }
+    /// Get material of i-th primitive (nullptr if no material)
+    const Material* getMaterial(std::uint32_t i) const {
+      auto m = m_materialIndices[i];
+      return m == none ? nullptr : m_materials[m].get();
+    }
+    /// Get area light of i-th primitive (nullptr if no light)
+    const AreaLight* getAreaLight(std::uint32_t i) const {
+      auto l = m_areaLightIndices[i];
+      return l == none ? nullptr : m_areaLights[l].get();
+    }
+    /// Get number of unique materials
+    std::size_t getNumMaterials() const {
+      return m_materials.size();
+    }
+    /// Get number of unique area lights
+    std::size_t getNumAreaLights() const {
+      return m_areaLights.size();
+    }
+
+    /** \brief Call `func` with shape of i-th primitive by its type.
+     * `func` is called with `const Triangle&`, `const Shape&` (other shapes)
+     * or `std::monostate` (no shape), so triangles are dispatched without
+     * virtual calls.
+     */
+    template <class F>
+    decltype(auto) visitShape(std::uint32_t i, F&& func) const {
+      auto s = m_shapeIndices[i];
+      switch (m_shapeTypes[i]) {
+        case FlatShapeType::Triangle:
+          return func(*m_triangles[s]);
+        case FlatShapeType::Other:
+          return func(*m_shapes[s]);
+        default:
+          return func(std::monostate());
+      }
+    }
+
+    /// Build interaction of hit in one of the primitives (hits in nested
+    /// aggregates are built by the aggregate primitive)
+    Interaction getInteraction(const Ray& ray, const HitRecord& hit) const;
+
+  private:
+    /// Primitives (keep shapes alive)
+    std::vector<std::shared_ptr<Primitive>> m_primitives;
+    /// Shape types of primitives
+    std::vector<FlatShapeType> m_shapeTypes;
+    /// Indices of shapes of primitives in pool of their type
+    std::vector<std::uint32_t> m_shapeIndices;
+    /// Indices of materials of primitives
+    std::vector<std::uint32_t> m_materialIndices;
+    /// Indices of area lights of primitives
+    std::vector<std::uint32_t> m_areaLightIndices;
+    /// Triangles
+    std::vector<const Triangle*> m_triangles;
+    /// Other shapes
+    std::vector<const Shape*> m_shapes;
+    /// Unique materials
+    std::vector<std::shared_ptr<Material>> m_materials;
+    /// Unique area lights
+    std::vector<std::shared_ptr<AreaLight>> m_areaLights;
+  };
+}
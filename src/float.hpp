@@ -1,5 +1,6 @@
 #pragma once
 #include <limits>
+#include <type_traits>
 
 namespace naga::rt {
   static_assert(std::numeric_limits<float>::is_iec559);
@@ -9,6 +10,15 @@ namespace naga::rt {
   /// define float_t
   using float_t = float;
 
+  /// Bound of relative rounding error of n floating point operations
+  constexpr float_t gamma(int n) {
+    constexpr float_t eps = std::numeric_limits<float_t>::epsilon() / 2;
+    return (n * eps) / (1 - n * eps);
+  }
+
+  /// Scale of far slab distance which makes ray/box tests conservative
+  constexpr float_t slabFarScale = 1 + 2 * gamma(3);
+
   /// fma
   template <class FP>
   constexpr FP fma(FP x, FP y, FP z) {
@@ -32,7 +42,12 @@ namespace naga::rt {
   }
 
   /// lerp
-  template <class FP, class V0, class V1>
+  template <
+    class FP,
+    class V0,
+    class V1,
+    class = std::enable_if_t<
+      std::is_convertible_v<V0, FP> && std::is_convertible_v<V1, FP>>>
   constexpr FP lerp(FP t, V0 v0, V1 v1) {
     //  vfnmadd213ss    xmm1, xmm0, xmm1
     //  vfmadd213ss     xmm0, xmm2, xmm1
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+/// \file Hash of binary data
+
+namespace naga::rt {
+
+  /// 64-bit FNV-1a hash over 32-bit words
+  class Hasher {
+  public:
+    /// Add bytes (trailing bytes of incomplete word are also added)
+    void add(const void* data, std::size_t size) {
+      auto p = static_cast<const unsigned char*>(data);
+      std::size_t i = 0;
+      for (; i + 4 <= size; i += 4) {
+        std::uint32_t w;
+        std::memcpy(&w, p + i, 4);
+        m_hash = (m_hash ^ w) * prime;
+      }
+      for (; i < size; ++i)
+        m_hash = (m_hash ^ p[i]) * prime;
+    }
+    /// Add value
+    template <class T>
+    void add(const T& v) {
+      add(&v, sizeof(T));
+    }
+    /// Get hash (with final mixing)
+    std::uint64_t get() const {
+      auto h = m_hash;
+      h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ull;
+      h = (h ^ (h >> 27)) * 0x94d049bb133111ebull;
+      return h ^ (h >> 31);
+    }
+
+  private:
+    /// FNV prime
+    static constexpr std::uint64_t prime = 1099511628211ull;
+    /// Hash
+    std::uint64_t m_hash = 14695981039346656037ull;
+  };
+}
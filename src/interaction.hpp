@@ -1,7 +1,12 @@
 #pragma once
 
 #include <variant>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <memory>
 
+#include "float.hpp"
 #include "geometry.hpp"
 #include "material.hpp"
 #include "light.hpp"
@@ -15,6 +20,7 @@ namespace naga::rt {
   class Shape;
 
   class SurfaceInteraction {
+  public:
     SurfaceInteraction() = default;
     SurfaceInteraction(const SurfaceInteraction&) = default;
     SurfaceInteraction(SurfaceInteraction&&) = default;
@@ -32,7 +38,7 @@ namespace naga::rt {
       const Vec3& dpdv,
       const Vec3& dndu,
       const Vec3& dndv,
-      const std::shared_ptr<Shape> s)
+      const Shape* s)
       : m_t{t}
       , m_pos{p}
       , m_pos_error{p_err}
@@ -72,31 +78,27 @@ namespace naga::rt {
     const auto& surfaceGeometry() const {
       return m_geometry.surface;
     }
+    /// shape
+    const Shape* shape() const {
+      return m_shape;
+    }
     /// BSDF
-    const std::shared_ptr<BSDF>& bsdf() {
+    BSDF* bsdf() const {
       return m_bsdf;
     }
     /// BSSRDF
-    const std::shared_ptr<BSSRDF>& bssrdf() {
+    BSSRDF* bssrdf() const {
       return m_bssrdf;
     }
 
-    /// Set BSDF
-    void setBSDF(const std::shared_ptr<BSDF>& p) {
+    /// Set BSDF (usually created in MemoryArena of rendering thread)
+    void setBSDF(BSDF* p) {
       m_bsdf = p;
     }
-    /// Set BSDF
-    void setBSDF(std::shared_ptr<BSDF>&& p) {
-      m_bsdf = std::move(p);
-    }
-    /// Set BSSRDF
-    void setBSSRDF(const std::shared_ptr<BSSRDF>& p) {
+    /// Set BSSRDF (usually created in MemoryArena of rendering thread)
+    void setBSSRDF(BSSRDF* p) {
       m_bssrdf = p;
     }
-    /// Set BSSRDF
-    void setBSSRDF(std::shared_ptr<BSSRDF>&& p) {
-      m_bssrdf = std::move(p);
-    }
     /// Set shading geometry
     void setShadingGeometry(
       const Vec3& normal,
@@ -132,12 +134,12 @@ namespace naga::rt {
         Vec3 dndu, dndv;
       } surface, shading;
     } m_geometry;
-    /// BSDF
-    std::shared_ptr<BSDF> m_bsdf;
-    /// BSSRDF
-    std::shared_ptr<BSSRDF> m_bssrdf;
-    /// Shape
-    std::shared_ptr<Shape> m_shape;
+    /// BSDF (not owned)
+    BSDF* m_bsdf = nullptr;
+    /// BSSRDF (not owned)
+    BSSRDF* m_bssrdf = nullptr;
+    /// Shape (not owned)
+    const Shape* m_shape = nullptr;
   };
 
   struct MediumInteraction {
@@ -147,4 +149,40 @@ namespace naga::rt {
   /// Interaction
   using Interaction =
     std::variant<std::monostate, SurfaceInteraction, MediumInteraction>;
+
+  /** \brief Compact record of closest hit.
+   * Written by traversal instead of Interaction, so candidate hits replaced
+   * by closer ones do not build differential geometry. Interaction of the
+   * final hit is built by Primitive::getInteraction().
+   */
+  struct HitRecord {
+    /// No index
+    static constexpr std::uint32_t none = ~std::uint32_t(0);
+
+    /// Ray parameter
+    float_t t = std::numeric_limits<float_t>::infinity();
+    /// Surface coordinates of hit (barycentrics b1, b2 for triangles)
+    Vec2 uv = Vec2(0);
+    /// Index of primitive in aggregate
+    std::uint32_t primitive = none;
+    /// Index of instance in top-level aggregate (when primitive is in
+    /// nested aggregate)
+    std::uint32_t instance = none;
+  };
+
+  /// Get interval (tMin, tMax) which contains hit again after rounding of
+  /// its ray parameter by instance transforms (used to intersect again)
+  inline void
+    getHitInterval(const HitRecord& hit, float_t* tMin, float_t* tMax) {
+    constexpr auto inf = std::numeric_limits<float_t>::infinity();
+    auto d = std::abs(hit.t) * gamma(3);
+    *tMin = std::nextafter(hit.t - d, -inf);
+    *tMax = std::nextafter(hit.t + d, inf);
+  }
+
+  /// Get ray parameter of surface interaction (infinity if not a surface hit)
+  inline float_t getRayParam(const Interaction& isec) {
+    if (auto si = std::get_if<SurfaceInteraction>(&isec)) return si->t();
+    return std::numeric_limits<float_t>::infinity();
+  }
 }
\ No newline at end of file
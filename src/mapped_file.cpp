@@ -0,0 +1,68 @@
+#include "mapped_file.hpp"
+
+#if defined(_WIN32)
+  #define WIN32_LEAN_AND_MEAN
+  #define NOMINMAX
+  #include <windows.h>
+#else
+  #include <fcntl.h>
+  #include <sys/mman.h>
+  #include <sys/stat.h>
+  #include <unistd.h>
+#endif
+
+namespace naga::rt {
+
+#if defined(_WIN32)
+
+  MappedFile::MappedFile(const std::string& path) {
+    HANDLE file = CreateFileA(
+      path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+      FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) return;
+    m_file = file;
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) return;
+
+    m_mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!m_mapping) return;
+
+    auto p = MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0);
+    if (!p) return;
+    m_data = static_cast<const std::byte*>(p);
+    m_size = static_cast<std::size_t>(size.QuadPart);
+  }
+
+  MappedFile::~MappedFile() {
+    if (m_data) UnmapViewOfFile(m_data);
+    if (m_mapping) CloseHandle(m_mapping);
+    if (m_file) CloseHandle(m_file);
+  }
+
+#else
+
+  MappedFile::MappedFile(const std::string& path) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return;
+
+    struct stat st;
+    if (::fstat(fd, &st) == 0 && st.st_size > 0) {
+      auto size = static_cast<std::size_t>(st.st_size);
+      void* p = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (p != MAP_FAILED) {
+        m_data = static_cast<const std::byte*>(p);
+        m_size = size;
+      }
+    }
+    // mapping stays valid after closing descriptor
+    ::close(fd);
+  }
+
+  MappedFile::~MappedFile() {
+    if (m_data)
+      ::munmap(const_cast<std::byte*>(m_data), m_size);
+  }
+
+#endif
+}
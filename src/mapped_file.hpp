@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+/// \file Read-only memory-mapped file
+
+namespace naga::rt {
+
+  /** \brief Read-only memory-mapped file.
+   * Whole file is mapped on construction and unmapped on destruction.
+   * Mapping starts at page boundary, so data is aligned for any type.
+   */
+  class MappedFile {
+  public:
+    /// Ctor (map file at `path`, check `isOpen()` for failure)
+    explicit MappedFile(const std::string& path);
+    /// Dtor
+    ~MappedFile();
+
+    /// Deleted
+    MappedFile(const MappedFile&) = delete;
+    /// Deleted
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    /// Check if file is mapped
+    bool isOpen() const {
+      return m_data != nullptr;
+    }
+    /// Get pointer to mapped data
+    const std::byte* data() const {
+      return m_data;
+    }
+    /// Get size of file
+    std::size_t size() const {
+      return m_size;
+    }
+
+  private:
+    /// Mapped data
+    const std::byte* m_data = nullptr;
+    /// Size of file
+    std::size_t m_size = 0;
+#if defined(_WIN32)
+    /// File handle
+    void* m_file = nullptr;
+    /// Mapping handle
+    void* m_mapping = nullptr;
+#endif
+  };
+}
@@ -0,0 +1,212 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <new>
+#include <utility>
+#include <vector>
+
+/// \file Memory utilities
+
+namespace naga::rt {
+
+  /// L1 cache line size (bytes)
+  constexpr std::size_t cacheLineSize = 64;
+
+  /// Allocator which aligns storage to `Alignment` bytes
+  template <class T, std::size_t Alignment = cacheLineSize>
+  class AlignedAllocator {
+  public:
+    using value_type = T;
+
+    /// rebind
+    template <class U>
+    struct rebind {
+      using other = AlignedAllocator<U, Alignment>;
+    };
+
+    /// Ctor
+    AlignedAllocator() = default;
+    /// Ctor
+    template <class U>
+    AlignedAllocator(const AlignedAllocator<U, Alignment>&) {}
+
+    /// Allocate storage for n objects
+    T* allocate(std::size_t n) {
+      return static_cast<T*>(
+        ::operator new(n * sizeof(T), std::align_val_t{Alignment}));
+    }
+    /// Deallocate storage
+    void deallocate(T* p, std::size_t) {
+      ::operator delete(p, std::align_val_t{Alignment});
+    }
+  };
+
+  /// operator==
+  template <class T, class U, std::size_t Alignment>
+  bool operator==(
+    const AlignedAllocator<T, Alignment>&,
+    const AlignedAllocator<U, Alignment>&) {
+    return true;
+  }
+
+  /// operator!=
+  template <class T, class U, std::size_t Alignment>
+  bool operator!=(
+    const AlignedAllocator<T, Alignment>&,
+    const AlignedAllocator<U, Alignment>&) {
+    return false;
+  }
+
+  /// Non-owning view of contiguous array
+  template <class T>
+  class ArrayView {
+  public:
+    /// Ctor
+    constexpr ArrayView() = default;
+    /// Ctor
+    constexpr ArrayView(T* data, std::size_t size)
+      : m_data{data}, m_size{size} {}
+    /// Ctor (view of container)
+    template <class Container>
+    ArrayView(Container& c) : m_data{c.data()}, m_size{c.size()} {}
+
+    /// Get pointer to first element
+    constexpr T* data() const {
+      return m_data;
+    }
+    /// Get number of elements
+    constexpr std::size_t size() const {
+      return m_size;
+    }
+    /// Check if view is empty
+    constexpr bool empty() const {
+      return m_size == 0;
+    }
+    /// Get element
+    constexpr T& operator[](std::size_t i) const {
+      return m_data[i];
+    }
+    /// begin
+    constexpr T* begin() const {
+      return m_data;
+    }
+    /// end
+    constexpr T* end() const {
+      return m_data + m_size;
+    }
+
+  private:
+    /// Pointer to first element
+    T* m_data = nullptr;
+    /// Number of elements
+    std::size_t m_size = 0;
+  };
+
+  /** \brief Bump-pointer memory arena.
+   * Allocates objects from large blocks. Objects are never freed one by
+   * one: reset() makes all blocks reusable at once, without calling
+   * destructors. Used for per-hit data (BSDF, BSSRDF) by one thread, which
+   * resets it after each pixel or sample. Not thread-safe.
+   */
+  class MemoryArena {
+  public:
+    /// Ctor
+    explicit MemoryArena(std::size_t blockSize = 256 * 1024)
+      : m_blockSize{blockSize} {}
+    /// Deleted
+    MemoryArena(const MemoryArena&) = delete;
+    /// Deleted
+    MemoryArena& operator=(const MemoryArena&) = delete;
+    /// Ctor
+    MemoryArena(MemoryArena&& other) noexcept
+      : m_blockSize{other.m_blockSize}
+      , m_blocks{std::move(other.m_blocks)}
+      , m_current{std::exchange(other.m_current, 0)}
+      , m_offset{std::exchange(other.m_offset, 0)} {
+      other.m_blocks.clear();
+    }
+    /// Dtor
+    ~MemoryArena() {
+      for (auto& b : m_blocks)
+        ::operator delete(b.data, std::align_val_t{cacheLineSize});
+    }
+
+    /// Allocate `size` bytes aligned to `alignment` (at most cacheLineSize)
+    void* allocate(std::size_t size, std::size_t alignment) {
+      if (m_current < m_blocks.size()) {
+        auto& b = m_blocks[m_current];
+        auto offset = (m_offset + alignment - 1) & ~(alignment - 1);
+        if (offset + size <= b.size) {
+          m_offset = offset + size;
+          return b.data + offset;
+        }
+      }
+      return allocateBlock(size);
+    }
+    /// Create object (destructor is never called)
+    template <class T, class... Args>
+    T* create(Args&&... args) {
+      static_assert(alignof(T) <= cacheLineSize);
+      return new (allocate(sizeof(T), alignof(T)))
+        T(std::forward<Args>(args)...);
+    }
+    /// Create array of `n` value-initialized objects
+    template <class T>
+    T* createArray(std::size_t n) {
+      static_assert(alignof(T) <= cacheLineSize);
+      auto p = static_cast<T*>(allocate(n * sizeof(T), alignof(T)));
+      for (std::size_t i = 0; i < n; ++i)
+        new (p + i) T();
+      return p;
+    }
+
+    /// Release all objects (blocks are kept for reuse)
+    void reset() {
+      m_current = 0;
+      m_offset = 0;
+    }
+    /// Get size of all blocks
+    std::size_t getCapacity() const {
+      std::size_t size = 0;
+      for (auto& b : m_blocks)
+        size += b.size;
+      return size;
+    }
+
+  private:
+    /// Block of memory
+    struct Block {
+      /// Storage (aligned to cacheLineSize)
+      std::byte* data;
+      /// Size
+      std::size_t size;
+    };
+
+    /// Move to next block which fits `size` bytes (allocating if needed)
+    void* allocateBlock(std::size_t size) {
+      // blocks too small for `size` are skipped until reset()
+      auto next = m_blocks.empty() ? 0 : m_current + 1;
+      while (next < m_blocks.size() && m_blocks[next].size < size)
+        ++next;
+      if (next == m_blocks.size()) {
+        auto blockSize = std::max(size, m_blockSize);
+        m_blocks.push_back({static_cast<std::byte*>(::operator new(
+                              blockSize, std::align_val_t{cacheLineSize})),
+                            blockSize});
+      }
+      m_current = next;
+      m_offset = size;
+      return m_blocks[m_current].data;
+    }
+
+    /// Default size of blocks
+    std::size_t m_blockSize;
+    /// Blocks (blocks before m_current are in use)
+    std::vector<Block> m_blocks;
+    /// Index of current block
+    std::size_t m_current = 0;
+    /// Offset in current block
+    std::size_t m_offset = 0;
+  };
+}
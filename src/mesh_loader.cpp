@@ -0,0 +1,834 @@
+#include "mesh_loader.hpp"
+#include "hash.hpp"
+#include "mapped_file.hpp"
+#include "parallel.hpp"
+
+#include <algorithm>
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <sstream>
+#include <unordered_map>
+#include <vector>
+
+namespace naga::rt {
+
+  namespace {
+
+    /// Marker of missing OBJ index
+    constexpr std::uint32_t noIndex = ~0u;
+
+    /// Split [0, count) into chunks and call `func(chunk, begin, end)`.
+    /// \returns true if `func` returned true for every chunk
+    template <class F>
+    bool parallelAll(std::size_t count, std::size_t nThreads, F&& func) {
+      std::vector<char> ok(std::max<std::size_t>(nThreads, 1), 1);
+      parallelForChunks(
+        count, nThreads,
+        [&](std::size_t c, std::size_t begin, std::size_t end) {
+          ok[c] = func(c, begin, end);
+        });
+      return std::all_of(ok.begin(), ok.end(), [](char v) { return v; });
+    }
+
+    /// Transform vertices to world space in parallel
+    void transformVertices(
+      const MeshLoadOptions& options,
+      std::vector<Vec3>& positions,
+      std::vector<Vec3>& normals) {
+      const auto& objectToWorld = options.objectToWorld;
+      if (objectToWorld.isIdentity()) return;
+      auto transform = [&](const auto& t) {
+        parallelForChunks(
+          positions.size(), options.nThreads,
+          [&](std::size_t, std::size_t begin, std::size_t end) {
+            for (auto i = begin; i < end; ++i)
+              positions[i] = t.transformPoint(positions[i]);
+          });
+        parallelForChunks(
+          normals.size(), options.nThreads,
+          [&](std::size_t, std::size_t begin, std::size_t end) {
+            for (auto i = begin; i < end; ++i)
+              normals[i] = glm::normalize(t.transformNormal(normals[i]));
+          });
+      };
+      // affine transforms skip homogeneous divide
+      if (objectToWorld.isAffine())
+        transform(AffineTransform(objectToWorld));
+      else
+        transform(objectToWorld);
+    }
+
+    /// Check if all indices are less than `n`
+    bool checkIndices(
+      const std::vector<std::uint32_t>& indices,
+      std::size_t n,
+      std::size_t nThreads) {
+      return parallelAll(
+        indices.size(), nThreads,
+        [&](std::size_t, std::size_t begin, std::size_t end) {
+          for (auto i = begin; i < end; ++i)
+            if (indices[i] >= n) return false;
+          return true;
+        });
+    }
+
+    // ------------------------------------------
+    // OBJ
+    // ------------------------------------------
+
+    /// Kind of OBJ line
+    enum class ObjLine { Other, Position, Normal, UV, Face };
+
+    /// Check if character is space (not newline)
+    bool isSpace(char c) {
+      return c == ' ' || c == '\t' || c == '\r';
+    }
+    /// Skip spaces
+    const char* skipSpaces(const char* p, const char* end) {
+      while (p < end && isSpace(*p))
+        ++p;
+      return p;
+    }
+    /// Get start of next line
+    const char* nextLine(const char* p, const char* end) {
+      p = static_cast<const char*>(std::memchr(p, '\n', end - p));
+      return p ? p + 1 : end;
+    }
+    /// Check if p is at end of line (or comment)
+    bool isEndOfLine(const char* p, const char* end) {
+      return p == end || *p == '\n' || *p == '#';
+    }
+
+    /// Get kind of line and move p after keyword
+    ObjLine getObjLine(const char*& p, const char* end) {
+      p = skipSpaces(p, end);
+      if (end - p < 2) return ObjLine::Other;
+      if (p[0] == 'f' && isSpace(p[1])) {
+        p += 2;
+        return ObjLine::Face;
+      }
+      if (p[0] != 'v') return ObjLine::Other;
+      if (isSpace(p[1])) {
+        p += 2;
+        return ObjLine::Position;
+      }
+      if (end - p < 3 || !isSpace(p[2])) return ObjLine::Other;
+      if (p[1] == 'n') {
+        p += 3;
+        return ObjLine::Normal;
+      }
+      if (p[1] == 't') {
+        p += 3;
+        return ObjLine::UV;
+      }
+      return ObjLine::Other;
+    }
+
+    /// Parse float
+    bool parseFloat(const char*& p, const char* end, float_t* v) {
+      p = skipSpaces(p, end);
+      if (p < end && *p == '+') ++p;
+      auto [ptr, ec] = std::from_chars(p, end, *v);
+      if (ec != std::errc()) return false;
+      p = ptr;
+      return true;
+    }
+
+    /// Parse integer
+    bool parseInt(const char*& p, const char* end, std::int64_t* v) {
+      bool negative = false;
+      if (p < end && (*p == '-' || *p == '+')) negative = *p++ == '-';
+      if (p == end || *p < '0' || *p > '9') return false;
+      std::int64_t r = 0;
+      while (p < end && *p >= '0' && *p <= '9')
+        r = r * 10 + (*p++ - '0');
+      *v = negative ? -r : r;
+      return true;
+    }
+
+    /// Corner of OBJ face (indices as written, 0 when missing)
+    struct ObjCorner {
+      std::int64_t v, vt, vn;
+    };
+
+    /// Parse corner `v`, `v/vt`, `v//vn` or `v/vt/vn`
+    bool parseCorner(const char*& p, const char* end, ObjCorner* c) {
+      *c = {0, 0, 0};
+      if (!parseInt(p, end, &c->v)) return false;
+      if (p == end || *p != '/') return true;
+      ++p;
+      if (p < end && *p != '/' && !parseInt(p, end, &c->vt)) return false;
+      if (p == end || *p != '/') return true;
+      ++p;
+      return parseInt(p, end, &c->vn);
+    }
+
+    /// Convert OBJ index (1-based, or negative relative to `count`) to
+    /// 0-based index (noIndex when missing or out of range)
+    std::uint32_t resolveIndex(std::int64_t i, std::size_t count) {
+      std::int64_t r = i > 0 ? i - 1 : static_cast<std::int64_t>(count) + i;
+      if (i == 0 || r < 0 || r >= static_cast<std::int64_t>(noIndex))
+        return noIndex;
+      return static_cast<std::uint32_t>(r);
+    }
+
+    /// Number of elements in chunk of OBJ file
+    struct ObjCounts {
+      std::size_t positions = 0;
+      std::size_t normals = 0;
+      std::size_t uvs = 0;
+      std::size_t triangles = 0;
+    };
+
+    /// Count elements of chunk
+    ObjCounts countObjChunk(const char* p, const char* end) {
+      ObjCounts counts;
+      for (; p < end; p = nextLine(p, end)) {
+        switch (getObjLine(p, end)) {
+          case ObjLine::Position: ++counts.positions; break;
+          case ObjLine::Normal: ++counts.normals; break;
+          case ObjLine::UV: ++counts.uvs; break;
+          case ObjLine::Face: {
+            std::size_t n = 0;
+            for (p = skipSpaces(p, end); !isEndOfLine(p, end);
+                 p = skipSpaces(p, end)) {
+              while (p < end && !isSpace(*p) && *p != '\n')
+                ++p;
+              ++n;
+            }
+            if (n >= 3) counts.triangles += n - 2;
+            break;
+          }
+          case ObjLine::Other: break;
+        }
+      }
+      return counts;
+    }
+
+    /// Position, UV and normal indices of vertex of OBJ mesh
+    struct ObjVertex {
+      std::uint32_t v, vt, vn;
+
+      bool operator==(const ObjVertex& other) const {
+        return v == other.v && vt == other.vt && vn == other.vn;
+      }
+    };
+
+    /// Hash of ObjVertex
+    struct ObjVertexHash {
+      std::size_t operator()(const ObjVertex& vertex) const {
+        Hasher hasher;
+        hasher.add(vertex);
+        return static_cast<std::size_t>(hasher.get());
+      }
+    };
+
+    /// Map from indices of vertex to index in mesh
+    using ObjVertexMap =
+      std::unordered_map<ObjVertex, std::uint32_t, ObjVertexHash>;
+
+    /// Parsed OBJ data
+    struct ObjData {
+      std::vector<Vec3> positions;
+      std::vector<Vec3> normals;
+      std::vector<Vec2> uvs;
+      /// Position, UV and normal indices of triangle corners
+      std::vector<std::uint32_t> corners[3];
+    };
+
+    /// Parse chunk into `data` at offsets `base`
+    bool parseObjChunk(
+      const char* p, const char* end, ObjCounts base, ObjData& data) {
+      auto& [positions, normals, uvs, triangles] = base;
+      for (; p < end; p = nextLine(p, end)) {
+        switch (getObjLine(p, end)) {
+          case ObjLine::Position: {
+            auto& v = data.positions[positions++];
+            if (
+              !parseFloat(p, end, &v.x) || !parseFloat(p, end, &v.y) ||
+              !parseFloat(p, end, &v.z))
+              return false;
+            break;
+          }
+          case ObjLine::Normal: {
+            auto& n = data.normals[normals++];
+            if (
+              !parseFloat(p, end, &n.x) || !parseFloat(p, end, &n.y) ||
+              !parseFloat(p, end, &n.z))
+              return false;
+            break;
+          }
+          case ObjLine::UV: {
+            auto& uv = data.uvs[uvs++];
+            if (!parseFloat(p, end, &uv.x)) return false;
+            // v is optional
+            uv.y = 0;
+            if (!isEndOfLine(skipSpaces(p, end), end))
+              if (!parseFloat(p, end, &uv.y)) return false;
+            break;
+          }
+          case ObjLine::Face: {
+            // triangulate as fan
+            std::uint32_t first[3];
+            std::uint32_t prev[3];
+            std::size_t n = 0;
+            for (p = skipSpaces(p, end); !isEndOfLine(p, end);
+                 p = skipSpaces(p, end), ++n) {
+              ObjCorner c;
+              if (!parseCorner(p, end, &c)) return false;
+              std::uint32_t corner[3] = {resolveIndex(c.v, positions),
+                                         resolveIndex(c.vt, uvs),
+                                         resolveIndex(c.vn, normals)};
+              if (corner[0] == noIndex) return false;
+              if (n >= 2) {
+                auto i = 3 * triangles++;
+                for (auto k = 0; k < 3; ++k) {
+                  data.corners[k][i] = first[k];
+                  data.corners[k][i + 1] = prev[k];
+                  data.corners[k][i + 2] = corner[k];
+                }
+              }
+              for (auto k = 0; k < 3; ++k) {
+                if (n == 0) first[k] = corner[k];
+                prev[k] = corner[k];
+              }
+            }
+            break;
+          }
+          case ObjLine::Other: break;
+        }
+      }
+      return true;
+    }
+  } // namespace
+
+  std::shared_ptr<TriangleMesh>
+    loadOBJ(const std::string& path, const MeshLoadOptions& options) {
+    MappedFile file(path);
+    if (!file.isOpen()) return nullptr;
+    const auto nThreads = std::max<std::size_t>(options.nThreads, 1);
+    const char* data = reinterpret_cast<const char*>(file.data());
+    const std::size_t size = file.size();
+
+    // split into chunks at line boundaries
+    std::vector<const char*> bounds(nThreads + 1, data + size);
+    bounds[0] = data;
+    for (std::size_t c = 1; c < nThreads; ++c) {
+      auto p = std::max(bounds[c - 1], data + size * c / nThreads);
+      bounds[c] = p == data ? p : nextLine(p - 1, data + size);
+    }
+
+    // count elements of chunks
+    std::vector<ObjCounts> counts(nThreads);
+    parallelFor(nThreads, nThreads, [&](std::size_t c) {
+      counts[c] = countObjChunk(bounds[c], bounds[c + 1]);
+    });
+
+    // offsets of chunks
+    std::vector<ObjCounts> offsets(nThreads + 1);
+    for (std::size_t c = 0; c < nThreads; ++c) {
+      offsets[c + 1].positions = offsets[c].positions + counts[c].positions;
+      offsets[c + 1].normals = offsets[c].normals + counts[c].normals;
+      offsets[c + 1].uvs = offsets[c].uvs + counts[c].uvs;
+      offsets[c + 1].triangles = offsets[c].triangles + counts[c].triangles;
+    }
+    const auto& total = offsets[nThreads];
+    if (total.triangles == 0) return nullptr;
+
+    // parse chunks in place
+    ObjData obj;
+    obj.positions.resize(total.positions);
+    obj.normals.resize(total.normals);
+    obj.uvs.resize(total.uvs);
+    for (auto& c : obj.corners)
+      c.resize(3 * total.triangles);
+    std::vector<char> ok(nThreads);
+    parallelFor(nThreads, nThreads, [&](std::size_t c) {
+      ok[c] = parseObjChunk(bounds[c], bounds[c + 1], offsets[c], obj);
+    });
+    if (std::find(ok.begin(), ok.end(), 0) != ok.end()) return nullptr;
+
+    auto& indices = obj.corners[0];
+    if (!checkIndices(indices, total.positions, nThreads)) return nullptr;
+
+    // UVs and normals are used only when every corner references them
+    bool hasUVs =
+      total.uvs > 0 && checkIndices(obj.corners[1], total.uvs, nThreads);
+    bool hasNormals =
+      total.normals > 0 &&
+      checkIndices(obj.corners[2], total.normals, nThreads);
+
+    // can attributes share position indices?
+    auto sameIndices = [&](int k, std::size_t count) {
+      return count == total.positions && obj.corners[k] == indices;
+    };
+    bool shared = (!hasUVs || sameIndices(1, total.uvs)) &&
+                  (!hasNormals || sameIndices(2, total.normals));
+
+    std::vector<Vec3> positions;
+    std::vector<Vec3> normals;
+    std::vector<Vec2> uvs;
+    if (shared) {
+      positions = std::move(obj.positions);
+      if (hasNormals) normals = std::move(obj.normals);
+      if (hasUVs) uvs = std::move(obj.uvs);
+    } else {
+      // one vertex per distinct (position, UV, normal) indices: find
+      // distinct vertices of chunks in parallel, then merge them in order
+      auto n = indices.size();
+      std::vector<std::vector<ObjVertex>> chunkVertices(nThreads);
+      // index of vertex of corner in vertices of its chunk
+      std::vector<std::uint32_t> chunkIndices(n);
+      parallelForChunks(
+        n, nThreads, [&](std::size_t c, std::size_t begin, std::size_t end) {
+          ObjVertexMap map;
+          auto& vertices = chunkVertices[c];
+          for (auto i = begin; i < end; ++i) {
+            ObjVertex vertex = {
+              indices[i], hasUVs ? obj.corners[1][i] : 0,
+              hasNormals ? obj.corners[2][i] : 0};
+            auto next = static_cast<std::uint32_t>(vertices.size());
+            auto [it, inserted] = map.emplace(vertex, next);
+            if (inserted) vertices.push_back(vertex);
+            chunkIndices[i] = it->second;
+          }
+        });
+
+      ObjVertexMap map;
+      std::vector<std::vector<std::uint32_t>> meshIndices(nThreads);
+      for (std::size_t c = 0; c < nThreads; ++c) {
+        for (auto& vertex : chunkVertices[c]) {
+          auto next = static_cast<std::uint32_t>(positions.size());
+          auto [it, inserted] = map.emplace(vertex, next);
+          if (inserted) {
+            positions.push_back(obj.positions[vertex.v]);
+            if (hasUVs) uvs.push_back(obj.uvs[vertex.vt]);
+            if (hasNormals) normals.push_back(obj.normals[vertex.vn]);
+          }
+          meshIndices[c].push_back(it->second);
+        }
+      }
+
+      // chunks are same as above
+      parallelForChunks(
+        n, nThreads, [&](std::size_t c, std::size_t begin, std::size_t end) {
+          for (auto i = begin; i < end; ++i)
+            indices[i] = meshIndices[c][chunkIndices[i]];
+        });
+    }
+
+    transformVertices(options, positions, normals);
+    return std::make_shared<TriangleMesh>(
+      Transform(), std::move(indices), std::move(positions),
+      std::move(normals), std::move(uvs));
+  }
+
+  namespace {
+
+    // ------------------------------------------
+    // PLY
+    // ------------------------------------------
+
+    /// Scalar type of PLY property
+    enum class PlyType {
+      Int8,
+      UInt8,
+      Int16,
+      UInt16,
+      Int32,
+      UInt32,
+      Float32,
+      Float64
+    };
+
+    /// Parse name of PLY type
+    bool parsePlyType(const std::string& s, PlyType* type) {
+      static const std::pair<const char*, PlyType> names[] = {
+        {"char", PlyType::Int8},       {"int8", PlyType::Int8},
+        {"uchar", PlyType::UInt8},     {"uint8", PlyType::UInt8},
+        {"short", PlyType::Int16},     {"int16", PlyType::Int16},
+        {"ushort", PlyType::UInt16},   {"uint16", PlyType::UInt16},
+        {"int", PlyType::Int32},       {"int32", PlyType::Int32},
+        {"uint", PlyType::UInt32},     {"uint32", PlyType::UInt32},
+        {"float", PlyType::Float32},   {"float32", PlyType::Float32},
+        {"double", PlyType::Float64},  {"float64", PlyType::Float64}};
+      for (auto& [name, t] : names) {
+        if (s == name) {
+          *type = t;
+          return true;
+        }
+      }
+      return false;
+    }
+
+    /// Get size of PLY type
+    std::size_t getPlySize(PlyType type) {
+      switch (type) {
+        case PlyType::Int8:
+        case PlyType::UInt8: return 1;
+        case PlyType::Int16:
+        case PlyType::UInt16: return 2;
+        case PlyType::Int32:
+        case PlyType::UInt32:
+        case PlyType::Float32: return 4;
+        case PlyType::Float64: return 8;
+      }
+      return 0;
+    }
+
+    /// Load value of type T, swapping bytes if needed
+    template <class T>
+    T loadPly(const std::byte* p, bool swap) {
+      unsigned char bytes[sizeof(T)];
+      std::memcpy(bytes, p, sizeof(T));
+      if (swap) std::reverse(bytes, bytes + sizeof(T));
+      T v;
+      std::memcpy(&v, bytes, sizeof(T));
+      return v;
+    }
+
+    /// Read value of PLY property
+    double readPly(const std::byte* p, PlyType type, bool swap) {
+      switch (type) {
+        case PlyType::Int8: return loadPly<std::int8_t>(p, swap);
+        case PlyType::UInt8: return loadPly<std::uint8_t>(p, swap);
+        case PlyType::Int16: return loadPly<std::int16_t>(p, swap);
+        case PlyType::UInt16: return loadPly<std::uint16_t>(p, swap);
+        case PlyType::Int32: return loadPly<std::int32_t>(p, swap);
+        case PlyType::UInt32: return loadPly<std::uint32_t>(p, swap);
+        case PlyType::Float32: return loadPly<float>(p, swap);
+        case PlyType::Float64: return loadPly<double>(p, swap);
+      }
+      return 0;
+    }
+
+    /// Read index of PLY list (noIndex for negative values)
+    std::uint32_t readPlyIndex(const std::byte* p, PlyType type, bool swap) {
+      switch (type) {
+        case PlyType::Int32: {
+          auto i = loadPly<std::int32_t>(p, swap);
+          return i < 0 ? noIndex : static_cast<std::uint32_t>(i);
+        }
+        case PlyType::UInt32: return loadPly<std::uint32_t>(p, swap);
+        default: {
+          auto i = readPly(p, type, swap);
+          return i < 0 ? noIndex : static_cast<std::uint32_t>(i);
+        }
+      }
+    }
+
+    /// PLY property
+    struct PlyProperty {
+      /// Name
+      std::string name;
+      /// Type (of list items for lists)
+      PlyType type;
+      /// List property?
+      bool isList = false;
+      /// Type of list count
+      PlyType countType;
+      /// Offset in record (fixed-size elements)
+      std::size_t offset = 0;
+    };
+
+    /// PLY element
+    struct PlyElement {
+      /// Name
+      std::string name;
+      /// Number of records
+      std::size_t count = 0;
+      /// Properties
+      std::vector<PlyProperty> properties;
+      /// Size of record (without lists)
+      std::size_t stride = 0;
+      /// Has list property?
+      bool hasList = false;
+
+      /// Find property (nullptr if not found)
+      const PlyProperty* find(std::initializer_list<const char*> names) const {
+        for (auto name : names)
+          for (auto& p : properties)
+            if (p.name == name) return &p;
+        return nullptr;
+      }
+    };
+
+    /// Check if host is little-endian
+    bool isLittleEndian() {
+      const std::uint16_t one = 1;
+      unsigned char byte;
+      std::memcpy(&byte, &one, 1);
+      return byte == 1;
+    }
+
+    /// Check if `count` records of `stride` bytes fit into [p, end)
+    /// (without overflow of size)
+    bool fitsPly(
+      std::size_t count,
+      std::size_t stride,
+      const std::byte* p,
+      const std::byte* end) {
+      return stride == 0 || count <= static_cast<std::size_t>(end - p) / stride;
+    }
+
+    /** \brief Walk variable-size records of element from `p`.
+     * Calls `onList(record, property, data, n)` for lists.
+     * \returns Pointer after last record (nullptr if data ends early)
+     */
+    template <class F>
+    const std::byte* walkPlyRecords(
+      const PlyElement& element,
+      const std::byte* p,
+      const std::byte* end,
+      bool swap,
+      F&& onList) {
+      for (std::size_t r = 0; r < element.count; ++r) {
+        for (auto& prop : element.properties) {
+          if (!prop.isList) {
+            if (!fitsPly(1, getPlySize(prop.type), p, end)) return nullptr;
+            p += getPlySize(prop.type);
+            continue;
+          }
+          auto countSize = getPlySize(prop.countType);
+          if (!fitsPly(1, countSize, p, end)) return nullptr;
+          auto n = readPly(p, prop.countType, swap);
+          if (n < 0) return nullptr;
+          p += countSize;
+          auto itemSize = getPlySize(prop.type);
+          if (!fitsPly(static_cast<std::size_t>(n), itemSize, p, end))
+            return nullptr;
+          onList(r, prop, p, static_cast<std::size_t>(n));
+          p += static_cast<std::size_t>(n) * itemSize;
+        }
+      }
+      return p;
+    }
+
+    /// Owner of PLY mesh data referencing mapped file
+    struct PlyMeshOwner {
+      /// Mapped file
+      std::shared_ptr<MappedFile> file;
+      /// Vertex indices
+      std::vector<std::uint32_t> indices;
+    };
+  } // namespace
+
+  std::shared_ptr<TriangleMesh>
+    loadPLY(const std::string& path, const MeshLoadOptions& options) {
+    auto file = std::make_shared<MappedFile>(path);
+    if (!file->isOpen()) return nullptr;
+    const auto nThreads = std::max<std::size_t>(options.nThreads, 1);
+    const std::byte* data = file->data();
+    const std::byte* end = data + file->size();
+
+    // header
+    constexpr char endHeader[] = "end_header\n";
+    const char* text = reinterpret_cast<const char*>(data);
+    std::string_view view(text, file->size());
+    auto headerEnd = view.find(endHeader);
+    if (view.substr(0, 4) != "ply\n" || headerEnd == view.npos) return nullptr;
+    std::istringstream header(std::string(view.substr(0, headerEnd)));
+    std::vector<PlyElement> elements;
+    bool binary = false;
+    bool swap = false;
+    for (std::string line; std::getline(header, line);) {
+      std::istringstream ss(line);
+      std::string keyword;
+      ss >> keyword;
+      if (keyword == "format") {
+        std::string format;
+        ss >> format;
+        binary = format == "binary_little_endian" ||
+                 format == "binary_big_endian";
+        swap = (format == "binary_little_endian") != isLittleEndian();
+      } else if (keyword == "element") {
+        auto& e = elements.emplace_back();
+        ss >> e.name >> e.count;
+        if (!ss) return nullptr;
+      } else if (keyword == "property") {
+        if (elements.empty()) return nullptr;
+        auto& e = elements.back();
+        PlyProperty prop;
+        std::string type;
+        ss >> type;
+        if (type == "list") {
+          std::string countType;
+          ss >> countType >> type;
+          prop.isList = true;
+          if (!parsePlyType(countType, &prop.countType)) return nullptr;
+          e.hasList = true;
+        }
+        if (!parsePlyType(type, &prop.type)) return nullptr;
+        ss >> prop.name;
+        if (!prop.isList) {
+          prop.offset = e.stride;
+          e.stride += getPlySize(prop.type);
+        }
+        e.properties.push_back(std::move(prop));
+      }
+    }
+    if (!binary) return nullptr;
+
+    const std::byte* p = data + headerEnd + sizeof(endHeader) - 1;
+    const PlyElement* vertexElement = nullptr;
+    const std::byte* vertexData = nullptr;
+    std::vector<std::uint32_t> indices;
+    bool hasFaces = false;
+
+    for (auto& e : elements) {
+      if (e.name == "vertex") {
+        if (e.hasList) return nullptr;
+        if (!fitsPly(e.count, e.stride, p, end)) return nullptr;
+        vertexElement = &e;
+        vertexData = p;
+        p += e.count * e.stride;
+        continue;
+      }
+      if (e.name != "face") {
+        if (!e.hasList) {
+          if (!fitsPly(e.count, e.stride, p, end)) return nullptr;
+          p += e.count * e.stride;
+        } else {
+          p = walkPlyRecords(e, p, end, swap, [](auto&&...) {});
+          if (!p) return nullptr;
+        }
+        continue;
+      }
+
+      // faces
+      hasFaces = true;
+      auto list = e.find({"vertex_indices", "vertex_index"});
+      if (!list || !list->isList) return nullptr;
+      auto countSize = getPlySize(list->countType);
+      auto indexSize = getPlySize(list->type);
+      std::size_t nLists = 0;
+      for (auto& prop : e.properties)
+        nLists += prop.isList;
+
+      // fast path: only triangles and a single list, so records have fixed
+      // size and can be read in parallel
+      auto stride = e.stride + countSize + 3 * indexSize;
+      bool triangles = nLists == 1 && fitsPly(e.count, stride, p, end);
+      if (triangles) {
+        // offset of list in record
+        std::size_t listOffset = 0;
+        for (auto& prop : e.properties) {
+          if (&prop == list) break;
+          listOffset += getPlySize(prop.type);
+        }
+        indices.resize(3 * e.count);
+        triangles = parallelAll(
+          e.count, nThreads,
+          [&](std::size_t, std::size_t begin, std::size_t end) {
+            for (auto f = begin; f < end; ++f) {
+              auto record = p + f * stride + listOffset;
+              if (readPly(record, list->countType, swap) != 3) return false;
+              for (auto k = 0; k < 3; ++k) {
+                indices[3 * f + k] = readPlyIndex(
+                  record + countSize + k * indexSize, list->type, swap);
+              }
+            }
+            return true;
+          });
+        if (triangles) p += e.count * stride;
+      }
+      if (!triangles) {
+        // polygons: walk records and triangulate as fans
+        indices.clear();
+        p = walkPlyRecords(
+          e, p, end, swap,
+          [&](std::size_t, const PlyProperty& prop, const std::byte* items,
+              std::size_t n) {
+            if (&prop != list) return;
+            auto index = [&](std::size_t k) {
+              return readPlyIndex(items + k * indexSize, prop.type, swap);
+            };
+            for (std::size_t k = 2; k < n; ++k) {
+              indices.push_back(index(0));
+              indices.push_back(index(k - 1));
+              indices.push_back(index(k));
+            }
+          });
+        if (!p) return nullptr;
+      }
+    }
+    if (!vertexElement || !hasFaces || indices.empty()) return nullptr;
+
+    const auto& ve = *vertexElement;
+    auto x = ve.find({"x"});
+    auto y = ve.find({"y"});
+    auto z = ve.find({"z"});
+    if (!x || !y || !z) return nullptr;
+    if (!checkIndices(indices, ve.count, nThreads)) return nullptr;
+
+    // positions in place
+    bool zeroCopy = !swap && options.objectToWorld.isIdentity() &&
+                    ve.properties.size() == 3 && ve.stride == sizeof(Vec3) &&
+                    x->offset == 0 && y->offset == 4 && z->offset == 8 &&
+                    x->type == PlyType::Float32 &&
+                    y->type == PlyType::Float32 &&
+                    z->type == PlyType::Float32 &&
+                    std::is_same_v<float_t, float> &&
+                    reinterpret_cast<std::uintptr_t>(vertexData) %
+                        alignof(Vec3) ==
+                      0;
+    if (zeroCopy) {
+      auto owner = std::make_shared<PlyMeshOwner>();
+      owner->file = file;
+      owner->indices = std::move(indices);
+      TriangleMeshStorage storage;
+      storage.indices = owner->indices;
+      storage.positions = {
+        reinterpret_cast<const Vec3*>(vertexData), ve.count};
+      storage.owner = std::move(owner);
+      return std::make_shared<TriangleMesh>(std::move(storage));
+    }
+
+    // convert vertices
+    auto nx = ve.find({"nx"});
+    auto ny = ve.find({"ny"});
+    auto nz = ve.find({"nz"});
+    auto u = ve.find({"u", "s", "texture_u", "texture_s"});
+    auto v = ve.find({"v", "t", "texture_v", "texture_t"});
+    bool hasNormals = nx && ny && nz;
+    bool hasUVs = u && v;
+    std::vector<Vec3> positions(ve.count);
+    std::vector<Vec3> normals(hasNormals ? ve.count : 0);
+    std::vector<Vec2> uvs(hasUVs ? ve.count : 0);
+    parallelForChunks(
+      ve.count, nThreads,
+      [&](std::size_t, std::size_t begin, std::size_t end) {
+        auto read = [&](const std::byte* record, const PlyProperty* prop) {
+          return static_cast<float_t>(
+            readPly(record + prop->offset, prop->type, swap));
+        };
+        for (auto i = begin; i < end; ++i) {
+          auto record = vertexData + i * ve.stride;
+          positions[i] = {read(record, x), read(record, y), read(record, z)};
+          if (hasNormals)
+            normals[i] = {
+              read(record, nx), read(record, ny), read(record, nz)};
+          if (hasUVs) uvs[i] = {read(record, u), read(record, v)};
+        }
+      });
+
+    transformVertices(options, positions, normals);
+    return std::make_shared<TriangleMesh>(
+      Transform(), std::move(indices), std::move(positions),
+      std::move(normals), std::move(uvs));
+  }
+
+  std::shared_ptr<TriangleMesh>
+    loadMesh(const std::string& path, const MeshLoadOptions& options) {
+    auto dot = path.rfind('.');
+    if (dot == std::string::npos) return nullptr;
+    auto ext = path.substr(dot + 1);
+    std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c) {
+      return static_cast<char>(std::tolower(c));
+    });
+    if (ext == "obj") return loadOBJ(path, options);
+    if (ext == "ply") return loadPLY(path, options);
+    return nullptr;
+  }
+}
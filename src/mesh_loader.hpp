@@ -0,0 +1,42 @@
+#pragma once
+
+#include <memory>
+#include <string>
+
+#include "transform.hpp"
+#include "triangle.hpp"
+
+/// \file Mesh loaders
+
+namespace naga::rt {
+
+  /// Options of mesh loading
+  struct MeshLoadOptions {
+    /// Number of parser threads
+    std::size_t nThreads = 1;
+    /// Transform from object space to world space
+    Transform objectToWorld;
+  };
+
+  /** \brief Load Wavefront OBJ file.
+   * File is memory-mapped and split into chunks at line boundaries, which
+   * are parsed in parallel. Polygons are triangulated as fans. Corners
+   * which reference same position, UV and normal share one vertex.
+   * \returns Mesh, or nullptr when file can not be read or is malformed
+   */
+  std::shared_ptr<TriangleMesh>
+    loadOBJ(const std::string& path, const MeshLoadOptions& options = {});
+
+  /** \brief Load binary PLY file.
+   * Positions reference the mapped file without copying when they are
+   * the only (float) vertex properties, byte order matches and transform is
+   * identity. Otherwise vertices are converted in parallel.
+   * \returns Mesh, or nullptr when file can not be read or is malformed
+   */
+  std::shared_ptr<TriangleMesh>
+    loadPLY(const std::string& path, const MeshLoadOptions& options = {});
+
+  /// Load mesh file by extension (.obj or .ply)
+  std::shared_ptr<TriangleMesh>
+    loadMesh(const std::string& path, const MeshLoadOptions& options = {});
+}
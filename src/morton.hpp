@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstdint>
+
+#include "geometry.hpp"
+
+/// \file Morton codes
+
+namespace naga::rt {
+
+  /// Number of bits of Morton code used per axis
+  constexpr int mortonBits = 10;
+
+  /// Spread lower 10 bits of v to every third bit
+  inline std::uint32_t leftShift3(std::uint32_t v) {
+    if (v == (1 << mortonBits)) --v;
+    v = (v | (v << 16)) & 0b00000011000000000000000011111111;
+    v = (v | (v << 8)) & 0b00000011000000001111000000001111;
+    v = (v | (v << 4)) & 0b00000011000011000011000011000011;
+    v = (v | (v << 2)) & 0b00001001001001001001001001001001;
+    return v;
+  }
+
+  /// Encode 30-bit Morton code from point in [0, 2^10]^3
+  inline std::uint32_t encodeMorton3(const Vec3& v) {
+    return (leftShift3(static_cast<std::uint32_t>(v.z)) << 2) |
+           (leftShift3(static_cast<std::uint32_t>(v.y)) << 1) |
+           leftShift3(static_cast<std::uint32_t>(v.x));
+  }
+}
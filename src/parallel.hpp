@@ -0,0 +1,176 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+/// \file Parallel loops
+
+namespace naga::rt {
+
+  /** \brief Persistent worker threads for parallel loops.
+   * Workers are started once and sleep while no job is queued, so parallel
+   * loops do not pay thread startup per call. The calling thread always
+   * works on its own job, so jobs submitted from workers (nested loops)
+   * complete even when every worker is busy.
+   */
+  class ThreadPool {
+  public:
+    /// Ctor
+    explicit ThreadPool(std::size_t nWorkers) {
+      for (std::size_t i = 0; i < nWorkers; ++i)
+        m_workers.emplace_back([this]() { work(); });
+    }
+    /// Dtor
+    ~ThreadPool() {
+      {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+      }
+      m_wakeup.notify_all();
+      for (auto& t : m_workers)
+        t.join();
+    }
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    /// Get shared pool (one worker per hardware thread besides caller)
+    static ThreadPool& get() {
+      static ThreadPool pool(
+        std::max(std::thread::hardware_concurrency(), 1u) - 1);
+      return pool;
+    }
+
+    /// Get number of worker threads
+    std::size_t getNumWorkers() const {
+      return m_workers.size();
+    }
+
+    /// Call `func(i)` for each i in [0, count) on calling thread and up to
+    /// `nThreads - 1` workers. Indices are handed out dynamically.
+    template <class F>
+    void run(std::size_t count, std::size_t nThreads, F&& func) {
+      if (count == 0) return;
+      Job job;
+      using Func = std::remove_reference_t<F>;
+      job.invoke = [](void* f, std::size_t i) {
+        (*static_cast<Func*>(f))(i);
+      };
+      job.func = const_cast<void*>(static_cast<const void*>(&func));
+      job.count = count;
+      // caller is one of the threads
+      job.maxWorkers =
+        std::max<std::size_t>(std::min(nThreads, count), 1) - 1;
+      if (job.maxWorkers > 0 && !m_workers.empty()) {
+        {
+          std::lock_guard<std::mutex> lock(m_mutex);
+          m_jobs.push_back(&job);
+        }
+        m_wakeup.notify_all();
+        runJob(job);
+        {
+          std::lock_guard<std::mutex> lock(m_mutex);
+          m_jobs.erase(std::find(m_jobs.begin(), m_jobs.end(), &job));
+        }
+        // wait for indices taken by workers
+        while (job.nActive.load(std::memory_order_acquire) > 0)
+          std::this_thread::yield();
+      } else {
+        runJob(job);
+      }
+    }
+
+  private:
+    /// Loop submitted to pool (owned by calling thread)
+    struct Job {
+      /// Call function at index
+      void (*invoke)(void*, std::size_t);
+      /// Function
+      void* func;
+      /// Number of indices
+      std::size_t count;
+      /// Max number of workers joining caller
+      std::size_t maxWorkers;
+      /// Number of workers which joined
+      std::size_t nJoined = 0;
+      /// Next index
+      std::atomic<std::size_t> next{0};
+      /// Number of workers running this job
+      std::atomic<std::size_t> nActive{0};
+    };
+
+    /// Run indices of job until none is left
+    static void runJob(Job& job) {
+      for (auto i = job.next++; i < job.count; i = job.next++)
+        job.invoke(job.func, i);
+    }
+
+    /// Worker loop
+    void work() {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      while (true) {
+        Job* job = nullptr;
+        m_wakeup.wait(lock, [&]() {
+          if (m_stop) return true;
+          for (auto j : m_jobs) {
+            if (j->nJoined < j->maxWorkers && j->next < j->count) {
+              job = j;
+              return true;
+            }
+          }
+          return false;
+        });
+        if (m_stop) return;
+        // job is kept alive by caller until nActive drops to zero
+        ++job->nJoined;
+        job->nActive.fetch_add(1, std::memory_order_relaxed);
+        lock.unlock();
+        runJob(*job);
+        job->nActive.fetch_sub(1, std::memory_order_release);
+        lock.lock();
+      }
+    }
+
+    /// Workers
+    std::vector<std::thread> m_workers;
+    /// Queued jobs
+    std::vector<Job*> m_jobs;
+    /// Protects m_jobs and m_stop
+    std::mutex m_mutex;
+    /// Notifies workers of new jobs
+    std::condition_variable m_wakeup;
+    /// Stop workers
+    bool m_stop = false;
+  };
+
+  /** \brief Split [0, count) into `nChunks` contiguous chunks and call
+   * `func(chunk, begin, end)` for each chunk, using up to `nChunks` threads
+   * of the shared ThreadPool (including calling thread).
+   * Chunk boundaries only depend on `count` and `nChunks`, so two calls with
+   * same arguments visit same ranges.
+   */
+  template <class F>
+  void parallelForChunks(std::size_t count, std::size_t nChunks, F&& func) {
+    nChunks = std::max<std::size_t>(1, std::min(nChunks, count));
+    auto begin = [&](std::size_t c) { return count * c / nChunks; };
+    if (nChunks == 1) {
+      func(std::size_t(0), begin(0), begin(1));
+      return;
+    }
+    ThreadPool::get().run(nChunks, nChunks, [&](std::size_t c) {
+      func(c, begin(c), begin(c + 1));
+    });
+  }
+
+  /// Call `func(i)` for each i in [0, count) on up to `nThreads` threads.
+  /// Indices are handed out dynamically, so tasks may be unbalanced.
+  template <class F>
+  void parallelFor(std::size_t count, std::size_t nThreads, F&& func) {
+    ThreadPool::get().run(count, std::max<std::size_t>(nThreads, 1), func);
+  }
+}
@@ -1,6 +1,61 @@
 #include "primitive.hpp"
 
+#include <cassert>
+#include <cmath>
+
 namespace naga::rt {
+
+  namespace {
+    /// Transform surface interaction, dividing ray parameter by `tScale`
+    SurfaceInteraction transformInteraction(
+      const Transform& t, const SurfaceInteraction& si, float_t tScale) {
+      const auto& surface = si.surfaceGeometry();
+      const auto& shading = si.shadingGeometry();
+      const auto& m = t.getMatrix();
+      // propagate position error conservatively with |M|
+      Vec3 err = {};
+      for (auto i = 0; i < 3; ++i)
+        for (auto j = 0; j < 3; ++j)
+          err[i] += std::abs(m[j][i]) * si.pos_error()[j];
+
+      SurfaceInteraction ret(
+        si.t() / tScale, t.transformPoint(si.pos()), err,
+        glm::normalize(t.transformVector(si.incident())), si.uv(),
+        t.transformVector(surface.dpdu), t.transformVector(surface.dpdv),
+        t.transformNormal(surface.dndu), t.transformNormal(surface.dndv),
+        si.shape());
+      ret.setShadingGeometry(
+        glm::normalize(t.transformNormal(shading.normal)),
+        t.transformVector(shading.dpdu), t.transformVector(shading.dpdv),
+        t.transformNormal(shading.dndu), t.transformNormal(shading.dndv));
+      ret.setBSDF(si.bsdf());
+      ret.setBSSRDF(si.bssrdf());
+      return ret;
+    }
+  } // namespace
+
+  bool Primitive::intersect(
+    const Ray& ray, float_t tMin, float_t tMax, HitRecord* hit) const {
+    Interaction isec;
+    if (!intersect(ray, tMin, tMax, &isec)) return false;
+    hit->t = getRayParam(isec);
+    if (auto si = std::get_if<SurfaceInteraction>(&isec)) hit->uv = si->uv();
+    return true;
+  }
+
+  Interaction
+    Primitive::getInteraction(const Ray& ray, const HitRecord& hit) const {
+    float_t tMin, tMax;
+    getHitInterval(hit, &tMin, &tMax);
+    Interaction isec;
+    intersect(ray, tMin, tMax, &isec);
+    return isec;
+  }
+
+  Bounds3 Primitive::getClippedBoundingBox(const Bounds3& clip) const {
+    return Bounds3::overlap(getBoundingBox(), clip);
+  }
+
   GeometricPrimitive::GeometricPrimitive(
     const std::shared_ptr<Material>& m,
     const std::shared_ptr<AreaLight>& l,
@@ -19,5 +74,222 @@ namespace naga::rt {
     return m_shape;
   }
 
+  bool GeometricPrimitive::intersect(
+    const Ray& ray, float_t tMin, float_t tMax, Interaction* isec) const {
+    return m_shape->intersect(ray, tMin, tMax, isec);
+  }
+
+  bool GeometricPrimitive::intersect(
+    const Ray& ray, float_t tMin, float_t tMax, HitRecord* hit) const {
+    return m_shape->intersect(ray, tMin, tMax, hit);
+  }
+
+  Interaction GeometricPrimitive::getInteraction(
+    const Ray& ray, const HitRecord& hit) const {
+    return m_shape->getInteraction(ray, hit);
+  }
+
+  bool GeometricPrimitive::intersectP(
+    const Ray& ray, float_t tMin, float_t tMax) const {
+    return m_shape->intersectP(ray, tMin, tMax);
+  }
+
+  Bounds3 GeometricPrimitive::getBoundingBox() const {
+    return m_shape->getBoundingBox();
+  }
+
+  Bounds3 GeometricPrimitive::getClippedBoundingBox(const Bounds3& clip) const {
+    return m_shape->getClippedBoundingBox(clip);
+  }
+
   GeometricPrimitive::~GeometricPrimitive() {}
-} // namespace naga::rt
\ No newline at end of file
+
+  std::shared_ptr<Material> Aggregate::getMaterial() {
+    return nullptr;
+  }
+
+  std::shared_ptr<AreaLight> Aggregate::getAreaLight() {
+    return nullptr;
+  }
+
+  std::shared_ptr<Shape> Aggregate::getShape() {
+    return nullptr;
+  }
+
+  Aggregate::~Aggregate() {}
+
+  bool Aggregate::intersectChild(
+    const Primitive& child,
+    std::uint32_t index,
+    const Ray& ray,
+    float_t tMin,
+    float_t tMax,
+    HitRecord* hit) {
+    HitRecord h;
+    if (!child.intersect(ray, tMin, tMax, &h)) return false;
+    if (h.primitive == HitRecord::none)
+      h.primitive = index;
+    else {
+      // hit in nested aggregate
+      assert(h.instance == HitRecord::none);
+      h.instance = index;
+    }
+    *hit = h;
+    return true;
+  }
+
+  std::uint32_t
+    Aggregate::getChildIndex(const HitRecord& hit, HitRecord* childHit) {
+    *childHit = hit;
+    if (hit.instance == HitRecord::none) return hit.primitive;
+    childHit->instance = HitRecord::none;
+    return hit.instance;
+  }
+
+  TransformedPrimitive::TransformedPrimitive(
+    const std::shared_ptr<Primitive>& primitive,
+    const std::shared_ptr<const Transform>& instanceToWorld)
+    : m_primitive{primitive}, m_instanceToWorld{instanceToWorld} {
+    auto b = m_primitive->getBoundingBox();
+    if (m_instanceToWorld->isAffine()) {
+      AffineTransform instanceToWorld(*m_instanceToWorld);
+      m_worldToInstance = instanceToWorld.inverse();
+      m_bounds = instanceToWorld.transformBounds(b);
+    } else
+      m_bounds = m_instanceToWorld->transformBounds(b);
+  }
+
+  std::shared_ptr<Material> TransformedPrimitive::getMaterial() {
+    return m_primitive->getMaterial();
+  }
+
+  std::shared_ptr<AreaLight> TransformedPrimitive::getAreaLight() {
+    return m_primitive->getAreaLight();
+  }
+
+  std::shared_ptr<Shape> TransformedPrimitive::getShape() {
+    return m_primitive->getShape();
+  }
+
+  bool TransformedPrimitive::intersect(
+    const Ray& ray, float_t tMin, float_t tMax, Interaction* isec) const {
+    // transform ray into instance space once per visit
+    float_t tScale;
+    Ray r = toInstance(ray, &tScale);
+    if (!m_primitive->intersect(r, tMin * tScale, tMax * tScale, isec))
+      return false;
+    // transform interaction back to world space
+    if (auto si = std::get_if<SurfaceInteraction>(isec))
+      *isec = transformInteraction(*m_instanceToWorld, *si, tScale);
+    return true;
+  }
+
+  bool TransformedPrimitive::intersect(
+    const Ray& ray, float_t tMin, float_t tMax, HitRecord* hit) const {
+    float_t tScale;
+    Ray r = toInstance(ray, &tScale);
+    if (!m_primitive->intersect(r, tMin * tScale, tMax * tScale, hit))
+      return false;
+    hit->t /= tScale;
+    return true;
+  }
+
+  Interaction TransformedPrimitive::getInteraction(
+    const Ray& ray, const HitRecord& hit) const {
+    float_t tScale;
+    Ray r = toInstance(ray, &tScale);
+    auto h = hit;
+    h.t *= tScale;
+    auto isec = m_primitive->getInteraction(r, h);
+    if (auto si = std::get_if<SurfaceInteraction>(&isec))
+      isec = transformInteraction(*m_instanceToWorld, *si, tScale);
+    return isec;
+  }
+
+  bool TransformedPrimitive::intersectP(
+    const Ray& ray, float_t tMin, float_t tMax) const {
+    float_t tScale;
+    Ray r = toInstance(ray, &tScale);
+    return m_primitive->intersectP(r, tMin * tScale, tMax * tScale);
+  }
+
+  Bounds3 TransformedPrimitive::getBoundingBox() const {
+    return m_bounds;
+  }
+
+  Ray TransformedPrimitive::toInstance(const Ray& ray, float_t* tScale) const {
+    if (m_worldToInstance) return m_worldToInstance->transformRay(ray, tScale);
+    return m_instanceToWorld->inverse().transformRay(ray, tScale);
+  }
+
+  TransformedPrimitive::~TransformedPrimitive() {}
+
+  AnimatedPrimitive::AnimatedPrimitive(
+    const std::shared_ptr<Primitive>& primitive,
+    const std::shared_ptr<const AnimatedTransform>& instanceToWorld)
+    : m_primitive{primitive}, m_instanceToWorld{instanceToWorld} {
+    m_bounds = m_instanceToWorld->motionBounds(m_primitive->getBoundingBox());
+  }
+
+  std::shared_ptr<Material> AnimatedPrimitive::getMaterial() {
+    return m_primitive->getMaterial();
+  }
+
+  std::shared_ptr<AreaLight> AnimatedPrimitive::getAreaLight() {
+    return m_primitive->getAreaLight();
+  }
+
+  std::shared_ptr<Shape> AnimatedPrimitive::getShape() {
+    return m_primitive->getShape();
+  }
+
+  bool AnimatedPrimitive::intersect(
+    const Ray& ray, float_t tMin, float_t tMax, Interaction* isec) const {
+    auto instanceToWorld = m_instanceToWorld->interpolate(ray.time());
+    float_t tScale;
+    Ray r = instanceToWorld.inverse().transformRay(ray, &tScale);
+    if (!m_primitive->intersect(r, tMin * tScale, tMax * tScale, isec))
+      return false;
+    if (auto si = std::get_if<SurfaceInteraction>(isec))
+      *isec = transformInteraction(instanceToWorld, *si, tScale);
+    return true;
+  }
+
+  bool AnimatedPrimitive::intersect(
+    const Ray& ray, float_t tMin, float_t tMax, HitRecord* hit) const {
+    auto instanceToWorld = m_instanceToWorld->interpolate(ray.time());
+    float_t tScale;
+    Ray r = instanceToWorld.inverse().transformRay(ray, &tScale);
+    if (!m_primitive->intersect(r, tMin * tScale, tMax * tScale, hit))
+      return false;
+    hit->t /= tScale;
+    return true;
+  }
+
+  Interaction AnimatedPrimitive::getInteraction(
+    const Ray& ray, const HitRecord& hit) const {
+    auto instanceToWorld = m_instanceToWorld->interpolate(ray.time());
+    float_t tScale;
+    Ray r = instanceToWorld.inverse().transformRay(ray, &tScale);
+    auto h = hit;
+    h.t *= tScale;
+    auto isec = m_primitive->getInteraction(r, h);
+    if (auto si = std::get_if<SurfaceInteraction>(&isec))
+      isec = transformInteraction(instanceToWorld, *si, tScale);
+    return isec;
+  }
+
+  bool AnimatedPrimitive::intersectP(
+    const Ray& ray, float_t tMin, float_t tMax) const {
+    auto instanceToWorld = m_instanceToWorld->interpolate(ray.time());
+    float_t tScale;
+    Ray r = instanceToWorld.inverse().transformRay(ray, &tScale);
+    return m_primitive->intersectP(r, tMin * tScale, tMax * tScale);
+  }
+
+  Bounds3 AnimatedPrimitive::getBoundingBox() const {
+    return m_bounds;
+  }
+
+  AnimatedPrimitive::~AnimatedPrimitive() {}
+} // namespace naga::rt
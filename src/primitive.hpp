@@ -1,10 +1,15 @@
 #pragma once
 
+#include <optional>
+
 #include "geometry.hpp"
 #include "material.hpp"
 #include "ray.hpp"
 #include "bounds.hpp"
 #include "interaction.hpp"
+#include "shape.hpp"
+#include "transform.hpp"
+#include "animated_transform.hpp"
 
 namespace naga::rt {
   /// Primitive
@@ -16,12 +21,36 @@ namespace naga::rt {
     virtual std::shared_ptr<AreaLight> getAreaLight() = 0;
     /// Get shape
     virtual std::shared_ptr<Shape> getShape() = 0;
+    /// Calculate Ray-Primitive intersection
+    virtual bool intersect(
+      const Ray& ray, float_t tMin, float_t tMax, Interaction* isec) const = 0;
+    /** \brief Find closest hit in (tMin, tMax) without building interaction.
+     * Aggregates record index of hit primitive in `hit`. Default
+     * implementation calls intersect() and keeps ray parameter.
+     */
+    virtual bool intersect(
+      const Ray& ray, float_t tMin, float_t tMax, HitRecord* hit) const;
+    /// Build interaction of hit found by intersect(ray, ..., hit).
+    /// Default implementation intersects again around ray parameter of hit.
+    virtual Interaction
+      getInteraction(const Ray& ray, const HitRecord& hit) const;
+    /// Check if ray hits primitive in (tMin, tMax) (occlusion test).
+    /// Returns at first hit found, without building interaction.
+    virtual bool intersectP(
+      const Ray& ray, float_t tMin, float_t tMax) const = 0;
+    /// Get bounding box in world space
+    virtual Bounds3 getBoundingBox() const = 0;
+    /// Get bounding box of the part of primitive inside `clip`.
+    /// Used by spatial split BVH builder. Default implementation clips the
+    /// bounding box.
+    virtual Bounds3 getClippedBoundingBox(const Bounds3& clip) const;
     /// Dtor
     virtual ~Primitive() {}
   };
 
   /// GeometrycPrimitive
   class GeometricPrimitive : public Primitive {
+  public:
     /// Ctor
     GeometricPrimitive(
       const std::shared_ptr<Material>& m,
@@ -33,6 +62,28 @@ namespace naga::rt {
     virtual std::shared_ptr<AreaLight> getAreaLight() override;
     /// Get shape
     virtual std::shared_ptr<Shape> getShape() override;
+    /// Calculate Ray-Primitive intersection
+    virtual bool intersect(
+      const Ray& ray,
+      float_t tMin,
+      float_t tMax,
+      Interaction* isec) const override;
+    /// Find closest hit without building interaction
+    virtual bool intersect(
+      const Ray& ray,
+      float_t tMin,
+      float_t tMax,
+      HitRecord* hit) const override;
+    /// Build interaction of hit
+    virtual Interaction
+      getInteraction(const Ray& ray, const HitRecord& hit) const override;
+    /// Check if ray hits shape
+    virtual bool intersectP(
+      const Ray& ray, float_t tMin, float_t tMax) const override;
+    /// Get bounding box in world space
+    virtual Bounds3 getBoundingBox() const override;
+    /// Get bounding box of the part of shape inside `clip`
+    virtual Bounds3 getClippedBoundingBox(const Bounds3& clip) const override;
     /// Dtor
     virtual ~GeometricPrimitive() override;
 
@@ -44,4 +95,133 @@ namespace naga::rt {
     /// Shape
     std::shared_ptr<Shape> m_shape;
   };
-}
\ No newline at end of file
+
+  /// Aggregate
+  /// Primitive which holds collection of primitives.
+  class Aggregate : public Primitive {
+  public:
+    /// Aggregates do not have material (always nullptr)
+    virtual std::shared_ptr<Material> getMaterial() override;
+    /// Aggregates do not have area light (always nullptr)
+    virtual std::shared_ptr<AreaLight> getAreaLight() override;
+    /// Aggregates do not have shape (always nullptr)
+    virtual std::shared_ptr<Shape> getShape() override;
+    /// Dtor
+    virtual ~Aggregate() override;
+
+  protected:
+    /** \brief Find closest hit of child primitive at `index`.
+     * Records `index` as primitive of hit, or as instance when child is an
+     * aggregate (at most two levels of aggregates). Writes `hit` only when
+     * child is hit.
+     */
+    static bool intersectChild(
+      const Primitive& child,
+      std::uint32_t index,
+      const Ray& ray,
+      float_t tMin,
+      float_t tMax,
+      HitRecord* hit);
+    /// Get index of child primitive of hit and hit relative to the child
+    static std::uint32_t
+      getChildIndex(const HitRecord& hit, HitRecord* childHit);
+  };
+
+  /// TransformedPrimitive
+  /// Instance of shared primitive (typically BVH) placed by transform.
+  class TransformedPrimitive : public Primitive {
+  public:
+    /// Ctor
+    TransformedPrimitive(
+      const std::shared_ptr<Primitive>& primitive,
+      const std::shared_ptr<const Transform>& instanceToWorld);
+    /// Get material of instanced primitive
+    virtual std::shared_ptr<Material> getMaterial() override;
+    /// Get area light of instanced primitive
+    virtual std::shared_ptr<AreaLight> getAreaLight() override;
+    /// Get shape of instanced primitive
+    virtual std::shared_ptr<Shape> getShape() override;
+    /// Calculate Ray-Primitive intersection in instance space
+    virtual bool intersect(
+      const Ray& ray,
+      float_t tMin,
+      float_t tMax,
+      Interaction* isec) const override;
+    /// Find closest hit without building interaction
+    virtual bool intersect(
+      const Ray& ray,
+      float_t tMin,
+      float_t tMax,
+      HitRecord* hit) const override;
+    /// Build interaction of hit
+    virtual Interaction
+      getInteraction(const Ray& ray, const HitRecord& hit) const override;
+    /// Check if ray hits instanced primitive
+    virtual bool intersectP(
+      const Ray& ray, float_t tMin, float_t tMax) const override;
+    /// Get bounding box in world space
+    virtual Bounds3 getBoundingBox() const override;
+    /// Dtor
+    virtual ~TransformedPrimitive() override;
+
+  private:
+    /// Transform ray into instance space
+    Ray toInstance(const Ray& ray, float_t* tScale) const;
+
+    /// Instanced primitive
+    std::shared_ptr<Primitive> m_primitive;
+    /// Transform from instance space to world space
+    std::shared_ptr<const Transform> m_instanceToWorld;
+    /// Transform from world space to instance space (when affine)
+    std::optional<AffineTransform> m_worldToInstance;
+    /// Bounding box in world space
+    Bounds3 m_bounds;
+  };
+
+  /// AnimatedPrimitive
+  /// Instance of shared primitive placed by animated transform. Rays are
+  /// transformed by the transform at their time (motion blur).
+  class AnimatedPrimitive : public Primitive {
+  public:
+    /// Ctor
+    AnimatedPrimitive(
+      const std::shared_ptr<Primitive>& primitive,
+      const std::shared_ptr<const AnimatedTransform>& instanceToWorld);
+    /// Get material of instanced primitive
+    virtual std::shared_ptr<Material> getMaterial() override;
+    /// Get area light of instanced primitive
+    virtual std::shared_ptr<AreaLight> getAreaLight() override;
+    /// Get shape of instanced primitive
+    virtual std::shared_ptr<Shape> getShape() override;
+    /// Calculate Ray-Primitive intersection at time of ray
+    virtual bool intersect(
+      const Ray& ray,
+      float_t tMin,
+      float_t tMax,
+      Interaction* isec) const override;
+    /// Find closest hit without building interaction
+    virtual bool intersect(
+      const Ray& ray,
+      float_t tMin,
+      float_t tMax,
+      HitRecord* hit) const override;
+    /// Build interaction of hit
+    virtual Interaction
+      getInteraction(const Ray& ray, const HitRecord& hit) const override;
+    /// Check if ray hits instanced primitive at time of ray
+    virtual bool intersectP(
+      const Ray& ray, float_t tMin, float_t tMax) const override;
+    /// Get bounding box over shutter interval
+    virtual Bounds3 getBoundingBox() const override;
+    /// Dtor
+    virtual ~AnimatedPrimitive() override;
+
+  private:
+    /// Instanced primitive
+    std::shared_ptr<Primitive> m_primitive;
+    /// Transform from instance space to world space
+    std::shared_ptr<const AnimatedTransform> m_instanceToWorld;
+    /// Bounding box in world space over shutter interval
+    Bounds3 m_bounds;
+  };
+}
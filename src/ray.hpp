@@ -31,6 +31,11 @@ namespace naga::rt {
      * \notes: dropping constexpr since glm does not support it.
      */
     /*constexpr*/ Ray(const Vec3 &o, const Vec3 &d) : m_origin{o}, m_dir{normalize(d)} {}
+    /** \brief Ctor
+     * Stores origin, normalized direction and time (for motion blur).
+     */
+    /*constexpr*/ Ray(const Vec3 &o, const Vec3 &d, float_t time)
+      : m_origin{o}, m_dir{normalize(d)}, m_time{time} {}
 
     /// Get origin
     constexpr const Vec3 &get_origin() const {
@@ -52,6 +57,15 @@ namespace naga::rt {
       m_dir = normalize(d);
     }
 
+    /// Get time
+    constexpr float_t get_time() const {
+      return m_time;
+    }
+    /// Set time
+    constexpr void set_time(float_t time) {
+      m_time = time;
+    }
+
     /// Get origin
     constexpr const Vec3 &origin() const {
       return get_origin();
@@ -60,24 +74,30 @@ namespace naga::rt {
     constexpr const Vec3 &dir() const {
       return get_dir();
     }
+    /// Get time
+    constexpr float_t time() const {
+      return get_time();
+    }
 
   private:
     /// Origin
     Vec3 m_origin;
     /// (normalized) Direction
     Vec3 m_dir;
+    /// Time in shutter interval
+    float_t m_time = 0;
   };
 
   /** \brief Calculate ray position
    * `origin + t * dir`
    * \notes: dropping constexpr since glm does not support it.
    */
-  /*constepxr*/ Vec3 position(const Ray &ray, float_t t) {
+  /*constepxr*/ inline Vec3 position(const Ray &ray, float_t t) {
     return ray.origin() + t * ray.dir();
   }
 
   /// dump information to text
-  std::string to_string(const Ray &ray) {
+  inline std::string to_string(const Ray &ray) {
     return fmt::format(
       "Ray({0}, {1})", to_string(ray.origin()), to_string(ray.dir()));
   }
@@ -0,0 +1,188 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+
+#include "bounds.hpp"
+#include "memory.hpp"
+#include "primitive.hpp"
+#include "ray.hpp"
+
+/// \file Ray packets
+
+namespace naga::rt {
+
+  /** \brief Packet of N rays in structure-of-arrays form.
+   * Each component is stored as an array of N floats, so a box can be tested
+   * against all rays of the packet with vectorized loops. Rays which are not
+   * part of the packet (e.g. outside of image) are cleared in `active`.
+   */
+  template <std::size_t N>
+  struct alignas(cacheLineSize) RayPacket {
+    static_assert(N == 4 || N == 8 || N == 16, "N should be 4, 8 or 16");
+
+    /// Number of rays
+    static constexpr std::size_t size = N;
+
+    /// Origins (per axis)
+    float_t origin[3][N];
+    /// Normalized directions (per axis)
+    float_t dir[3][N];
+    /// Reciprocal of directions (per axis)
+    float_t invDir[3][N];
+    /// Min ray parameters
+    float_t tMin[N];
+    /// Max ray parameters (updated to closest hit by traversal)
+    float_t tMax[N];
+    /// Times
+    float_t time[N];
+    /// Bit mask of active rays
+    std::uint32_t active = 0;
+
+    /// Set i-th ray and make it active
+    void set(
+      std::size_t i,
+      const Ray& ray,
+      float_t t0 = 0,
+      float_t t1 = std::numeric_limits<float_t>::infinity()) {
+      for (auto a = 0; a < 3; ++a) {
+        origin[a][i] = ray.origin()[a];
+        dir[a][i] = ray.dir()[a];
+        invDir[a][i] = 1 / ray.dir()[a];
+      }
+      tMin[i] = t0;
+      tMax[i] = t1;
+      time[i] = ray.time();
+      active |= 1u << i;
+    }
+
+    /// Get i-th ray
+    Ray getRay(std::size_t i) const {
+      return Ray(
+        Vec3(origin[0][i], origin[1][i], origin[2][i]),
+        Vec3(dir[0][i], dir[1][i], dir[2][i]), time[i]);
+    }
+
+    /** \brief Get direction octant shared by all active rays.
+     * Bit `a` of octant is set when inverse direction is negative on axis
+     * `a`, as in single ray traversal (so -0 counts as negative).
+     * \returns Octant, or -1 when active rays point to different octants
+     */
+    int getOctant() const {
+      int octant = -1;
+      for (std::size_t i = 0; i < N; ++i) {
+        if (!(active & (1u << i))) continue;
+        int o = (invDir[0][i] < 0) | (invDir[1][i] < 0) << 1 |
+                (invDir[2][i] < 0) << 2;
+        if (octant != -1 && octant != o) return -1;
+        octant = o;
+      }
+      return octant;
+    }
+  };
+
+  /// Count bits set in mask of active rays
+  inline int countActive(std::uint32_t mask) {
+    int n = 0;
+    for (; mask; mask &= mask - 1)
+      ++n;
+    return n;
+  }
+
+  /** \brief Test rays of packet in `mask` against bounding box.
+   * Slab distances are computed for all rays, so the loops vectorize.
+   * \returns Mask of rays which hit the box within [tMin, tMax]
+   */
+  template <std::size_t N>
+  std::uint32_t intersect(
+    const Bounds3& bounds, const RayPacket<N>& packet, std::uint32_t mask) {
+    float_t t0[N];
+    float_t t1[N];
+    for (std::size_t i = 0; i < N; ++i) {
+      t0[i] = packet.tMin[i];
+      t1[i] = packet.tMax[i];
+    }
+    for (auto a = 0; a < 3; ++a) {
+      for (std::size_t i = 0; i < N; ++i) {
+        float_t o = packet.origin[a][i];
+        float_t n = (bounds.min()[a] - o) * packet.invDir[a][i];
+        float_t f = (bounds.max()[a] - o) * packet.invDir[a][i];
+        float_t tNear = n < f ? n : f;
+        float_t tFar = (n < f ? f : n) * slabFarScale;
+        t0[i] = tNear > t0[i] ? tNear : t0[i];
+        t1[i] = tFar < t1[i] ? tFar : t1[i];
+      }
+    }
+    std::uint32_t hit = 0;
+    for (std::size_t i = 0; i < N; ++i)
+      hit |= static_cast<std::uint32_t>(t0[i] <= t1[i]) << i;
+    return hit & mask;
+  }
+
+  /** \brief Intersect rays of packet in `mask` with primitive.
+   * Writes interaction of i-th ray to `isecs[i]` and shortens its `tMax`
+   * on hit.
+   * \returns Mask of rays which hit the primitive
+   */
+  template <std::size_t N>
+  std::uint32_t intersect(
+    const Primitive& primitive,
+    RayPacket<N>& packet,
+    std::uint32_t mask,
+    Interaction* isecs) {
+    std::uint32_t hit = 0;
+    for (std::size_t i = 0; i < N; ++i) {
+      if (!(mask & (1u << i))) continue;
+      if (primitive.intersect(
+            packet.getRay(i), packet.tMin[i], packet.tMax[i], &isecs[i])) {
+        packet.tMax[i] = getRayParam(isecs[i]);
+        hit |= 1u << i;
+      }
+    }
+    return hit;
+  }
+
+  /// Width of pixel block covered by packet
+  template <std::size_t N>
+  constexpr std::size_t packetBlockWidth = N == 4 ? 2 : 4;
+  /// Height of pixel block covered by packet
+  template <std::size_t N>
+  constexpr std::size_t packetBlockHeight = N / packetBlockWidth<N>;
+
+  /** \brief Generate packets of camera rays covering tile.
+   * Tile is split into blocks of `packetBlockWidth<N> x packetBlockHeight<N>`
+   * pixels. `generateRay(x, y)` returns ray of pixel, and
+   * `func(packet, x, y)` is called for each packet with pixel coordinates
+   * of its rays. Pixels outside of tile are inactive.
+   */
+  template <std::size_t N, class GenerateRay, class F>
+  void forEachTilePacket(
+    std::size_t x0,
+    std::size_t y0,
+    std::size_t width,
+    std::size_t height,
+    GenerateRay&& generateRay,
+    F&& func) {
+    constexpr auto bw = packetBlockWidth<N>;
+    constexpr auto bh = packetBlockHeight<N>;
+    for (std::size_t by = 0; by < height; by += bh) {
+      for (std::size_t bx = 0; bx < width; bx += bw) {
+        RayPacket<N> packet;
+        std::size_t xs[N];
+        std::size_t ys[N];
+        for (std::size_t i = 0; i < N; ++i) {
+          xs[i] = x0 + bx + i % bw;
+          ys[i] = y0 + by + i / bw;
+          bool inside = bx + i % bw < width && by + i / bw < height;
+          // keep rays outside of tile finite, but inactive
+          packet.set(
+            i,
+            inside ? generateRay(xs[i], ys[i]) : Ray(Vec3(0), Vec3(0, 0, 1)));
+          if (!inside) packet.active &= ~(1u << i);
+        }
+        func(packet, xs, ys);
+      }
+    }
+  }
+}
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "bounds.hpp"
+#include "morton.hpp"
+#include "parallel.hpp"
+
+/// \file Ray sorting
+
+namespace naga::rt {
+
+  /// Max number of bits of origin Morton code per axis, so that keys with
+  /// octant fit 32 bits
+  constexpr int maxRayOriginBits = std::min(mortonBits, (32 - 3) / 3);
+
+  /// Options of ray sorting
+  struct RaySortOptions {
+    /// Sort secondary rays before tracing them?
+    bool enabled = true;
+    /// Number of rays sorted together (0 to sort whole queue)
+    std::size_t batchSize = 1 << 16;
+    /// Number of bits of origin Morton code per axis (at most
+    /// maxRayOriginBits)
+    int originBits = 6;
+  };
+
+  /** \brief Get sort key of ray.
+   * Direction octant is put above Morton code of origin quantized in
+   * `bounds`, so rays are grouped by direction first and by origin second.
+   * Origins outside of `bounds` are clamped to it. `originBits` should be
+   * at most maxRayOriginBits.
+   */
+  inline std::uint32_t getRaySortKey(
+    const Vec3& origin,
+    const Vec3& dir,
+    const Bounds3& bounds,
+    int originBits) {
+    constexpr float_t mortonScale = 1 << mortonBits;
+    auto o = glm::clamp(bounds.offset(origin), Vec3(0), Vec3(1));
+    // upper bits of Morton code are Morton code of coarser grid
+    auto morton =
+      encodeMorton3(o * mortonScale) >> (3 * (mortonBits - originBits));
+    // sign bits match octants of packets (-0 counts as negative)
+    std::uint32_t octant = std::signbit(dir.x) | std::signbit(dir.y) << 1 |
+                           std::signbit(dir.z) << 2;
+    return octant << (3 * originBits) | morton;
+  }
+
+  /** \brief Sort (key, index) pairs by key with LSD radix sort.
+   * Stable, and only sorts lower `nBits` bits of keys. `temp` is used as
+   * scratch buffer. Each pass counts digits of `nThreads` chunks in
+   * parallel and scatters chunks to offsets in (digit, chunk) order.
+   */
+  inline void sortRayKeys(
+    std::pair<std::uint32_t, std::uint32_t>* keys,
+    std::size_t n,
+    int nBits,
+    std::vector<std::pair<std::uint32_t, std::uint32_t>>& temp,
+    std::size_t nThreads = 1) {
+    constexpr int bitsPerPass = 8;
+    constexpr std::size_t nRadixBuckets = 1 << bitsPerPass;
+    constexpr std::uint32_t bitMask = nRadixBuckets - 1;
+
+    // do not create chunks smaller than this
+    constexpr std::size_t minChunkSize = 4096;
+    std::size_t nChunks =
+      std::max<std::size_t>(1, std::min(nThreads, n / minChunkSize));
+    std::vector<std::array<std::size_t, nRadixBuckets>> counts(nChunks);
+
+    temp.resize(n);
+    auto in = keys;
+    auto out = temp.data();
+    for (int lowBit = 0; lowBit < nBits; lowBit += bitsPerPass) {
+      // last digit may be narrower
+      auto digitMask = nBits - lowBit < bitsPerPass
+                         ? (std::uint32_t(1) << (nBits - lowBit)) - 1
+                         : bitMask;
+
+      // count per chunk
+      parallelForChunks(
+        n, nChunks, [&](std::size_t c, std::size_t begin, std::size_t end) {
+          counts[c].fill(0);
+          for (auto i = begin; i < end; ++i)
+            ++counts[c][(in[i].first >> lowBit) & digitMask];
+        });
+
+      // exclusive prefix sum in (bucket, chunk) order
+      std::size_t sum = 0;
+      for (std::size_t b = 0; b < nRadixBuckets; ++b) {
+        for (auto& c : counts) {
+          auto count = c[b];
+          c[b] = sum;
+          sum += count;
+        }
+      }
+
+      // scatter
+      parallelForChunks(
+        n, nChunks, [&](std::size_t c, std::size_t begin, std::size_t end) {
+          for (auto i = begin; i < end; ++i)
+            out[counts[c][(in[i].first >> lowBit) & digitMask]++] = in[i];
+        });
+      std::swap(in, out);
+    }
+    if (in != keys) std::copy(in, in + n, keys);
+  }
+}
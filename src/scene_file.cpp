@@ -0,0 +1,324 @@
+#include "scene_file.hpp"
+#include "hash.hpp"
+#include "mapped_file.hpp"
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <type_traits>
+
+namespace naga::rt {
+
+  namespace {
+
+    /// Magic number of scene file
+    constexpr char sceneMagic[8] = {'N', 'A', 'G', 'A', 'S', 'C', 'N', '\0'};
+    /// Version of scene file layout
+    constexpr std::uint32_t sceneVersion = 1;
+    /// Marker of byte order
+    constexpr std::uint32_t byteOrderMark = 0x01020304;
+    /// Size of header
+    constexpr std::size_t headerSize = 128;
+    /// Alignment of arrays
+    constexpr std::size_t sectionAlignment = cacheLineSize;
+
+    /// Array in scene file
+    struct SceneFileSection {
+      /// Offset from start of file
+      std::uint64_t offset;
+      /// Number of elements
+      std::uint64_t count;
+    };
+
+    /// Mesh in scene file
+    struct SceneFileMesh {
+      /// Vertex indices
+      SceneFileSection indices;
+      /// Positions
+      SceneFileSection positions;
+      /// Normals
+      SceneFileSection normals;
+      /// UV coordinates
+      SceneFileSection uvs;
+    };
+
+    /** \brief Header of scene file.
+     * Followed by arrays of meshes, table of meshes, transforms, primitives
+     * and spectra, each aligned to sectionAlignment.
+     */
+    struct SceneFileHeader {
+      /// Magic number
+      char magic[8];
+      /// Version of layout
+      std::uint32_t version;
+      /// sizeof(float_t)
+      std::uint32_t floatSize;
+      /// byteOrderMark in byte order of writer
+      std::uint32_t byteOrder;
+      /// Reserved (0)
+      std::uint32_t reserved;
+      /// Size of file
+      std::uint64_t fileSize;
+      /// Checksum of data after header
+      std::uint64_t checksum;
+      /// Table of meshes
+      SceneFileSection meshes;
+      /// Instance transforms
+      SceneFileSection transforms;
+      /// Primitives
+      SceneFileSection primitives;
+      /// Spectra
+      SceneFileSection spectra;
+    };
+
+    static_assert(sizeof(SceneFileHeader) <= headerSize);
+    static_assert(headerSize % sectionAlignment == 0);
+    static_assert(std::is_trivially_copyable_v<Vec3>);
+    static_assert(std::is_trivially_copyable_v<Mat4>);
+    static_assert(std::is_trivially_copyable_v<RGBSpectrum>);
+    static_assert(sizeof(Vec3) == 3 * sizeof(float_t));
+    static_assert(sizeof(Mat4) == 16 * sizeof(float_t));
+    static_assert(sizeof(RGBSpectrum) == 3 * sizeof(float));
+
+    /// Sequential writer of sections
+    class SceneFileWriter {
+    public:
+      /// Ctor (reserves header)
+      explicit SceneFileWriter(const std::string& path)
+        : m_out(path, std::ios::binary | std::ios::trunc) {
+        char header[headerSize] = {};
+        m_out.write(header, headerSize);
+      }
+
+      /// Check if stream is good
+      bool good() const {
+        return m_out.good();
+      }
+      /// Write array aligned to sectionAlignment
+      template <class T>
+      SceneFileSection write(ArrayView<const T> array) {
+        static_assert(sizeof(T) % 4 == 0);
+        // padding
+        char padding[sectionAlignment] = {};
+        auto nPadding = (sectionAlignment - m_offset % sectionAlignment) %
+                        sectionAlignment;
+        writeBytes(padding, nPadding);
+        SceneFileSection section = {m_offset, array.size()};
+        writeBytes(array.data(), array.size() * sizeof(T));
+        return section;
+      }
+      /// Write header and close file
+      bool close(SceneFileHeader header) {
+        header.fileSize = m_offset;
+        header.checksum = m_checksum.get();
+        m_out.seekp(0);
+        m_out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        m_out.close();
+        return !m_out.fail();
+      }
+
+    private:
+      /// Write bytes and add them to checksum
+      void writeBytes(const void* data, std::size_t size) {
+        m_out.write(static_cast<const char*>(data), size);
+        m_checksum.add(data, size);
+        m_offset += size;
+      }
+
+      /// Output stream
+      std::ofstream m_out;
+      /// Current offset
+      std::uint64_t m_offset = headerSize;
+      /// Checksum of data after header
+      Hasher m_checksum;
+    };
+
+    /// Get array of section (false when out of file or misaligned)
+    template <class T>
+    bool getSection(
+      const MappedFile& file,
+      const SceneFileSection& section,
+      ArrayView<const T>* array) {
+      std::size_t size = file.size();
+      if (
+        section.offset % sectionAlignment != 0 || section.offset > size ||
+        section.count > (size - section.offset) / sizeof(T))
+        return false;
+      *array = {
+        reinterpret_cast<const T*>(file.data() + section.offset),
+        section.count};
+      return true;
+    }
+
+    /// Set error if requested
+    bool setError(std::string* error, const std::string& message) {
+      if (error) *error = message;
+      return false;
+    }
+
+    /// Map scene file and check header and sections
+    std::shared_ptr<const SceneDescription> openSceneFile(
+      const std::string& path,
+      SceneFileHeader* header,
+      std::string* error) {
+      auto file = std::make_shared<MappedFile>(path);
+      if (!file->isOpen()) {
+        setError(error, "can not map file");
+        return nullptr;
+      }
+      if (file->size() < headerSize) {
+        setError(error, "file is truncated");
+        return nullptr;
+      }
+      std::memcpy(header, file->data(), sizeof(*header));
+      if (std::memcmp(header->magic, sceneMagic, sizeof(sceneMagic)) != 0) {
+        setError(error, "not a scene file");
+        return nullptr;
+      }
+      if (
+        header->version != sceneVersion ||
+        header->floatSize != sizeof(float_t) ||
+        header->byteOrder != byteOrderMark) {
+        setError(error, "unsupported version, float size or byte order");
+        return nullptr;
+      }
+      if (header->fileSize != file->size()) {
+        setError(error, "file size mismatch");
+        return nullptr;
+      }
+
+      auto scene = std::make_shared<SceneDescription>();
+      ArrayView<const SceneFileMesh> meshes;
+      if (
+        !getSection(*file, header->meshes, &meshes) ||
+        !getSection(*file, header->transforms, &scene->transforms) ||
+        !getSection(*file, header->primitives, &scene->primitives) ||
+        !getSection(*file, header->spectra, &scene->spectra)) {
+        setError(error, "section out of file");
+        return nullptr;
+      }
+
+      // meshes (pointer fixups and counts only)
+      scene->meshes.reserve(meshes.size());
+      for (std::size_t m = 0; m < meshes.size(); ++m) {
+        auto& mesh = meshes[m];
+        auto name = "mesh " + std::to_string(m) + ": ";
+        TriangleMeshStorage storage;
+        if (
+          !getSection(*file, mesh.indices, &storage.indices) ||
+          !getSection(*file, mesh.positions, &storage.positions) ||
+          !getSection(*file, mesh.normals, &storage.normals) ||
+          !getSection(*file, mesh.uvs, &storage.uvs)) {
+          setError(error, name + "array out of file");
+          return nullptr;
+        }
+        auto nPositions = storage.positions.size();
+        if (storage.indices.empty() || storage.indices.size() % 3 != 0) {
+          setError(error, name + "invalid number of indices");
+          return nullptr;
+        }
+        if (
+          (!storage.normals.empty() && storage.normals.size() != nPositions) ||
+          (!storage.uvs.empty() && storage.uvs.size() != nPositions)) {
+          setError(error, name + "attribute count mismatch");
+          return nullptr;
+        }
+        storage.owner = file;
+        scene->meshes.push_back(
+          std::make_shared<TriangleMesh>(std::move(storage)));
+      }
+      scene->owner = std::move(file);
+      return scene;
+    }
+  } // namespace
+
+  bool saveSceneFile(const std::string& path, const SceneDescription& scene) {
+    auto tmpPath = path + ".tmp";
+    {
+      SceneFileWriter writer(tmpPath);
+      if (!writer.good()) return false;
+
+      std::vector<SceneFileMesh> meshes;
+      meshes.reserve(scene.meshes.size());
+      for (auto& mesh : scene.meshes) {
+        SceneFileMesh m;
+        m.indices = writer.write(mesh->getIndices());
+        m.positions = writer.write(mesh->getPositions());
+        m.normals = writer.write(mesh->getNormals());
+        m.uvs = writer.write(mesh->getUVs());
+        meshes.push_back(m);
+      }
+
+      SceneFileHeader header;
+      std::memset(&header, 0, sizeof(header));
+      std::memcpy(header.magic, sceneMagic, sizeof(sceneMagic));
+      header.version = sceneVersion;
+      header.floatSize = sizeof(float_t);
+      header.byteOrder = byteOrderMark;
+      header.meshes = writer.write(ArrayView<const SceneFileMesh>(meshes));
+      header.transforms = writer.write(scene.transforms);
+      header.primitives = writer.write(scene.primitives);
+      header.spectra = writer.write(scene.spectra);
+      if (!writer.close(header)) {
+        std::remove(tmpPath.c_str());
+        return false;
+      }
+    }
+
+#if defined(_WIN32)
+    std::remove(path.c_str());
+#endif
+    if (std::rename(tmpPath.c_str(), path.c_str()) != 0) {
+      std::remove(tmpPath.c_str());
+      return false;
+    }
+    return true;
+  }
+
+  std::shared_ptr<const SceneDescription>
+    loadSceneFile(const std::string& path) {
+    SceneFileHeader header;
+    return openSceneFile(path, &header, nullptr);
+  }
+
+  bool validateSceneFile(const std::string& path, std::string* error) {
+    SceneFileHeader header;
+    auto scene = openSceneFile(path, &header, error);
+    if (!scene) return false;
+
+    auto file = std::static_pointer_cast<const MappedFile>(scene->owner);
+    Hasher checksum;
+    checksum.add(file->data() + headerSize, file->size() - headerSize);
+    if (checksum.get() != header.checksum)
+      return setError(error, "checksum mismatch");
+
+    for (std::size_t m = 0; m < scene->meshes.size(); ++m) {
+      auto& mesh = *scene->meshes[m];
+      auto name = "mesh " + std::to_string(m) + ": ";
+      auto positions = mesh.getPositions();
+      auto indices = mesh.getIndices();
+      for (auto i : indices)
+        if (i >= positions.size())
+          return setError(error, name + "vertex index out of range");
+      for (auto& p : positions)
+        if (!std::isfinite(p.x) || !std::isfinite(p.y) || !std::isfinite(p.z))
+          return setError(error, name + "position is not finite");
+    }
+
+    auto inRange = [](std::uint32_t i, std::size_t n, bool optional) {
+      return (optional && i == ScenePrimitive::none) || i < n;
+    };
+    for (std::size_t i = 0; i < scene->primitives.size(); ++i) {
+      auto& p = scene->primitives[i];
+      if (
+        !inRange(p.mesh, scene->meshes.size(), false) ||
+        !inRange(p.transform, scene->transforms.size(), true) ||
+        !inRange(p.material, scene->spectra.size(), true) ||
+        !inRange(p.emission, scene->spectra.size(), true))
+        return setError(
+          error, "primitive " + std::to_string(i) + ": invalid reference");
+    }
+    return true;
+  }
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "memory.hpp"
+#include "spectrum.hpp"
+#include "triangle.hpp"
+
+/// \file Binary scene file
+
+namespace naga::rt {
+
+  /// Primitive of scene: instance of mesh with material
+  struct ScenePrimitive {
+    /// Marker of missing reference
+    static constexpr std::uint32_t none = ~0u;
+
+    /// Index of mesh
+    std::uint32_t mesh;
+    /// Index of instance transform (none for meshes placed in world space)
+    std::uint32_t transform = none;
+    /// Index of reflectance spectrum
+    std::uint32_t material = none;
+    /// Index of emitted spectrum (none for non-emissive primitives)
+    std::uint32_t emission = none;
+  };
+
+  /** \brief Geometry and appearance of scene in flat arrays.
+   * Arrays are views, so the description either references vectors of the
+   * caller (for export) or the mapped scene file (after load), which is
+   * kept alive by `owner`.
+   */
+  struct SceneDescription {
+    /// Meshes (world space)
+    std::vector<std::shared_ptr<const TriangleMesh>> meshes;
+    /// Instance transforms
+    ArrayView<const Mat4> transforms;
+    /// Primitives
+    ArrayView<const ScenePrimitive> primitives;
+    /// Spectra referenced by primitives
+    ArrayView<const RGBSpectrum> spectra;
+    /// Owner of arrays
+    std::shared_ptr<const void> owner;
+  };
+
+  /** \brief Write scene to binary scene file.
+   * Arrays are written in their in-memory layout, aligned to cache lines,
+   * so that they can be used in place after mapping the file.
+   * File is written to temporary file and renamed.
+   * \returns false when failed to write file
+   */
+  bool saveSceneFile(const std::string& path, const SceneDescription& scene);
+
+  /** \brief Load scene from memory-mapped binary scene file.
+   * Only header, array bounds and attribute counts are checked, and arrays
+   * are used in place without copying. Use validateSceneFile() for
+   * untrusted files.
+   * \returns nullptr when file can not be mapped, was written with other
+   * version, float_t or byte order, or has arrays out of file or with
+   * mismatching counts
+   */
+  std::shared_ptr<const SceneDescription>
+    loadSceneFile(const std::string& path);
+
+  /** \brief Validate binary scene file.
+   * Checks header, array bounds and attribute counts like loadSceneFile(),
+   * then checksum, vertex indices and references of primitives.
+   * \param error Description of first error found (optional)
+   */
+  bool validateSceneFile(const std::string& path, std::string* error = nullptr);
+}
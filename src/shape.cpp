@@ -1,8 +1,63 @@
 #include "shape.hpp"
+#include "transform.hpp"
 
 namespace naga::rt {
+  bool Shape::intersectP(const Ray& ray, float_t tMin, float_t tMax) const {
+    Interaction isec;
+    return intersect(ray, tMin, tMax, &isec);
+  }
+
+  bool Shape::intersect(
+    const Ray& ray, float_t tMin, float_t tMax, HitRecord* hit) const {
+    Interaction isec;
+    if (!intersect(ray, tMin, tMax, &isec)) return false;
+    hit->t = getRayParam(isec);
+    if (auto si = std::get_if<SurfaceInteraction>(&isec)) hit->uv = si->uv();
+    return true;
+  }
+
+  Interaction
+    Shape::getInteraction(const Ray& ray, const HitRecord& hit) const {
+    // intersection is deterministic, so the same hit is found again
+    float_t tMin, tMax;
+    getHitInterval(hit, &tMin, &tMax);
+    Interaction isec;
+    intersect(ray, tMin, tMax, &isec);
+    return isec;
+  }
+
+  bool Shape::intersectBatch(
+    ArrayView<const Shape* const> shapes,
+    const Ray& ray,
+    float_t tMin,
+    float_t tMax,
+    HitRecord* hit) const {
+    bool found = false;
+    for (std::size_t i = 0; i < shapes.size(); ++i) {
+      if (shapes[i]->intersect(ray, tMin, tMax, hit)) {
+        found = true;
+        tMax = hit->t;
+        hit->primitive = static_cast<std::uint32_t>(i);
+      }
+    }
+    return found;
+  }
+
+  bool Shape::intersectBatchP(
+    ArrayView<const Shape* const> shapes,
+    const Ray& ray,
+    float_t tMin,
+    float_t tMax) const {
+    for (auto shape : shapes)
+      if (shape->intersectP(ray, tMin, tMax)) return true;
+    return false;
+  }
+
+  Bounds3 Shape::getClippedBoundingBox(const Bounds3& clip) const {
+    return Bounds3::overlap(getBoundingBox(), clip);
+  }
+
   Bounds3 GeometricShape::getBoundingBox() const {
-    return Bounds3{(*m_object_to_world) * Vec4(getObjectBound().min(), 1),
-                   (*m_object_to_world) * Vec4(getObjectBound().max(), 1)};
+    return transformBounds(*m_object_to_world, getObjectBound());
   }
 }
\ No newline at end of file
@@ -3,6 +3,7 @@
 #include "ray.hpp"
 #include "bounds.hpp"
 #include "interaction.hpp"
+#include "memory.hpp"
 
 namespace naga::rt {
 
@@ -12,8 +13,42 @@ namespace naga::rt {
     /// Calculate Ray-Shape intersection
     virtual bool intersect(
       const Ray& ray, float_t tMin, float_t tMax, Interaction* isec) const = 0;
+    /// Find closest hit in (tMin, tMax) without building interaction.
+    /// Default implementation calls intersect() and keeps ray parameter.
+    virtual bool intersect(
+      const Ray& ray, float_t tMin, float_t tMax, HitRecord* hit) const;
+    /// Build interaction of hit found by intersect(ray, ..., hit).
+    /// Default implementation intersects again around ray parameter of hit.
+    virtual Interaction
+      getInteraction(const Ray& ray, const HitRecord& hit) const;
+    /// Check if ray hits shape in (tMin, tMax) (occlusion test).
+    /// Default implementation calls intersect(). Shapes should override it
+    /// to skip building interaction.
+    virtual bool intersectP(const Ray& ray, float_t tMin, float_t tMax) const;
+    /** \brief Find closest hit among `shapes` (of the same type as this).
+     * Called once per homogeneous BVH leaf, with index of hit shape in
+     * `shapes` recorded as primitive of `hit`. Default implementation calls
+     * intersect() of each shape. Shapes should override it with a
+     * non-virtual loop (or SIMD kernel) over their own type.
+     */
+    virtual bool intersectBatch(
+      ArrayView<const Shape* const> shapes,
+      const Ray& ray,
+      float_t tMin,
+      float_t tMax,
+      HitRecord* hit) const;
+    /// Check if any of `shapes` (of the same type as this) is hit.
+    /// Default implementation calls intersectP() of each shape.
+    virtual bool intersectBatchP(
+      ArrayView<const Shape* const> shapes,
+      const Ray& ray,
+      float_t tMin,
+      float_t tMax) const;
     /// Get bounding box
     virtual Bounds3 getBoundingBox() const = 0;
+    /// Get bounding box of the part of shape inside `clip`.
+    /// Default implementation clips the bounding box.
+    virtual Bounds3 getClippedBoundingBox(const Bounds3& clip) const;
     /// Dtor
     virtual ~Shape(){};
   };
@@ -4,11 +4,24 @@
 #include <array>
 #include <algorithm>
 #include <optional>
+#include <cmath>
+#include <type_traits>
 #include "float.hpp"
 #include "geometry.hpp"
 #include "XYZ.hpp"
 #include "RGB.hpp"
 
+#if defined(__SSE__) || defined(_M_X64)
+  #include <immintrin.h>
+  #define RT_SPECTRUM_SSE
+#endif
+#if defined(__AVX__)
+  #define RT_SPECTRUM_AVX
+#endif
+#if defined(__AVX512F__)
+  #define RT_SPECTRUM_AVX512
+#endif
+
 namespace naga::rt {
 
   /// calculate avarage spectrum
@@ -19,10 +32,321 @@ namespace naga::rt {
   /// Spectrum Type
   enum class SpectrumType { Reflectance, Illuminant };
 
+  template <size_t N>
+  class CoefficientSpectrum;
+
+  /// \brief Kernels of spectrum expressions.
+  /// Operations are overloaded for a single sample and for SSE, AVX and
+  /// AVX-512 registers (when enabled by compiler), so spectra are processed
+  /// by the widest packets fitting their number of samples.
+  struct SpectrumKernel {
+    /// Tag of packet width
+    template <size_t W>
+    struct Width {};
+
+    static float_t load(const float_t* p, Width<1>) {
+      return *p;
+    }
+    static void store(float_t* p, float_t v) {
+      *p = v;
+    }
+    static float_t broadcast(float_t v, Width<1>) {
+      return v;
+    }
+    static float_t add(float_t a, float_t b) {
+      return a + b;
+    }
+    static float_t sub(float_t a, float_t b) {
+      return a - b;
+    }
+    static float_t mul(float_t a, float_t b) {
+      return a * b;
+    }
+    static float_t div(float_t a, float_t b) {
+      return a / b;
+    }
+    static float_t sqrt(float_t a) {
+      return std::sqrt(a);
+    }
+    static float_t clamp(float_t a, float_t low, float_t high) {
+      return std::clamp(a, low, high);
+    }
+    static bool hasNaN(float_t a) {
+      return std::isnan(a);
+    }
+
+#if defined(RT_SPECTRUM_SSE)
+    static_assert(std::is_same_v<float_t, float>);
+
+    static __m128 load(const float_t* p, Width<4>) {
+      return _mm_loadu_ps(p);
+    }
+    static void store(float_t* p, __m128 v) {
+      _mm_storeu_ps(p, v);
+    }
+    static __m128 broadcast(float_t v, Width<4>) {
+      return _mm_set1_ps(v);
+    }
+    static __m128 add(__m128 a, __m128 b) {
+      return _mm_add_ps(a, b);
+    }
+    static __m128 sub(__m128 a, __m128 b) {
+      return _mm_sub_ps(a, b);
+    }
+    static __m128 mul(__m128 a, __m128 b) {
+      return _mm_mul_ps(a, b);
+    }
+    static __m128 div(__m128 a, __m128 b) {
+      return _mm_div_ps(a, b);
+    }
+    static __m128 sqrt(__m128 a) {
+      return _mm_sqrt_ps(a);
+    }
+    static __m128 clamp(__m128 a, float_t low, float_t high) {
+      // min/max return second operand for NaN, so NaN is kept like std::clamp
+      return _mm_min_ps(_mm_set1_ps(high), _mm_max_ps(_mm_set1_ps(low), a));
+    }
+    static bool hasNaN(__m128 a) {
+      return _mm_movemask_ps(_mm_cmpunord_ps(a, a)) != 0;
+    }
+#endif
+
+#if defined(RT_SPECTRUM_AVX)
+    static __m256 load(const float_t* p, Width<8>) {
+      return _mm256_loadu_ps(p);
+    }
+    static void store(float_t* p, __m256 v) {
+      _mm256_storeu_ps(p, v);
+    }
+    static __m256 broadcast(float_t v, Width<8>) {
+      return _mm256_set1_ps(v);
+    }
+    static __m256 add(__m256 a, __m256 b) {
+      return _mm256_add_ps(a, b);
+    }
+    static __m256 sub(__m256 a, __m256 b) {
+      return _mm256_sub_ps(a, b);
+    }
+    static __m256 mul(__m256 a, __m256 b) {
+      return _mm256_mul_ps(a, b);
+    }
+    static __m256 div(__m256 a, __m256 b) {
+      return _mm256_div_ps(a, b);
+    }
+    static __m256 sqrt(__m256 a) {
+      return _mm256_sqrt_ps(a);
+    }
+    static __m256 clamp(__m256 a, float_t low, float_t high) {
+      return _mm256_min_ps(
+        _mm256_set1_ps(high), _mm256_max_ps(_mm256_set1_ps(low), a));
+    }
+    static bool hasNaN(__m256 a) {
+      return _mm256_movemask_ps(_mm256_cmp_ps(a, a, _CMP_UNORD_Q)) != 0;
+    }
+#endif
+
+#if defined(RT_SPECTRUM_AVX512)
+    static __m512 load(const float_t* p, Width<16>) {
+      return _mm512_loadu_ps(p);
+    }
+    static void store(float_t* p, __m512 v) {
+      _mm512_storeu_ps(p, v);
+    }
+    static __m512 broadcast(float_t v, Width<16>) {
+      return _mm512_set1_ps(v);
+    }
+    static __m512 add(__m512 a, __m512 b) {
+      return _mm512_add_ps(a, b);
+    }
+    static __m512 sub(__m512 a, __m512 b) {
+      return _mm512_sub_ps(a, b);
+    }
+    static __m512 mul(__m512 a, __m512 b) {
+      return _mm512_mul_ps(a, b);
+    }
+    static __m512 div(__m512 a, __m512 b) {
+      return _mm512_div_ps(a, b);
+    }
+    static __m512 sqrt(__m512 a) {
+      return _mm512_sqrt_ps(a);
+    }
+    static __m512 clamp(__m512 a, float_t low, float_t high) {
+      return _mm512_min_ps(
+        _mm512_set1_ps(high), _mm512_max_ps(_mm512_set1_ps(low), a));
+    }
+    static bool hasNaN(__m512 a) {
+      return _mm512_cmp_ps_mask(a, a, _CMP_UNORD_Q) != 0;
+    }
+#endif
+
+    /// Call `func(i, tag)` for packets covering samples [0, N), widest first
+    template <size_t N, class F>
+    static void forEach(F&& func) {
+      size_t i = 0;
+#if defined(RT_SPECTRUM_AVX512)
+      for (; i < N / 16 * 16; i += 16)
+        func(i, Width<16>());
+#endif
+#if defined(RT_SPECTRUM_AVX)
+      for (; i < N / 8 * 8; i += 8)
+        func(i, Width<8>());
+#endif
+#if defined(RT_SPECTRUM_SSE)
+      for (; i < N / 4 * 4; i += 4)
+        func(i, Width<4>());
+#endif
+      for (; i < N; ++i)
+        func(i, Width<1>());
+    }
+  };
+
+  /// Sample-wise addition
+  struct SpectrumAdd {
+    template <class V>
+    V operator()(V a, V b) const {
+      return SpectrumKernel::add(a, b);
+    }
+  };
+  /// Sample-wise subtraction
+  struct SpectrumSub {
+    template <class V>
+    V operator()(V a, V b) const {
+      return SpectrumKernel::sub(a, b);
+    }
+  };
+  /// Sample-wise multiplication
+  struct SpectrumMul {
+    template <class V>
+    V operator()(V a, V b) const {
+      return SpectrumKernel::mul(a, b);
+    }
+  };
+  /// Sample-wise division
+  struct SpectrumDiv {
+    template <class V>
+    V operator()(V a, V b) const {
+      return SpectrumKernel::div(a, b);
+    }
+  };
+  /// Sample-wise sqrt
+  struct SpectrumSqrt {
+    template <class V>
+    V operator()(V a) const {
+      return SpectrumKernel::sqrt(a);
+    }
+  };
+  /// Sample-wise clamp
+  struct SpectrumClamp {
+    float_t low;
+    float_t high;
+    template <class V>
+    V operator()(V a) const {
+      return SpectrumKernel::clamp(a, low, high);
+    }
+  };
+
+  template <class Op, class E, size_t N>
+  class SpectrumUnaryExpr;
+
+  /// Operand of spectrum expression (spectra are referenced, sub-expressions
+  /// are copied)
+  template <class E>
+  struct SpectrumOperand {
+    using type = E;
+  };
+  /// Operand of spectrum expression
+  template <size_t N>
+  struct SpectrumOperand<CoefficientSpectrum<N>> {
+    using type = const CoefficientSpectrum<N>&;
+  };
+
+  /** \brief Base of spectrum expressions.
+   * Arithmetic on spectra builds expressions, which are evaluated in a single
+   * pass over samples when assigned to a spectrum, so compound expressions
+   * like `a * b + c * d` need no temporary spectra. Expressions reference
+   * their spectrum operands, so they should not be kept (e.g. by `auto`)
+   * beyond lifetime of the operands.
+   * \param E Expression type
+   * \param N Number of samples
+   */
+  template <class E, size_t N>
+  class SpectrumExpr {
+  public:
+    /// Get expression
+    const E& self() const {
+      return static_cast<const E&>(*this);
+    }
+
+    /// take sqrt
+    friend auto sqrt(const SpectrumExpr& s) {
+      return SpectrumUnaryExpr<SpectrumSqrt, E, N>(SpectrumSqrt(), s.self());
+    }
+    /// take clamp
+    friend auto clamp(const SpectrumExpr& s, float_t low, float_t high) {
+      return SpectrumUnaryExpr<SpectrumClamp, E, N>(
+        SpectrumClamp{low, high}, s.self());
+    }
+  };
+
+  /// Scalar broadcast to all samples
+  template <size_t N>
+  class SpectrumScalarExpr : public SpectrumExpr<SpectrumScalarExpr<N>, N> {
+  public:
+    /// Ctor
+    explicit SpectrumScalarExpr(float_t v) : m_value{v} {}
+
+    /// Get samples at [i, i + W)
+    template <size_t W>
+    auto get(size_t, SpectrumKernel::Width<W> tag) const {
+      return SpectrumKernel::broadcast(m_value, tag);
+    }
+
+  private:
+    float_t m_value;
+  };
+
+  /// Sample-wise unary operation
+  template <class Op, class E, size_t N>
+  class SpectrumUnaryExpr
+    : public SpectrumExpr<SpectrumUnaryExpr<Op, E, N>, N> {
+  public:
+    /// Ctor
+    SpectrumUnaryExpr(const Op& op, const E& e) : m_op{op}, m_expr{e} {}
+
+    /// Get samples at [i, i + W)
+    template <size_t W>
+    auto get(size_t i, SpectrumKernel::Width<W> tag) const {
+      return m_op(m_expr.get(i, tag));
+    }
+
+  private:
+    Op m_op;
+    typename SpectrumOperand<E>::type m_expr;
+  };
+
+  /// Sample-wise binary operation
+  template <class Op, class L, class R, size_t N>
+  class SpectrumBinaryExpr
+    : public SpectrumExpr<SpectrumBinaryExpr<Op, L, R, N>, N> {
+  public:
+    /// Ctor
+    SpectrumBinaryExpr(const L& lhs, const R& rhs) : m_lhs{lhs}, m_rhs{rhs} {}
+
+    /// Get samples at [i, i + W)
+    template <size_t W>
+    auto get(size_t i, SpectrumKernel::Width<W> tag) const {
+      return Op()(m_lhs.get(i, tag), m_rhs.get(i, tag));
+    }
+
+  private:
+    typename SpectrumOperand<L>::type m_lhs;
+    typename SpectrumOperand<R>::type m_rhs;
+  };
+
   /// \brief CoefficientSpectrum
   /// \param N Number of sample spectrum
   template <size_t N>
-  class CoefficientSpectrum {
+  class CoefficientSpectrum : public SpectrumExpr<CoefficientSpectrum<N>, N> {
   public:
     /// Ctor
     CoefficientSpectrum() = default;
@@ -39,37 +363,67 @@ namespace naga::rt {
     CoefficientSpectrum(float_t v) {
       std::fill_n(m_samples.data(), N, v);
     }
+    /// Evaluate expression
+    template <class E>
+    CoefficientSpectrum(const SpectrumExpr<E, N>& expr) {
+      assign(expr.self());
+    }
+    /// Evaluate expression
+    template <class E>
+    CoefficientSpectrum& operator=(const SpectrumExpr<E, N>& expr) {
+      assign(expr.self());
+      return *this;
+    }
 
     /// operator+=
-    CoefficientSpectrum& operator+=(const CoefficientSpectrum& other) {
-      std::transform(
-        m_samples.begin(), m_samples.end(), other.m_samples.begin(),
-        std::plus<float_t>());
+    template <class E>
+    CoefficientSpectrum& operator+=(const SpectrumExpr<E, N>& other) {
+      return *this = *this + other;
+    }
+    /// operator-=
+    template <class E>
+    CoefficientSpectrum& operator-=(const SpectrumExpr<E, N>& other) {
+      return *this = *this - other;
+    }
+    /// operator*=
+    template <class E>
+    CoefficientSpectrum& operator*=(const SpectrumExpr<E, N>& other) {
+      return *this = *this * other;
+    }
+    /// operator/=
+    template <class E>
+    CoefficientSpectrum& operator/=(const SpectrumExpr<E, N>& other) {
+      return *this = *this / other;
     }
     /// operator+=
-    CoefficientSpectrum& operator-=(const CoefficientSpectrum& other) {
-      std::transform(
-        m_samples.begin(), m_samples.end(), other.m_samples.begin(),
-        std::minus<float_t>());
+    CoefficientSpectrum& operator+=(float_t v) {
+      return *this = *this + v;
+    }
+    /// operator-=
+    CoefficientSpectrum& operator-=(float_t v) {
+      return *this = *this - v;
     }
     /// operator*=
-    CoefficientSpectrum& operator*=(const CoefficientSpectrum& other) {
-      std::transform(
-        m_samples.begin(), m_samples.end(), other.m_samples.begin(),
-        std::multiplies<float_t>());
+    CoefficientSpectrum& operator*=(float_t v) {
+      return *this = *this * v;
     }
     /// operator/=
-    CoefficientSpectrum& operator/=(const CoefficientSpectrum& other) {
-      std::transform(
-        m_samples.begin(), m_samples.end(), other.m_samples.begin(),
-        std::divides<float_t>());
+    CoefficientSpectrum& operator/=(float_t v) {
+      return *this = *this / v;
     }
 
     /// has_NaN
     bool has_NaN() const {
-      for (auto&& v : m_samples)
-        if (std::isnan(v)) return true;
-      return false;
+      bool ret = false;
+      SpectrumKernel::forEach<N>([&](size_t i, auto tag) {
+        ret |= SpectrumKernel::hasNaN(get(i, tag));
+      });
+      return ret;
+    }
+    /// Get samples at [i, i + W)
+    template <size_t W>
+    auto get(size_t i, SpectrumKernel::Width<W> tag) const {
+      return SpectrumKernel::load(m_samples.data() + i, tag);
     }
     /// operator[]
     constexpr float& operator[](size_t n) {
@@ -80,7 +434,7 @@ namespace naga::rt {
       return m_samples[n];
     }
     /// size
-    constexpr size_t size() {
+    constexpr size_t size() const {
       return m_samples.size();
     }
     /// operator==
@@ -93,63 +447,89 @@ namespace naga::rt {
       const CoefficientSpectrum& lhs, const CoefficientSpectrum& rhs) {
       return lhs.m_samples != rhs.m_samples;
     }
-    /// take sqrt
-    friend CoefficientSpectrum sqrt(const CoefficientSpectrum& s) {
-      CoefficientSpectrum ret;
-      std::transform(
-        s.m_samples.begin(), s.m_samples.end(), ret.begin(),
-        [](auto v) { return std::sqrt(v); });
-      return ret;
-    }
-    /// take clamp
-    friend CoefficientSpectrum clamp(
-      const CoefficientSpectrum& s, float_t low, float_t high) {
-      CoefficientSpectrum ret;
-      std::transform(
-        s.m_samples.begin(), s.m_samples.end(), ret.m_samples.begin(),
-        [&](auto v) { return std::clamp(v, low, high); });
-      return ret;
-    }
 
   protected:
     /// samples
     std::array<float_t, N> m_samples;
+
+  private:
+    /// Evaluate expression into samples
+    template <class E>
+    void assign(const E& expr) {
+      // each packet is loaded before stored, so expression may reference
+      // this spectrum
+      SpectrumKernel::forEach<N>([&](size_t i, auto tag) {
+        SpectrumKernel::store(m_samples.data() + i, expr.get(i, tag));
+      });
+    }
   };
 
   /// operator+
-  template <size_t N>
-  CoefficientSpectrum<N> operator+(
-    const CoefficientSpectrum<N>& lhs, const CoefficientSpectrum<N>& rhs) {
-    auto ret = lhs;
-    return ret += rhs;
+  template <class L, class R, size_t N>
+  auto operator+(const SpectrumExpr<L, N>& lhs, const SpectrumExpr<R, N>& rhs) {
+    return SpectrumBinaryExpr<SpectrumAdd, L, R, N>(lhs.self(), rhs.self());
+  }
+  /// operator+
+  template <class E, size_t N>
+  auto operator+(const SpectrumExpr<E, N>& lhs, float_t rhs) {
+    return lhs + SpectrumScalarExpr<N>(rhs);
+  }
+  /// operator+
+  template <class E, size_t N>
+  auto operator+(float_t lhs, const SpectrumExpr<E, N>& rhs) {
+    return SpectrumScalarExpr<N>(lhs) + rhs;
   }
   /// operator-
-  template <size_t N>
-  CoefficientSpectrum<N> operator-(
-    const CoefficientSpectrum<N>& lhs, const CoefficientSpectrum<N>& rhs) {
-    auto ret = lhs;
-    return ret -= rhs;
+  template <class L, class R, size_t N>
+  auto operator-(const SpectrumExpr<L, N>& lhs, const SpectrumExpr<R, N>& rhs) {
+    return SpectrumBinaryExpr<SpectrumSub, L, R, N>(lhs.self(), rhs.self());
+  }
+  /// operator-
+  template <class E, size_t N>
+  auto operator-(const SpectrumExpr<E, N>& lhs, float_t rhs) {
+    return lhs - SpectrumScalarExpr<N>(rhs);
+  }
+  /// operator-
+  template <class E, size_t N>
+  auto operator-(float_t lhs, const SpectrumExpr<E, N>& rhs) {
+    return SpectrumScalarExpr<N>(lhs) - rhs;
   }
   /// operator*
-  template <size_t N>
-  CoefficientSpectrum<N> operator*(
-    const CoefficientSpectrum<N>& lhs, const CoefficientSpectrum<N>& rhs) {
-    auto ret = lhs;
-    return ret *= rhs;
+  template <class L, class R, size_t N>
+  auto operator*(const SpectrumExpr<L, N>& lhs, const SpectrumExpr<R, N>& rhs) {
+    return SpectrumBinaryExpr<SpectrumMul, L, R, N>(lhs.self(), rhs.self());
+  }
+  /// operator*
+  template <class E, size_t N>
+  auto operator*(const SpectrumExpr<E, N>& lhs, float_t rhs) {
+    return lhs * SpectrumScalarExpr<N>(rhs);
+  }
+  /// operator*
+  template <class E, size_t N>
+  auto operator*(float_t lhs, const SpectrumExpr<E, N>& rhs) {
+    return SpectrumScalarExpr<N>(lhs) * rhs;
   }
   /// operator/
-  template <size_t N>
-  CoefficientSpectrum<N> operator/(
-    const CoefficientSpectrum<N>& lhs, const CoefficientSpectrum<N>& rhs) {
-    auto ret = lhs;
-    return ret /= rhs;
+  template <class L, class R, size_t N>
+  auto operator/(const SpectrumExpr<L, N>& lhs, const SpectrumExpr<R, N>& rhs) {
+    return SpectrumBinaryExpr<SpectrumDiv, L, R, N>(lhs.self(), rhs.self());
+  }
+  /// operator/
+  template <class E, size_t N>
+  auto operator/(const SpectrumExpr<E, N>& lhs, float_t rhs) {
+    return lhs / SpectrumScalarExpr<N>(rhs);
+  }
+  /// operator/
+  template <class E, size_t N>
+  auto operator/(float_t lhs, const SpectrumExpr<E, N>& rhs) {
+    return SpectrumScalarExpr<N>(lhs) / rhs;
   }
   /// lerp
-  template <size_t N>
-  CoefficientSpectrum<N> lerp(
+  template <class E1, class E2, size_t N>
+  auto lerp(
     float_t t,
-    const CoefficientSpectrum<N>& s1,
-    const CoefficientSpectrum<N>& s2) {
+    const SpectrumExpr<E1, N>& s1,
+    const SpectrumExpr<E2, N>& s2) {
     return (1 - t) * s1 + t * s2;
   }
 
@@ -178,6 +558,12 @@ namespace naga::rt {
     constexpr SampledSpectrum() : CoefficientSpectrum<N>(){};
     /// Ctor
     constexpr SampledSpectrum(float_t v) : CoefficientSpectrum<N>(v) {}
+    /// Evaluate spectrum expression
+    template <class E>
+    SampledSpectrum(const SpectrumExpr<E, N>& expr)
+      : CoefficientSpectrum<N>(expr) {}
+
+    using CoefficientSpectrum<N>::operator=;
 
     /// Initialize SampledSpectrum from samples
     SampledSpectrum(const std::vector<std::pair<float_t, float_t>>& samples) {
@@ -259,6 +645,12 @@ namespace naga::rt {
 
       /// Construct RGBSpectrum from constant value
       RGBSpectrum(float_t v) : CoefficientSpectrum<3>(v){};
+      /// Evaluate spectrum expression
+      template <class E>
+      RGBSpectrum(const SpectrumExpr<E, 3>& expr)
+        : CoefficientSpectrum<3>(expr) {}
+
+      using CoefficientSpectrum<3>::operator=;
 
       /// Construct RGBSpectrum from sRGB color
       RGBSpectrum(const RGBColor& rgb) {
@@ -405,7 +797,8 @@ namespace naga::rt {
   }
 
   template <size_t Start, size_t End, size_t N>
-  SampledSpectrum<Start, End, N>::SampledSpectrum(const RGBColor& rgb, SpectrumType type) {
+  SampledSpectrum<Start, End, N>::SampledSpectrum(const RGBColor& rgb, SpectrumType type)
+    : CoefficientSpectrum<N>(0) {
     if (type == SpectrumType::Reflectance) {
       if (rgb[0] <= rgb[1] && rgb[0] <= rgb[2]) {
         *this += rgb[0] * rWhite;
@@ -0,0 +1,159 @@
+#include "transform.hpp"
+
+#include <cassert>
+#include <type_traits>
+
+#if defined(__SSE__) || defined(_M_X64)
+  #include <immintrin.h>
+  #define RT_TRANSFORM_SSE
+#endif
+#if defined(__AVX2__) && defined(__FMA__)
+  #define RT_TRANSFORM_AVX2
+#endif
+
+namespace naga::rt {
+
+  namespace {
+
+    /// Transform non-empty bounding box by affine matrix
+    inline Bounds3 transformAffineBounds(const Mat4& m, const Bounds3& b) {
+#if defined(RT_TRANSFORM_SSE)
+      static_assert(std::is_same_v<float_t, float>);
+      static_assert(sizeof(Mat4) == 16 * sizeof(float));
+      // one column per register (w lane is unused)
+      __m128 lo = _mm_loadu_ps(&m[3][0]);
+      __m128 hi = lo;
+      for (auto j = 0; j < 3; ++j) {
+        __m128 c = _mm_loadu_ps(&m[j][0]);
+        __m128 a = _mm_mul_ps(c, _mm_set1_ps(b.min()[j]));
+        __m128 d = _mm_mul_ps(c, _mm_set1_ps(b.max()[j]));
+        lo = _mm_add_ps(lo, _mm_min_ps(a, d));
+        hi = _mm_add_ps(hi, _mm_max_ps(a, d));
+      }
+      alignas(16) float l[4];
+      alignas(16) float h[4];
+      _mm_store_ps(l, lo);
+      _mm_store_ps(h, hi);
+      Bounds3 ret;
+      ret.setMin({l[0], l[1], l[2]});
+      ret.setMax({h[0], h[1], h[2]});
+      return ret;
+#else
+      return transformBounds(m, b);
+#endif
+    }
+
+    /** \brief Multiply SoA arrays by 3x4 rows (translation scaled by `w`).
+     * Inputs of each lane are loaded before outputs are stored, so output
+     * may alias input.
+     */
+    void transformSoA(
+      const Vec4* rows,
+      float_t w,
+      const float_t* x,
+      const float_t* y,
+      const float_t* z,
+      float_t* outX,
+      float_t* outY,
+      float_t* outZ,
+      std::size_t n) {
+      float_t* out[3] = {outX, outY, outZ};
+      std::size_t i = 0;
+#if defined(RT_TRANSFORM_AVX2)
+      static_assert(std::is_same_v<float_t, float>);
+      __m256 m[3][4];
+      for (auto r = 0; r < 3; ++r) {
+        for (auto c = 0; c < 3; ++c)
+          m[r][c] = _mm256_set1_ps(rows[r][c]);
+        m[r][3] = _mm256_set1_ps(rows[r][3] * w);
+      }
+      for (; i + 8 <= n; i += 8) {
+        __m256 vx = _mm256_loadu_ps(x + i);
+        __m256 vy = _mm256_loadu_ps(y + i);
+        __m256 vz = _mm256_loadu_ps(z + i);
+        __m256 v[3];
+        for (auto r = 0; r < 3; ++r) {
+          __m256 t = _mm256_fmadd_ps(m[r][2], vz, m[r][3]);
+          t = _mm256_fmadd_ps(m[r][1], vy, t);
+          v[r] = _mm256_fmadd_ps(m[r][0], vx, t);
+        }
+        for (auto r = 0; r < 3; ++r)
+          _mm256_storeu_ps(out[r] + i, v[r]);
+      }
+#endif
+      for (; i < n; ++i) {
+        Vec4 p(x[i], y[i], z[i], w);
+        float_t v[3];
+        for (auto r = 0; r < 3; ++r)
+          v[r] = glm::dot(rows[r], p);
+        for (auto r = 0; r < 3; ++r)
+          out[r][i] = v[r];
+      }
+    }
+  } // namespace
+
+  void transformBounds(
+    const Mat4& m, ArrayView<const Bounds3> bounds, ArrayView<Bounds3> out) {
+    assert(bounds.size() == out.size());
+    if (!isAffine(m)) {
+      for (std::size_t i = 0; i < bounds.size(); ++i)
+        out[i] = transformBounds(m, bounds[i]);
+      return;
+    }
+    for (std::size_t i = 0; i < bounds.size(); ++i) {
+      if (!bounds[i].empty())
+        out[i] = transformAffineBounds(m, bounds[i]);
+      else
+        out[i] = bounds[i];
+    }
+  }
+
+  void transformBounds(
+    ArrayView<const Mat4> matrices,
+    ArrayView<const Bounds3> bounds,
+    ArrayView<Bounds3> out) {
+    assert(matrices.size() == bounds.size() && bounds.size() == out.size());
+    for (std::size_t i = 0; i < bounds.size(); ++i) {
+      if (isAffine(matrices[i]) && !bounds[i].empty())
+        out[i] = transformAffineBounds(matrices[i], bounds[i]);
+      else
+        out[i] = transformBounds(matrices[i], bounds[i]);
+    }
+  }
+
+  void AffineTransform::transformPoints(
+    ArrayView<const Vec3> in, ArrayView<Vec3> out) const {
+    assert(in.size() == out.size());
+    for (std::size_t i = 0; i < in.size(); ++i)
+      out[i] = transformPoint(in[i]);
+  }
+
+  void AffineTransform::transformNormals(
+    ArrayView<const Vec3> in, ArrayView<Vec3> out) const {
+    assert(in.size() == out.size());
+    for (std::size_t i = 0; i < in.size(); ++i)
+      out[i] = transformNormal(in[i]);
+  }
+
+  void AffineTransform::transformPoints(
+    const float_t* x,
+    const float_t* y,
+    const float_t* z,
+    float_t* outX,
+    float_t* outY,
+    float_t* outZ,
+    std::size_t n) const {
+    transformSoA(m_matrix, 1, x, y, z, outX, outY, outZ, n);
+  }
+
+  void AffineTransform::transformVectors(
+    const float_t* x,
+    const float_t* y,
+    const float_t* z,
+    float_t* outX,
+    float_t* outY,
+    float_t* outZ,
+    std::size_t n) const {
+    transformSoA(m_matrix, 0, x, y, z, outX, outY, outZ, n);
+  }
+}
@@ -1,10 +1,67 @@
 #pragma once
 
+#include "bounds.hpp"
 #include "float.hpp"
 #include "geometry.hpp"
+#include "memory.hpp"
+#include "ray.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <utility>
 
 namespace naga::rt {
 
+  /// Check if last row of matrix is (0, 0, 0, 1)
+  inline bool isAffine(const Mat4& m) {
+    return m[0][3] == 0 && m[1][3] == 0 && m[2][3] == 0 && m[3][3] == 1;
+  }
+
+  /** \brief Transform bounding box.
+   * Returns the bounds of all 8 transformed corners. For affine matrices
+   * this uses Arvo's method: each axis of the result is the translation
+   * plus, for every input axis, the smaller (larger) product of the matrix
+   * entry with min and max. Empty bounds are returned unchanged.
+   */
+  inline Bounds3 transformBounds(const Mat4& m, const Bounds3& b) {
+    if (b.empty()) return b;
+    Bounds3 ret;
+    if (!isAffine(m)) {
+      // projective: transform corners
+      auto corner = [&](unsigned char i) {
+        auto p = m * Vec4(b.corner(i), 1);
+        return Vec3(p) / p.w;
+      };
+      ret = Bounds3(corner(0));
+      for (unsigned char i = 1; i < 8; ++i)
+        ret = Bounds3::merge(ret, corner(i));
+      return ret;
+    }
+    Vec3 lo(m[3]);
+    Vec3 hi(m[3]);
+    for (auto j = 0; j < 3; ++j) {
+      Vec3 a = Vec3(m[j]) * b.min()[j];
+      Vec3 c = Vec3(m[j]) * b.max()[j];
+      lo += glm::min(a, c);
+      hi += glm::max(a, c);
+    }
+    ret.setMin(lo);
+    ret.setMax(hi);
+    return ret;
+  }
+
+  /** \brief Transform array of bounding boxes by single matrix.
+   * Same result as transformBounds(), with SIMD for affine matrices.
+   * `out` may alias `bounds`.
+   */
+  void transformBounds(
+    const Mat4& m, ArrayView<const Bounds3> bounds, ArrayView<Bounds3> out);
+  /// Transform i-th bounding box by i-th matrix (e.g. bounds of instances)
+  void transformBounds(
+    ArrayView<const Mat4> matrices,
+    ArrayView<const Bounds3> bounds,
+    ArrayView<Bounds3> out);
+
   /// Transform
   class Transform {
   public:
@@ -52,68 +109,226 @@ namespace naga::rt {
     /// rotate to arbitrary axis
     static Transform rotate(const Vec3& axis, Radian angle);
 
-    Vec3 operator()(const Vec3& vec) {
+    Vec3 operator()(const Vec3& vec) const {
       auto ret = m_matrix * Vec4(vec, 1);
       return ret / ret.w;
     }
 
+    /// transform point
+    Vec3 transformPoint(const Vec3& p) const {
+      return (*this)(p);
+    }
+    /// transform vector (ignores translation)
+    Vec3 transformVector(const Vec3& v) const {
+      return Mat3(m_matrix) * v;
+    }
+    /// transform normal (by inverse transpose)
+    Vec3 transformNormal(const Vec3& n) const {
+      return glm::transpose(Mat3(m_inverse)) * n;
+    }
+    /// transform bounding box
+    Bounds3 transformBounds(const Bounds3& b) const {
+      return naga::rt::transformBounds(m_matrix, b);
+    }
+    /// check if transform is affine
+    bool isAffine() const {
+      return naga::rt::isAffine(m_matrix);
+    }
+    /** \brief transform ray
+     * Ray direction is normalized, so ray parameter changes its scale.
+     * `tScale` receives factor to convert parameter (t' = t * tScale).
+     */
+    Ray transformRay(const Ray& ray, float_t* tScale) const {
+      auto d = transformVector(ray.dir());
+      *tScale = glm::length(d);
+      return {transformPoint(ray.origin()), d, ray.time()};
+    }
+
   protected:
     Mat4 m_matrix;
     Mat4 m_inverse;
   };
 
   /// operator==
-  bool operator==(const Transform& lhs, const Transform& rhs) {
+  inline bool operator==(const Transform& lhs, const Transform& rhs) {
     return lhs.getMatrix() == rhs.getMatrix() &&
            lhs.getInverseMatrix() == rhs.getInverseMatrix();
   }
 
   /// operator==
-  bool operator!=(const Transform& lhs, const Transform& rhs) {
+  inline bool operator!=(const Transform& lhs, const Transform& rhs) {
     return !(lhs == rhs);
   }
 
   /// create inverse transform
-  Transform Transform::inverse() const {
+  inline Transform Transform::inverse() const {
     return {m_inverse, m_matrix};
   }
 
-  Transform Transform::translate(const Vec3& v) {
+  inline Transform Transform::translate(const Vec3& v) {
     return {glm::translate(Mat4(1), v)};
   }
 
-  Transform Transform::scale(const Vec3& v) {
+  inline Transform Transform::scale(const Vec3& v) {
     return {glm::scale(Mat4(1), v)};
   }
 
-  Transform Transform::rotate(Radian angle, const Vec3& v) {
+  inline Transform Transform::rotate(Radian angle, const Vec3& v) {
     return {glm::rotate(Mat4(1), angle.value(), v)};
   }
 
   /// rotate to arbitrary axis
-  Transform Transform::rotate(const Vec3& axis, Radian angle) {
+  inline Transform Transform::rotate(const Vec3& axis, Radian angle) {
     auto cos = std::cos(angle.value());
     auto sin = std::sin(angle.value());
     auto n1 = axis.x;
     auto n2 = axis.y;
     auto n3 = axis.z;
 
-    Vec4 c1 = {cos + std::pow(n1, 2) * (1 - cos), //
+    Vec4 c1 = {cos + n1 * n1 * (1 - cos), //
                n2 * n1 * (1 - cos) + n3 * sin,    //
                n3 * n1 * (1 - cos) - n2 * sin,    //
                0};                                //
 
     Vec4 c2 = {n1 * n2 * (1 - cos) - n3 * sin,    //
-               cos + std::pow(n2, 2) * (1 - cos), //
+               cos + n2 * n2 * (1 - cos), //
                n3 * n2 * (1 - cos) + n1 * sin,    //
                0};                                //
 
     Vec4 c3 = {n1 * n3 * (1 - cos) + n2 * sin,    //
                n2 * n3 * (1 - cos) - n1 * sin,    //
-               cos - std::pow(n3, 2) * (1 - cos), //
+               cos - n3 * n3 * (1 - cos), //
                0};                                //
 
     Vec4 c4 = {0, 0, 0, 1};
     return Transform(Mat4(c1, c2, c3, c4));
   }
-}
\ No newline at end of file
+
+  /** \brief Affine transform.
+   * Stores the upper 3 rows of matrix and inverse (3x4 each). Points are
+   * transformed without homogeneous divide, which makes it the fast path
+   * for mesh pre-transform, instance rays and bounds.
+   */
+  class AffineTransform {
+  public:
+    /// Create identity transform
+    AffineTransform() : AffineTransform(Mat4(1), Mat4(1)) {}
+    /// Construct from matrix and inverse (last rows should be (0, 0, 0, 1))
+    AffineTransform(const Mat4& mat, const Mat4& inv) {
+      for (auto i = 0; i < 3; ++i) {
+        m_matrix[i] = {mat[0][i], mat[1][i], mat[2][i], mat[3][i]};
+        m_inverse[i] = {inv[0][i], inv[1][i], inv[2][i], inv[3][i]};
+      }
+    }
+    /// Construct from affine transform
+    explicit AffineTransform(const Transform& t)
+      : AffineTransform(t.getMatrix(), t.getInverseMatrix()) {
+      assert(t.isAffine());
+    }
+
+    /// create inverse transform
+    AffineTransform inverse() const {
+      AffineTransform ret = *this;
+      std::swap(ret.m_matrix, ret.m_inverse);
+      return ret;
+    }
+    /// check identity
+    bool isIdentity() const {
+      return *this == AffineTransform();
+    }
+
+    /// transform point
+    Vec3 transformPoint(const Vec3& p) const {
+      Vec4 h(p, 1);
+      return {glm::dot(m_matrix[0], h), glm::dot(m_matrix[1], h),
+              glm::dot(m_matrix[2], h)};
+    }
+    /// transform vector (ignores translation)
+    Vec3 transformVector(const Vec3& v) const {
+      return {glm::dot(Vec3(m_matrix[0]), v), glm::dot(Vec3(m_matrix[1]), v),
+              glm::dot(Vec3(m_matrix[2]), v)};
+    }
+    /// transform normal (by inverse transpose)
+    Vec3 transformNormal(const Vec3& n) const {
+      return Vec3(m_inverse[0]) * n.x + Vec3(m_inverse[1]) * n.y +
+             Vec3(m_inverse[2]) * n.z;
+    }
+    /** \brief transform ray
+     * `tScale` receives factor to convert parameter (t' = t * tScale).
+     */
+    Ray transformRay(const Ray& ray, float_t* tScale) const {
+      auto d = transformVector(ray.dir());
+      *tScale = glm::length(d);
+      return {transformPoint(ray.origin()), d, ray.time()};
+    }
+    /// transform bounding box (Arvo's method, empty bounds are unchanged)
+    Bounds3 transformBounds(const Bounds3& b) const {
+      if (b.empty()) return b;
+      Vec3 lo, hi;
+      for (auto i = 0; i < 3; ++i) {
+        lo[i] = hi[i] = m_matrix[i].w;
+        for (auto j = 0; j < 3; ++j) {
+          auto a = m_matrix[i][j] * b.min()[j];
+          auto c = m_matrix[i][j] * b.max()[j];
+          lo[i] += std::min(a, c);
+          hi[i] += std::max(a, c);
+        }
+      }
+      Bounds3 ret;
+      ret.setMin(lo);
+      ret.setMax(hi);
+      return ret;
+    }
+
+    /// Transform points (output may alias input)
+    void transformPoints(ArrayView<const Vec3> in, ArrayView<Vec3> out) const;
+    /// Transform normals, without normalizing (output may alias input)
+    void transformNormals(ArrayView<const Vec3> in, ArrayView<Vec3> out) const;
+    /** \brief Transform points in structure-of-arrays form.
+     * Uses AVX2 when available. Output may alias input.
+     */
+    void transformPoints(
+      const float_t* x,
+      const float_t* y,
+      const float_t* z,
+      float_t* outX,
+      float_t* outY,
+      float_t* outZ,
+      std::size_t n) const;
+    /// Transform vectors in structure-of-arrays form (see transformPoints())
+    void transformVectors(
+      const float_t* x,
+      const float_t* y,
+      const float_t* z,
+      float_t* outX,
+      float_t* outY,
+      float_t* outZ,
+      std::size_t n) const;
+
+    /// get rows of matrix (translation in w)
+    const Vec4* getRows() const {
+      return m_matrix;
+    }
+    /// get rows of inverse (translation in w)
+    const Vec4* getInverseRows() const {
+      return m_inverse;
+    }
+
+    /// operator==
+    friend bool
+      operator==(const AffineTransform& lhs, const AffineTransform& rhs) {
+      for (auto i = 0; i < 3; ++i)
+        if (
+          lhs.m_matrix[i] != rhs.m_matrix[i] ||
+          lhs.m_inverse[i] != rhs.m_inverse[i])
+          return false;
+      return true;
+    }
+
+  private:
+    /// Rows of matrix
+    Vec4 m_matrix[3];
+    /// Rows of inverse
+    Vec4 m_inverse[3];
+  };
+}
@@ -0,0 +1,72 @@
+#include "transform_pool.hpp"
+#include "hash.hpp"
+
+#include <cassert>
+#include <cstring>
+#include <limits>
+
+namespace naga::rt {
+
+  namespace {
+    /// Hash of matrix content
+    std::uint64_t hashMatrix(const Mat4& m) {
+      Hasher hasher;
+      hasher.add(m);
+      return hasher.get();
+    }
+  } // namespace
+
+  TransformPool::TransformPool() : m_storage{std::make_shared<Storage>()} {}
+
+  TransformPool::Handle TransformPool::intern(const Mat4& matrix) {
+    auto hash = hashMatrix(matrix);
+    Handle h;
+    if (find(matrix, hash, &h)) return h;
+    return add(Transform(matrix), hash);
+  }
+
+  TransformPool::Handle TransformPool::intern(const Transform& t) {
+    auto hash = hashMatrix(t.getMatrix());
+    Handle h;
+    if (find(t.getMatrix(), hash, &h)) return h;
+    return add(t, hash);
+  }
+
+  std::shared_ptr<const Transform> TransformPool::share(Handle h) const {
+    return {m_storage, &get(h)};
+  }
+
+  std::shared_ptr<const Mat4> TransformPool::shareMatrix(Handle h) const {
+    return {m_storage, &get(h).getMatrix()};
+  }
+
+  std::shared_ptr<const Mat4>
+    TransformPool::shareInverseMatrix(Handle h) const {
+    return {m_storage, &get(h).getInverseMatrix()};
+  }
+
+  bool TransformPool::find(const Mat4& matrix, std::uint64_t hash, Handle* h) {
+    auto [begin, end] = m_index.equal_range(hash);
+    for (auto it = begin; it != end; ++it) {
+      const auto& m = get(it->second).getMatrix();
+      if (std::memcmp(&m, &matrix, sizeof(Mat4)) == 0) {
+        *h = it->second;
+        ++m_nHits;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  TransformPool::Handle
+    TransformPool::add(const Transform& t, std::uint64_t hash) {
+    auto& storage = *m_storage;
+    assert(storage.size < std::numeric_limits<Handle>::max());
+    if (storage.size == storage.blocks.size() * blockSize)
+      storage.blocks.push_back(std::make_unique<Transform[]>(blockSize));
+    auto h = static_cast<Handle>(storage.size++);
+    storage.blocks[h / blockSize][h % blockSize] = t;
+    m_index.emplace(hash, h);
+    return h;
+  }
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "transform.hpp"
+
+/// \file Pool of shared transforms
+
+namespace naga::rt {
+
+  /** \brief Pool of unique transforms.
+   * Transforms are interned by content, so objects placed by the same
+   * matrix share one Transform whose inverse is computed once. Transforms
+   * are stored in fixed-size blocks, so references and pointers handed out
+   * stay valid while the pool or any pointer shared from it is alive.
+   * Matrices are compared bitwise (0 and -0 differ). Not thread-safe.
+   */
+  class TransformPool {
+  public:
+    /// Compact handle of transform
+    using Handle = std::uint32_t;
+
+    /// Ctor
+    TransformPool();
+
+    /// Intern transform of matrix (inverse is computed for new matrices)
+    Handle intern(const Mat4& matrix);
+    /// Intern transform (inverse is taken from `t`)
+    Handle intern(const Transform& t);
+
+    /// Get transform
+    const Transform& get(Handle h) const {
+      return m_storage->blocks[h / blockSize][h % blockSize];
+    }
+    /// Get shared pointer to transform (shares ownership of pool storage,
+    /// so no allocation per object)
+    std::shared_ptr<const Transform> share(Handle h) const;
+    /// Get shared pointer to matrix (e.g. object-to-world of GeometricShape)
+    std::shared_ptr<const Mat4> shareMatrix(Handle h) const;
+    /// Get shared pointer to inverse matrix
+    std::shared_ptr<const Mat4> shareInverseMatrix(Handle h) const;
+
+    /// Get number of unique transforms
+    std::size_t size() const {
+      return m_storage->size;
+    }
+    /// Get number of intern() calls which returned existing transform
+    std::size_t getNumHits() const {
+      return m_nHits;
+    }
+
+  private:
+    /// Number of transforms per block
+    static constexpr std::size_t blockSize = 1024;
+
+    /// Blocks of transforms
+    struct Storage {
+      /// Blocks
+      std::vector<std::unique_ptr<Transform[]>> blocks;
+      /// Number of transforms
+      std::size_t size = 0;
+    };
+
+    /// Find interned matrix with hash (false if not found)
+    bool find(const Mat4& matrix, std::uint64_t hash, Handle* h);
+    /// Add new transform
+    Handle add(const Transform& t, std::uint64_t hash);
+
+    /// Storage (shared with pointers handed out)
+    std::shared_ptr<Storage> m_storage;
+    /// Handles by hash of matrix
+    std::unordered_multimap<std::uint64_t, Handle> m_index;
+    /// Number of hits
+    std::size_t m_nHits = 0;
+  };
+}
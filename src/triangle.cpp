@@ -0,0 +1,359 @@
+#include "triangle.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <limits>
+#include <utility>
+
+namespace naga::rt {
+
+  namespace {
+    /// Permute components of vector
+    Vec3 permute(const Vec3& v, int x, int y, int z) {
+      return {v[x], v[y], v[z]};
+    }
+
+    /// Create 2 vectors orthogonal to v (and to each other)
+    void coordinateSystem(const Vec3& v, Vec3* v1, Vec3* v2) {
+      if (std::abs(v.x) > std::abs(v.y))
+        *v1 = Vec3(-v.z, 0, v.x) / std::sqrt(v.x * v.x + v.z * v.z);
+      else
+        *v1 = Vec3(0, v.z, -v.y) / std::sqrt(v.y * v.y + v.z * v.z);
+      *v2 = cross(v, *v1);
+    }
+
+    /// Edge function in double precision (for edges through ray)
+    float_t edgeFunction(const Vec3& a, const Vec3& b) {
+      return static_cast<float_t>(
+        static_cast<double>(a.x) * b.y - static_cast<double>(a.y) * b.x);
+    }
+
+    /** \brief Check if edge from `a` to `b` through ray counts as inside of
+     * triangle with determinant `det`. Decides as if ray was moved by
+     * infinitesimal offset (1, epsilon) in ray space, so that of triangles
+     * sharing the edge (in opposite directions) exactly one is hit.
+     */
+    bool ownsEdge(const Vec3& a, const Vec3& b, float_t det) {
+      float_t dx = b.x - a.x;
+      float_t dy = b.y - a.y;
+      // sign of edge function at offset
+      float_t s = dy != 0 ? -dy : dx;
+      return det > 0 ? s > 0 : s < 0;
+    }
+  } // namespace
+
+  TriangleMesh::TriangleMesh(
+    const Transform& objectToWorld,
+    std::vector<std::uint32_t> indices,
+    std::vector<Vec3> positions,
+    std::vector<Vec3> normals,
+    std::vector<Vec2> uvs)
+    : m_indices{std::move(indices)}
+    , m_positions{std::move(positions)}
+    , m_normals{std::move(normals)}
+    , m_uvs{std::move(uvs)} {
+    assert(m_indices.size() % 3 == 0);
+    assert(m_normals.empty() || m_normals.size() == m_positions.size());
+    assert(m_uvs.empty() || m_uvs.size() == m_positions.size());
+
+    if (objectToWorld.isAffine() && !objectToWorld.isIdentity()) {
+      AffineTransform t(objectToWorld);
+      t.transformPoints(m_positions, m_positions);
+      t.transformNormals(m_normals, m_normals);
+      for (auto& n : m_normals)
+        n = glm::normalize(n);
+    } else if (!objectToWorld.isIdentity()) {
+      for (auto& p : m_positions)
+        p = objectToWorld.transformPoint(p);
+      for (auto& n : m_normals)
+        n = glm::normalize(objectToWorld.transformNormal(n));
+    }
+    m_indexView = m_indices;
+    m_positionView = m_positions;
+    m_normalView = m_normals;
+    m_uvView = m_uvs;
+  }
+
+  TriangleMesh::TriangleMesh(TriangleMeshStorage storage)
+    : m_indexView{storage.indices}
+    , m_positionView{storage.positions}
+    , m_normalView{storage.normals}
+    , m_uvView{storage.uvs}
+    , m_storage{std::move(storage.owner)} {
+    assert(m_indexView.size() % 3 == 0);
+    assert(
+      m_normalView.empty() || m_normalView.size() == m_positionView.size());
+    assert(m_uvView.empty() || m_uvView.size() == m_positionView.size());
+  }
+
+  WatertightRay::WatertightRay(const Ray& ray) : origin{ray.origin()} {
+    const auto& d = ray.dir();
+    auto ad = glm::abs(d);
+    kz = ad.x > ad.y ? (ad.x > ad.z ? 0 : 2) : (ad.y > ad.z ? 1 : 2);
+    kx = kz == 2 ? 0 : kz + 1;
+    ky = kx == 2 ? 0 : kx + 1;
+    // keep winding of permuted triangle
+    if (d[kz] < 0) std::swap(kx, ky);
+    sx = -d[kx] / d[kz];
+    sy = -d[ky] / d[kz];
+    sz = 1 / d[kz];
+  }
+
+  Triangle::Triangle(
+    std::shared_ptr<const TriangleMesh> mesh, std::uint32_t index)
+    : m_mesh{std::move(mesh)}, m_index{index} {}
+
+  bool Triangle::intersectBarycentric(
+    const WatertightRay& wray,
+    float_t tMin,
+    float_t tMax,
+    float_t* t,
+    float_t b[3]) const {
+    auto v = getVertexIndices();
+    auto positions = m_mesh->getPositions();
+
+    // transform vertices to ray space
+    Vec3 p[3];
+    for (auto i = 0; i < 3; ++i) {
+      p[i] = permute(positions[v[i]] - wray.origin, wray.kx, wray.ky, wray.kz);
+      p[i].x += wray.sx * p[i].z;
+      p[i].y += wray.sy * p[i].z;
+    }
+
+    // edge functions
+    float_t e0 = p[1].x * p[2].y - p[1].y * p[2].x;
+    float_t e1 = p[2].x * p[0].y - p[2].y * p[0].x;
+    float_t e2 = p[0].x * p[1].y - p[0].y * p[1].x;
+    if (e0 == 0 || e1 == 0 || e2 == 0) {
+      e0 = edgeFunction(p[1], p[2]);
+      e1 = edgeFunction(p[2], p[0]);
+      e2 = edgeFunction(p[0], p[1]);
+    }
+    if ((e0 < 0 || e1 < 0 || e2 < 0) && (e0 > 0 || e1 > 0 || e2 > 0))
+      return false;
+    float_t det = e0 + e1 + e2;
+    if (det == 0) return false;
+    // ray through edge or vertex
+    if (e0 == 0 && !ownsEdge(p[1], p[2], det)) return false;
+    if (e1 == 0 && !ownsEdge(p[2], p[0], det)) return false;
+    if (e2 == 0 && !ownsEdge(p[0], p[1], det)) return false;
+
+    // ray parameter
+    float_t tScaled =
+      (e0 * p[0].z + e1 * p[1].z + e2 * p[2].z) * wray.sz;
+    float_t invDet = 1 / det;
+    float_t tHit = tScaled * invDet;
+    if (!(tHit > tMin && tHit < tMax)) return false;
+
+    *t = tHit;
+    b[0] = e0 * invDet;
+    b[1] = e1 * invDet;
+    b[2] = e2 * invDet;
+    return true;
+  }
+
+  bool Triangle::intersect(
+    const Ray& ray, float_t tMin, float_t tMax, Interaction* isec) const {
+    return intersect(ray, WatertightRay(ray), tMin, tMax, isec);
+  }
+
+  bool Triangle::intersect(
+    const Ray& ray,
+    const WatertightRay& wray,
+    float_t tMin,
+    float_t tMax,
+    Interaction* isec) const {
+    float_t t;
+    float_t b[3];
+    if (!intersectBarycentric(wray, tMin, tMax, &t, b)) return false;
+    *isec = getInteraction(ray, t, b);
+    return true;
+  }
+
+  bool Triangle::intersect(
+    const Ray& ray, float_t tMin, float_t tMax, HitRecord* hit) const {
+    float_t t;
+    float_t b[3];
+    if (!intersectBarycentric(WatertightRay(ray), tMin, tMax, &t, b))
+      return false;
+    hit->t = t;
+    hit->uv = Vec2(b[1], b[2]);
+    return true;
+  }
+
+  bool Triangle::intersectBatch(
+    ArrayView<const Shape* const> shapes,
+    const Ray& ray,
+    float_t tMin,
+    float_t tMax,
+    HitRecord* hit) const {
+    WatertightRay wray(ray);
+    bool found = false;
+    for (std::size_t i = 0; i < shapes.size(); ++i) {
+      auto triangle = static_cast<const Triangle*>(shapes[i]);
+      float_t t;
+      float_t b[3];
+      if (triangle->intersectBarycentric(wray, tMin, tMax, &t, b)) {
+        found = true;
+        tMax = t;
+        hit->t = t;
+        hit->uv = Vec2(b[1], b[2]);
+        hit->primitive = static_cast<std::uint32_t>(i);
+      }
+    }
+    return found;
+  }
+
+  bool Triangle::intersectBatchP(
+    ArrayView<const Shape* const> shapes,
+    const Ray& ray,
+    float_t tMin,
+    float_t tMax) const {
+    WatertightRay wray(ray);
+    for (auto shape : shapes)
+      if (static_cast<const Triangle*>(shape)->intersectP(wray, tMin, tMax))
+        return true;
+    return false;
+  }
+
+  Interaction
+    Triangle::getInteraction(const Ray& ray, const HitRecord& hit) const {
+    float_t b[3] = {1 - hit.uv[0] - hit.uv[1], hit.uv[0], hit.uv[1]};
+    return getInteraction(ray, hit.t, b);
+  }
+
+  SurfaceInteraction Triangle::getInteraction(
+    const Ray& ray, float_t t, const float_t b[3]) const {
+    auto v = getVertexIndices();
+    auto positions = m_mesh->getPositions();
+    auto normals = m_mesh->getNormals();
+    auto uvs = m_mesh->getUVs();
+    const Vec3& p0 = positions[v[0]];
+    const Vec3& p1 = positions[v[1]];
+    const Vec3& p2 = positions[v[2]];
+    Vec2 uv[3] = {Vec2(0, 0), Vec2(1, 0), Vec2(1, 1)};
+    if (!uvs.empty())
+      for (auto i = 0; i < 3; ++i)
+        uv[i] = uvs[v[i]];
+
+    // partial derivatives
+    Vec3 dpdu, dpdv;
+    Vec2 duv02 = uv[0] - uv[2];
+    Vec2 duv12 = uv[1] - uv[2];
+    Vec3 dp02 = p0 - p2;
+    Vec3 dp12 = p1 - p2;
+    float_t determinant = duv02.x * duv12.y - duv02.y * duv12.x;
+    bool degenerate = std::abs(determinant) < 1e-8f;
+    if (!degenerate) {
+      float_t invDet = 1 / determinant;
+      dpdu = (duv12.y * dp02 - duv02.y * dp12) * invDet;
+      dpdv = (duv02.x * dp12 - duv12.x * dp02) * invDet;
+    }
+    if (degenerate || glm::length(cross(dpdu, dpdv)) == 0)
+      coordinateSystem(glm::normalize(cross(p2 - p0, p1 - p0)), &dpdu, &dpdv);
+
+    // hit position and its error
+    Vec3 pHit = b[0] * p0 + b[1] * p1 + b[2] * p2;
+    Vec3 pError = gamma(7) * (glm::abs(b[0] * p0) + glm::abs(b[1] * p1) +
+                              glm::abs(b[2] * p2));
+    Vec2 uvHit = b[0] * uv[0] + b[1] * uv[1] + b[2] * uv[2];
+
+    SurfaceInteraction si(
+      t, pHit, pError, -ray.dir(), uvHit, dpdu, dpdv, Vec3(0), Vec3(0),
+      this);
+
+    // interpolated shading normal
+    if (!normals.empty()) {
+      Vec3 ns = b[0] * normals[v[0]] + b[1] * normals[v[1]] +
+                b[2] * normals[v[2]];
+      if (glm::length(ns) > 0) {
+        ns = glm::normalize(ns);
+        Vec3 ss = glm::normalize(dpdu);
+        Vec3 ts = cross(ns, ss);
+        if (glm::length(ts) > 0)
+          ss = cross(ts = glm::normalize(ts), ns);
+        else
+          coordinateSystem(ns, &ss, &ts);
+        si.setShadingGeometry(ns, ss, ts, Vec3(0), Vec3(0));
+      }
+    }
+
+    return si;
+  }
+
+  bool Triangle::intersectP(
+    const Ray& ray, float_t tMin, float_t tMax) const {
+    return intersectP(WatertightRay(ray), tMin, tMax);
+  }
+
+  bool Triangle::intersectP(
+    const WatertightRay& wray, float_t tMin, float_t tMax) const {
+    float_t t;
+    float_t b[3];
+    return intersectBarycentric(wray, tMin, tMax, &t, b);
+  }
+
+  Bounds3 Triangle::getBoundingBox() const {
+    auto v = getVertexIndices();
+    auto positions = m_mesh->getPositions();
+    return Bounds3::merge(
+      Bounds3(positions[v[0]], positions[v[1]]), positions[v[2]]);
+  }
+
+  Bounds3 Triangle::getClippedBoundingBox(const Bounds3& clip) const {
+    auto v = getVertexIndices();
+    auto positions = m_mesh->getPositions();
+
+    // clip polygon by 6 planes (each plane adds at most 1 vertex)
+    constexpr int maxVertices = 9;
+    Vec3 poly[maxVertices] = {
+      positions[v[0]], positions[v[1]], positions[v[2]]};
+    int n = 3;
+    for (auto a = 0; a < 3; ++a) {
+      for (auto side = 0; side < 2; ++side) {
+        float_t plane = side ? clip.max()[a] : clip.min()[a];
+        auto inside = [&](const Vec3& p) {
+          return side ? p[a] <= plane : p[a] >= plane;
+        };
+        Vec3 out[maxVertices];
+        int m = 0;
+        for (auto i = 0; i < n; ++i) {
+          const Vec3& p = poly[i];
+          const Vec3& q = poly[(i + 1) % n];
+          if (inside(p)) out[m++] = p;
+          if (inside(p) != inside(q)) {
+            Vec3 x = p + (q - p) * ((plane - p[a]) / (q[a] - p[a]));
+            x[a] = plane;
+            out[m++] = x;
+          }
+        }
+        if (m == 0) {
+          // no part of triangle inside clip
+          Bounds3 empty;
+          empty.setMin(Vec3(std::numeric_limits<float_t>::infinity()));
+          empty.setMax(Vec3(-std::numeric_limits<float_t>::infinity()));
+          return empty;
+        }
+        n = m;
+        std::copy(out, out + m, poly);
+      }
+    }
+
+    Bounds3 ret(poly[0]);
+    for (auto i = 1; i < n; ++i)
+      ret = Bounds3::merge(ret, poly[i]);
+    // clipped vertices are rounded, so keep result inside of clip
+    return Bounds3::overlap(ret, clip);
+  }
+
+  std::vector<std::shared_ptr<Triangle>>
+    createTriangles(const std::shared_ptr<const TriangleMesh>& mesh) {
+    std::vector<std::shared_ptr<Triangle>> triangles;
+    triangles.reserve(mesh->getNumTriangles());
+    for (std::size_t i = 0; i < mesh->getNumTriangles(); ++i)
+      triangles.push_back(
+        std::make_shared<Triangle>(mesh, static_cast<std::uint32_t>(i)));
+    return triangles;
+  }
+}
@@ -0,0 +1,214 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "memory.hpp"
+#include "shape.hpp"
+#include "transform.hpp"
+
+/// \file Triangle mesh
+
+namespace naga::rt {
+
+  /** \brief Vertex attributes of triangle mesh in external storage.
+   * Used to create TriangleMesh from memory-mapped files without copying.
+   * Attributes should be in world space.
+   */
+  struct TriangleMeshStorage {
+    /// Vertex indices (3 per triangle)
+    ArrayView<const std::uint32_t> indices;
+    /// Positions
+    ArrayView<const Vec3> positions;
+    /// Normals (may be empty)
+    ArrayView<const Vec3> normals;
+    /// UV coordinates (may be empty)
+    ArrayView<const Vec2> uvs;
+    /// Owner of the storage, kept alive while mesh is alive
+    std::shared_ptr<const void> owner;
+  };
+
+  /** \brief Triangle mesh.
+   * Vertex attributes are stored in world space, in arrays shared by all
+   * triangles of the mesh.
+   */
+  class TriangleMesh {
+  public:
+    /** \brief Ctor
+     * Transforms positions and normals to world space once.
+     * \param indices 3 vertex indices per triangle
+     * \param normals Shading normals of vertices (empty for none)
+     * \param uvs UV coordinates of vertices (empty for default)
+     */
+    TriangleMesh(
+      const Transform& objectToWorld,
+      std::vector<std::uint32_t> indices,
+      std::vector<Vec3> positions,
+      std::vector<Vec3> normals = {},
+      std::vector<Vec2> uvs = {});
+    /// Ctor from external storage (world space, not copied)
+    explicit TriangleMesh(TriangleMeshStorage storage);
+
+    /// Get number of triangles
+    std::size_t getNumTriangles() const {
+      return m_indexView.size() / 3;
+    }
+    /// Get vertex indices (3 per triangle)
+    ArrayView<const std::uint32_t> getIndices() const {
+      return m_indexView;
+    }
+    /// Get positions of vertices
+    ArrayView<const Vec3> getPositions() const {
+      return m_positionView;
+    }
+    /// Get shading normals of vertices (may be empty)
+    ArrayView<const Vec3> getNormals() const {
+      return m_normalView;
+    }
+    /// Get UV coordinates of vertices (may be empty)
+    ArrayView<const Vec2> getUVs() const {
+      return m_uvView;
+    }
+
+  private:
+    /// Vertex indices
+    std::vector<std::uint32_t> m_indices;
+    /// Positions
+    std::vector<Vec3> m_positions;
+    /// Normals
+    std::vector<Vec3> m_normals;
+    /// UV coordinates
+    std::vector<Vec2> m_uvs;
+    /// Vertex indices (owned or external)
+    ArrayView<const std::uint32_t> m_indexView;
+    /// Positions (owned or external)
+    ArrayView<const Vec3> m_positionView;
+    /// Normals (owned or external)
+    ArrayView<const Vec3> m_normalView;
+    /// UV coordinates (owned or external)
+    ArrayView<const Vec2> m_uvView;
+    /// Owner of external storage
+    std::shared_ptr<const void> m_storage;
+  };
+
+  /** \brief Per-ray constants of watertight ray/triangle test.
+   * Ray direction is permuted so that its largest component is z, and
+   * sheared to +z. Computing these once per ray lets the same ray be
+   * tested against many triangles.
+   */
+  struct WatertightRay {
+    /// Ctor
+    explicit WatertightRay(const Ray& ray);
+
+    /// Origin of ray
+    Vec3 origin;
+    /// Permutation of axes (kz is the largest component of direction)
+    int kx, ky, kz;
+    /// Shear constants
+    float_t sx, sy, sz;
+  };
+
+  /** \brief Triangle of mesh.
+   * Only references the mesh and the index of the triangle.
+   * Interactions reference the triangle by non-owning pointer, so
+   * triangles should outlive interactions. Final, so calls through
+   * `const Triangle&` are not virtual.
+   */
+  class Triangle final : public Shape {
+  public:
+    /// Ctor
+    Triangle(std::shared_ptr<const TriangleMesh> mesh, std::uint32_t index);
+
+    /// Calculate Ray-Triangle intersection
+    virtual bool intersect(
+      const Ray& ray,
+      float_t tMin,
+      float_t tMax,
+      Interaction* isec) const override;
+    /// Calculate intersection with precomputed ray constants
+    bool intersect(
+      const Ray& ray,
+      const WatertightRay& wray,
+      float_t tMin,
+      float_t tMax,
+      Interaction* isec) const;
+    /// Find closest hit (records barycentrics b1, b2 as uv of hit)
+    virtual bool intersect(
+      const Ray& ray,
+      float_t tMin,
+      float_t tMax,
+      HitRecord* hit) const override;
+    /// Build interaction of hit
+    virtual Interaction
+      getInteraction(const Ray& ray, const HitRecord& hit) const override;
+    /// Find closest hit among triangles (non-virtual loop)
+    virtual bool intersectBatch(
+      ArrayView<const Shape* const> shapes,
+      const Ray& ray,
+      float_t tMin,
+      float_t tMax,
+      HitRecord* hit) const override;
+    /// Check if any of triangles is hit (non-virtual loop)
+    virtual bool intersectBatchP(
+      ArrayView<const Shape* const> shapes,
+      const Ray& ray,
+      float_t tMin,
+      float_t tMax) const override;
+    /// Check if ray hits triangle in (tMin, tMax)
+    virtual bool
+      intersectP(const Ray& ray, float_t tMin, float_t tMax) const override;
+    /// Occlusion test with precomputed ray constants
+    bool
+      intersectP(const WatertightRay& wray, float_t tMin, float_t tMax) const;
+    /// Get bounding box
+    virtual Bounds3 getBoundingBox() const override;
+    /// Get bounding box of the part of triangle inside `clip`
+    virtual Bounds3
+      getClippedBoundingBox(const Bounds3& clip) const override;
+
+    /** \brief Find hit in (tMin, tMax). Writes ray parameter and
+     * barycentrics. Rays through an edge or vertex shared by triangles of
+     * a closed mesh hit exactly one of them.
+     */
+    bool intersectBarycentric(
+      const WatertightRay& wray,
+      float_t tMin,
+      float_t tMax,
+      float_t* t,
+      float_t b[3]) const;
+    /// Create interaction of hit found by intersectBarycentric()
+    SurfaceInteraction
+      getInteraction(const Ray& ray, float_t t, const float_t b[3]) const;
+    /// Get vertex positions
+    void getPositions(Vec3 p[3]) const {
+      auto v = getVertexIndices();
+      for (auto i = 0; i < 3; ++i)
+        p[i] = m_mesh->getPositions()[v[i]];
+    }
+
+    /// Get mesh
+    const std::shared_ptr<const TriangleMesh>& getMesh() const {
+      return m_mesh;
+    }
+    /// Get index of triangle in mesh
+    std::uint32_t getIndex() const {
+      return m_index;
+    }
+
+  private:
+    /// Get vertex indices
+    const std::uint32_t* getVertexIndices() const {
+      return &m_mesh->getIndices()[3 * m_index];
+    }
+
+    /// Mesh
+    std::shared_ptr<const TriangleMesh> m_mesh;
+    /// Index of triangle
+    std::uint32_t m_index;
+  };
+
+  /// Create triangles of mesh
+  std::vector<std::shared_ptr<Triangle>>
+    createTriangles(const std::shared_ptr<const TriangleMesh>& mesh);
+}
@@ -0,0 +1,197 @@
+#include "triangle_leaf.hpp"
+
+#include <limits>
+#include <type_traits>
+
+#if defined(__AVX__)
+  #include <immintrin.h>
+#endif
+
+namespace naga::rt {
+
+  PackedTriangles::PackedTriangles(
+    const std::vector<std::shared_ptr<Primitive>>& primitives)
+    : m_triangles(primitives.size(), nullptr) {
+    auto size = primitives.size() + width;
+    for (auto& vertex : m_vertices)
+      for (auto& axis : vertex)
+        axis.assign(size, std::numeric_limits<float_t>::quiet_NaN());
+
+    for (std::size_t i = 0; i < primitives.size(); ++i) {
+      auto gp = dynamic_cast<GeometricPrimitive*>(primitives[i].get());
+      if (!gp) continue;
+      auto triangle = dynamic_cast<const Triangle*>(gp->getShape().get());
+      if (!triangle) continue;
+
+      Vec3 p[3];
+      triangle->getPositions(p);
+      for (auto v = 0; v < 3; ++v)
+        for (auto a = 0; a < 3; ++a)
+          m_vertices[v][a][i] = p[v][a];
+      m_triangles[i] = triangle;
+      ++m_nPacked;
+    }
+  }
+
+  bool PackedTriangles::allPacked(std::size_t offset, std::size_t n) const {
+    for (auto i = offset; i < offset + n; ++i)
+      if (!m_triangles[i]) return false;
+    return true;
+  }
+
+  unsigned PackedTriangles::intersectLanes(
+    const WatertightRay& wray,
+    std::size_t offset,
+    float_t tMin,
+    float_t tMax,
+    float_t t[width],
+    float_t b[3][width]) const {
+    const int k[3] = {wray.kx, wray.ky, wray.kz};
+    unsigned hit = 0;
+    // lanes whose edge function is 0 (retested in double precision)
+    unsigned retest = 0;
+
+#if defined(__AVX__)
+    static_assert(std::is_same_v<float_t, float> && width == 8);
+    __m256 sx = _mm256_set1_ps(wray.sx);
+    __m256 sy = _mm256_set1_ps(wray.sy);
+    __m256 p[3][3];
+    for (auto v = 0; v < 3; ++v) {
+      for (auto a = 0; a < 3; ++a) {
+        p[v][a] = _mm256_sub_ps(
+          _mm256_loadu_ps(&m_vertices[v][k[a]][offset]),
+          _mm256_set1_ps(wray.origin[k[a]]));
+      }
+      // shear
+      p[v][0] = _mm256_add_ps(p[v][0], _mm256_mul_ps(sx, p[v][2]));
+      p[v][1] = _mm256_add_ps(p[v][1], _mm256_mul_ps(sy, p[v][2]));
+    }
+
+    // edge functions
+    auto edge = [&](int i, int j) {
+      return _mm256_sub_ps(
+        _mm256_mul_ps(p[i][0], p[j][1]), _mm256_mul_ps(p[i][1], p[j][0]));
+    };
+    __m256 e[3] = {edge(1, 2), edge(2, 0), edge(0, 1)};
+
+    __m256 zero = _mm256_setzero_ps();
+    __m256 neg = zero;
+    __m256 pos = zero;
+    __m256 isZero = zero;
+    for (auto i = 0; i < 3; ++i) {
+      neg = _mm256_or_ps(neg, _mm256_cmp_ps(e[i], zero, _CMP_LT_OQ));
+      pos = _mm256_or_ps(pos, _mm256_cmp_ps(e[i], zero, _CMP_GT_OQ));
+      isZero = _mm256_or_ps(isZero, _mm256_cmp_ps(e[i], zero, _CMP_EQ_OQ));
+    }
+    __m256 det = _mm256_add_ps(_mm256_add_ps(e[0], e[1]), e[2]);
+    __m256 tScaled = _mm256_mul_ps(
+      _mm256_add_ps(
+        _mm256_add_ps(
+          _mm256_mul_ps(e[0], p[0][2]), _mm256_mul_ps(e[1], p[1][2])),
+        _mm256_mul_ps(e[2], p[2][2])),
+      _mm256_set1_ps(wray.sz));
+    __m256 invDet = _mm256_div_ps(_mm256_set1_ps(1), det);
+    __m256 tHit = _mm256_mul_ps(tScaled, invDet);
+
+    __m256 valid = _mm256_andnot_ps(
+      _mm256_and_ps(neg, pos), _mm256_cmp_ps(det, zero, _CMP_NEQ_OQ));
+    valid = _mm256_and_ps(
+      valid, _mm256_cmp_ps(tHit, _mm256_set1_ps(tMin), _CMP_GT_OQ));
+    valid = _mm256_and_ps(
+      valid, _mm256_cmp_ps(tHit, _mm256_set1_ps(tMax), _CMP_LT_OQ));
+
+    _mm256_storeu_ps(t, tHit);
+    for (auto i = 0; i < 3; ++i)
+      _mm256_storeu_ps(b[i], _mm256_mul_ps(e[i], invDet));
+    hit = static_cast<unsigned>(_mm256_movemask_ps(valid));
+    retest = static_cast<unsigned>(_mm256_movemask_ps(isZero));
+#else
+    for (std::size_t l = 0; l < width; ++l) {
+      Vec3 p[3];
+      for (auto v = 0; v < 3; ++v) {
+        for (auto a = 0; a < 3; ++a)
+          p[v][a] = m_vertices[v][k[a]][offset + l] - wray.origin[k[a]];
+        p[v].x += wray.sx * p[v].z;
+        p[v].y += wray.sy * p[v].z;
+      }
+      float_t e0 = p[1].x * p[2].y - p[1].y * p[2].x;
+      float_t e1 = p[2].x * p[0].y - p[2].y * p[0].x;
+      float_t e2 = p[0].x * p[1].y - p[0].y * p[1].x;
+      if (e0 == 0 || e1 == 0 || e2 == 0) {
+        retest |= 1u << l;
+        continue;
+      }
+      if ((e0 < 0 || e1 < 0 || e2 < 0) && (e0 > 0 || e1 > 0 || e2 > 0))
+        continue;
+      float_t det = e0 + e1 + e2;
+      if (det == 0) continue;
+      float_t invDet = 1 / det;
+      t[l] = (e0 * p[0].z + e1 * p[1].z + e2 * p[2].z) * wray.sz * invDet;
+      if (!(t[l] > tMin && t[l] < tMax)) continue;
+      b[0][l] = e0 * invDet;
+      b[1][l] = e1 * invDet;
+      b[2][l] = e2 * invDet;
+      hit |= 1u << l;
+    }
+#endif
+
+    // edge through ray: use scalar test (recomputes edges in double)
+    for (std::size_t l = 0; retest && l < width; ++l) {
+      if (!(retest & (1u << l))) continue;
+      hit &= ~(1u << l);
+      if (offset + l >= m_triangles.size() || !m_triangles[offset + l])
+        continue;
+      float_t bl[3];
+      if (m_triangles[offset + l]->intersectBarycentric(
+            wray, tMin, tMax, &t[l], bl)) {
+        for (auto i = 0; i < 3; ++i)
+          b[i][l] = bl[i];
+        hit |= 1u << l;
+      }
+    }
+    return hit;
+  }
+
+  std::ptrdiff_t PackedTriangles::intersect(
+    const WatertightRay& wray,
+    std::size_t offset,
+    std::size_t n,
+    float_t tMin,
+    float_t tMax,
+    float_t* t,
+    float_t b[3]) const {
+    std::ptrdiff_t index = -1;
+    for (std::size_t g = 0; g < n; g += width) {
+      alignas(32) float_t tl[width];
+      alignas(32) float_t bl[3][width];
+      auto hit = intersectLanes(wray, offset + g, tMin, tMax, tl, bl);
+      if (n - g < width) hit &= (1u << (n - g)) - 1;
+      // closest lane
+      for (std::size_t l = 0; hit && l < width; ++l) {
+        if (!(hit & (1u << l)) || !(tl[l] < tMax)) continue;
+        tMax = tl[l];
+        index = static_cast<std::ptrdiff_t>(offset + g + l);
+        *t = tl[l];
+        for (auto i = 0; i < 3; ++i)
+          b[i] = bl[i][l];
+      }
+    }
+    return index;
+  }
+
+  bool PackedTriangles::intersectP(
+    const WatertightRay& wray,
+    std::size_t offset,
+    std::size_t n,
+    float_t tMin,
+    float_t tMax) const {
+    for (std::size_t g = 0; g < n; g += width) {
+      alignas(32) float_t tl[width];
+      alignas(32) float_t bl[3][width];
+      auto hit = intersectLanes(wray, offset + g, tMin, tMax, tl, bl);
+      if (n - g < width) hit &= (1u << (n - g)) - 1;
+      if (hit) return true;
+    }
+    return false;
+  }
+}
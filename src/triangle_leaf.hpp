@@ -0,0 +1,89 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "memory.hpp"
+#include "primitive.hpp"
+#include "triangle.hpp"
+
+/// \file Packed triangles of BVH leaves
+
+namespace naga::rt {
+
+  /** \brief Vertices of triangles referenced by BVH leaves, packed in
+   * structure-of-arrays form.
+   * Arrays are parallel to the primitives of BVH, so a leaf covering
+   * primitives [offset, offset + n) is tested by loading `width` lanes at
+   * `offset`. Primitives which are not triangles are marked unpacked and
+   * never hit by the kernel.
+   */
+  class PackedTriangles {
+  public:
+    /// Number of triangles tested at once
+    static constexpr std::size_t width = 8;
+
+    /// Ctor
+    PackedTriangles() = default;
+    /// Pack triangles of GeometricPrimitive (others are left unpacked)
+    explicit PackedTriangles(
+      const std::vector<std::shared_ptr<Primitive>>& primitives);
+
+    /// Check if no primitive is packed
+    bool empty() const {
+      return m_nPacked == 0;
+    }
+    /// Check if i-th primitive is packed
+    bool isPacked(std::size_t i) const {
+      return m_triangles[i] != nullptr;
+    }
+    /// Check if all primitives in [offset, offset + n) are packed
+    bool allPacked(std::size_t offset, std::size_t n) const;
+    /// Get triangle of i-th primitive (nullptr if not packed)
+    const Triangle* getTriangle(std::size_t i) const {
+      return m_triangles[i];
+    }
+
+    /** \brief Find closest hit among packed triangles in [offset, offset + n)
+     * with watertight test.
+     * \returns Index of hit primitive (-1 for no hit). Writes ray parameter
+     * and barycentrics of the hit.
+     */
+    std::ptrdiff_t intersect(
+      const WatertightRay& wray,
+      std::size_t offset,
+      std::size_t n,
+      float_t tMin,
+      float_t tMax,
+      float_t* t,
+      float_t b[3]) const;
+    /// Check if any packed triangle in [offset, offset + n) is hit
+    bool intersectP(
+      const WatertightRay& wray,
+      std::size_t offset,
+      std::size_t n,
+      float_t tMin,
+      float_t tMax) const;
+
+  private:
+    /// Test lanes [offset, offset + width) and return mask of hit lanes.
+    /// Writes ray parameters and barycentrics of lanes.
+    unsigned intersectLanes(
+      const WatertightRay& wray,
+      std::size_t offset,
+      float_t tMin,
+      float_t tMax,
+      float_t t[width],
+      float_t b[3][width]) const;
+
+    /// Vertex coordinates `[vertex][axis][primitive]` (NaN when not packed,
+    /// padded by `width`)
+    std::vector<float_t, AlignedAllocator<float_t>> m_vertices[3][3];
+    /// Triangles of primitives
+    std::vector<const Triangle*> m_triangles;
+    /// Number of packed triangles
+    std::size_t m_nPacked = 0;
+  };
+}
@@ -0,0 +1,449 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "image.hpp"
+#include "scene.hpp"
+#include "camera.hpp"
+#include "interaction.hpp"
+#include "memory.hpp"
+#include "parallel.hpp"
+#include "primitive.hpp"
+#include "ray.hpp"
+#include "ray_sort.hpp"
+#include "renderer.hpp"
+
+/// \file Wavefront renderer
+
+namespace naga::rt {
+
+  /// Result of wavefront shading kernel
+  struct WavefrontShadeResult {
+    /// Radiance toward ray origin (not weighted by path throughput)
+    Vec3 emitted = Vec3(0);
+    /// Shadow ray of light sample
+    Ray shadowRay;
+    /// Max ray parameter of shadow ray (0 for no shadow ray)
+    float_t shadowTMax = 0;
+    /// Radiance added when shadow ray is unoccluded (not weighted by path
+    /// throughput)
+    Vec3 shadowRadiance = Vec3(0);
+    /// Continue path?
+    bool continues = false;
+    /// Next ray of path
+    Ray nextRay;
+    /// Factor applied to path throughput
+    Vec3 throughputScale = Vec3(1);
+  };
+
+  /** \brief Wavefront renderer.
+   * Keeps a wave of paths in structure-of-arrays queues and runs each stage
+   * over the whole queue in parallel:
+   *  1. generate camera rays
+   *  2. sort secondary rays by direction and origin (optional)
+   *  3. find closest hits
+   *  4. shade paths grouped by material
+   *  5. trace shadow rays
+   *  6. compact queue to continuing paths (in material order)
+   *
+   * KernelsType should provide:
+   *  - `KernelsType(scene, camera, PixelLength width, PixelLength height)`
+   *  - `const Primitive& getAggregate() const`
+   *  - `Ray generateRay(PixelIndex x, PixelIndex y, std::uint64_t* rng) const`
+   *  - `std::uint32_t getMaterialKey(const Interaction& isec) const`
+   *  - `WavefrontShadeResult shade(const Ray& ray, const Interaction* isec,
+   *      std::uint32_t depth, std::uint64_t* rng, MemoryArena& arena) const`
+   *    (`isec` is nullptr when ray escaped, and rays returned in result
+   *    should keep the time of `ray` for motion blur; BSDFs and BSSRDFs
+   *    should be created in `arena`, which is reset after each call)
+   *  - `Pixel toPixel(const Vec3& radiance) const`
+   */
+  template <class KernelsType>
+  class WavefrontRenderer : public Renderer {
+  public:
+    /// Ctor
+    WavefrontRenderer(
+      const std::shared_ptr<Scene>& scene,
+      const std::shared_ptr<Camera>& camera,
+      std::size_t n_threads,
+      std::size_t samples_per_pixel,
+      std::size_t max_depth,
+      std::size_t wave_size = std::size_t(1) << 20,
+      const RaySortOptions& ray_sort = {})
+      : m_scene{scene}
+      , m_camera{camera}
+      , m_n_threads{std::max<std::size_t>(n_threads, 1)}
+      , m_samples_per_pixel{std::max<std::size_t>(samples_per_pixel, 1)}
+      , m_max_depth{max_depth}
+      , m_wave_size{std::max(wave_size, m_samples_per_pixel)}
+      , m_ray_sort{ray_sort} {}
+
+    /// Render image
+    virtual void render(Image& img) const override {
+      KernelsType kernels(m_scene, m_camera, img.width(), img.height());
+
+      const std::size_t width = img.width();
+      const std::size_t nPixels = width * img.height();
+      const std::size_t spp = m_samples_per_pixel;
+      // pixels per wave (all samples of a pixel are in the same wave)
+      const std::size_t wavePixels = m_wave_size / spp;
+
+      Wave wave;
+      for (std::size_t t = 0; t < m_n_threads; ++t)
+        wave.arenas.emplace_back();
+      for (std::size_t p0 = 0; p0 < nPixels; p0 += wavePixels) {
+        auto p1 = std::min(nPixels, p0 + wavePixels);
+        auto nPaths = (p1 - p0) * spp;
+
+        // 1. generate camera rays
+        wave.paths.resize(nPaths);
+        wave.radiance.assign(nPaths, Vec3(0));
+        parallelForChunks(
+          nPaths, m_n_threads,
+          [&](std::size_t, std::size_t begin, std::size_t end) {
+            for (auto i = begin; i < end; ++i) {
+              auto pixel = p0 + i / spp;
+              auto& q = wave.paths;
+              q.rng[i] = seed(pixel * spp + i % spp);
+              q.setRay(
+                i, kernels.generateRay(
+                     PixelIndex(pixel % width), PixelIndex(pixel / width),
+                     &q.rng[i]));
+              q.path[i] = static_cast<std::uint32_t>(i);
+              q.depth[i] = 0;
+              for (auto a = 0; a < 3; ++a)
+                q.throughput[a][i] = 1;
+            }
+          });
+
+        for (std::size_t bounce = 0; wave.paths.size() > 0; ++bounce) {
+          // camera rays are already coherent
+          if (bounce > 0 && m_ray_sort.enabled) sortStage(kernels, wave);
+          intersectStage(kernels, wave);
+          shadeStage(kernels, wave);
+          shadowStage(kernels, wave);
+          compactStage(wave);
+        }
+
+        // accumulate samples of pixels
+        parallelForChunks(
+          p1 - p0, m_n_threads,
+          [&](std::size_t, std::size_t begin, std::size_t end) {
+            for (auto i = begin; i < end; ++i) {
+              Vec3 sum(0);
+              for (std::size_t s = 0; s < spp; ++s)
+                sum += wave.radiance[i * spp + s];
+              auto pixel = p0 + i;
+              img(PixelIndex(pixel % width), PixelIndex(pixel / width)) =
+                kernels.toPixel(sum / static_cast<float_t>(spp));
+            }
+          });
+      }
+    }
+
+    /// Dtor
+    virtual ~WavefrontRenderer() {}
+
+    /** \brief Seed random number generator of sample (splitmix64 of sample
+     * index `pixel * samples_per_pixel + sample`).
+     * Renderers which trace paths from the same seeds render the same image.
+     */
+    static std::uint64_t seed(std::uint64_t i) {
+      auto z = (i + 1) * 0x9e3779b97f4a7c15ull;
+      z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+      z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+      return z ^ (z >> 31);
+    }
+
+  private:
+    /// Path states in structure-of-arrays form
+    struct PathQueue {
+      /// Ray origins (per axis)
+      std::vector<float_t> origin[3];
+      /// Ray directions (per axis)
+      std::vector<float_t> dir[3];
+      /// Ray times
+      std::vector<float_t> time;
+      /// Path throughputs (per channel)
+      std::vector<float_t> throughput[3];
+      /// Index of path in wave (radiance slot)
+      std::vector<std::uint32_t> path;
+      /// Number of bounces
+      std::vector<std::uint32_t> depth;
+      /// Random number generator states
+      std::vector<std::uint64_t> rng;
+
+      /// Resize queue
+      void resize(std::size_t n) {
+        for (auto a = 0; a < 3; ++a) {
+          origin[a].resize(n);
+          dir[a].resize(n);
+          throughput[a].resize(n);
+        }
+        time.resize(n);
+        path.resize(n);
+        depth.resize(n);
+        rng.resize(n);
+      }
+      /// Get number of paths
+      std::size_t size() const {
+        return path.size();
+      }
+      /// Get ray of i-th path
+      Ray getRay(std::size_t i) const {
+        return Ray(
+          Vec3(origin[0][i], origin[1][i], origin[2][i]),
+          Vec3(dir[0][i], dir[1][i], dir[2][i]), time[i]);
+      }
+      /// Set ray of i-th path
+      void setRay(std::size_t i, const Ray& ray) {
+        for (auto a = 0; a < 3; ++a) {
+          origin[a][i] = ray.origin()[a];
+          dir[a][i] = ray.dir()[a];
+        }
+        time[i] = ray.time();
+      }
+      /// Get throughput of i-th path
+      Vec3 getThroughput(std::size_t i) const {
+        return {throughput[0][i], throughput[1][i], throughput[2][i]};
+      }
+      /// Copy i-th path of `src` into j-th path
+      void copy(const PathQueue& src, std::size_t i, std::size_t j) {
+        for (auto a = 0; a < 3; ++a) {
+          origin[a][j] = src.origin[a][i];
+          dir[a][j] = src.dir[a][i];
+          throughput[a][j] = src.throughput[a][i];
+        }
+        time[j] = src.time[i];
+        path[j] = src.path[i];
+        depth[j] = src.depth[i];
+        rng[j] = src.rng[i];
+      }
+    };
+
+    /// Shadow rays in structure-of-arrays form (one slot per path)
+    struct ShadowQueue {
+      /// Ray origins (per axis)
+      std::vector<float_t> origin[3];
+      /// Ray directions (per axis)
+      std::vector<float_t> dir[3];
+      /// Max ray parameters (0 for empty slot)
+      std::vector<float_t> tMax;
+      /// Ray times
+      std::vector<float_t> time;
+      /// Radiance weighted by path throughput (per channel)
+      std::vector<float_t> radiance[3];
+
+      /// Resize queue
+      void resize(std::size_t n) {
+        for (auto a = 0; a < 3; ++a) {
+          origin[a].resize(n);
+          dir[a].resize(n);
+          radiance[a].resize(n);
+        }
+        tMax.resize(n);
+        time.resize(n);
+      }
+    };
+
+    /// State of wave
+    struct Wave {
+      /// Active paths
+      PathQueue paths;
+      /// Compaction target
+      PathQueue next;
+      /// Shadow rays
+      ShadowQueue shadows;
+      /// Closest hits
+      std::vector<Interaction> isecs;
+      /// Hit flags
+      std::vector<char> hits;
+      /// Paths which continue after shading
+      std::vector<char> continues;
+      /// Material keys of paths (misses have largest key)
+      std::vector<std::pair<std::uint32_t, std::uint32_t>> order;
+      /// Ray sort keys of paths
+      std::vector<std::pair<std::uint32_t, std::uint32_t>> keys;
+      /// Scratch buffer of material sort
+      std::vector<std::pair<std::uint32_t, std::uint32_t>> sortTemp;
+      /// Radiance of paths
+      std::vector<Vec3> radiance;
+      /// Memory arenas of shading threads
+      std::vector<MemoryArena> arenas;
+    };
+
+    /// 2. reorder paths by sort key of their rays, batch by batch
+    void sortStage(const KernelsType& kernels, Wave& wave) const {
+      using Key = std::pair<std::uint32_t, std::uint32_t>;
+      auto n = wave.paths.size();
+      auto bounds = kernels.getAggregate().getBoundingBox();
+      auto bits = std::clamp(m_ray_sort.originBits, 1, maxRayOriginBits);
+      auto batchSize = m_ray_sort.batchSize ? m_ray_sort.batchSize : n;
+      auto nBatches = (n + batchSize - 1) / batchSize;
+
+      wave.keys.resize(n);
+      wave.next.resize(n);
+      parallelFor(nBatches, m_n_threads, [&](std::size_t b) {
+        auto begin = b * batchSize;
+        auto end = std::min(n, begin + batchSize);
+        const auto& q = wave.paths;
+        for (auto i = begin; i < end; ++i) {
+          auto key = getRaySortKey(
+            Vec3(q.origin[0][i], q.origin[1][i], q.origin[2][i]),
+            Vec3(q.dir[0][i], q.dir[1][i], q.dir[2][i]), bounds, bits);
+          wave.keys[i] = {key, static_cast<std::uint32_t>(i)};
+        }
+        std::vector<Key> temp;
+        sortRayKeys(&wave.keys[begin], end - begin, 3 * bits + 3, temp);
+        for (auto i = begin; i < end; ++i)
+          wave.next.copy(q, wave.keys[i].second, i);
+      });
+      std::swap(wave.paths, wave.next);
+    }
+
+    /// 3. find closest hits and material keys
+    void intersectStage(const KernelsType& kernels, Wave& wave) const {
+      constexpr auto missKey = std::numeric_limits<std::uint32_t>::max();
+      auto n = wave.paths.size();
+      wave.isecs.resize(n);
+      wave.hits.resize(n);
+      wave.order.resize(n);
+      const auto& aggregate = kernels.getAggregate();
+      std::vector<std::uint32_t> maxKeys(m_n_threads, 0);
+      parallelForChunks(
+        n, m_n_threads, [&](std::size_t c, std::size_t begin, std::size_t end) {
+          for (auto i = begin; i < end; ++i) {
+            wave.hits[i] = aggregate.intersect(
+              wave.paths.getRay(i), 0, std::numeric_limits<float_t>::infinity(),
+              &wave.isecs[i]);
+            auto key =
+              wave.hits[i] ? kernels.getMaterialKey(wave.isecs[i]) : missKey;
+            if (wave.hits[i]) maxKeys[c] = std::max(maxKeys[c], key);
+            wave.order[i] = {key, static_cast<std::uint32_t>(i)};
+          }
+        });
+      // group by material, sorting only bits of used keys. lower bits of
+      // miss key are all set, so misses stay after hits.
+      std::uint64_t maxKey = *std::max_element(maxKeys.begin(), maxKeys.end());
+      int nBits = 1;
+      while (nBits < 32 && (std::uint64_t(1) << nBits) <= maxKey + 1)
+        ++nBits;
+      sortRayKeys(wave.order.data(), n, nBits, wave.sortTemp, m_n_threads);
+    }
+
+    /// 4. shade paths in material order
+    void shadeStage(const KernelsType& kernels, Wave& wave) const {
+      auto n = wave.paths.size();
+      wave.shadows.resize(n);
+      wave.continues.resize(n);
+      parallelForChunks(
+        n, m_n_threads, [&](std::size_t c, std::size_t begin, std::size_t end) {
+          auto& q = wave.paths;
+          auto& arena = wave.arenas[c];
+          for (auto k = begin; k < end; ++k) {
+            auto i = wave.order[k].second;
+            auto throughput = q.getThroughput(i);
+            auto r = kernels.shade(
+              q.getRay(i), wave.hits[i] ? &wave.isecs[i] : nullptr, q.depth[i],
+              &q.rng[i], arena);
+            // result holds no pointers into arena
+            arena.reset();
+
+            wave.radiance[q.path[i]] += throughput * r.emitted;
+
+            // shadow ray
+            auto& s = wave.shadows;
+            s.tMax[i] = r.shadowTMax;
+            if (r.shadowTMax > 0) {
+              auto radiance = throughput * r.shadowRadiance;
+              for (auto a = 0; a < 3; ++a) {
+                s.origin[a][i] = r.shadowRay.origin()[a];
+                s.dir[a][i] = r.shadowRay.dir()[a];
+                s.radiance[a][i] = radiance[a];
+              }
+              s.time[i] = r.shadowRay.time();
+            }
+
+            // continuation
+            wave.continues[i] = r.continues && q.depth[i] + 1 <= m_max_depth;
+            if (wave.continues[i]) {
+              q.setRay(i, r.nextRay);
+              throughput = throughput * r.throughputScale;
+              for (auto a = 0; a < 3; ++a)
+                q.throughput[a][i] = throughput[a];
+              ++q.depth[i];
+            }
+          }
+        });
+    }
+
+    /// 5. trace shadow rays (any hit)
+    void shadowStage(const KernelsType& kernels, Wave& wave) const {
+      const auto& aggregate = kernels.getAggregate();
+      parallelForChunks(
+        wave.paths.size(), m_n_threads,
+        [&](std::size_t, std::size_t begin, std::size_t end) {
+          const auto& s = wave.shadows;
+          for (auto i = begin; i < end; ++i) {
+            if (!(s.tMax[i] > 0)) continue;
+            Ray ray(
+              Vec3(s.origin[0][i], s.origin[1][i], s.origin[2][i]),
+              Vec3(s.dir[0][i], s.dir[1][i], s.dir[2][i]), s.time[i]);
+            if (aggregate.intersectP(ray, 0, s.tMax[i])) continue;
+            wave.radiance[wave.paths.path[i]] +=
+              Vec3(s.radiance[0][i], s.radiance[1][i], s.radiance[2][i]);
+          }
+        });
+    }
+
+    /// 6. compact continuing paths into next queue in material order
+    void compactStage(Wave& wave) const {
+      auto n = wave.paths.size();
+      std::vector<std::size_t> offsets(m_n_threads + 1, 0);
+
+      // count per chunk
+      parallelForChunks(
+        n, m_n_threads, [&](std::size_t c, std::size_t begin, std::size_t end) {
+          std::size_t count = 0;
+          for (auto k = begin; k < end; ++k)
+            count += wave.continues[wave.order[k].second];
+          offsets[c + 1] = count;
+        });
+      for (std::size_t c = 0; c < m_n_threads; ++c)
+        offsets[c + 1] += offsets[c];
+
+      // scatter
+      wave.next.resize(offsets.back());
+      parallelForChunks(
+        n, m_n_threads, [&](std::size_t c, std::size_t begin, std::size_t end) {
+          auto j = offsets[c];
+          for (auto k = begin; k < end; ++k) {
+            auto i = wave.order[k].second;
+            if (wave.continues[i]) wave.next.copy(wave.paths, i, j++);
+          }
+        });
+      std::swap(wave.paths, wave.next);
+    }
+
+  private:
+    /// Scene
+    std::shared_ptr<Scene> m_scene;
+    /// Camera
+    std::shared_ptr<Camera> m_camera;
+    /// Number of thread
+    std::size_t m_n_threads;
+    /// Number of samples per pixel
+    std::size_t m_samples_per_pixel;
+    /// Max number of bounces
+    std::size_t m_max_depth;
+    /// Max number of paths in flight
+    std::size_t m_wave_size;
+    /// Options of secondary ray sorting
+    RaySortOptions m_ray_sort;
+  };
+}
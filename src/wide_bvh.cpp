@@ -0,0 +1,326 @@
+#include "wide_bvh.hpp"
+
+#include <array>
+#include <cassert>
+#include <limits>
+#include <type_traits>
+
+#if defined(__SSE__) || defined(_M_X64)
+  #include <immintrin.h>
+  #define RT_WIDE_BVH_SSE
+#endif
+
+namespace naga::rt {
+
+  namespace {
+
+    /// Stack entry of wide BVH traversal
+    struct StackItem {
+      /// Node index or offset of first primitive
+      std::uint32_t index;
+      /// Number of primitives (0 for interior node)
+      std::uint32_t nPrimitives;
+      /// Entry distance
+      float_t tNear;
+    };
+
+    /** \brief Test ray against all children of wide node.
+     * Near/far planes are selected by sign of direction, so no per-axis
+     * swap is needed. Returns bit mask of hit children and writes entry
+     * distances to `tNear`.
+     */
+    template <std::size_t Width>
+    unsigned intersectChildren(
+      const WideBVHNode<Width>& node,
+      const Vec3& origin,
+      const Vec3& invDir,
+      const int dirIsNeg[3],
+      float_t tMin,
+      float_t tMax,
+      float_t* tNear) {
+
+      const float_t* nearPlane[3];
+      const float_t* farPlane[3];
+      for (auto a = 0; a < 3; ++a) {
+        nearPlane[a] = dirIsNeg[a] ? node.boundsMax[a] : node.boundsMin[a];
+        farPlane[a] = dirIsNeg[a] ? node.boundsMin[a] : node.boundsMax[a];
+      }
+
+#if defined(__AVX__)
+      if constexpr (Width == 8) {
+        static_assert(std::is_same_v<float_t, float>);
+        __m256 tEnter = _mm256_set1_ps(tMin);
+        __m256 tExit = _mm256_set1_ps(tMax);
+        for (auto a = 0; a < 3; ++a) {
+          __m256 o = _mm256_set1_ps(origin[a]);
+          __m256 inv = _mm256_set1_ps(invDir[a]);
+          __m256 t0 = _mm256_mul_ps(
+            _mm256_sub_ps(_mm256_load_ps(nearPlane[a]), o), inv);
+          __m256 t1 = _mm256_mul_ps(
+            _mm256_sub_ps(_mm256_load_ps(farPlane[a]), o), inv);
+          t1 = _mm256_mul_ps(t1, _mm256_set1_ps(slabFarScale));
+          tEnter = _mm256_max_ps(t0, tEnter);
+          tExit = _mm256_min_ps(t1, tExit);
+        }
+        _mm256_storeu_ps(tNear, tEnter);
+        return static_cast<unsigned>(
+          _mm256_movemask_ps(_mm256_cmp_ps(tEnter, tExit, _CMP_LE_OQ)));
+      }
+#endif
+
+#if defined(RT_WIDE_BVH_SSE)
+      static_assert(std::is_same_v<float_t, float>);
+      unsigned mask = 0;
+      for (std::size_t g = 0; g < Width; g += 4) {
+        __m128 tEnter = _mm_set1_ps(tMin);
+        __m128 tExit = _mm_set1_ps(tMax);
+        for (auto a = 0; a < 3; ++a) {
+          __m128 o = _mm_set1_ps(origin[a]);
+          __m128 inv = _mm_set1_ps(invDir[a]);
+          __m128 t0 =
+            _mm_mul_ps(_mm_sub_ps(_mm_load_ps(nearPlane[a] + g), o), inv);
+          __m128 t1 =
+            _mm_mul_ps(_mm_sub_ps(_mm_load_ps(farPlane[a] + g), o), inv);
+          t1 = _mm_mul_ps(t1, _mm_set1_ps(slabFarScale));
+          tEnter = _mm_max_ps(t0, tEnter);
+          tExit = _mm_min_ps(t1, tExit);
+        }
+        _mm_storeu_ps(tNear + g, tEnter);
+        mask |= static_cast<unsigned>(
+                  _mm_movemask_ps(_mm_cmple_ps(tEnter, tExit)))
+                << g;
+      }
+      return mask;
+#else
+      unsigned mask = 0;
+      for (std::size_t i = 0; i < Width; ++i) {
+        float_t t0 = tMin;
+        float_t t1 = tMax;
+        for (auto a = 0; a < 3; ++a) {
+          float_t n = (nearPlane[a][i] - origin[a]) * invDir[a];
+          float_t f =
+            (farPlane[a][i] - origin[a]) * invDir[a] * slabFarScale;
+          t0 = n > t0 ? n : t0;
+          t1 = f < t1 ? f : t1;
+        }
+        tNear[i] = t0;
+        if (t0 <= t1) mask |= 1u << i;
+      }
+      return mask;
+#endif
+    }
+  } // namespace
+
+  template <std::size_t Width>
+  WideBVHAccel<Width>::WideBVHAccel(const BVHAccel& bvh)
+    : m_bounds{bvh.getBoundingBox()}, m_primitives{bvh.getPrimitives()} {
+    // quantized nodes can not be collapsed
+    assert(bvh.getOptions().encoding == BVHNodeEncoding::Float32);
+    const auto& nodes = bvh.getNodes();
+    if (nodes.empty()) return;
+
+    if (nodes[0].nPrimitives > 0) {
+      // single leaf: wrap into one wide node
+      auto& node = m_nodes.emplace_back();
+      for (std::size_t i = 0; i < Width; ++i) {
+        for (auto a = 0; a < 3; ++a) {
+          node.boundsMin[a][i] = std::numeric_limits<float_t>::infinity();
+          node.boundsMax[a][i] = -std::numeric_limits<float_t>::infinity();
+        }
+        node.children[i] = 0;
+        node.nPrimitives[i] = 0;
+      }
+      for (auto a = 0; a < 3; ++a) {
+        node.boundsMin[a][0] = nodes[0].bounds.min()[a];
+        node.boundsMax[a][0] = nodes[0].bounds.max()[a];
+      }
+      node.children[0] = nodes[0].primitivesOffset;
+      node.nPrimitives[0] = nodes[0].nPrimitives;
+      return;
+    }
+
+    m_nodes.reserve(nodes.size() / (Width / 2));
+    collapse(bvh, 0);
+  }
+
+  template <std::size_t Width>
+  std::uint32_t WideBVHAccel<Width>::collapse(
+    const BVHAccel& bvh, std::uint32_t index) {
+    const auto& nodes = bvh.getNodes();
+
+    // open interior children with largest surface area until full
+    std::array<std::uint32_t, Width> slots;
+    std::size_t nSlots = 2;
+    slots[0] = index + 1;
+    slots[1] = nodes[index].secondChildOffset;
+    while (nSlots < Width) {
+      std::size_t best = Width;
+      float_t bestArea = -1;
+      for (std::size_t i = 0; i < nSlots; ++i) {
+        const auto& n = nodes[slots[i]];
+        if (n.nPrimitives == 0 && n.bounds.surfaceArea() > bestArea) {
+          best = i;
+          bestArea = n.bounds.surfaceArea();
+        }
+      }
+      if (best == Width) break;
+      auto c = slots[best];
+      slots[best] = c + 1;
+      slots[nSlots++] = nodes[c].secondChildOffset;
+    }
+
+    auto nodeIndex = static_cast<std::uint32_t>(m_nodes.size());
+    m_nodes.emplace_back();
+
+    for (std::size_t i = 0; i < Width; ++i) {
+      // m_nodes may be reallocated while collapsing children
+      std::uint32_t child = 0;
+      std::uint16_t nPrimitives = 0;
+      Bounds3 b;
+      if (i < nSlots) {
+        const auto& n = nodes[slots[i]];
+        b = n.bounds;
+        if (n.nPrimitives > 0) {
+          child = n.primitivesOffset;
+          nPrimitives = n.nPrimitives;
+        } else {
+          child = collapse(bvh, slots[i]);
+        }
+      }
+      auto& node = m_nodes[nodeIndex];
+      for (auto a = 0; a < 3; ++a) {
+        node.boundsMin[a][i] = i < nSlots
+                                 ? b.min()[a]
+                                 : std::numeric_limits<float_t>::infinity();
+        node.boundsMax[a][i] = i < nSlots
+                                 ? b.max()[a]
+                                 : -std::numeric_limits<float_t>::infinity();
+      }
+      node.children[i] = child;
+      node.nPrimitives[i] = nPrimitives;
+    }
+    return nodeIndex;
+  }
+
+  template <std::size_t Width>
+  bool WideBVHAccel<Width>::intersect(
+    const Ray& ray, float_t tMin, float_t tMax, Interaction* isec) const {
+    HitRecord hit;
+    if (!intersect(ray, tMin, tMax, &hit)) return false;
+    *isec = getInteraction(ray, hit);
+    return true;
+  }
+
+  template <std::size_t Width>
+  Interaction WideBVHAccel<Width>::getInteraction(
+    const Ray& ray, const HitRecord& hit) const {
+    HitRecord h;
+    auto i = getChildIndex(hit, &h);
+    return m_primitives[i]->getInteraction(ray, h);
+  }
+
+  template <std::size_t Width>
+  bool WideBVHAccel<Width>::intersect(
+    const Ray& ray, float_t tMin, float_t tMax, HitRecord* hit) const {
+    if (m_nodes.empty()) return false;
+
+    Vec3 invDir = Vec3(1) / ray.dir();
+    int dirIsNeg[3] = {invDir.x < 0, invDir.y < 0, invDir.z < 0};
+
+    bool found = false;
+    // nodes to visit (wide nodes are at most as deep as binary nodes)
+    StackItem toVisit[BVHAccel::maxDepth * Width];
+    std::size_t toVisitOffset = 0;
+    toVisit[toVisitOffset++] = {0, 0, tMin};
+
+    while (toVisitOffset != 0) {
+      auto item = toVisit[--toVisitOffset];
+      // closer hit was found after this item was pushed
+      if (item.tNear > tMax) continue;
+
+      if (item.nPrimitives > 0) {
+        // leaf
+        for (std::size_t i = 0; i < item.nPrimitives; ++i) {
+          auto index = static_cast<std::uint32_t>(item.index + i);
+          if (intersectChild(
+                *m_primitives[index], index, ray, tMin, tMax, hit)) {
+            found = true;
+            tMax = hit->t;
+          }
+        }
+        continue;
+      }
+
+      const auto& node = m_nodes[item.index];
+      alignas(32) float_t tNear[Width];
+      unsigned mask = intersectChildren(
+        node, ray.origin(), invDir, dirIsNeg, tMin, tMax, tNear);
+
+      // sort hit children from far to near, so nearest is popped first
+      std::size_t nHits = 0;
+      StackItem hits[Width];
+      for (std::size_t i = 0; i < Width; ++i) {
+        if (!(mask & (1u << i))) continue;
+        StackItem h = {node.children[i], node.nPrimitives[i], tNear[i]};
+        auto j = nHits++;
+        for (; j > 0 && hits[j - 1].tNear < h.tNear; --j)
+          hits[j] = hits[j - 1];
+        hits[j] = h;
+      }
+      assert(toVisitOffset + nHits <= BVHAccel::maxDepth * Width);
+      for (std::size_t i = 0; i < nHits; ++i)
+        toVisit[toVisitOffset++] = hits[i];
+    }
+    return found;
+  }
+
+  template <std::size_t Width>
+  bool WideBVHAccel<Width>::intersectP(
+    const Ray& ray, float_t tMin, float_t tMax) const {
+    if (m_nodes.empty()) return false;
+
+    Vec3 invDir = Vec3(1) / ray.dir();
+    int dirIsNeg[3] = {invDir.x < 0, invDir.y < 0, invDir.z < 0};
+
+    // nodes to visit (no ordering, tNear is unused)
+    StackItem toVisit[BVHAccel::maxDepth * Width];
+    std::size_t toVisitOffset = 0;
+    toVisit[toVisitOffset++] = {0, 0, tMin};
+
+    while (toVisitOffset != 0) {
+      auto item = toVisit[--toVisitOffset];
+
+      if (item.nPrimitives > 0) {
+        // leaf: stop at first hit
+        for (std::size_t i = 0; i < item.nPrimitives; ++i)
+          if (m_primitives[item.index + i]->intersectP(ray, tMin, tMax))
+            return true;
+        continue;
+      }
+
+      const auto& node = m_nodes[item.index];
+      alignas(32) float_t tNear[Width];
+      unsigned mask = intersectChildren(
+        node, ray.origin(), invDir, dirIsNeg, tMin, tMax, tNear);
+      for (std::size_t i = 0; i < Width; ++i) {
+        if (mask & (1u << i)) {
+          assert(toVisitOffset < BVHAccel::maxDepth * Width);
+          toVisit[toVisitOffset++] = {
+            node.children[i], node.nPrimitives[i], tNear[i]};
+        }
+      }
+    }
+    return false;
+  }
+
+  template <std::size_t Width>
+  Bounds3 WideBVHAccel<Width>::getBoundingBox() const {
+    return m_bounds;
+  }
+
+  template <std::size_t Width>
+  WideBVHAccel<Width>::~WideBVHAccel() {}
+
+  template class WideBVHAccel<4>;
+  template class WideBVHAccel<8>;
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "bvh.hpp"
+#include "memory.hpp"
+
+/// \file Wide (4/8-ary) bounding volume hierarchy
+
+namespace naga::rt {
+
+  /** \brief Wide BVH node.
+   * Child boxes are stored in structure-of-arrays form so that a ray can be
+   * tested against all children with one SIMD instruction sequence.
+   * Unused child slots have empty (inverted) bounds and never hit.
+   */
+  template <std::size_t Width>
+  struct alignas(cacheLineSize) WideBVHNode {
+    static_assert(Width % 4 == 0, "Width should be multiple of 4");
+    /// Min corner of child bounds (per axis)
+    float_t boundsMin[3][Width];
+    /// Max corner of child bounds (per axis)
+    float_t boundsMax[3][Width];
+    /// (interior child) Node index, (leaf child) Offset of first primitive
+    std::uint32_t children[Width];
+    /// Number of primitives (0 for interior child)
+    std::uint16_t nPrimitives[Width];
+  };
+
+  /** \brief Wide BVH aggregate.
+   * Built by collapsing a binary BVHAccel with Float32 nodes. Quantized
+   * BVHs do not keep float bounds of nodes and can not be collapsed.
+   */
+  template <std::size_t Width>
+  class WideBVHAccel : public Aggregate {
+  public:
+    /// Ctor (`bvh` should use BVHNodeEncoding::Float32)
+    explicit WideBVHAccel(const BVHAccel& bvh);
+
+    /// Calculate Ray-BVH intersection (closest hit)
+    virtual bool intersect(
+      const Ray& ray,
+      float_t tMin,
+      float_t tMax,
+      Interaction* isec) const override;
+    /// Find closest hit without building interaction
+    virtual bool intersect(
+      const Ray& ray,
+      float_t tMin,
+      float_t tMax,
+      HitRecord* hit) const override;
+    /// Build interaction of hit
+    virtual Interaction
+      getInteraction(const Ray& ray, const HitRecord& hit) const override;
+    /// Check if ray hits any primitive (occlusion test, any hit)
+    virtual bool intersectP(
+      const Ray& ray, float_t tMin, float_t tMax) const override;
+    /// Get bounding box
+    virtual Bounds3 getBoundingBox() const override;
+
+    /// Get nodes
+    const auto& getNodes() const {
+      return m_nodes;
+    }
+
+    /// Dtor
+    virtual ~WideBVHAccel() override;
+
+  private:
+    /// Collapse binary subtree rooted at `index` into wide node
+    std::uint32_t collapse(const BVHAccel& bvh, std::uint32_t index);
+
+  private:
+    /// Bounding box
+    Bounds3 m_bounds;
+    /// Primitives
+    std::vector<std::shared_ptr<Primitive>> m_primitives;
+    /// Nodes
+    std::vector<WideBVHNode<Width>, AlignedAllocator<WideBVHNode<Width>>>
+      m_nodes;
+  };
+
+  /// 4-wide BVH
+  using QBVHAccel = WideBVHAccel<4>;
+  /// 8-wide BVH
+  using OBVHAccel = WideBVHAccel<8>;
+
+  extern template class WideBVHAccel<4>;
+  extern template class WideBVHAccel<8>;
+}
@@ -0,0 +1,152 @@
+#include "bvh.hpp"
+#include "test.hpp"
+#include "test_scene.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace naga::rt;
+
+/// Check if points agree (relative to their distance from origin)
+bool samePoint(const Vec3& a, const Vec3& b) {
+  return length(a - b) <= 1e-3f * std::max<float_t>(1, length(a));
+}
+
+/// Get normalized geometric normal of surface interaction
+Vec3 getNormal(const Interaction& isec) {
+  auto& si = std::get<SurfaceInteraction>(isec);
+  return normalize(si.surfaceGeometry().normal);
+}
+
+/// Create primitives of triangles of mesh transformed by `transform`
+std::vector<std::shared_ptr<Primitive>>
+  transformMesh(const TriangleMesh& mesh, const Transform& transform) {
+  std::vector<Vec3> positions;
+  for (auto& p : mesh.getPositions())
+    positions.push_back(transform.transformPoint(p));
+  auto indices = mesh.getIndices();
+  std::vector<std::shared_ptr<Primitive>> primitives;
+  for (auto& t : createTriangles(std::make_shared<TriangleMesh>(
+         Transform(),
+         std::vector<std::uint32_t>(indices.begin(), indices.end()),
+         std::move(positions))))
+    primitives.push_back(test_scene::makePrimitive(t));
+  return primitives;
+}
+
+/// Compose translation, rotation (about fixed axis) and scale
+Transform
+  keyframe(const Vec3& translation, float_t angle, const Vec3& scale) {
+  return Transform(
+    Transform::translate(translation).getMatrix() *
+    Transform::rotate(Radian(angle), normalize(Vec3(1, 2, 3))).getMatrix() *
+    Transform::scale(scale).getMatrix());
+}
+
+int main() {
+  test::test_name = "AnimatedPrimitive";
+
+  auto mesh = test_scene::randomMesh(200, 53);
+  std::vector<std::shared_ptr<Primitive>> local;
+  for (auto& t : createTriangles(mesh))
+    local.push_back(test_scene::makePrimitive(t));
+  std::shared_ptr<Primitive> object = std::make_shared<BVHAccel>(local);
+
+  // translated, rotated, scaled, and all at once
+  std::pair<std::string, AnimatedTransform> animations[] = {
+    {"translation",
+     AnimatedTransform(
+       Transform(), 0, Transform::translate(Vec3(3, -2, 1)), 1)},
+    {"rotation",
+     AnimatedTransform(
+       Transform(), 0, keyframe(Vec3(0), 2.5f, Vec3(1)), 1)},
+    {"scale",
+     AnimatedTransform(
+       keyframe(Vec3(0), 0, Vec3(0.5f, 1, 1)), 0,
+       keyframe(Vec3(0), 0, Vec3(1.5f, 0.7f, 1.2f)), 1)},
+    {"all",
+     AnimatedTransform(
+       keyframe(Vec3(-2, 0, 1), -0.5f, Vec3(0.8f)), 0,
+       keyframe(Vec3(2, 1, -1), 1.2f, Vec3(1.3f, 0.6f, 1)), 1)}};
+
+  std::mt19937 rng(54);
+  std::vector<Ray> rays;
+  for (auto i = 0; i < 2000; ++i)
+    rays.push_back(test_scene::randomRay(rng));
+
+  // instances alone, and all instances in one BVH
+  std::vector<std::shared_ptr<Primitive>> instances;
+  for (auto& [name, animation] : animations)
+    instances.push_back(std::make_shared<AnimatedPrimitive>(
+      object, std::make_shared<const AnimatedTransform>(animation)));
+  auto scene = std::make_shared<BVHAccel>(instances);
+
+  // times in shutter interval, and outside of it (clamped)
+  for (float_t time : {0.f, 0.3f, 0.5f, 0.77f, 1.f, -0.5f, 1.5f}) {
+    std::vector<std::shared_ptr<Primitive>> world;
+    for (std::size_t a = 0; a <= instances.size(); ++a) {
+      // last round tests scene of all instances
+      bool all = a == instances.size();
+      std::shared_ptr<Primitive> instance = all ? scene : instances[a];
+      auto name = (all ? std::string("scene") : animations[a].first) +
+                  " at " + std::to_string(time);
+      if (!all) {
+        auto transformed = transformMesh(
+          *mesh, animations[a].second.interpolate(time));
+        world.insert(world.end(), transformed.begin(), transformed.end());
+      }
+      auto expected = all ? world : std::vector<std::shared_ptr<Primitive>>(
+                                      world.end() - local.size(), world.end());
+
+      std::size_t nHits = 0, nMismatches = 0;
+      for (auto r : rays) {
+        Ray ray(r.origin(), r.dir(), time);
+        float_t t;
+        bool hit = test_scene::intersect(expected, ray, 0, 100, &t);
+        nHits += hit;
+
+        Interaction isec;
+        bool hit0 = instance->intersect(ray, 0, 100, &isec);
+        HitRecord record;
+        bool hit1 = instance->intersect(ray, 0, 100, &record);
+        if (
+          !test_scene::sameHit(hit, t, hit0, hit0 ? getRayParam(isec) : 0) ||
+          !test_scene::sameHit(hit, t, hit1, record.t)) {
+          ++nMismatches;
+          continue;
+        }
+
+        // occlusion before and after the closest hit
+        for (float_t tMax : {hit ? t * 0.99f : 100, hit ? t * 1.01f : 50}) {
+          nMismatches += instance->intersectP(ray, 0, tMax) !=
+                         test_scene::intersectP(expected, ray, 0, tMax);
+        }
+        if (!hit) continue;
+
+        // position and normal of hit, from both paths
+        Interaction reference;
+        for (auto& p : expected)
+          if (p->intersect(ray, 0, t * 1.0001f, &reference)) break;
+        auto p = position(ray, t);
+        auto n = getNormal(reference);
+        for (auto& found : {isec, instance->getInteraction(ray, record)}) {
+          auto& si = std::get<SurfaceInteraction>(found);
+          nMismatches +=
+            !samePoint(si.pos(), p) || dot(getNormal(found), n) < 0.999f;
+        }
+      }
+      rt_check(nHits > 50, name + ": too few hits");
+      rt_check(
+        nMismatches == 0,
+        name + ": " + std::to_string(nMismatches) + " mismatches of " +
+          std::to_string(nHits) + " hits");
+    }
+  }
+
+  test::summarize();
+  return test::messages.empty() ? 0 : 1;
+}
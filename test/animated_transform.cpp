@@ -0,0 +1,133 @@
+#include "animated_transform.hpp"
+#include "test.hpp"
+
+#include <random>
+#include <string>
+
+using namespace naga::rt;
+
+/// Check if point is in bounds, up to rounding
+bool inside(const Bounds3& b, const Vec3& p) {
+  for (auto i = 0; i < 3; ++i) {
+    auto eps = 1e-4f * std::max<float_t>(
+                         {1, std::abs(b.min()[i]), std::abs(b.max()[i])});
+    if (!(p[i] >= b.min()[i] - eps && p[i] <= b.max()[i] + eps)) return false;
+  }
+  return true;
+}
+
+/// Check if matrices agree up to rounding
+bool near(const Mat4& a, const Mat4& b) {
+  for (auto c = 0; c < 4; ++c)
+    for (auto r = 0; r < 4; ++r)
+      if (!(std::abs(a[c][r] - b[c][r]) <=
+            1e-3f * std::max<float_t>(1, std::abs(b[c][r]))))
+        return false;
+  return true;
+}
+
+/// Create random keyframe (scale, rotation and translation)
+Transform randomKeyframe(std::mt19937& rng) {
+  std::uniform_real_distribution<float_t> pos(-10, 10);
+  std::uniform_real_distribution<float_t> scale(0.2f, 3);
+  std::uniform_real_distribution<float_t> angle(-pi<float_t>, pi<float_t>);
+  Vec3 axis(pos(rng), pos(rng), pos(rng));
+  if (axis == Vec3(0)) axis.x = 1;
+  auto t = Transform::translate(Vec3(pos(rng), pos(rng), pos(rng)));
+  auto r = Transform::rotate(Radian(angle(rng)), glm::normalize(axis));
+  auto s = Transform::scale(Vec3(scale(rng), scale(rng), scale(rng)));
+  return {t.getMatrix() * r.getMatrix() * s.getMatrix()};
+}
+
+/// Check that motion bounds contain sampled positions of corners and inner
+/// points, and that interpolated transforms are consistent
+void testMotion(
+  const AnimatedTransform& a,
+  const Bounds3& b,
+  std::mt19937& rng,
+  const std::string& name) {
+  auto bounds = a.motionBounds(b);
+  std::uniform_real_distribution<float_t> u(0, 1);
+  std::size_t nOutside = 0;
+  bool consistent = true;
+  const int nTimes = 257;
+  for (auto i = 0; i < nTimes; ++i) {
+    auto time = a.getStartTime() +
+                (a.getEndTime() - a.getStartTime()) * i / (nTimes - 1);
+    auto t = a.interpolate(time);
+    consistent &= near(t.getMatrix() * t.getInverseMatrix(), Mat4(1));
+    for (unsigned char c = 0; c < 8; ++c)
+      nOutside += !inside(bounds, t.transformPoint(b.corner(c)));
+    for (auto k = 0; k < 4; ++k) {
+      Vec3 p = b.min() + Vec3(u(rng), u(rng), u(rng)) * b.diagonal();
+      nOutside += !inside(bounds, t.transformPoint(p));
+    }
+  }
+  rt_check(
+    nOutside == 0,
+    name + ": " + std::to_string(nOutside) + " points outside of bounds");
+  rt_check(consistent, name + ": inverse of interpolated transform");
+}
+
+int main() {
+  test::test_name = "AnimatedTransform";
+
+  std::mt19937 rng(17);
+  std::uniform_real_distribution<float_t> pos(-5, 5);
+
+  for (auto i = 0; i < 30; ++i) {
+    auto name = "keyframes " + std::to_string(i);
+    auto start = randomKeyframe(rng);
+    auto end = randomKeyframe(rng);
+    AnimatedTransform a(start, 0.25f, end, 1.5f);
+    rt_check(a.isAnimated(), name + ": not animated");
+
+    // keyframes are hit at ends of interval, times outside are clamped
+    rt_check(
+      near(a.interpolate(0.25f).getMatrix(), start.getMatrix()) &&
+        near(a.interpolate(-1).getMatrix(), start.getMatrix()) &&
+        near(a.interpolate(1.5f).getMatrix(), end.getMatrix()) &&
+        near(a.interpolate(2).getMatrix(), end.getMatrix()),
+      name + ": keyframes");
+
+    for (auto j = 0; j < 5; ++j) {
+      Bounds3 b(
+        Vec3(pos(rng), pos(rng), pos(rng)), Vec3(pos(rng), pos(rng), pos(rng)));
+      testMotion(a, b, rng, name + ", box " + std::to_string(j));
+    }
+  }
+
+  // quarter and almost half turn, where ends alone miss the motion
+  auto unit = Bounds3(Vec3(1, -0.5f, -0.5f), Vec3(2, 0.5f, 0.5f));
+  for (auto angle : {pi<float_t> / 2, pi<float_t> * 0.99f}) {
+    AnimatedTransform a(
+      Transform(), 0, Transform::rotate(Radian(angle), Vec3(0, 0, 1)), 1);
+    testMotion(a, unit, rng, "rotation by " + std::to_string(angle));
+  }
+
+  // without rotation, bounds are merged bounds of keyframes
+  auto start = Transform::translate(Vec3(1, 2, 3));
+  auto end = Transform(
+    Transform::translate(Vec3(-4, 0, 1)).getMatrix() *
+    Transform::scale(Vec3(2, 1, 0.5f)).getMatrix());
+  AnimatedTransform moving(start, 0, end, 1);
+  auto expected = Bounds3::merge(
+    start.transformBounds(unit), end.transformBounds(unit));
+  auto bounds = moving.motionBounds(unit);
+  rt_check(
+    inside(expected, bounds.min()) && inside(expected, bounds.max()) &&
+      inside(bounds, expected.min()) && inside(bounds, expected.max()),
+    "bounds of translation and scale");
+  testMotion(moving, unit, rng, "translation and scale");
+
+  // not animated
+  AnimatedTransform fixed(start, 0, start, 1);
+  rt_check(!fixed.isAnimated(), "same keyframes are animated");
+  rt_check(
+    fixed.motionBounds(unit).min() == start.transformBounds(unit).min() &&
+      fixed.motionBounds(unit).max() == start.transformBounds(unit).max(),
+    "bounds of fixed transform");
+
+  test::summarize();
+  return test::messages.empty() ? 0 : 1;
+}
@@ -0,0 +1,625 @@
+#include "bvh.hpp"
+#include "wide_bvh.hpp"
+#include "benchmark.hpp"
+#include "test.hpp"
+#include "test_scene.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+using namespace naga::rt;
+
+/// Create `n` random rays
+std::vector<Ray> randomRays(std::size_t n, std::uint32_t seed) {
+  std::mt19937 rng(seed);
+  std::vector<Ray> rays;
+  for (std::size_t i = 0; i < n; ++i)
+    rays.push_back(test_scene::randomRay(rng));
+  return rays;
+}
+
+/// Find closest hits of rays (infinity for misses)
+std::vector<float_t>
+  trace(const Primitive& accel, const std::vector<Ray>& rays) {
+  std::vector<float_t> ts(rays.size());
+  for (std::size_t i = 0; i < rays.size(); ++i) {
+    HitRecord hit;
+    accel.intersect(rays[i], 0, 100, &hit);
+    ts[i] = hit.t;
+  }
+  return ts;
+}
+
+/// Count mismatches of closest hits
+std::size_t countMismatches(
+  const std::vector<float_t>& a, const std::vector<float_t>& b) {
+  std::size_t n = 0;
+  for (std::size_t i = 0; i < a.size(); ++i)
+    n += !test_scene::sameHit(a[i] < 100, a[i], b[i] < 100, b[i]);
+  return n;
+}
+
+/// SAH BVH: build time, and closest hits against brute force over scene
+/// sizes
+void benchSAH() {
+  std::printf("SAH BVH against brute force (closest hit)\n");
+  auto rays = randomRays(4000, 26);
+  // brute force is only timed on a subset of rays
+  std::vector<Ray> bruteRays(rays.begin(), rays.begin() + 100);
+  for (std::size_t n : {1000, 4000, 16000, 64000}) {
+    auto primitives = test_scene::smallTriangles(n, 24);
+    auto prefix = std::to_string(n) + " triangles: ";
+    std::unique_ptr<BVHAccel> bvh;
+    auto ms = benchmark::measure(
+      [&] { bvh = std::make_unique<BVHAccel>(primitives); }, 1);
+    benchmark::report(prefix + "build", ms);
+
+    std::vector<float_t> expected(bruteRays.size());
+    ms = benchmark::measure(
+      [&] {
+        for (std::size_t i = 0; i < bruteRays.size(); ++i)
+          test_scene::intersect(
+            primitives, bruteRays[i], 0, 100, &expected[i]);
+      },
+      1);
+    auto bruteRate =
+      benchmark::reportRate(prefix + "brute force", "rays", 100, ms);
+    std::vector<float_t> ts;
+    ms = benchmark::measure([&] { ts = trace(*bvh, rays); });
+    benchmark::reportRate(
+      prefix + "BVH", "rays", double(rays.size()), ms, bruteRate);
+    ts.resize(bruteRays.size());
+    auto nMismatches = countMismatches(expected, ts);
+    rt_check(
+      nMismatches == 0,
+      prefix + std::to_string(nMismatches) + " mismatches");
+  }
+}
+
+/// HLBVH: build time per million primitives over number of threads, against
+/// SAH
+void benchHLBVH() {
+  std::printf("HLBVH build (ms per million primitives)\n");
+  const std::size_t n = 1000000;
+  auto primitives = test_scene::smallTriangles(n, 25);
+  auto perMillion = 1e6 / double(n);
+  auto rays = randomRays(1000, 26);
+  BVHAccel sah(primitives);
+  auto expected = trace(sah, rays);
+  double baselineMs = 0;
+  auto maxThreads =
+    std::max<std::size_t>(8, std::thread::hardware_concurrency());
+  for (std::size_t nThreads = 1; nThreads <= maxThreads; nThreads *= 2) {
+    BVHBuildOptions options;
+    options.method = BVHBuildMethod::HLBVH;
+    options.nThreads = nThreads;
+    auto name = "HLBVH, " + std::to_string(nThreads) + " threads";
+    std::unique_ptr<BVHAccel> bvh;
+    auto ms = benchmark::measure(
+      [&] { bvh = std::make_unique<BVHAccel>(primitives, options); }, 1);
+    benchmark::report(name, ms * perMillion, baselineMs);
+    if (nThreads == 1) baselineMs = ms * perMillion;
+    auto nMismatches = countMismatches(expected, trace(*bvh, rays));
+    rt_check(
+      nMismatches == 0,
+      name + ": " + std::to_string(nMismatches) + " mismatches");
+  }
+  auto ms = benchmark::measure([&] { BVHAccel bvh(primitives); }, 1);
+  benchmark::report("SAH, 1 thread", ms * perMillion, baselineMs);
+}
+
+/// SBVH against SAH on scene with long triangles: build time, node visits
+/// per ray and closest hits
+void benchSBVH() {
+  std::printf("SBVH (every 4th triangle long)\n");
+  const std::size_t n = 20000;
+  auto primitives = test_scene::randomTriangles(n, 37);
+  auto rays = randomRays(4000, 38);
+  std::pair<BVHBuildMethod, std::string> methods[] = {
+    {BVHBuildMethod::SAH, "SAH"}, {BVHBuildMethod::SBVH, "SBVH"}};
+  double baselineMs = 0, baselineRate = 0;
+  std::vector<float_t> expected;
+  for (auto& [method, name] : methods) {
+    BVHBuildOptions options;
+    options.method = method;
+    std::unique_ptr<BVHAccel> bvh;
+    auto buildMs = benchmark::measure(
+      [&] { bvh = std::make_unique<BVHAccel>(primitives, options); }, 1);
+    benchmark::report(name + ": build", buildMs, baselineMs);
+    std::printf(
+      "  %-36s %10.3f\n", (name + ": references/primitive").c_str(),
+      double(bvh->getPrimitives().size()) / double(n));
+    std::size_t nodeVisits = 0;
+    for (auto& ray : rays) {
+      HitRecord hit;
+      bvh->intersect(ray, 0, 100, &hit, &nodeVisits);
+    }
+    std::printf(
+      "  %-36s %10.3f\n", (name + ": node visits/ray").c_str(),
+      double(nodeVisits) / double(rays.size()));
+    std::vector<float_t> ts;
+    auto ms = benchmark::measure([&] { ts = trace(*bvh, rays); });
+    auto rate = benchmark::reportRate(
+      name + ": trace", "rays", double(rays.size()), ms, baselineRate);
+    if (method == BVHBuildMethod::SAH) {
+      baselineMs = buildMs;
+      baselineRate = rate;
+      expected = ts;
+    }
+    auto nMismatches = countMismatches(expected, ts);
+    rt_check(
+      nMismatches == 0,
+      name + ": " + std::to_string(nMismatches) + " mismatches");
+  }
+}
+
+/// Node encodings: node memory per primitive and closest hits
+void benchEncodings() {
+  std::printf("node encodings\n");
+  const std::size_t n = 64000;
+  auto primitives = test_scene::smallTriangles(n, 35);
+  auto rays = randomRays(4000, 36);
+  std::pair<BVHNodeEncoding, std::string> encodings[] = {
+    {BVHNodeEncoding::Float32, "Float32"},
+    {BVHNodeEncoding::Quantized8, "Quantized8"}};
+  double baselineRate = 0;
+  std::vector<float_t> expected;
+  for (auto& [encoding, name] : encodings) {
+    BVHBuildOptions options;
+    options.encoding = encoding;
+    BVHAccel bvh(primitives, options);
+    std::printf(
+      "  %-36s %10.3f\n", (name + ": node bytes/primitive").c_str(),
+      double(bvh.getNodeMemory()) / double(n));
+    std::vector<float_t> ts;
+    auto ms = benchmark::measure([&] { ts = trace(bvh, rays); });
+    auto rate = benchmark::reportRate(
+      name, "rays", double(rays.size()), ms, baselineRate);
+    if (encoding == BVHNodeEncoding::Float32) {
+      baselineRate = rate;
+      expected = ts;
+    }
+    auto nMismatches = countMismatches(expected, ts);
+    rt_check(
+      nMismatches == 0,
+      name + ": " + std::to_string(nMismatches) + " mismatches");
+  }
+}
+
+/// Trace rays through wide BVH: node memory per primitive and closest
+/// hits against binary BVH
+template <std::size_t Width>
+void benchWideBVH(
+  const BVHAccel& bvh,
+  const std::vector<Ray>& rays,
+  const std::vector<float_t>& expected,
+  double baselineRate,
+  const std::string& name) {
+  WideBVHAccel<Width> wide(bvh);
+  auto nPrimitives = double(bvh.getPrimitives().size());
+  std::printf(
+    "  %-36s %10.3f\n", (name + ": node bytes/primitive").c_str(),
+    double(wide.getNodes().size() * sizeof(WideBVHNode<Width>)) /
+      nPrimitives);
+  std::vector<float_t> ts;
+  auto ms = benchmark::measure([&] { ts = trace(wide, rays); });
+  benchmark::reportRate(name, "rays", double(rays.size()), ms, baselineRate);
+  auto nMismatches = countMismatches(expected, ts);
+  rt_check(
+    nMismatches == 0,
+    name + ": " + std::to_string(nMismatches) + " mismatches");
+}
+
+/// QBVH and OBVH collapsed from binary BVH
+void benchWideBVHs() {
+  std::printf("wide BVHs (collapsed from binary BVH)\n");
+  auto primitives = test_scene::smallTriangles(64000, 42);
+  auto rays = randomRays(4000, 43);
+  BVHAccel bvh(primitives);
+  std::printf(
+    "  %-36s %10.3f\n", "binary: node bytes/primitive",
+    double(bvh.getNodeMemory()) / double(primitives.size()));
+  std::vector<float_t> expected;
+  auto ms = benchmark::measure([&] { expected = trace(bvh, rays); });
+  auto rate =
+    benchmark::reportRate("binary", "rays", double(rays.size()), ms);
+  benchWideBVH<4>(bvh, rays, expected, rate, "QBVH (4-wide)");
+  benchWideBVH<8>(bvh, rays, expected, rate, "OBVH (8-wide)");
+}
+
+/// Occlusion of shadow rays: intersectP against closest hit, for binary
+/// and wide BVHs
+void benchOcclusion() {
+  std::printf("occlusion (shadow rays)\n");
+  auto primitives = test_scene::smallTriangles(64000, 44);
+  auto rays = randomRays(20000, 45);
+  BVHAccel bvh(primitives);
+  QBVHAccel qbvh(bvh);
+  std::pair<const Primitive*, std::string> accels[] = {
+    {&bvh, "binary"}, {&qbvh, "QBVH"}};
+  // segments to random points (direction is target - origin), and rays to
+  // distant light
+  std::pair<float_t, std::string> lights[] = {{1, "point"}, {100, "distant"}};
+  for (auto& [accel, name] : accels) {
+    for (auto& [tMax, light] : lights) {
+      auto prefix = name + ", " + light + ": ";
+      std::vector<bool> expected(rays.size()), occluded(rays.size());
+      auto ms = benchmark::measure([&] {
+        for (std::size_t i = 0; i < rays.size(); ++i) {
+          HitRecord hit;
+          expected[i] = accel->intersect(rays[i], 0, tMax, &hit);
+        }
+      });
+      auto rate = benchmark::reportRate(
+        prefix + "closest hit", "rays", double(rays.size()), ms);
+      ms = benchmark::measure([&] {
+        for (std::size_t i = 0; i < rays.size(); ++i)
+          occluded[i] = accel->intersectP(rays[i], 0, tMax);
+      });
+      benchmark::reportRate(
+        prefix + "intersectP", "rays", double(rays.size()), ms, rate);
+      std::size_t nOccluded = 0, nMismatches = 0;
+      for (std::size_t i = 0; i < rays.size(); ++i) {
+        nOccluded += expected[i];
+        nMismatches += occluded[i] != expected[i];
+      }
+      std::printf(
+        "  %-36s %10.3f\n", (prefix + "occluded fraction").c_str(),
+        double(nOccluded) / double(rays.size()));
+      rt_check(
+        nMismatches == 0,
+        prefix + std::to_string(nMismatches) + " mismatches");
+    }
+  }
+}
+
+/// Triangle which builds full interaction of every candidate hit (as
+/// traversal did before HitRecord), counting candidate hits
+class InteractionTriangle : public Shape {
+public:
+  /// Ctor
+  explicit InteractionTriangle(std::shared_ptr<Triangle> triangle)
+    : m_triangle{std::move(triangle)} {}
+
+  virtual bool intersect(
+    const Ray& ray,
+    float_t tMin,
+    float_t tMax,
+    Interaction* isec) const override {
+    if (!m_triangle->intersect(ray, tMin, tMax, isec)) return false;
+    ++nCandidates;
+    return true;
+  }
+  virtual Bounds3 getBoundingBox() const override {
+    return m_triangle->getBoundingBox();
+  }
+
+  /// Number of candidate hits
+  static inline std::size_t nCandidates = 0;
+
+private:
+  std::shared_ptr<Triangle> m_triangle;
+};
+
+/// Compact hit records against full interaction per candidate hit:
+/// bytes written per ray and closest hits
+void benchHitRecords() {
+  std::printf("hit records (full interaction per candidate hit)\n");
+  auto primitives = test_scene::smallTriangles(64000, 46);
+  std::vector<std::shared_ptr<Primitive>> full;
+  for (auto& p : primitives) {
+    auto t = std::dynamic_pointer_cast<Triangle>(p->getShape());
+    full.push_back(
+      test_scene::makePrimitive(std::make_shared<InteractionTriangle>(t)));
+  }
+  auto rays = randomRays(4000, 47);
+  BVHAccel bvh(primitives), fullBVH(full);
+
+  std::vector<float_t> expected, ts;
+  InteractionTriangle::nCandidates = 0;
+  expected = trace(fullBVH, rays);
+  auto candidates =
+    double(InteractionTriangle::nCandidates) / double(rays.size());
+  auto ms = benchmark::measure([&] { expected = trace(fullBVH, rays); });
+  auto rate = benchmark::reportRate(
+    "interaction per candidate", "rays", double(rays.size()), ms);
+  ms = benchmark::measure([&] { ts = trace(bvh, rays); });
+  benchmark::reportRate("HitRecord", "rays", double(rays.size()), ms, rate);
+  auto nMismatches = countMismatches(expected, ts);
+  ms = benchmark::measure([&] {
+    for (std::size_t i = 0; i < rays.size(); ++i) {
+      Interaction isec;
+      ts[i] = bvh.intersect(rays[i], 0, 100, &isec) ? getRayParam(isec) : 100;
+    }
+  });
+  benchmark::reportRate(
+    "HitRecord, then interaction", "rays", double(rays.size()), ms, rate);
+  nMismatches += countMismatches(expected, ts);
+  rt_check(nMismatches == 0, std::to_string(nMismatches) + " mismatches");
+
+  std::printf("  %-36s %10.3f\n", "candidate hits/ray", candidates);
+  std::printf(
+    "  %-36s %10.3f\n", "interaction: bytes written/ray",
+    candidates * double(sizeof(SurfaceInteraction)));
+  std::printf(
+    "  %-36s %10.3f\n", "HitRecord: bytes written/ray",
+    candidates * double(sizeof(HitRecord)));
+}
+
+/// Create clusters of 8 spheres at random positions (of CountingSphere<0>
+/// if `counting`), so that leaves hold several spheres
+std::vector<std::shared_ptr<Primitive>>
+  sphereClusters(std::size_t n, std::uint32_t seed, bool counting) {
+  std::mt19937 rng(seed);
+  std::uniform_real_distribution<float_t> pos(-10, 10);
+  std::uniform_real_distribution<float_t> offset(-0.05f, 0.05f);
+  std::vector<std::shared_ptr<Primitive>> primitives;
+  Vec3 center;
+  for (std::size_t i = 0; i < n; ++i) {
+    if (i % 8 == 0) center = Vec3(pos(rng), pos(rng), pos(rng));
+    Vec3 c = center + Vec3(offset(rng), offset(rng), offset(rng));
+    primitives.push_back(test_scene::makePrimitive(
+      counting ? std::make_shared<test_scene::CountingSphere<0>>(c, 0.1f)
+               : std::make_shared<test_scene::Sphere>(c, 0.1f)));
+  }
+  return primitives;
+}
+
+/// Homogeneous leaves: closest hits and sphere kernel calls per ray in
+/// a scene of triangles and spheres
+void benchHomogeneousLeaves() {
+  std::printf("homogeneous leaves (triangles and spheres)\n");
+  auto rays = randomRays(4000, 27);
+  auto primitives = test_scene::smallTriangles(20000, 28);
+  auto counted = primitives;
+  auto s = sphereClusters(20000, 29, false);
+  auto c = sphereClusters(20000, 29, true);
+  primitives.insert(primitives.end(), s.begin(), s.end());
+  counted.insert(counted.end(), c.begin(), c.end());
+
+  double baselineRate = 0;
+  std::vector<float_t> expected;
+  for (auto homogeneous : {false, true}) {
+    BVHBuildOptions options;
+    options.maxPrimsInNode = 8;
+    options.homogeneousLeaves = homogeneous;
+    std::string name = homogeneous ? "homogeneous" : "mixed";
+    BVHAccel bvh(primitives, options);
+    std::vector<float_t> ts;
+    auto ms = benchmark::measure([&] { ts = trace(bvh, rays); });
+    auto rate = benchmark::reportRate(
+      name + " leaves", "rays", double(rays.size()), ms, baselineRate);
+    if (!homogeneous) {
+      baselineRate = rate;
+      expected = ts;
+    }
+    auto n = countMismatches(expected, ts);
+    rt_check(n == 0, name + ": " + std::to_string(n) + " mismatches");
+
+    // virtual calls into sphere kernels, per sphere or per leaf
+    using Counting = test_scene::CountingSphere<0>;
+    Counting::nCalls = 0;
+    trace(BVHAccel(counted, options), rays);
+    Counting::batches.clear();
+    std::printf(
+      "  %-36s %10.3f\n", (name + ": sphere dispatches/ray").c_str(),
+      double(Counting::nCalls) / double(rays.size()));
+  }
+}
+
+/// Trace packets of N rays (origins of `rays` jittered by up to `spread`
+/// units), against the same rays one by one
+template <std::size_t N>
+void benchPacket(
+  const BVHAccel& bvh,
+  const std::vector<Ray>& rays,
+  float_t spread,
+  const std::string& name) {
+  std::mt19937 rng(33);
+  std::uniform_real_distribution<float_t> jitter(-spread, spread);
+  std::vector<RayPacket<N>> packets(rays.size());
+  std::vector<Ray> packetRays;
+  for (std::size_t p = 0; p < packets.size(); ++p) {
+    for (std::size_t i = 0; i < N; ++i) {
+      auto& base = rays[p];
+      Ray ray(base.origin() + Vec3(jitter(rng), jitter(rng), 0), base.dir());
+      packets[p].set(i, ray, 0, 100);
+      packetRays.push_back(ray);
+    }
+  }
+  auto prefix = "RayPacket<" + std::to_string(N) + ">, " + name + ": ";
+  std::vector<float_t> expected;
+  auto ms = benchmark::measure([&] { expected = trace(bvh, packetRays); });
+  auto singleRate = benchmark::reportRate(
+    prefix + "single rays", "rays", double(packetRays.size()), ms);
+  std::vector<float_t> ts(packetRays.size());
+  ms = benchmark::measure([&] {
+    for (std::size_t p = 0; p < packets.size(); ++p) {
+      auto packet = packets[p];
+      HitRecord hits[N];
+      bvh.intersect(packet, hits);
+      for (std::size_t i = 0; i < N; ++i)
+        ts[p * N + i] = hits[i].t;
+    }
+  });
+  benchmark::reportRate(
+    prefix + "packets", "rays", double(packetRays.size()), ms, singleRate);
+  auto n = countMismatches(expected, ts);
+  rt_check(n == 0, prefix + std::to_string(n) + " mismatches");
+}
+
+/// Ray packets against single rays
+void benchPackets() {
+  std::printf("packets (origins spread around rays)\n");
+  auto primitives = test_scene::smallTriangles(40000, 30);
+  auto spheres = test_scene::randomSpheres(10000, 31);
+  primitives.insert(primitives.end(), spheres.begin(), spheres.end());
+  BVHAccel bvh(primitives);
+  auto rays = randomRays(1000, 32);
+  std::pair<float_t, std::string> spreads[] = {
+    {0.5f, "coherent"}, {4, "divergent"}};
+  for (auto& [spread, name] : spreads) {
+    benchPacket<4>(bvh, rays, spread, name);
+    benchPacket<8>(bvh, rays, spread, name);
+    benchPacket<16>(bvh, rays, spread, name);
+  }
+}
+
+/// Vertices of `n` x `n` grid over [-10, 10]^2, twisted around z axis by
+/// `twist` radians per unit of distance from axis, with wave of height 1
+void deformGrid(std::vector<Vec3>& positions, std::size_t n, float_t twist) {
+  for (std::size_t y = 0; y <= n; ++y) {
+    for (std::size_t x = 0; x <= n; ++x) {
+      auto u = -10 + 20 * float_t(x) / float_t(n);
+      auto v = -10 + 20 * float_t(y) / float_t(n);
+      auto angle = twist * std::sqrt(u * u + v * v);
+      auto c = std::cos(angle), s = std::sin(angle);
+      positions[y * (n + 1) + x] =
+        Vec3(c * u - s * v, s * u + c * v, std::sin(u + twist));
+    }
+  }
+}
+
+/// Deforming mesh: refit (with rebuilds of degraded subtrees) against full
+/// rebuild per frame, and closest hits after both
+void benchRefit() {
+  std::printf("deforming mesh (refit against rebuild per frame)\n");
+  const std::size_t n = 200;
+  auto positions = std::make_shared<std::vector<Vec3>>((n + 1) * (n + 1));
+  auto indices = std::make_shared<std::vector<std::uint32_t>>();
+  for (std::size_t y = 0; y < n; ++y) {
+    for (std::size_t x = 0; x < n; ++x) {
+      auto i = static_cast<std::uint32_t>(y * (n + 1) + x);
+      auto j = static_cast<std::uint32_t>(i + n + 1);
+      indices->insert(indices->end(), {i, i + 1, j, i + 1, j + 1, j});
+    }
+  }
+  deformGrid(*positions, n, 0);
+  TriangleMeshStorage storage;
+  storage.indices = *indices;
+  storage.positions = *positions;
+  storage.owner = positions;
+  std::vector<std::shared_ptr<Primitive>> primitives;
+  for (auto& t :
+       createTriangles(std::make_shared<TriangleMesh>(std::move(storage))))
+    primitives.push_back(test_scene::makePrimitive(t));
+  auto rays = randomRays(4000, 34);
+
+  std::printf("  %zu triangles\n", primitives.size());
+  BVHBuildOptions options;
+  options.nThreads = 4;
+  BVHAccel refitted(primitives, options);
+  for (auto frame = 1; frame <= 4; ++frame) {
+    auto twist = float_t(0.05f) * float_t(frame * frame);
+    deformGrid(*positions, n, twist);
+    auto prefix = "twist " + std::to_string(twist).substr(0, 4) + ": ";
+    std::size_t nRebuilt = 0;
+    auto ms = benchmark::measure([&] { nRebuilt = refitted.refit(); }, 1);
+    std::unique_ptr<BVHAccel> rebuilt;
+    auto rebuildMs = benchmark::measure(
+      [&] { rebuilt = std::make_unique<BVHAccel>(primitives, options); }, 1);
+    benchmark::report(prefix + "rebuild", rebuildMs);
+    benchmark::report(prefix + "refit", ms, rebuildMs);
+    std::printf(
+      "  %-36s %10zu\n", (prefix + "subtrees rebuilt").c_str(), nRebuilt);
+
+    std::vector<float_t> expected, ts;
+    ms = benchmark::measure([&] { expected = trace(*rebuilt, rays); });
+    auto rebuiltRate = benchmark::reportRate(
+      prefix + "rebuilt BVH", "rays", double(rays.size()), ms);
+    ms = benchmark::measure([&] { ts = trace(refitted, rays); });
+    benchmark::reportRate(
+      prefix + "refitted BVH", "rays", double(rays.size()), ms, rebuiltRate);
+    auto nMismatches = countMismatches(expected, ts);
+    rt_check(
+      nMismatches == 0,
+      prefix + std::to_string(nMismatches) + " mismatches");
+  }
+}
+
+/// Packed triangle leaves against scalar per-triangle tests on a dense
+/// mesh: closest hits and occlusion (the AVX kernel needs RT_ENABLE_AVX2)
+void benchPackedLeaves() {
+#if defined(__AVX__)
+  std::printf("packed triangle leaves (AVX kernel)\n");
+#else
+  std::printf("packed triangle leaves (scalar lanes, no RT_ENABLE_AVX2)\n");
+#endif
+  const std::size_t n = 400;
+  std::vector<Vec3> positions((n + 1) * (n + 1));
+  deformGrid(positions, n, 0);
+  std::vector<std::uint32_t> indices;
+  for (std::size_t y = 0; y < n; ++y) {
+    for (std::size_t x = 0; x < n; ++x) {
+      auto i = static_cast<std::uint32_t>(y * (n + 1) + x);
+      auto j = static_cast<std::uint32_t>(i + n + 1);
+      indices.insert(indices.end(), {i, i + 1, j, i + 1, j + 1, j});
+    }
+  }
+  std::vector<std::shared_ptr<Primitive>> primitives;
+  for (auto& t : createTriangles(std::make_shared<TriangleMesh>(
+         Transform(), std::move(indices), std::move(positions))))
+    primitives.push_back(test_scene::makePrimitive(t));
+  auto rays = randomRays(20000, 41);
+  std::printf("  %zu triangles\n", primitives.size());
+
+  for (std::size_t maxPrims : {4, 8}) {
+    double baselineRate = 0, baselineOccludedRate = 0;
+    std::vector<float_t> expected;
+    std::vector<bool> expectedOccluded;
+    for (auto packed : {false, true}) {
+      BVHBuildOptions options;
+      options.maxPrimsInNode = maxPrims;
+      options.packTriangles = packed;
+      BVHAccel bvh(primitives, options);
+      auto name = std::string(packed ? "packed" : "scalar") + ", " +
+                  std::to_string(maxPrims) + "/leaf";
+      std::vector<float_t> ts;
+      auto ms = benchmark::measure([&] { ts = trace(bvh, rays); });
+      auto rate = benchmark::reportRate(
+        name, "rays", double(rays.size()), ms, baselineRate);
+      std::vector<bool> occluded(rays.size());
+      ms = benchmark::measure([&] {
+        for (std::size_t i = 0; i < rays.size(); ++i)
+          occluded[i] = bvh.intersectP(rays[i], 0, 100);
+      });
+      auto occludedRate = benchmark::reportRate(
+        name + ": occlusion", "rays", double(rays.size()), ms,
+        baselineOccludedRate);
+      if (!packed) {
+        baselineRate = rate;
+        baselineOccludedRate = occludedRate;
+        expected = ts;
+        expectedOccluded = occluded;
+      }
+      auto nMismatches = countMismatches(expected, ts);
+      rt_check(
+        nMismatches == 0 && occluded == expectedOccluded,
+        name + ": " + std::to_string(nMismatches) + " mismatches");
+    }
+  }
+}
+
+int main() {
+  test::test_name = "BVH benchmark";
+
+  benchSAH();
+  benchHLBVH();
+  benchSBVH();
+  benchEncodings();
+  benchWideBVHs();
+  benchOcclusion();
+  benchHitRecords();
+  benchPackets();
+  benchHomogeneousLeaves();
+  benchRefit();
+  benchPackedLeaves();
+
+  test::summarize();
+  return test::messages.empty() ? 0 : 1;
+}
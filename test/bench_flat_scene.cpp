@@ -0,0 +1,93 @@
+#include "flat_scene.hpp"
+#include "benchmark.hpp"
+#include "test.hpp"
+#include "test_scene.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <random>
+#include <type_traits>
+#include <vector>
+
+using namespace naga::rt;
+
+/** \brief Create `n` distinct handles of type T without constructing T.
+ * FlatScene only compares and stores pointers of materials and lights, so
+ * handles alias storage owned by one control block.
+ */
+template <class T>
+std::vector<std::shared_ptr<T>> createHandles(std::size_t n) {
+  auto storage = std::make_shared<std::vector<std::max_align_t>>(n);
+  std::vector<std::shared_ptr<T>> handles;
+  for (std::size_t i = 0; i < n; ++i)
+    handles.emplace_back(storage, reinterpret_cast<T*>(&(*storage)[i]));
+  return handles;
+}
+
+/// Combine address into checksum (so lookups are not optimized out)
+std::uintptr_t mix(std::uintptr_t sum, const void* p) {
+  return sum * 31 + reinterpret_cast<std::uintptr_t>(p);
+}
+
+int main() {
+  test::test_name = "FlatScene benchmark";
+
+  // triangles with 16 materials, every 8th of them emissive (4 lights)
+  const std::size_t n = 500000, nHits = 4000000;
+  auto materials = createHandles<Material>(16);
+  auto lights = createHandles<AreaLight>(4);
+  std::vector<std::shared_ptr<Primitive>> primitives;
+  for (auto& p : test_scene::smallTriangles(n, 48)) {
+    auto i = primitives.size();
+    primitives.push_back(std::make_shared<GeometricPrimitive>(
+      materials[i % 16], i % 8 ? nullptr : lights[i / 8 % 4],
+      p->getShape()));
+  }
+  FlatScene flat(primitives);
+
+  // hits in random primitives
+  std::mt19937 rng(49);
+  std::uniform_int_distribution<std::uint32_t> index(0, n - 1);
+  std::vector<std::uint32_t> hits(nHits);
+  for (auto& hit : hits)
+    hit = index(rng);
+  std::printf(
+    "lookups of material, light and shape (%zu hits, %zu primitives)\n",
+    nHits, n);
+
+  std::uintptr_t expected = 0;
+  auto baselineMs = benchmark::measure([&] {
+    expected = 0;
+    for (auto i : hits) {
+      auto& primitive = primitives[i];
+      expected = mix(expected, primitive->getMaterial().get());
+      expected = mix(expected, primitive->getAreaLight().get());
+      expected = mix(expected, primitive->getShape().get());
+    }
+  });
+  benchmark::report("Primitive (virtual, shared_ptr)", baselineMs);
+  std::uintptr_t sum = 0;
+  auto ms = benchmark::measure([&] {
+    sum = 0;
+    for (auto i : hits) {
+      sum = mix(sum, flat.getMaterial(i));
+      sum = mix(sum, flat.getAreaLight(i));
+      sum = mix(sum, flat.visitShape(i, [](const auto& shape) {
+        using S = std::decay_t<decltype(shape)>;
+        if constexpr (std::is_same_v<S, std::monostate>)
+          return static_cast<const Shape*>(nullptr);
+        else
+          return static_cast<const Shape*>(&shape);
+      }));
+    }
+  });
+  benchmark::report("FlatScene", ms, baselineMs);
+  std::printf(
+    "  %-36s %10.3f\n", "Primitive: ns/hit", baselineMs * 1e6 / nHits);
+  std::printf("  %-36s %10.3f\n", "FlatScene: ns/hit", ms * 1e6 / nHits);
+  rt_check(sum == expected, "lookups differ");
+
+  test::summarize();
+  return test::messages.empty() ? 0 : 1;
+}
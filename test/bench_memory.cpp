@@ -0,0 +1,85 @@
+#include "benchmark.hpp"
+#include "memory.hpp"
+#include "parallel.hpp"
+#include "test.hpp"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace naga::rt;
+
+/// Object of the size of a small BSDF
+struct Lobe {
+  float data[12] = {};
+};
+
+/// Object of the size of a BSDF with lobes
+struct BSDF {
+  float frame[9] = {};
+  Lobe* lobes[8] = {};
+  int nLobes = 0;
+};
+
+/// Samples per thread
+constexpr std::size_t nSamples = 20000;
+/// Lobes per sample
+constexpr int nLobes = 4;
+
+int main() {
+  test::test_name = "MemoryArena benchmark";
+
+  std::printf(
+    "BSDF and %d lobes per sample, %zu samples per thread\n", nLobes,
+    nSamples);
+  for (std::size_t nThreads : {1, 8, 64}) {
+    // own pool, so every thread runs even on machines with fewer cores
+    ThreadPool pool(nThreads - 1);
+    auto nAllocations = double(nThreads * nSamples * (nLobes + 1));
+    std::vector<float> sums(nThreads);
+    auto prefix = std::to_string(nThreads) + " threads: ";
+
+    // new and delete per sample
+    auto ms = benchmark::measure([&] {
+      pool.run(nThreads, nThreads, [&](std::size_t t) {
+        float sum = 0;
+        for (std::size_t s = 0; s < nSamples; ++s) {
+          auto bsdf = std::make_unique<BSDF>();
+          std::unique_ptr<Lobe> lobes[nLobes];
+          for (auto i = 0; i < nLobes; ++i) {
+            lobes[i] = std::make_unique<Lobe>();
+            bsdf->lobes[bsdf->nLobes++] = lobes[i].get();
+          }
+          sum += bsdf->lobes[s % nLobes]->data[0] + bsdf->frame[0];
+        }
+        sums[t] = sum;
+      });
+    });
+    auto baselineRate =
+      benchmark::reportRate(prefix + "new/delete", "allocs", nAllocations, ms);
+
+    // one arena per thread, reset per sample
+    std::vector<MemoryArena> arenas(nThreads);
+    ms = benchmark::measure([&] {
+      pool.run(nThreads, nThreads, [&](std::size_t t) {
+        auto& arena = arenas[t];
+        float sum = 0;
+        for (std::size_t s = 0; s < nSamples; ++s) {
+          auto bsdf = arena.create<BSDF>();
+          for (auto i = 0; i < nLobes; ++i)
+            bsdf->lobes[bsdf->nLobes++] = arena.create<Lobe>();
+          sum += bsdf->lobes[s % nLobes]->data[0] + bsdf->frame[0];
+          arena.reset();
+        }
+        sums[t] = sum;
+      });
+    });
+    benchmark::reportRate(
+      prefix + "MemoryArena", "allocs", nAllocations, ms, baselineRate);
+    for (auto& arena : arenas)
+      rt_check(arena.getCapacity() == 256 * 1024, "arena grows");
+  }
+
+  test::summarize();
+  return test::messages.empty() ? 0 : 1;
+}
@@ -0,0 +1,152 @@
+#include "mesh_loader.hpp"
+#include "benchmark.hpp"
+#include "test.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace naga::rt;
+
+/// Grid size (2 * n * n triangles)
+constexpr std::size_t n = 700;
+
+/// Position of grid vertex
+Vec3 gridPosition(std::size_t x, std::size_t y) {
+  return Vec3(
+    float_t(x) * 0.01f, float_t(y) * 0.01f, float_t((x * 7 + y * 3) % 11));
+}
+
+/// Vertex indices of grid triangles
+std::vector<std::uint32_t> gridIndices() {
+  std::vector<std::uint32_t> indices;
+  for (std::size_t y = 0; y < n; ++y) {
+    for (std::size_t x = 0; x < n; ++x) {
+      auto i = static_cast<std::uint32_t>(y * (n + 1) + x);
+      auto j = static_cast<std::uint32_t>(i + n + 1);
+      indices.insert(indices.end(), {i, i + 1, j, i + 1, j + 1, j});
+    }
+  }
+  return indices;
+}
+
+/// Write grid as OBJ with positions, UVs and normals
+std::size_t writeOBJ(const std::string& path) {
+  std::string data;
+  char line[128];
+  for (std::size_t y = 0; y <= n; ++y) {
+    for (std::size_t x = 0; x <= n; ++x) {
+      auto p = gridPosition(x, y);
+      std::snprintf(line, sizeof(line), "v %g %g %g\n", p.x, p.y, p.z);
+      data += line;
+      std::snprintf(
+        line, sizeof(line), "vt %g %g\n", float_t(x) / n, float_t(y) / n);
+      data += line;
+    }
+  }
+  data += "vn 0 0 1\n";
+  auto indices = gridIndices();
+  for (std::size_t i = 0; i < indices.size(); i += 3) {
+    std::snprintf(
+      line, sizeof(line), "f %u/%u/1 %u/%u/1 %u/%u/1\n", indices[i] + 1,
+      indices[i] + 1, indices[i + 1] + 1, indices[i + 1] + 1,
+      indices[i + 2] + 1, indices[i + 2] + 1);
+    data += line;
+  }
+  std::ofstream(path, std::ios::binary | std::ios::trunc)
+    .write(data.data(), static_cast<std::streamsize>(data.size()));
+  return data.size();
+}
+
+/// Write grid as little endian binary PLY with float positions (and
+/// normals if `normals`, which are converted on load)
+std::size_t writePLY(const std::string& path, bool normals) {
+  std::string data = "ply\nformat binary_little_endian 1.0\n";
+  data += "element vertex " + std::to_string((n + 1) * (n + 1)) + "\n";
+  data += "property float x\nproperty float y\nproperty float z\n";
+  if (normals)
+    data += "property float nx\nproperty float ny\nproperty float nz\n";
+  data += "element face " + std::to_string(2 * n * n) + "\n";
+  data += "property list uchar int vertex_indices\n";
+  // align vertex data for zero-copy loading
+  data += "comment " + std::string((4 - (data.size() + 20) % 4) % 4, 'x') +
+          "\nend_header\n";
+  auto append = [&](const void* p, std::size_t size) {
+    data.append(static_cast<const char*>(p), size);
+  };
+  for (std::size_t y = 0; y <= n; ++y) {
+    for (std::size_t x = 0; x <= n; ++x) {
+      auto p = gridPosition(x, y);
+      float v[6] = {float(p.x), float(p.y), float(p.z), 0, 0, 1};
+      append(v, (normals ? 6 : 3) * sizeof(float));
+    }
+  }
+  auto indices = gridIndices();
+  for (std::size_t i = 0; i < indices.size(); i += 3) {
+    std::uint8_t count = 3;
+    append(&count, 1);
+    for (auto k = 0; k < 3; ++k) {
+      auto index = static_cast<std::int32_t>(indices[i + k]);
+      append(&index, sizeof(index));
+    }
+  }
+  std::ofstream(path, std::ios::binary | std::ios::trunc)
+    .write(data.data(), static_cast<std::streamsize>(data.size()));
+  return data.size();
+}
+
+/// Load mesh file with 1, 2, 4, ... threads
+void bench(const std::string& path, std::size_t size, const std::string& name) {
+  std::printf(
+    "%s (%.1f MB, %zu triangles)\n", name.c_str(), double(size) / 1e6,
+    2 * n * n);
+  auto nTriangles = double(2 * n * n);
+  auto maxThreads =
+    std::max<std::size_t>(8, std::thread::hardware_concurrency());
+  double baselineBytes = 0, baselineTriangles = 0;
+  std::vector<Vec3> expected;
+  for (std::size_t nThreads = 1; nThreads <= maxThreads; nThreads *= 2) {
+    MeshLoadOptions options;
+    options.nThreads = nThreads;
+    std::shared_ptr<TriangleMesh> mesh;
+    auto ms = benchmark::measure([&] { mesh = loadMesh(path, options); });
+    auto prefix = std::to_string(nThreads) + " threads: ";
+    auto bytes = benchmark::reportRate(
+      prefix + "read", "B", double(size), ms, baselineBytes);
+    auto triangles = benchmark::reportRate(
+      prefix + "triangles", "triangles", nTriangles, ms, baselineTriangles);
+    rt_assert(
+      mesh && mesh->getNumTriangles() == 2 * n * n,
+      name + ", " + prefix + "wrong number of triangles");
+    std::vector<Vec3> corners;
+    for (auto i : mesh->getIndices())
+      corners.push_back(mesh->getPositions()[i]);
+    if (nThreads == 1) {
+      baselineBytes = bytes;
+      baselineTriangles = triangles;
+      expected = std::move(corners);
+    } else {
+      rt_check(
+        corners == expected, name + ", " + prefix + "triangles differ");
+    }
+  }
+  std::remove(path.c_str());
+}
+
+int main() {
+  test::test_name = "Mesh loader benchmark";
+
+  auto size = writeOBJ("bench_mesh_loader.obj");
+  bench("bench_mesh_loader.obj", size, "OBJ");
+  size = writePLY("bench_mesh_loader.ply", false);
+  bench("bench_mesh_loader.ply", size, "PLY, positions (zero-copy)");
+  size = writePLY("bench_mesh_loader.ply", true);
+  bench("bench_mesh_loader.ply", size, "PLY, positions and normals");
+
+  test::summarize();
+  return test::messages.empty() ? 0 : 1;
+}
@@ -0,0 +1,118 @@
+#include "benchmark.hpp"
+#include "test.hpp"
+#include "test_renderer.hpp"
+
+#include <algorithm>
+#include <limits>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace naga::rt;
+
+using Key = std::pair<std::uint32_t, std::uint32_t>;
+
+int main() {
+  test::test_name = "Ray sorting benchmark";
+
+  // small triangles, so that traversal is bound by memory of nodes
+  auto primitives = test_scene::smallTriangles(400000, 42);
+  auto spheres = test_scene::randomSpheres(20000, 43);
+  primitives.insert(primitives.end(), spheres.begin(), spheres.end());
+  auto bvh =
+    std::make_shared<test_renderer::RecordingBVH>(std::move(primitives));
+  test_renderer::aggregate() = bvh;
+  const std::size_t width = 128;
+  const std::size_t height = 96;
+  const auto nPaths = width * height * test_renderer::samplesPerPixel;
+
+  // secondary rays in the order of an unsorted wave (material order)
+  RaySortOptions unsorted;
+  unsorted.enabled = false;
+  Image img{PixelLength(width), PixelLength(height)};
+  bvh->recording = true;
+  WavefrontRenderer<test_renderer::Kernels>(
+    nullptr, nullptr, 1, test_renderer::samplesPerPixel, 1, 1 << 20,
+    unsorted)
+    .render(img);
+  bvh->recording = false;
+  std::vector<Ray> rays(bvh->rays.begin() + nPaths, bvh->rays.end());
+  bvh->rays.clear();
+  auto nRays = double(rays.size());
+  std::printf("%zu secondary rays\n", rays.size());
+
+  auto trace = [&](const std::vector<Ray>& queue) {
+    std::size_t nHits = 0;
+    for (auto& ray : queue) {
+      Interaction isec;
+      nHits += bvh->intersect(
+        ray, 0, std::numeric_limits<float_t>::infinity(), &isec);
+    }
+    return nHits;
+  };
+  auto expectedHits = trace(rays);
+  auto baselineMs = benchmark::measure([&] { trace(rays); });
+  auto baselineRate =
+    benchmark::reportRate("unsorted: trace", "rays", nRays, baselineMs);
+  benchmark::reportCount(
+    "unsorted: cache misses/ray",
+    benchmark::countCacheMisses([&] { trace(rays); }), nRays);
+
+  // sorted in batches as by WavefrontRenderer
+  auto bounds = bvh->getBoundingBox();
+  RaySortOptions options;
+  for (std::size_t batchSize : {std::size_t(4096), options.batchSize}) {
+    auto name = "batches of " + std::to_string(batchSize);
+    std::vector<Ray> sorted(rays.size());
+    auto sortRays = [&] {
+      std::vector<Key> keys(rays.size());
+      std::vector<Key> temp;
+      for (std::size_t begin = 0; begin < rays.size(); begin += batchSize) {
+        auto end = std::min(rays.size(), begin + batchSize);
+        for (auto i = begin; i < end; ++i)
+          keys[i] = {
+            getRaySortKey(
+              rays[i].origin(), rays[i].dir(), bounds, options.originBits),
+            static_cast<std::uint32_t>(i)};
+        sortRayKeys(
+          &keys[begin], end - begin, 3 * options.originBits + 3, temp);
+      }
+      for (std::size_t i = 0; i < rays.size(); ++i)
+        sorted[i] = rays[keys[i].second];
+    };
+    auto sortMs = benchmark::measure(sortRays);
+    benchmark::reportRate(name + ": sort", "rays", nRays, sortMs);
+    rt_check(trace(sorted) == expectedHits, name + ": hits differ");
+    auto ms = benchmark::measure([&] { trace(sorted); });
+    benchmark::reportRate(name + ": trace", "rays", nRays, ms, baselineRate);
+    benchmark::reportRate(
+      name + ": sort + trace", "rays", nRays, sortMs + ms, baselineRate);
+    benchmark::reportCount(
+      name + ": cache misses/ray",
+      benchmark::countCacheMisses([&] { trace(sorted); }), nRays);
+  }
+
+  // whole renders
+  std::printf(
+    "%zux%zu pixels, %zu spp\n", width, height,
+    test_renderer::samplesPerPixel);
+  double renderMs[2];
+  for (auto enabled : {false, true}) {
+    RaySortOptions sort;
+    sort.enabled = enabled;
+    renderMs[enabled] = benchmark::measure(
+      [&] {
+        WavefrontRenderer<test_renderer::Kernels>(
+          nullptr, nullptr, 1, test_renderer::samplesPerPixel,
+          test_renderer::maxDepth, 1 << 20, sort)
+          .render(img);
+      },
+      1);
+    benchmark::report(
+      std::string("render, ") + (enabled ? "sorted" : "unsorted"),
+      renderMs[enabled], enabled ? renderMs[0] : 0);
+  }
+
+  test::summarize();
+  return test::messages.empty() ? 0 : 1;
+}
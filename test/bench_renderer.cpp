@@ -0,0 +1,55 @@
+#include "benchmark.hpp"
+#include "test.hpp"
+#include "test_renderer.hpp"
+
+#include <string>
+#include <thread>
+
+using namespace naga::rt;
+
+int main() {
+  test::test_name = "Renderer benchmark";
+
+  using test_renderer::maxDepth;
+  using test_renderer::samplesPerPixel;
+  test_renderer::createScene(5000, 2000, 31);
+  const std::size_t width = 96;
+  const std::size_t height = 72;
+  const std::size_t nThreads =
+    std::max(std::thread::hardware_concurrency(), 1u);
+
+  std::printf(
+    "%zux%zu pixels, %zu spp, %zu threads\n", width, height, samplesPerPixel,
+    nThreads);
+  Image expected{PixelLength(width), PixelLength(height)};
+  auto baselineMs = benchmark::measure(
+    [&] {
+      BasicRenderer<test_renderer::PixelRenderer>(
+        nullptr, nullptr, nThreads, 8, 8)
+        .render(expected);
+    },
+    1);
+  benchmark::report("BasicRenderer", baselineMs);
+
+  Image img{PixelLength(width), PixelLength(height)};
+  auto ms = benchmark::measure(
+    [&] {
+      WavefrontRenderer<test_renderer::Kernels>(
+        nullptr, nullptr, nThreads, samplesPerPixel, maxDepth)
+        .render(img);
+    },
+    1);
+  benchmark::report("WavefrontRenderer", ms, baselineMs);
+  std::size_t n = 0;
+  for (std::size_t y = 0; y < height; ++y) {
+    for (std::size_t x = 0; x < width; ++x) {
+      auto& a = img(PixelIndex(x), PixelIndex(y));
+      auto& b = expected(PixelIndex(x), PixelIndex(y));
+      n += a[0] != b[0] || a[1] != b[1] || a[2] != b[2];
+    }
+  }
+  rt_check(n == 0, std::to_string(n) + " pixels differ");
+
+  test::summarize();
+  return test::messages.empty() ? 0 : 1;
+}
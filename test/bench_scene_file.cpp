@@ -0,0 +1,125 @@
+#include "bvh_cache.hpp"
+#include "mesh_loader.hpp"
+#include "scene_file.hpp"
+#include "benchmark.hpp"
+#include "test.hpp"
+#include "test_scene.hpp"
+
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+
+using namespace naga::rt;
+
+/// Grid size (2 * n * n triangles)
+constexpr std::size_t n = 500;
+
+/// Write grid with wave as OBJ
+void writeOBJ(const std::string& path) {
+  std::string data;
+  char line[128];
+  for (std::size_t y = 0; y <= n; ++y) {
+    for (std::size_t x = 0; x <= n; ++x) {
+      auto u = -10 + 20 * float_t(x) / n;
+      auto v = -10 + 20 * float_t(y) / n;
+      std::snprintf(
+        line, sizeof(line), "v %g %g %g\n", u, v, std::sin(u) * std::cos(v));
+      data += line;
+    }
+  }
+  for (std::size_t y = 0; y < n; ++y) {
+    for (std::size_t x = 0; x < n; ++x) {
+      auto i = y * (n + 1) + x + 1;
+      auto j = i + n + 1;
+      std::snprintf(
+        line, sizeof(line), "f %zu %zu %zu\nf %zu %zu %zu\n", i, i + 1, j,
+        i + 1, j + 1, j);
+      data += line;
+    }
+  }
+  std::ofstream(path, std::ios::binary | std::ios::trunc)
+    .write(data.data(), static_cast<std::streamsize>(data.size()));
+}
+
+/// Create primitives of triangles of meshes
+std::vector<std::shared_ptr<Primitive>>
+  createPrimitives(const SceneDescription& scene) {
+  std::vector<std::shared_ptr<Primitive>> primitives;
+  for (auto& p : scene.primitives)
+    for (auto& t : createTriangles(scene.meshes[p.mesh]))
+      primitives.push_back(test_scene::makePrimitive(t));
+  return primitives;
+}
+
+/// Trace first ray (down onto grid)
+float_t traceFirstRay(const BVHAccel& bvh) {
+  HitRecord hit;
+  bvh.intersect(Ray(Vec3(0.3f, 0.2f, 5), Vec3(0, 0, -1)), 0, 100, &hit);
+  return hit.t;
+}
+
+int main() {
+  test::test_name = "Scene file benchmark";
+
+  const std::string objPath = "bench_scene_file.obj";
+  const std::string scenePath = "bench_scene_file.nscn";
+  const std::string cachePath = "bench_scene_file.bvh";
+  writeOBJ(objPath);
+  std::printf("time to first ray (%zu triangles)\n", 2 * n * n);
+
+  // text: parse OBJ, then describe scene of the mesh (there is no text
+  // scene format, so the OBJ mesh is the text scene)
+  std::shared_ptr<const SceneDescription> text;
+  std::vector<ScenePrimitive> records = {{0}};
+  auto textMs = benchmark::measure(
+    [&] {
+      auto scene = std::make_shared<SceneDescription>();
+      scene->meshes = {loadOBJ(objPath)};
+      scene->primitives = records;
+      text = scene;
+    },
+    1);
+  rt_assert(text->meshes[0], "failed to load OBJ");
+  benchmark::report("OBJ: load", textMs);
+
+  // binary: converted once, then mapped
+  rt_assert(saveSceneFile(scenePath, *text), "failed to save scene");
+  std::shared_ptr<const SceneDescription> binary;
+  auto binaryMs =
+    benchmark::measure([&] { binary = loadSceneFile(scenePath); }, 1);
+  rt_assert(binary, "failed to load scene file");
+  benchmark::report("binary: load", binaryMs, textMs);
+
+  // first ray: text with BVH build, binary with BVH cache
+  float_t expected = 0;
+  auto firstRayMs = benchmark::measure(
+    [&] {
+      auto scene = std::make_shared<SceneDescription>();
+      scene->meshes = {loadOBJ(objPath)};
+      scene->primitives = records;
+      BVHAccel bvh(createPrimitives(*scene));
+      expected = traceFirstRay(bvh);
+    },
+    1);
+  benchmark::report("OBJ: first ray (load, build BVH)", firstRayMs);
+  std::remove(cachePath.c_str());
+  loadOrBuildBVH(cachePath, createPrimitives(*binary), {});
+  float_t t = 0;
+  auto ms = benchmark::measure(
+    [&] {
+      auto scene = loadSceneFile(scenePath);
+      auto bvh = loadOrBuildBVH(cachePath, createPrimitives(*scene), {});
+      t = traceFirstRay(*bvh);
+    },
+    1);
+  benchmark::report("binary: first ray (map, BVH cache)", ms, firstRayMs);
+  rt_check(expected < 100 && t == expected, "first rays differ");
+
+  std::remove(objPath.c_str());
+  std::remove(scenePath.c_str());
+  std::remove(cachePath.c_str());
+  test::summarize();
+  return test::messages.empty() ? 0 : 1;
+}
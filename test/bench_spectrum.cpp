@@ -0,0 +1,130 @@
+#include "spectrum.hpp"
+#include "benchmark.hpp"
+#include "test.hpp"
+
+#include <algorithm>
+#include <functional>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace naga::rt;
+
+/// Operators as before expression templates: one std::transform and one
+/// temporary spectrum per operation
+namespace transformed {
+  template <std::size_t N, class F>
+  CoefficientSpectrum<N> apply(
+    const CoefficientSpectrum<N>& a, const CoefficientSpectrum<N>& b, F f) {
+    CoefficientSpectrum<N> ret;
+    std::transform(&a[0], &a[0] + N, &b[0], &ret[0], f);
+    return ret;
+  }
+  template <std::size_t N, class F>
+  CoefficientSpectrum<N> apply(const CoefficientSpectrum<N>& a, F f) {
+    CoefficientSpectrum<N> ret;
+    std::transform(&a[0], &a[0] + N, &ret[0], f);
+    return ret;
+  }
+  template <std::size_t N>
+  CoefficientSpectrum<N>
+    add(const CoefficientSpectrum<N>& a, const CoefficientSpectrum<N>& b) {
+    return apply(a, b, std::plus<float_t>());
+  }
+  template <std::size_t N>
+  CoefficientSpectrum<N>
+    mul(const CoefficientSpectrum<N>& a, const CoefficientSpectrum<N>& b) {
+    return apply(a, b, std::multiplies<float_t>());
+  }
+  template <std::size_t N>
+  CoefficientSpectrum<N>
+    div(const CoefficientSpectrum<N>& a, const CoefficientSpectrum<N>& b) {
+    return apply(a, b, std::divides<float_t>());
+  }
+  template <std::size_t N>
+  CoefficientSpectrum<N> mul(const CoefficientSpectrum<N>& a, float_t v) {
+    return apply(a, [v](float_t x) { return x * v; });
+  }
+  template <std::size_t N>
+  CoefficientSpectrum<N> sqrt(const CoefficientSpectrum<N>& a) {
+    return apply(a, [](float_t x) { return std::sqrt(x); });
+  }
+  template <std::size_t N>
+  CoefficientSpectrum<N>
+    clamp(const CoefficientSpectrum<N>& a, float_t low, float_t high) {
+    return apply(a, [&](float_t x) { return std::clamp(x, low, high); });
+  }
+}
+
+/// Expressions and accumulation of spectra of N samples, against
+/// std::transform per operation
+template <std::size_t N>
+void bench() {
+  using Spectrum = CoefficientSpectrum<N>;
+  const std::size_t n = 20000;
+  std::mt19937 rng(28);
+  std::uniform_real_distribution<float_t> dist(0.5f, 2);
+  std::vector<Spectrum> a(n), b(n), c(n), d(n), out(n), expected(n);
+  for (auto* v : {&a, &b, &c, &d})
+    for (auto& s : *v)
+      for (std::size_t k = 0; k < N; ++k)
+        s[k] = dist(rng);
+  auto prefix = "N = " + std::to_string(N) + ": ";
+
+  // a * b + c * d, then clamp(sqrt(r) / a, 0, 1) as in shading code
+  auto baselineMs = benchmark::measure([&] {
+    using namespace transformed;
+    for (std::size_t i = 0; i < n; ++i) {
+      auto r = add(mul(a[i], b[i]), mul(c[i], d[i]));
+      expected[i] = clamp(div(sqrt(r), a[i]), 0, 1);
+    }
+  });
+  benchmark::report(prefix + "expression, std::transform", baselineMs);
+  auto ms = benchmark::measure([&] {
+    for (std::size_t i = 0; i < n; ++i) {
+      out[i] = a[i] * b[i] + c[i] * d[i];
+      out[i] = clamp(sqrt(out[i]) / a[i], 0, 1);
+    }
+  });
+  benchmark::report(prefix + "expression", ms, baselineMs);
+  bool same = true;
+  for (std::size_t i = 0; i < n; ++i)
+    for (std::size_t k = 0; k < N; ++k)
+      same &= std::abs(out[i][k] - expected[i][k]) <= 1e-6f;
+  rt_check(same, prefix + "expression differs from std::transform");
+
+  // accumulation of weighted spectra (e.g. radiance along paths)
+  Spectrum expectedSum(0.f);
+  baselineMs = benchmark::measure([&] {
+    using namespace transformed;
+    expectedSum = Spectrum(0.f);
+    for (std::size_t i = 0; i < n; ++i)
+      expectedSum = add(expectedSum, mul(mul(a[i], b[i]), 0.5f));
+  });
+  benchmark::report(prefix + "accumulation, std::transform", baselineMs);
+  Spectrum sum(0.f);
+  ms = benchmark::measure([&] {
+    sum = Spectrum(0.f);
+    for (std::size_t i = 0; i < n; ++i)
+      sum += a[i] * b[i] * 0.5f;
+  });
+  benchmark::report(prefix + "accumulation", ms, baselineMs);
+  same = !sum.has_NaN();
+  for (std::size_t k = 0; k < N; ++k)
+    same &= std::abs(sum[k] - expectedSum[k]) <= 1e-5f * expectedSum[k];
+  rt_check(same, prefix + "accumulation differs from std::transform");
+}
+
+int main() {
+  test::test_name = "Spectrum benchmark";
+
+  std::printf("20000 spectra of N samples\n");
+  bench<3>();
+  bench<4>();
+  bench<8>();
+  bench<16>();
+  bench<60>();
+
+  test::summarize();
+  return test::messages.empty() ? 0 : 1;
+}
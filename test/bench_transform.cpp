@@ -0,0 +1,294 @@
+#include "transform.hpp"
+#include "transform_pool.hpp"
+#include "benchmark.hpp"
+#include "test.hpp"
+
+#include "bvh.hpp"
+#include "test_scene.hpp"
+
+#include <cstdlib>
+#include <new>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace naga::rt;
+
+/// Bytes allocated by operator new and not yet deleted
+std::size_t liveBytes = 0;
+
+/// Size of header which stores size of allocation
+constexpr std::size_t headerSize = alignof(std::max_align_t);
+
+void* operator new(std::size_t size) {
+  auto p = static_cast<char*>(std::malloc(size + headerSize));
+  if (!p) std::abort();
+  *reinterpret_cast<std::size_t*>(p) = size;
+  liveBytes += size;
+  return p + headerSize;
+}
+
+void operator delete(void* ptr) noexcept {
+  if (!ptr) return;
+  auto p = static_cast<char*>(ptr) - headerSize;
+  liveBytes -= *reinterpret_cast<std::size_t*>(p);
+  std::free(p);
+}
+
+void operator delete(void* ptr, std::size_t) noexcept {
+  operator delete(ptr);
+}
+
+/// Print memory in MB, with saving relative to baseline if given
+void reportMemory(
+  const std::string& name, std::size_t bytes, std::size_t baseline = 0) {
+  if (baseline > 0)
+    std::printf(
+      "  %-36s %10.3f MB  (%.1f MB saved)\n", name.c_str(),
+      double(bytes) / 1e6, (double(baseline) - double(bytes)) / 1e6);
+  else
+    std::printf("  %-36s %10.3f MB\n", name.c_str(), double(bytes) / 1e6);
+}
+
+/// Transform bounds by merging all 8 transformed corners
+Bounds3 transformCorners(const Mat4& m, const Bounds3& b) {
+  Bounds3 ret(Vec3(m * Vec4(b.corner(0), 1)));
+  for (unsigned char i = 1; i < 8; ++i)
+    ret = Bounds3::merge(ret, Vec3(m * Vec4(b.corner(i), 1)));
+  return ret;
+}
+
+/// Check if vectors agree up to rounding
+bool near(const Vec3& a, const Vec3& b) {
+  for (auto i = 0; i < 3; ++i) {
+    auto scale = std::max<float_t>({1, std::abs(a[i]), std::abs(b[i])});
+    if (!(std::abs(a[i] - b[i]) <= 1e-4f * scale)) return false;
+  }
+  return true;
+}
+
+int main() {
+  test::test_name = "Transform benchmark";
+
+  const std::size_t n = 200000;
+  std::mt19937 rng(27);
+  std::uniform_real_distribution<float_t> pos(-10, 10);
+  auto transform = Transform(
+    Transform::translate(Vec3(1, -2, 3)).getMatrix() *
+    Transform::rotate(Radian(0.7f), glm::normalize(Vec3(1, 2, 3)))
+      .getMatrix() *
+    Transform::scale(Vec3(2, 0.5f, 1)).getMatrix());
+  const auto& m = transform.getMatrix();
+
+  // bounds
+  std::printf("bounds (%zu boxes)\n", n);
+  std::vector<Bounds3> bounds;
+  for (std::size_t i = 0; i < n; ++i)
+    bounds.emplace_back(
+      Vec3(pos(rng), pos(rng), pos(rng)), Vec3(pos(rng), pos(rng), pos(rng)));
+  std::vector<Bounds3> expected(n), out(n);
+  auto baselineMs = benchmark::measure([&] {
+    for (std::size_t i = 0; i < n; ++i)
+      expected[i] = transformCorners(m, bounds[i]);
+  });
+  benchmark::report("8 corners", baselineMs);
+  auto ms = benchmark::measure([&] {
+    for (std::size_t i = 0; i < n; ++i)
+      out[i] = transformBounds(m, bounds[i]);
+  });
+  benchmark::report("transformBounds", ms, baselineMs);
+  bool same = true;
+  for (std::size_t i = 0; i < n; ++i)
+    same &= near(out[i].min(), expected[i].min()) &&
+            near(out[i].max(), expected[i].max());
+  rt_check(same, "transformBounds differs from corners");
+  ms = benchmark::measure([&] { transformBounds(m, bounds, out); });
+  benchmark::report("transformBounds (array)", ms, baselineMs);
+  for (std::size_t i = 0; i < n; ++i)
+    same &= near(out[i].min(), expected[i].min()) &&
+            near(out[i].max(), expected[i].max());
+  rt_check(same, "transformBounds of array differs from corners");
+
+  // points
+  std::printf("points (%zu points)\n", n);
+  AffineTransform affine(transform);
+  std::vector<Vec3> points(n), expectedPoints(n), outPoints(n);
+  std::vector<float_t> x(n), y(n), z(n), outX(n), outY(n), outZ(n);
+  for (std::size_t i = 0; i < n; ++i) {
+    points[i] = Vec3(pos(rng), pos(rng), pos(rng));
+    x[i] = points[i].x;
+    y[i] = points[i].y;
+    z[i] = points[i].z;
+  }
+  baselineMs = benchmark::measure([&] {
+    for (std::size_t i = 0; i < n; ++i)
+      expectedPoints[i] = transform.transformPoint(points[i]);
+  });
+  benchmark::report("Transform", baselineMs);
+  ms = benchmark::measure([&] { affine.transformPoints(points, outPoints); });
+  benchmark::report("AffineTransform", ms, baselineMs);
+  ms = benchmark::measure([&] {
+    affine.transformPoints(
+      x.data(), y.data(), z.data(), outX.data(), outY.data(), outZ.data(), n);
+  });
+  benchmark::report("AffineTransform (SoA)", ms, baselineMs);
+  same = true;
+  for (std::size_t i = 0; i < n; ++i)
+    same &= near(outPoints[i], expectedPoints[i]) &&
+            near(Vec3(outX[i], outY[i], outZ[i]), expectedPoints[i]);
+  rt_check(same, "affine transform differs");
+
+  // interning of matrices shared by many objects
+  std::printf("transforms of %zu objects (100 unique)\n", n);
+  std::vector<Mat4> matrices;
+  for (std::size_t i = 0; i < n; ++i)
+    matrices.push_back(
+      Transform::translate(Vec3(float_t(i % 100), 0, 0)).getMatrix());
+  std::vector<std::shared_ptr<const Transform>> transforms(n);
+  baselineMs = benchmark::measure([&] {
+    for (std::size_t i = 0; i < n; ++i)
+      transforms[i] = std::make_shared<const Transform>(matrices[i]);
+  });
+  benchmark::report("shared Transform per object", baselineMs);
+  transforms.assign(n, nullptr);
+  auto bytes = liveBytes;
+  for (std::size_t i = 0; i < n; ++i)
+    transforms[i] = std::make_shared<const Transform>(matrices[i]);
+  auto baselineBytes = liveBytes - bytes;
+  reportMemory("shared Transform per object: memory", baselineBytes);
+  std::size_t poolSize = 0;
+  ms = benchmark::measure([&] {
+    TransformPool pool;
+    for (std::size_t i = 0; i < n; ++i)
+      transforms[i] = pool.share(pool.intern(matrices[i]));
+    poolSize = pool.size();
+  });
+  benchmark::report("TransformPool", ms, baselineMs);
+  rt_check(poolSize == 100, "pool holds duplicates");
+  transforms.assign(n, nullptr);
+  bytes = liveBytes;
+  {
+    TransformPool pool;
+    for (std::size_t i = 0; i < n; ++i)
+      transforms[i] = pool.share(pool.intern(matrices[i]));
+    reportMemory("TransformPool: memory", liveBytes - bytes, baselineBytes);
+  }
+  transforms.clear();
+
+  // scene of instances of small BVH, placed by 1000 unique matrices
+  const std::size_t nInstances = 1000000;
+  std::printf("scene of %zu instances (1000 unique transforms)\n", nInstances);
+  std::shared_ptr<Primitive> object =
+    std::make_shared<BVHAccel>(test_scene::randomTriangles(100, 39));
+  matrices.clear();
+  for (std::size_t i = 0; i < 1000; ++i)
+    matrices.push_back(
+      Transform(
+        Transform::translate(Vec3(pos(rng), pos(rng), pos(rng))).getMatrix() *
+        Transform::rotate(Radian(float_t(i)), Vec3(0, 0, 1)).getMatrix())
+        .getMatrix());
+  std::vector<std::shared_ptr<Primitive>> instances(nInstances);
+  auto buildScene = [&](bool pooled) {
+    instances.assign(nInstances, nullptr);
+    bytes = liveBytes;
+    TransformPool pool;
+    for (std::size_t i = 0; i < nInstances; ++i) {
+      auto& matrix = matrices[i * 7919 % matrices.size()];
+      instances[i] = std::make_shared<TransformedPrimitive>(
+        object, pooled ? pool.share(pool.intern(matrix))
+                       : std::make_shared<const Transform>(matrix));
+    }
+    auto instanceBytes = liveBytes - bytes;
+    BVHBuildOptions options;
+    options.method = BVHBuildMethod::HLBVH;
+    BVHAccel bvh(instances, options);
+    return instanceBytes;
+  };
+  std::size_t instanceBytes[2];
+  double sceneMs[2];
+  for (auto pooled : {false, true}) {
+    std::string name = pooled ? "TransformPool" : "Transform per instance";
+    sceneMs[pooled] = benchmark::measure(
+      [&] { instanceBytes[pooled] = buildScene(pooled); }, 1);
+    benchmark::report(
+      name + ": build", sceneMs[pooled], pooled ? sceneMs[0] : 0);
+    reportMemory(
+      name + ": memory", instanceBytes[pooled],
+      pooled ? instanceBytes[0] : 0);
+  }
+  instances.clear();
+
+  // motion blur: one BVH over animated instances, traced at all sample
+  // times, against rebuilding BVH of instances for each sample time
+  const std::size_t nAnimated = 10000, nSamples = 16, nSampleRays = 4000;
+  std::printf(
+    "motion blur (%zu instances, %zu times, %zu rays per time)\n", nAnimated,
+    nSamples, nSampleRays);
+  // instances of small triangles, scaled to about 1 unit
+  object = std::make_shared<BVHAccel>(test_scene::smallTriangles(100, 40));
+  auto scale = Transform::scale(Vec3(0.05f)).getMatrix();
+  std::vector<std::shared_ptr<const AnimatedTransform>> animations;
+  for (std::size_t i = 0; i < nAnimated; ++i) {
+    Vec3 start(pos(rng), pos(rng), pos(rng));
+    animations.push_back(std::make_shared<const AnimatedTransform>(
+      Transform(Transform::translate(start).getMatrix() * scale), 0,
+      Transform(
+        Transform::translate(start + Vec3(0.5f, 0, 0.2f)).getMatrix() *
+        Transform::rotate(Radian(0.3f), Vec3(0, 0, 1)).getMatrix() * scale),
+      1));
+  }
+  std::vector<Ray> rays;
+  for (std::size_t s = 0; s < nSamples; ++s) {
+    auto time = (float_t(s) + 0.5f) / nSamples;
+    for (std::size_t i = 0; i < nSampleRays; ++i) {
+      auto ray = test_scene::randomRay(rng);
+      rays.emplace_back(ray.origin(), ray.dir(), time);
+    }
+  }
+  std::vector<float_t> expectedHits(rays.size()), hits(rays.size());
+  baselineMs = benchmark::measure(
+    [&] {
+      for (std::size_t s = 0; s < nSamples; ++s) {
+        std::vector<std::shared_ptr<Primitive>> sampled;
+        for (auto& a : animations)
+          sampled.push_back(std::make_shared<TransformedPrimitive>(
+            object, std::make_shared<const Transform>(
+                      a->interpolate(rays[s * nSampleRays].time()))));
+        BVHAccel bvh(sampled);
+        for (auto i = s * nSampleRays; i < (s + 1) * nSampleRays; ++i) {
+          HitRecord hit;
+          expectedHits[i] =
+            bvh.intersect(rays[i], 0, 100, &hit) ? hit.t : 100;
+        }
+      }
+    },
+    1);
+  benchmark::report("rebuild BVH per time", baselineMs);
+  ms = benchmark::measure(
+    [&] {
+      std::vector<std::shared_ptr<Primitive>> animated;
+      for (auto& a : animations)
+        animated.push_back(std::make_shared<AnimatedPrimitive>(object, a));
+      BVHAccel bvh(animated);
+      for (std::size_t i = 0; i < rays.size(); ++i) {
+        HitRecord hit;
+        hits[i] = bvh.intersect(rays[i], 0, 100, &hit) ? hit.t : 100;
+      }
+    },
+    1);
+  benchmark::report("motion blur BVH", ms, baselineMs);
+  std::size_t nHits = 0, nMismatches = 0;
+  for (std::size_t i = 0; i < rays.size(); ++i) {
+    nHits += expectedHits[i] < 100;
+    nMismatches += !test_scene::sameHit(
+      expectedHits[i] < 100, expectedHits[i], hits[i] < 100, hits[i]);
+  }
+  rt_check(nHits > 0, "motion blur: no hits");
+  rt_check(
+    nMismatches == 0,
+    "motion blur: " + std::to_string(nMismatches) + " mismatches of " +
+      std::to_string(nHits) + " hits");
+
+  test::summarize();
+  return test::messages.empty() ? 0 : 1;
+}
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <limits>
+#include <string>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+/// \file Timing of microbenchmarks (tests labelled `benchmark`)
+
+namespace naga::rt::benchmark {
+
+  /// Get best time of `nRuns` calls of `func` in milliseconds
+  template <class F>
+  double measure(F&& func, int nRuns = 3) {
+    auto best = std::numeric_limits<double>::infinity();
+    for (auto i = 0; i < nRuns; ++i) {
+      auto start = std::chrono::steady_clock::now();
+      func();
+      auto end = std::chrono::steady_clock::now();
+      best = std::min(
+        best, std::chrono::duration<double, std::milli>(end - start).count());
+    }
+    return best;
+  }
+
+  /// Print time, with speedup over time of baseline if given
+  inline void
+    report(const std::string& name, double ms, double baselineMs = 0) {
+    if (baselineMs > 0)
+      std::printf(
+        "  %-36s %10.3f ms  (%.2fx)\n", name.c_str(), ms, baselineMs / ms);
+    else
+      std::printf("  %-36s %10.3f ms\n", name.c_str(), ms);
+  }
+
+  /** \brief Print throughput of `count` items of `unit` in `ms`, in
+   * millions per second, with speedup over rate of baseline if given.
+   * \returns Rate
+   */
+  inline double reportRate(
+    const std::string& name,
+    const char* unit,
+    double count,
+    double ms,
+    double baselineRate = 0) {
+    auto rate = count / (ms * 1e3);
+    if (baselineRate > 0)
+      std::printf(
+        "  %-36s %10.3f M%s/s  (%.2fx)\n", name.c_str(), rate, unit,
+        rate / baselineRate);
+    else
+      std::printf("  %-36s %10.3f M%s/s\n", name.c_str(), rate, unit);
+    return rate;
+  }
+
+  /** \brief Count cache misses (of last level cache) of the calling thread
+   * during one call of `func`, with perf events on Linux.
+   * \returns Number of misses, or -1 when perf events are not available
+   */
+  template <class F>
+  double countCacheMisses(F&& func) {
+#ifdef __linux__
+    perf_event_attr attr{};
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = PERF_COUNT_HW_CACHE_MISSES;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    int fd =
+      static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+    if (fd >= 0) {
+      ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+      ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+      func();
+      ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+      std::uint64_t count = 0;
+      auto n = read(fd, &count, sizeof(count));
+      close(fd);
+      if (n == sizeof(count)) return static_cast<double>(count);
+      return -1;
+    }
+#endif
+    func();
+    return -1;
+  }
+
+  /// Print count per item (n/a when count is negative)
+  inline void
+    reportCount(const std::string& name, double count, double nItems) {
+    if (count < 0)
+      std::printf("  %-36s %10s\n", name.c_str(), "n/a");
+    else
+      std::printf("  %-36s %10.3f\n", name.c_str(), count / nItems);
+  }
+}
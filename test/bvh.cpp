@@ -0,0 +1,304 @@
+#include "bvh.hpp"
+#include "test.hpp"
+#include "test_scene.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <set>
+#include <string>
+#include <tuple>
+#include <utility>
+
+using namespace naga::rt;
+
+/// Get max depth of leaves of float BVH
+int getDepth(const BVHAccel& bvh) {
+  const auto& nodes = bvh.getNodes();
+  if (nodes.empty()) return 0;
+  int depth = 0;
+  std::vector<std::pair<std::uint32_t, int>> toVisit = {{0, 0}};
+  while (!toVisit.empty()) {
+    auto [index, d] = toVisit.back();
+    toVisit.pop_back();
+    depth = std::max(depth, d);
+    if (nodes[index].nPrimitives > 0) continue;
+    toVisit.push_back({index + 1, d + 1});
+    toVisit.push_back({nodes[index].secondChildOffset, d + 1});
+  }
+  return depth;
+}
+
+/// Triangles at 16^-i along each axis, for which SAH splits off one
+/// triangle per level
+std::vector<std::shared_ptr<Primitive>> nestedTriangles() {
+  std::vector<std::uint32_t> indices;
+  std::vector<Vec3> positions;
+  for (auto axis = 0; axis < 3; ++axis) {
+    for (auto i = 0; i < 32; ++i) {
+      Vec3 c(0);
+      c[axis] = std::ldexp(float_t(1), -4 * i);
+      float_t s = c[axis] / 4;
+      Vec3 p[] = {c + Vec3(-s, -s, 0), c + Vec3(s, -s, 0), c + Vec3(0, s, 0)};
+      for (auto v = 0; v < 3; ++v) {
+        indices.push_back(static_cast<std::uint32_t>(positions.size()));
+        positions.push_back(p[v]);
+      }
+    }
+  }
+  auto mesh = std::make_shared<TriangleMesh>(
+    Transform(), std::move(indices), std::move(positions));
+  std::vector<std::shared_ptr<Primitive>> primitives;
+  for (auto& t : createTriangles(mesh))
+    primitives.push_back(test_scene::makePrimitive(t));
+  return primitives;
+}
+
+/// Triangles with spheres at centers of some of them, so that leaves of
+/// BVH built without partition by type hold both shapes
+std::vector<std::shared_ptr<Primitive>> mixedScene() {
+  auto primitives = test_scene::randomTriangles(1000, 3);
+  for (std::size_t i = 0; i < 300; ++i) {
+    auto center = primitives[i]->getBoundingBox().center();
+    primitives.push_back(test_scene::makePrimitive(
+      std::make_shared<test_scene::Sphere>(center, 0.2f)));
+  }
+  return primitives;
+}
+
+/// Create sphere of shape type `type` (one of `Tags`)
+template <int... Tags>
+std::shared_ptr<Shape> typedSphere(
+  int type, const Vec3& center, float_t radius,
+  std::integer_sequence<int, Tags...>) {
+  std::shared_ptr<Shape> shape;
+  ((type == Tags
+      ? shape = std::make_shared<test_scene::CountingSphere<Tags>>(
+          center, radius)
+      : shape),
+   ...);
+  return shape;
+}
+
+/// Clusters of concentric spheres of `nTypes` shape types, whose leaves
+/// hold spheres of all types
+std::vector<std::shared_ptr<Primitive>> sphereClusters(int nTypes) {
+  std::mt19937 rng(5);
+  std::uniform_real_distribution<float_t> pos(-10, 10);
+  std::vector<std::shared_ptr<Primitive>> primitives;
+  for (auto i = 0; i < 50; ++i) {
+    Vec3 center(pos(rng), pos(rng), pos(rng));
+    for (auto type = 0; type < nTypes; ++type)
+      primitives.push_back(test_scene::makePrimitive(typedSphere(
+        type, center, 0.2f + 0.05f * type,
+        std::make_integer_sequence<int, 16>())));
+  }
+  return primitives;
+}
+
+/** \brief Check that each leaf of spheres is intersected by one call of
+ * the batch kernel of its type, and never by calls per sphere.
+ * `bvh` should have Float32 nodes.
+ */
+void checkDispatches(
+  const BVHAccel& bvh, const std::vector<Ray>& rays, const std::string& name) {
+  using Counting = test_scene::CountingSphere<0>;
+  // leaves by first shape and size (spatial splits may reference a shape
+  // from several leaves)
+  std::set<std::pair<const Shape*, std::size_t>> leaves;
+  for (auto& node : bvh.getNodes()) {
+    if (node.nPrimitives > 0) {
+      auto& first = bvh.getPrimitives()[node.primitivesOffset];
+      leaves.insert({first->getShape().get(), node.nPrimitives});
+    }
+  }
+
+  std::size_t nBatches = 0, nMismatches = 0;
+  for (auto& ray : rays) {
+    for (auto occlusion : {false, true}) {
+      Counting::nCalls = 0;
+      Counting::batches.clear();
+      HitRecord hit;
+      if (occlusion)
+        bvh.intersectP(ray, 0, 100);
+      else
+        bvh.intersect(ray, 0, 100, &hit);
+      // batches view shapes of leaves in place, so they start at distinct
+      // addresses for distinct leaves
+      std::map<const Shape* const*, std::size_t> nDispatches;
+      for (auto& batch : Counting::batches) {
+        nMismatches += leaves.count({batch[0], batch.size()}) == 0;
+        ++nDispatches[batch.data()];
+      }
+      for (auto& [leaf, n] : nDispatches)
+        nMismatches += n != 1;
+      nMismatches += Counting::nCalls != Counting::batches.size();
+      nBatches += Counting::batches.size();
+    }
+  }
+  rt_check(nBatches > 0, name + ": no leaf of spheres is dispatched");
+  rt_check(
+    nMismatches == 0, name + ": " + std::to_string(nMismatches) +
+                        " leaves not dispatched once per ray");
+}
+
+/// Compare BVH against brute force
+void compare(
+  const BVHAccel& bvh,
+  const std::vector<std::shared_ptr<Primitive>>& primitives,
+  const std::vector<Ray>& rays,
+  const std::string& name) {
+  std::size_t nMismatches = 0, nHits = 0;
+  for (auto& ray : rays) {
+    float_t t;
+    bool hit = test_scene::intersect(primitives, ray, 0, 100, &t);
+    nHits += hit;
+
+    Interaction isec;
+    bool hit0 = bvh.intersect(ray, 0, 100, &isec);
+    HitRecord record;
+    bool hit1 = bvh.intersect(ray, 0, 100, &record);
+    if (
+      !test_scene::sameHit(hit, t, hit0, hit0 ? getRayParam(isec) : 0) ||
+      !test_scene::sameHit(hit, t, hit1, record.t))
+      ++nMismatches;
+
+    // occlusion before, at and after the closest hit
+    for (float_t tMax : {hit ? t * 0.5f : 100, hit ? t * 1.01f : 50}) {
+      if (
+        bvh.intersectP(ray, 0, tMax) !=
+        test_scene::intersectP(primitives, ray, 0, tMax))
+        ++nMismatches;
+    }
+  }
+  rt_check(nHits > 0, name + ": no ray hits scene");
+  rt_check(
+    nMismatches == 0,
+    name + ": " + std::to_string(nMismatches) + " mismatches");
+}
+
+int main() {
+  test::test_name = "BVHAccel";
+
+  auto triangles = test_scene::randomTriangles(2000, 1);
+  auto deep = nestedTriangles();
+
+  std::mt19937 rng(2);
+  std::vector<Ray> rays;
+  for (auto i = 0; i < 2000; ++i)
+    rays.push_back(test_scene::randomRay(rng));
+
+  // rays from unit cube to points near nested triangles
+  std::vector<Ray> deepRays;
+  std::uniform_int_distribution<int> axis(0, 2);
+  std::uniform_real_distribution<float_t> exponent(0, 124);
+  std::uniform_real_distribution<float_t> offset(-0.3f, 0.3f);
+  for (auto i = 0; i < 1000; ++i) {
+    float_t x = std::exp2(-exponent(rng));
+    Vec3 target = x * Vec3(offset(rng), offset(rng), offset(rng));
+    target[axis(rng)] += x;
+    Vec3 origin(offset(rng), offset(rng), 1);
+    deepRays.emplace_back(origin, target - origin);
+  }
+
+  std::pair<BVHBuildMethod, std::string> methods[] = {
+    {BVHBuildMethod::SAH, "SAH"},
+    {BVHBuildMethod::HLBVH, "HLBVH"},
+    {BVHBuildMethod::SBVH, "SBVH"}};
+  std::pair<BVHNodeEncoding, std::string> encodings[] = {
+    {BVHNodeEncoding::Float32, "Float32"},
+    {BVHNodeEncoding::Quantized8, "Quantized8"}};
+
+  for (auto& [method, methodName] : methods) {
+    for (auto& [encoding, encodingName] : encodings) {
+      auto name = methodName + "/" + encodingName;
+      BVHBuildOptions options;
+      options.method = method;
+      options.encoding = encoding;
+
+      BVHAccel bvh(triangles, options);
+      compare(bvh, triangles, rays, name);
+
+      BVHAccel deepBVH(deep, options);
+      compare(deepBVH, deep, deepRays, name + " (deep)");
+      if (encoding == BVHNodeEncoding::Float32) {
+        rt_check(
+          getDepth(deepBVH) <= BVHAccel::maxDepth,
+          name + ": depth exceeds max depth");
+      }
+
+      BVHAccel empty({}, options);
+      Interaction isec;
+      rt_check(
+        !empty.intersect(rays[0], 0, 100, &isec) &&
+          !empty.intersectP(rays[0], 0, 100),
+        name + ": empty BVH has hit");
+    }
+  }
+
+  // homogeneous leaves of triangles and spheres, with and without packed
+  // triangles, also over nodes built without partition by type
+  auto mixed = mixedScene();
+  std::vector<Ray> mixedRays(rays.begin(), rays.begin() + 400);
+  for (auto& [method, methodName] : methods) {
+    for (auto& [encoding, encodingName] : encodings) {
+      for (auto packTriangles : {false, true}) {
+        auto name = methodName + "/" + encodingName + " homogeneous" +
+                    (packTriangles ? " packed" : "");
+        BVHBuildOptions options;
+        options.method = method;
+        options.encoding = encoding;
+        options.packTriangles = packTriangles;
+        options.homogeneousLeaves = true;
+        BVHAccel bvh(mixed, options);
+        compare(bvh, mixed, mixedRays, name);
+
+        options.homogeneousLeaves = false;
+        BVHAccel mixedLeaves(mixed, options);
+        BVHNodeStorage storage;
+        storage.nodes = mixedLeaves.getNodes();
+        storage.quantizedNodes = mixedLeaves.getQuantizedNodes();
+        std::tie(storage.bounds, storage.rootReference) =
+          mixedLeaves.getQuantizedRoot();
+        options.homogeneousLeaves = true;
+        BVHAccel reused(mixedLeaves.getPrimitives(), storage, options);
+        compare(reused, mixed, mixedRays, name + " (mixed leaves)");
+      }
+    }
+  }
+
+  // leaves of many types are split in halves by type
+  auto clusters = sphereClusters(16);
+  for (auto& [method, methodName] : methods) {
+    auto name = methodName + " homogeneous, 16 types";
+    BVHBuildOptions options;
+    options.method = method;
+    options.maxPrimsInNode = 16;
+    int depth = getDepth(BVHAccel(clusters, options));
+    options.homogeneousLeaves = true;
+    BVHAccel bvh(clusters, options);
+    rt_check(
+      getDepth(bvh) <= depth + 4,
+      name + ": splits by type take more than 4 levels");
+    compare(bvh, clusters, mixedRays, name);
+  }
+
+  // one dispatch per homogeneous leaf of spheres
+  std::vector<std::shared_ptr<Primitive>> counted;
+  for (auto& p : test_scene::randomTriangles(1000, 4)) {
+    counted.push_back(p);
+    auto c = p->getBoundingBox().center();
+    counted.push_back(test_scene::makePrimitive(
+      std::make_shared<test_scene::CountingSphere<0>>(c, 0.3f)));
+  }
+  for (auto& [method, methodName] : methods) {
+    BVHBuildOptions options;
+    options.method = method;
+    options.homogeneousLeaves = true;
+    checkDispatches(
+      BVHAccel(counted, options), mixedRays, methodName + " dispatches");
+  }
+
+  test::summarize();
+  return test::messages.empty() ? 0 : 1;
+}
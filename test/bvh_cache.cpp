@@ -0,0 +1,193 @@
+#include "bvh_cache.hpp"
+#include "test.hpp"
+#include "test_scene.hpp"
+
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <string>
+
+using namespace naga::rt;
+
+/// Read file
+std::vector<char> readFile(const std::string& path) {
+  std::ifstream in(path, std::ios::binary);
+  return {std::istreambuf_iterator<char>(in), {}};
+}
+
+/// Write file
+void writeFile(const std::string& path, const std::vector<char>& data) {
+  std::ofstream out(path, std::ios::binary | std::ios::trunc);
+  out.write(data.data(), static_cast<std::streamsize>(data.size()));
+}
+
+/// Get status of loading cache file
+BVHCacheStatus getStatus(
+  const std::string& path,
+  const std::vector<std::shared_ptr<Primitive>>& primitives,
+  const BVHBuildOptions& options) {
+  BVHCacheStatus status;
+  auto bvh = loadBVHCache(path, primitives, options, &status);
+  rt_check(
+    (bvh != nullptr) == (status == BVHCacheStatus::Hit),
+    "BVH returned with status other than hit");
+  return status;
+}
+
+/** \brief Create primitives of randomTriangles(n, seed), with first
+ * triangle mirrored in its bounding box along every axis (so that bounds of
+ * all primitives are unchanged).
+ */
+std::vector<std::shared_ptr<Primitive>>
+  mirroredTriangles(std::size_t n, std::uint32_t seed) {
+  auto mesh = test_scene::randomMesh(n, seed);
+  auto indices = mesh->getIndices();
+  auto p = mesh->getPositions();
+  std::vector<Vec3> positions(p.begin(), p.end());
+  Bounds3 bounds(positions[indices[0]]);
+  for (auto i = 1; i < 3; ++i)
+    bounds = Bounds3::merge(bounds, positions[indices[i]]);
+  for (auto i = 0; i < 3; ++i) {
+    auto& v = positions[indices[i]];
+    for (auto a = 0; a < 3; ++a) {
+      if (v[a] == bounds.min()[a])
+        v[a] = bounds.max()[a];
+      else if (v[a] == bounds.max()[a])
+        v[a] = bounds.min()[a];
+    }
+  }
+  std::vector<std::shared_ptr<Primitive>> primitives;
+  for (auto& t : createTriangles(std::make_shared<TriangleMesh>(
+         Transform(),
+         std::vector<std::uint32_t>(indices.begin(), indices.end()),
+         std::move(positions))))
+    primitives.push_back(test_scene::makePrimitive(t));
+  return primitives;
+}
+
+int main() {
+  test::test_name = "BVH cache";
+
+  const std::string path = "test_bvh_cache.bin";
+  std::remove(path.c_str());
+
+  auto primitives = test_scene::randomTriangles(2000, 9);
+  std::mt19937 rng(10);
+  std::vector<Ray> rays;
+  for (auto i = 0; i < 1000; ++i)
+    rays.push_back(test_scene::randomRay(rng));
+
+  for (auto encoding :
+       {BVHNodeEncoding::Float32, BVHNodeEncoding::Quantized8}) {
+    auto name = std::string(
+      encoding == BVHNodeEncoding::Float32 ? "Float32" : "Quantized8");
+    BVHBuildOptions options;
+    options.encoding = encoding;
+    std::remove(path.c_str());
+
+    // round trip
+    BVHCacheStatus status;
+    auto built = loadOrBuildBVH(path, primitives, options, &status);
+    rt_check(status == BVHCacheStatus::Missing, name + ": missing file");
+    auto loaded = loadOrBuildBVH(path, primitives, options, &status);
+    rt_assert(
+      loaded && status == BVHCacheStatus::Hit, name + ": cache miss");
+    std::size_t nMismatches = 0;
+    for (auto& ray : rays) {
+      HitRecord hit0, hit1;
+      bool found0 = built->intersect(ray, 0, 100, &hit0);
+      bool found1 = loaded->intersect(ray, 0, 100, &hit1);
+      if (
+        found0 != found1 || hit0.t != hit1.t ||
+        built->intersectP(ray, 0, 100) != loaded->intersectP(ray, 0, 100))
+        ++nMismatches;
+    }
+    rt_check(
+      nMismatches == 0,
+      name + ": " + std::to_string(nMismatches) + " mismatches");
+
+    // stale: other options, encoding, leaf layout or primitives
+    auto other = options;
+    other.maxPrimsInNode = 2;
+    rt_check(
+      getStatus(path, primitives, other) == BVHCacheStatus::Stale,
+      name + ": other options");
+    other = options;
+    other.encoding = encoding == BVHNodeEncoding::Float32
+                       ? BVHNodeEncoding::Quantized8
+                       : BVHNodeEncoding::Float32;
+    rt_check(
+      getStatus(path, primitives, other) == BVHCacheStatus::Stale,
+      name + ": other encoding");
+    other = options;
+    other.homogeneousLeaves = true;
+    rt_check(
+      getStatus(path, primitives, other) == BVHCacheStatus::Stale,
+      name + ": homogeneous leaves");
+    rt_check(
+      getStatus(path, test_scene::randomTriangles(2000, 11), options) ==
+        BVHCacheStatus::Stale,
+      name + ": other primitives");
+    auto mirrored = mirroredTriangles(2000, 9);
+    auto b0 = mirrored[0]->getBoundingBox();
+    auto b1 = primitives[0]->getBoundingBox();
+    rt_check(
+      b0.min() == b1.min() && b0.max() == b1.max(),
+      name + ": bounds of mirrored triangle differ");
+    for (auto method : {BVHBuildMethod::SAH, BVHBuildMethod::SBVH}) {
+      other = options;
+      other.method = method;
+      auto m = method == BVHBuildMethod::SAH ? "SAH" : "SBVH";
+      rt_check(
+        hashBVHInput(mirrored, other) != hashBVHInput(primitives, other),
+        name + ": other geometry with same bounds, " + m);
+    }
+    rt_check(
+      getStatus(path, mirrored, options) == BVHCacheStatus::Stale,
+      name + ": other geometry with same bounds");
+
+    auto data = readFile(path);
+
+    // stale: other version (after magic number)
+    auto modified = data;
+    modified[8] ^= 0x40;
+    writeFile(path, modified);
+    rt_check(
+      getStatus(path, primitives, options) == BVHCacheStatus::Stale,
+      name + ": other version");
+
+    // corrupt: truncated, garbage, flipped bits of nodes or indices
+    for (auto size : {std::size_t(16), std::size_t(128), data.size() - 4}) {
+      writeFile(path, std::vector<char>(data.begin(), data.begin() + size));
+      rt_check(
+        getStatus(path, primitives, options) == BVHCacheStatus::Corrupt,
+        name + ": truncated to " + std::to_string(size));
+    }
+    modified = data;
+    modified[0] = 'X';
+    writeFile(path, modified);
+    rt_check(
+      getStatus(path, primitives, options) == BVHCacheStatus::Corrupt,
+      name + ": bad magic number");
+    for (auto offset : {std::size_t(200), data.size() - 2}) {
+      modified = data;
+      modified[offset] ^= 1;
+      writeFile(path, modified);
+      rt_check(
+        getStatus(path, primitives, options) == BVHCacheStatus::Corrupt,
+        name + ": flipped bit at " + std::to_string(offset));
+    }
+
+    // corrupt file is replaced by rebuild
+    loadOrBuildBVH(path, primitives, options, &status);
+    rt_check(status == BVHCacheStatus::Corrupt, name + ": rebuild status");
+    rt_check(
+      getStatus(path, primitives, options) == BVHCacheStatus::Hit,
+      name + ": cache not rewritten");
+  }
+
+  std::remove(path.c_str());
+  test::summarize();
+  return test::messages.empty() ? 0 : 1;
+}
@@ -0,0 +1,173 @@
+#include "bvh.hpp"
+#include "flat_scene.hpp"
+#include "test.hpp"
+#include "test_scene.hpp"
+
+#include <cstddef>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace naga::rt;
+
+/// Check if interactions are the same
+bool sameInteraction(const Interaction& a, const Interaction& b) {
+  auto sa = std::get_if<SurfaceInteraction>(&a);
+  auto sb = std::get_if<SurfaceInteraction>(&b);
+  if (!sa || !sb) return false;
+  return sa->t() == sb->t() && sa->pos() == sb->pos() &&
+         sa->uv() == sb->uv() && sa->shape() == sb->shape() &&
+         sa->surfaceGeometry().normal == sb->surfaceGeometry().normal &&
+         sa->surfaceGeometry().dpdu == sb->surfaceGeometry().dpdu &&
+         sa->shadingGeometry().normal == sb->shadingGeometry().normal;
+}
+
+/// Create scene of triangles, spheres and instances (of single shapes and
+/// of nested BVH), so every shape type of FlatScene is hit
+std::vector<std::shared_ptr<Primitive>> createScene() {
+  auto primitives = test_scene::randomTriangles(600, 18);
+  auto spheres = test_scene::randomSpheres(150, 19);
+  primitives.insert(primitives.end(), spheres.begin(), spheres.end());
+
+  auto nested = test_scene::randomTriangles(200, 20);
+  auto nestedSpheres = test_scene::randomSpheres(50, 21);
+  nested.insert(nested.end(), nestedSpheres.begin(), nestedSpheres.end());
+  std::shared_ptr<Primitive> bvh = std::make_shared<BVHAccel>(nested);
+  auto placement = std::make_shared<const Transform>(
+    Transform::translate(Vec3(2, -1, 0)).getMatrix() *
+    Transform::scale(Vec3(0.5f)).getMatrix());
+  primitives.push_back(std::make_shared<TransformedPrimitive>(bvh, placement));
+
+  auto sphere =
+    test_scene::makePrimitive(std::make_shared<test_scene::Sphere>(Vec3(0), 2));
+  auto moved =
+    std::make_shared<const Transform>(Transform::translate(Vec3(-5, 5, 0)));
+  primitives.push_back(std::make_shared<TransformedPrimitive>(sphere, moved));
+  auto animated = std::make_shared<const AnimatedTransform>(
+    Transform::translate(Vec3(5, 5, 5)), 0,
+    Transform::translate(Vec3(6, 5, 5)), 1);
+  primitives.push_back(
+    std::make_shared<AnimatedPrimitive>(primitives[0], animated));
+  return primitives;
+}
+
+/** \brief Create `n` distinct handles of type T without constructing T.
+ * FlatScene only compares and stores pointers of materials and lights, so
+ * handles alias storage owned by one control block.
+ */
+template <class T>
+std::vector<std::shared_ptr<T>> createHandles(std::size_t n) {
+  auto storage = std::make_shared<std::vector<std::max_align_t>>(n);
+  std::vector<std::shared_ptr<T>> handles;
+  for (std::size_t i = 0; i < n; ++i)
+    handles.emplace_back(storage, reinterpret_cast<T*>(&(*storage)[i]));
+  return handles;
+}
+
+/// Check that primitives sharing material or light share its index
+void testSharedMaterials() {
+  auto materials = createHandles<Material>(3);
+  auto lights = createHandles<AreaLight>(2);
+  // handle of first light with its own control block
+  auto aliasedLight = std::shared_ptr<AreaLight>(
+    std::make_shared<int>(), lights[0].get());
+
+  std::vector<std::shared_ptr<Primitive>> primitives;
+  auto triangles = createTriangles(test_scene::randomMesh(30, 23));
+  for (std::size_t i = 0; i < triangles.size(); ++i) {
+    std::shared_ptr<AreaLight> light;
+    if (i % 3 == 1) light = i % 2 ? aliasedLight : lights[0];
+    if (i % 3 == 2) light = lights[1];
+    primitives.push_back(std::make_shared<GeometricPrimitive>(
+      i % 5 == 4 ? nullptr : materials[i % 3], light, triangles[i]));
+  }
+  // instance of first primitive has its material and light
+  primitives.push_back(std::make_shared<TransformedPrimitive>(
+    primitives[1], std::make_shared<const Transform>(
+                     Transform::translate(Vec3(1, 0, 0)))));
+
+  FlatScene flat(primitives);
+  rt_check(
+    flat.getNumMaterials() == 3 && flat.getNumAreaLights() == 2,
+    "shared materials: number of unique materials or lights");
+  std::size_t nMismatches = 0;
+  for (std::uint32_t i = 0; i < flat.size(); ++i) {
+    auto material = primitives[i]->getMaterial().get();
+    auto light = primitives[i]->getAreaLight().get();
+    nMismatches += flat.getMaterial(i) != material;
+    nMismatches += flat.getAreaLight(i) != light;
+    for (std::uint32_t j = 0; j < i; ++j) {
+      nMismatches += (flat.getMaterialIndex(i) == flat.getMaterialIndex(j)) !=
+                     (primitives[j]->getMaterial().get() == material);
+      nMismatches +=
+        (flat.getAreaLightIndex(i) == flat.getAreaLightIndex(j)) !=
+        (primitives[j]->getAreaLight().get() == light);
+    }
+  }
+  rt_check(
+    nMismatches == 0,
+    "shared materials: " + std::to_string(nMismatches) + " mismatches");
+}
+
+int main() {
+  test::test_name = "FlatScene";
+
+  testSharedMaterials();
+
+  auto primitives = createScene();
+
+  for (auto packTriangles : {false, true}) {
+    auto name = std::string(packTriangles ? "packed" : "unpacked");
+    BVHBuildOptions options;
+    options.packTriangles = packTriangles;
+    BVHAccel bvh(primitives, options);
+    FlatScene flat(bvh.getPrimitives());
+
+    // shape types
+    rt_assert(flat.size() == bvh.getPrimitives().size(), name + ": size");
+    std::size_t counts[3] = {};
+    for (std::uint32_t i = 0; i < flat.size(); ++i) {
+      counts[static_cast<int>(flat.getShapeType(i))]++;
+      rt_check(
+        flat.getMaterial(i) == nullptr &&
+          flat.getMaterialIndex(i) == FlatScene::none &&
+          flat.getAreaLightIndex(i) == FlatScene::none,
+        name + ": material or light of primitive without them");
+    }
+    rt_check(
+      counts[int(FlatShapeType::None)] == 3 &&
+        counts[int(FlatShapeType::Other)] == 150 &&
+        counts[int(FlatShapeType::Triangle)] == flat.size() - 153,
+      name + ": shape types");
+
+    // interactions agree with interactions built by primitives
+    std::mt19937 rng(22);
+    std::size_t nHits = 0;
+    // hits by shape type, and hits in nested BVH
+    std::size_t nTypeHits[4] = {};
+    std::size_t nMismatches = 0;
+    for (auto i = 0; i < 3000; ++i) {
+      auto ray = test_scene::randomRay(rng);
+      HitRecord hit;
+      if (!bvh.intersect(ray, 0, 100, &hit)) continue;
+      ++nHits;
+      if (hit.instance != HitRecord::none)
+        nTypeHits[3]++;
+      else
+        nTypeHits[static_cast<int>(flat.getShapeType(hit.primitive))]++;
+      if (!sameInteraction(
+            flat.getInteraction(ray, hit), bvh.getInteraction(ray, hit)))
+        ++nMismatches;
+    }
+    rt_check(
+      nTypeHits[0] && nTypeHits[1] && nTypeHits[2] && nTypeHits[3],
+      name + ": shape type without hits");
+    rt_check(
+      nMismatches == 0,
+      name + ": " + std::to_string(nMismatches) + " mismatches of " +
+        std::to_string(nHits) + " hits");
+  }
+
+  test::summarize();
+  return test::messages.empty() ? 0 : 1;
+}
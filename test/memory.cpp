@@ -0,0 +1,112 @@
+#include "memory.hpp"
+#include "test.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace naga::rt;
+
+/// Allocation of arena
+struct Allocation {
+  std::uintptr_t begin;
+  std::size_t size;
+};
+
+/// Check that allocations do not overlap
+bool disjoint(std::vector<Allocation> allocations) {
+  std::sort(
+    allocations.begin(), allocations.end(),
+    [](const Allocation& a, const Allocation& b) { return a.begin < b.begin; });
+  for (std::size_t i = 1; i < allocations.size(); ++i)
+    if (allocations[i - 1].begin + allocations[i - 1].size >
+        allocations[i].begin)
+      return false;
+  return true;
+}
+
+/// Object with alignment of cache line
+struct alignas(cacheLineSize) Aligned {
+  int value = 7;
+};
+
+int main() {
+  test::test_name = "MemoryArena";
+
+  // alignment, and growth across blocks
+  MemoryArena arena(1024);
+  std::vector<Allocation> allocations;
+  std::size_t nMisaligned = 0;
+  for (auto i = 0; i < 400; ++i) {
+    std::size_t alignment = std::size_t(1) << (i % 7);
+    std::size_t size = 1 + i % 37;
+    auto p = reinterpret_cast<std::uintptr_t>(arena.allocate(size, alignment));
+    nMisaligned += p % alignment != 0;
+    allocations.push_back({p, size});
+  }
+  rt_check(nMisaligned == 0, std::to_string(nMisaligned) + " misaligned");
+  rt_check(disjoint(allocations), "allocations overlap");
+  auto capacity = arena.getCapacity();
+  rt_check(
+    capacity > 1024 && capacity % 1024 == 0,
+    "blocks of default size are not added");
+
+  // objects
+  auto a = arena.create<Aligned>();
+  auto pair = arena.create<std::pair<int, double>>(3, 0.5);
+  auto array = arena.createArray<Aligned>(5);
+  rt_check(
+    reinterpret_cast<std::uintptr_t>(a) % cacheLineSize == 0 &&
+      reinterpret_cast<std::uintptr_t>(array) % cacheLineSize == 0,
+    "objects are misaligned");
+  rt_check(
+    a->value == 7 && pair->first == 3 && pair->second == 0.5 &&
+      std::all_of(
+        array, array + 5, [](const Aligned& x) { return x.value == 7; }),
+    "objects are not constructed");
+
+  // oversized allocation gets block of its size, and small allocations
+  // continue after it
+  capacity = arena.getCapacity();
+  auto big = static_cast<std::byte*>(arena.allocate(5000, 16));
+  rt_check(
+    arena.getCapacity() == capacity + 5000, "oversized block has wrong size");
+  std::fill(big, big + 5000, std::byte{1});
+  auto small = static_cast<std::byte*>(arena.allocate(16, 16));
+  rt_check(
+    small + 16 <= big || small >= big + 5000,
+    "allocation overlaps oversized allocation");
+
+  // reset() reuses blocks: same allocations fit without new blocks, and
+  // oversized allocations reuse oversized blocks
+  capacity = arena.getCapacity();
+  for (auto rep = 0; rep < 3; ++rep) {
+    arena.reset();
+    std::vector<void*> first;
+    for (auto i = 0; i < 400; ++i)
+      first.push_back(arena.allocate(1 + i % 37, std::size_t(1) << (i % 7)));
+    arena.allocate(5000, 16);
+    arena.reset();
+    bool same = true;
+    for (auto i = 0; i < 400; ++i)
+      same &=
+        first[i] == arena.allocate(1 + i % 37, std::size_t(1) << (i % 7));
+    rt_check(same, "allocations after reset() differ");
+  }
+  rt_check(
+    arena.getCapacity() == capacity, "reset() does not reuse blocks");
+
+  // move
+  MemoryArena moved(std::move(arena));
+  rt_check(
+    moved.getCapacity() == capacity && arena.getCapacity() == 0,
+    "move does not take blocks");
+  moved.reset();
+  moved.allocate(100, 8);
+  rt_check(moved.getCapacity() == capacity, "moved arena allocates block");
+
+  test::summarize();
+  return test::messages.empty() ? 0 : 1;
+}
@@ -0,0 +1,259 @@
+#include "mesh_loader.hpp"
+#include "test.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+using namespace naga::rt;
+
+/// Write file
+void writeFile(const std::string& path, const std::string& data) {
+  std::ofstream out(path, std::ios::binary | std::ios::trunc);
+  out.write(data.data(), static_cast<std::streamsize>(data.size()));
+}
+
+/// Append value to binary data in given byte order
+template <class T>
+void append(std::string& data, T value, bool bigEndian) {
+  char bytes[sizeof(T)];
+  std::memcpy(bytes, &value, sizeof(T));
+  const std::uint16_t one = 1;
+  bool littleHost = *reinterpret_cast<const char*>(&one) == 1;
+  if (bigEndian == littleHost) std::reverse(bytes, bytes + sizeof(T));
+  data.append(bytes, sizeof(T));
+}
+
+/// Get positions of triangle corners
+std::vector<Vec3> getCorners(const TriangleMesh& mesh) {
+  std::vector<Vec3> corners;
+  for (auto i : mesh.getIndices())
+    corners.push_back(mesh.getPositions()[i]);
+  return corners;
+}
+
+/// Check OBJ loading
+void testOBJ() {
+  const std::string path = "test_mesh_loader.obj";
+
+  // quad with negative indices, pentagon with per corner UVs and normals
+  // which share some corners
+  writeFile(
+    path,
+    "# test\n"
+    "v 0 0 0\nv 1 0 0\nv 1 1 0\nv 0 1 0\n"
+    "f -4 -3 -2 -1\n"
+    "v 0 0 1\nv 1 0 1\nv 2 1 1\nv 1 2 1\nv 0 1 1\n"
+    "vt 0 0\nvt 1 0\nvt 1\n"
+    "vn 0 0 1\nvn 0 0 -1\n"
+    "f 5/1/1 6/2/1 7/3/1 8/3/2 9/1/1\n"
+    "f 5/1/1 7/3/1 9/1/1\n");
+
+  std::vector<Vec3> expected = {
+    Vec3(0, 0, 0), Vec3(1, 0, 0), Vec3(1, 1, 0),
+    Vec3(0, 0, 0), Vec3(1, 1, 0), Vec3(0, 1, 0),
+    Vec3(0, 0, 1), Vec3(1, 0, 1), Vec3(2, 1, 1),
+    Vec3(0, 0, 1), Vec3(2, 1, 1), Vec3(1, 2, 1),
+    Vec3(0, 0, 1), Vec3(1, 2, 1), Vec3(0, 1, 1),
+    Vec3(0, 0, 1), Vec3(2, 1, 1), Vec3(0, 1, 1)};
+
+  for (std::size_t nThreads : {1, 2, 5}) {
+    auto name = "OBJ (" + std::to_string(nThreads) + " threads)";
+    MeshLoadOptions options;
+    options.nThreads = nThreads;
+    auto mesh = loadOBJ(path, options);
+    rt_assert(mesh, name + ": failed to load");
+    rt_check(getCorners(*mesh) == expected, name + ": positions");
+    // UVs are not referenced by quad, so they are dropped
+    rt_check(
+      mesh->getUVs().empty() && mesh->getNormals().empty(),
+      name + ": attributes of partly referenced UVs or normals");
+    rt_check(mesh->getPositions().size() == 9, name + ": vertices");
+  }
+
+  // corners with same indices share vertex
+  writeFile(
+    path,
+    "v 0 0 0\nv 1 0 0\nv 1 1 0\nv 0 1 0\n"
+    "vt 0 0\nvt 1 0\nvt 1 1\n"
+    "vn 0 0 1\n"
+    "f 1/1/1 2/2/1 3/3/1\nf 1/1/1 3/3/1 4/1/1\nf 1/2/1 3/3/1 4/1/1\n");
+  for (std::size_t nThreads : {1, 3}) {
+    auto name = "OBJ corners (" + std::to_string(nThreads) + " threads)";
+    MeshLoadOptions options;
+    options.nThreads = nThreads;
+    auto mesh = loadOBJ(path, options);
+    rt_assert(mesh, name + ": failed to load");
+    rt_check(
+      mesh->getPositions().size() == 5 && mesh->getUVs().size() == 5 &&
+        mesh->getNormals().size() == 5,
+      name + ": corners are not merged");
+    bool same = true;
+    const Vec2 uvs[] = {
+      Vec2(0, 0), Vec2(1, 0), Vec2(1, 1), Vec2(0, 0), Vec2(1, 1),
+      Vec2(0, 0), Vec2(1, 0), Vec2(1, 1), Vec2(0, 0)};
+    auto indices = mesh->getIndices();
+    for (std::size_t i = 0; i < indices.size(); ++i)
+      same &= mesh->getUVs()[indices[i]] == uvs[i];
+    rt_check(same, name + ": uvs");
+  }
+
+  // shared indices keep vertices
+  writeFile(
+    path, "v 0 0 0\nv 1 0 0\nv 1 1 0\nvn 0 0 1\nvn 0 0 1\nvn 0 0 1\n"
+          "f 1//1 2//2 3//3\n");
+  auto mesh = loadOBJ(path);
+  rt_check(
+    mesh && mesh->getPositions().size() == 3 &&
+      mesh->getNormals().size() == 3,
+    "OBJ with shared indices");
+
+  // malformed
+  for (auto text :
+       {"v 0 0 0\nv 1 0 0\nv 1 1 0\nf 1 2 4\n",
+        "v 0 0 0\nv 1 0 0\nv 1 1 0\nf 0 1 2\n",
+        "v 0 0 0\nv 1 0 0\nv 1 1 0\nf -1 -2 -4\n",
+        "v 0 0 0\nv 1 0 0\nv 1 1 0\nf 1 2 -4\n",
+        "v 0 0 0\nv 1 0 0\nv 1 1 0\nf 1 2\n",
+        "v 0 0\nv 1 0 0\nv 1 1 0\nf 1 2 3\n"}) {
+    writeFile(path, text);
+    rt_check(!loadOBJ(path), std::string("malformed OBJ: ") + text);
+  }
+  std::remove(path.c_str());
+}
+
+/// Create PLY file of two triangles (or a quad)
+std::string createPLY(bool bigEndian, bool quad, bool attributes) {
+  std::string ply = "ply\n";
+  ply += bigEndian ? "format binary_big_endian 1.0\n"
+                   : "format binary_little_endian 1.0\n";
+  ply += "element vertex 4\n";
+  if (attributes) {
+    ply += "property double x\nproperty double y\nproperty double z\n";
+    ply += "property float nx\nproperty float ny\nproperty float nz\n";
+    ply += "property float u\nproperty float v\n";
+  } else {
+    ply += "property float x\nproperty float y\nproperty float z\n";
+  }
+  ply += "element material 1\nproperty uchar id\n";
+  ply += quad ? "element face 1\n" : "element face 2\n";
+  ply += "property list uchar int vertex_indices\n";
+  // align vertex data for zero-copy loading
+  ply += "comment " + std::string((4 - (ply.size() + 20) % 4) % 4, 'x') +
+         "\nend_header\n";
+  for (auto i = 0; i < 4; ++i) {
+    float_t p[] = {float_t(i & 1), float_t(i >> 1), float_t(i)};
+    for (auto v : p) {
+      if (attributes)
+        append(ply, double(v), bigEndian);
+      else
+        append(ply, float(v), bigEndian);
+    }
+    if (attributes) {
+      for (auto v : {0.f, 0.f, 1.f, float(i), 0.5f})
+        append(ply, v, bigEndian);
+    }
+  }
+  append(ply, std::uint8_t(7), bigEndian);
+  if (quad) {
+    append(ply, std::uint8_t(4), bigEndian);
+    for (auto i : {0, 1, 3, 2})
+      append(ply, std::int32_t(i), bigEndian);
+  } else {
+    for (auto face : {std::array{0, 1, 3}, std::array{0, 3, 2}}) {
+      append(ply, std::uint8_t(3), bigEndian);
+      for (auto i : face)
+        append(ply, std::int32_t(i), bigEndian);
+    }
+  }
+  return ply;
+}
+
+/// Check PLY loading
+void testPLY() {
+  const std::string path = "test_mesh_loader.ply";
+  std::vector<Vec3> expected = {
+    Vec3(0, 0, 0), Vec3(1, 0, 1), Vec3(1, 1, 3),
+    Vec3(0, 0, 0), Vec3(1, 1, 3), Vec3(0, 1, 2)};
+
+  for (auto bigEndian : {false, true}) {
+    for (auto quad : {false, true}) {
+      for (auto attributes : {false, true}) {
+        auto name = std::string("PLY (") +
+                    (bigEndian ? "big endian" : "little endian") +
+                    (quad ? ", quad" : ", triangles") +
+                    (attributes ? ", attributes)" : ")");
+        writeFile(path, createPLY(bigEndian, quad, attributes));
+        for (std::size_t nThreads : {1, 3}) {
+          MeshLoadOptions options;
+          options.nThreads = nThreads;
+          auto mesh = loadPLY(path, options);
+          rt_assert(mesh, name + ": failed to load");
+          rt_check(getCorners(*mesh) == expected, name + ": positions");
+          if (attributes) {
+            bool same = mesh->getNormals().size() == 4 &&
+                        mesh->getUVs().size() == 4;
+            for (std::size_t i = 0; same && i < 4; ++i) {
+              same &= mesh->getNormals()[i] == Vec3(0, 0, 1) &&
+                      mesh->getUVs()[i] == Vec2(float_t(i), 0.5f);
+            }
+            rt_check(same, name + ": attributes");
+          }
+        }
+      }
+    }
+  }
+
+#if defined(__linux__)
+  // zero-copy positions follow changes of the file (read-only private
+  // mappings share pages with the file until written)
+  auto ply = createPLY(false, false, false);
+  writeFile(path, ply);
+  auto mesh = loadPLY(path);
+  rt_assert(mesh, "PLY (zero-copy): failed to load");
+  auto offset = ply.find("end_header\n") + 11;
+  std::fstream file(path, std::ios::binary | std::ios::in | std::ios::out);
+  file.seekp(static_cast<std::streamoff>(offset));
+  float x = 5;
+  file.write(reinterpret_cast<const char*>(&x), sizeof(x));
+  file.close();
+  rt_check(
+    mesh->getPositions()[0].x == 5, "PLY (zero-copy): positions are copied");
+#endif
+
+  // malformed: truncated, index out of range, counts which overflow size
+  auto valid = createPLY(false, false, false);
+  writeFile(path, valid.substr(0, valid.size() - 4));
+  rt_check(!loadPLY(path), "truncated PLY");
+  auto bad = valid;
+  bad[bad.size() - 4] = 9;
+  writeFile(path, bad);
+  rt_check(!loadPLY(path), "PLY index out of range");
+  for (auto count : {"4611686018427387904", "1537228672809129302"}) {
+    bad = valid;
+    auto p = bad.find("vertex 4");
+    bad.replace(p, 8, std::string("vertex ") + count);
+    writeFile(path, bad);
+    rt_check(!loadPLY(path), std::string("PLY with vertex count ") + count);
+    bad = valid;
+    p = bad.find("face 2");
+    bad.replace(p, 6, std::string("face ") + count);
+    writeFile(path, bad);
+    rt_check(!loadPLY(path), std::string("PLY with face count ") + count);
+  }
+  std::remove(path.c_str());
+}
+
+int main() {
+  test::test_name = "mesh loader";
+
+  testOBJ();
+  testPLY();
+
+  test::summarize();
+  return test::messages.empty() ? 0 : 1;
+}
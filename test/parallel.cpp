@@ -0,0 +1,52 @@
+#include "parallel.hpp"
+#include "test.hpp"
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+using namespace naga::rt;
+
+int main() {
+  test::test_name = "parallel";
+
+  // own pool, so workers run even on single core machines
+  ThreadPool pool(4);
+  rt_check(pool.getNumWorkers() == 4, "number of workers");
+
+  for (auto rep = 0; rep < 200; ++rep) {
+    std::vector<std::atomic<int>> visits(1000);
+    pool.run(visits.size(), 5, [&](std::size_t i) { ++visits[i]; });
+    bool once = true;
+    for (auto& v : visits)
+      once &= v == 1;
+    rt_check(once, "index not visited once");
+  }
+
+  // nested loops complete while all workers are busy
+  std::atomic<std::size_t> sum{0};
+  pool.run(8, 5, [&](std::size_t i) {
+    pool.run(100, 5, [&](std::size_t j) { sum += i * 100 + j; });
+  });
+  rt_check(sum == 800 * 799 / 2, "nested sum " + std::to_string(sum.load()));
+
+  // chunks are contiguous and cover [0, count)
+  std::vector<std::pair<std::size_t, std::size_t>> ranges(7);
+  parallelForChunks(
+    100, 7, [&](std::size_t c, std::size_t begin, std::size_t end) {
+      ranges[c] = {begin, end};
+    });
+  bool contiguous = ranges.front().first == 0 && ranges.back().second == 100;
+  for (std::size_t c = 1; c < ranges.size(); ++c)
+    contiguous &= ranges[c].first == ranges[c - 1].second;
+  rt_check(contiguous, "chunks are not contiguous");
+
+  std::atomic<std::size_t> count{0};
+  parallelFor(1000, 8, [&](std::size_t) { ++count; });
+  rt_check(count == 1000, "parallelFor count");
+  parallelFor(0, 8, [&](std::size_t) { ++count; });
+  rt_check(count == 1000, "empty parallelFor");
+
+  test::summarize();
+  return test::messages.empty() ? 0 : 1;
+}
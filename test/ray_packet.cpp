@@ -0,0 +1,102 @@
+#include "bvh.hpp"
+#include "ray_packet.hpp"
+#include "test.hpp"
+#include "test_scene.hpp"
+
+#include <random>
+#include <string>
+
+using namespace naga::rt;
+
+/// Create packets of N rays. Coherent packets share origin region and
+/// direction octant, the others are random.
+template <std::size_t N>
+std::vector<RayPacket<N>>
+  createPackets(std::size_t count, bool coherent, std::mt19937& rng) {
+  std::uniform_real_distribution<float_t> jitter(-0.5f, 0.5f);
+  std::uniform_int_distribution<std::uint32_t> activeMask(1, (1u << N) - 1);
+  std::vector<RayPacket<N>> packets(count);
+  for (auto& packet : packets) {
+    auto base = test_scene::randomRay(rng);
+    for (std::size_t i = 0; i < N; ++i) {
+      auto ray = coherent ? Ray(
+                              base.origin() + Vec3(jitter(rng), jitter(rng), 0),
+                              base.dir())
+                          : test_scene::randomRay(rng);
+      packet.set(i, ray, 0, 100);
+    }
+    // some lanes inactive
+    if (!coherent) packet.active = activeMask(rng);
+  }
+  return packets;
+}
+
+/// Compare packet traversal against single ray traversal
+template <std::size_t N>
+void compare(
+  const BVHAccel& bvh,
+  std::vector<RayPacket<N>> packets,
+  const std::string& name) {
+  std::size_t nMismatches = 0;
+  for (auto& packet : packets) {
+    auto copy = packet;
+    Interaction isecs[N];
+    HitRecord hits[N];
+    auto mask0 = bvh.intersect(packet, isecs);
+    auto mask1 = bvh.intersect(copy, hits);
+    for (std::size_t i = 0; i < N; ++i) {
+      bool active = packet.active & (1u << i);
+      HitRecord hit;
+      bool found =
+        active && bvh.intersect(packet.getRay(i), 0, 100, &hit);
+      bool found0 = mask0 & (1u << i);
+      bool found1 = mask1 & (1u << i);
+      if (
+        found != found0 || found != found1 ||
+        (found && (getRayParam(isecs[i]) != hit.t || hits[i].t != hit.t ||
+                   packet.tMax[i] != hit.t || copy.tMax[i] != hit.t)))
+        ++nMismatches;
+    }
+  }
+  rt_check(
+    nMismatches == 0,
+    name + ": " + std::to_string(nMismatches) + " mismatches");
+}
+
+template <std::size_t N>
+void compare(const BVHAccel& bvh, const std::string& name) {
+  std::mt19937 rng(13);
+  compare(bvh, createPackets<N>(300, true, rng), name + " (coherent)");
+  compare(bvh, createPackets<N>(300, false, rng), name + " (random)");
+}
+
+int main() {
+  test::test_name = "RayPacket";
+
+  // octant of -0 agrees with sign of inverse direction
+  RayPacket<4> packet;
+  packet.set(0, Ray(Vec3(0), Vec3(-0.f, 1, -1)));
+  packet.set(1, Ray(Vec3(0), Vec3(-1, 1, -0.f)));
+  rt_check(packet.getOctant() == 5, "octant of -0");
+  packet.set(2, Ray(Vec3(0), Vec3(0, 1, -1)));
+  rt_check(packet.getOctant() == -1, "octant of +0 and -0");
+
+  auto primitives = test_scene::randomTriangles(2000, 14);
+  auto spheres = test_scene::randomSpheres(500, 15);
+  primitives.insert(primitives.end(), spheres.begin(), spheres.end());
+
+  std::pair<BVHNodeEncoding, std::string> encodings[] = {
+    {BVHNodeEncoding::Float32, "Float32"},
+    {BVHNodeEncoding::Quantized8, "Quantized8"}};
+  for (auto& [encoding, name] : encodings) {
+    BVHBuildOptions options;
+    options.encoding = encoding;
+    BVHAccel bvh(primitives, options);
+    compare<4>(bvh, name + "/4");
+    compare<8>(bvh, name + "/8");
+    compare<16>(bvh, name + "/16");
+  }
+
+  test::summarize();
+  return test::messages.empty() ? 0 : 1;
+}
@@ -0,0 +1,202 @@
+#include "test.hpp"
+#include "test_renderer.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace naga::rt;
+
+using Key = std::pair<std::uint32_t, std::uint32_t>;
+
+/// Octants are above origin bits, and -0 counts as negative
+void testOctants() {
+  Bounds3 bounds(Vec3(0), Vec3(1));
+  std::size_t nMismatches = 0;
+  for (int octant = 0; octant < 8; ++octant) {
+    for (auto zero : {false, true}) {
+      Vec3 dir;
+      for (auto a = 0; a < 3; ++a) {
+        float_t v = zero ? 0.f : 1.f;
+        dir[a] = (octant >> a) & 1 ? -v : v;
+      }
+      for (int bits : {1, 6, maxRayOriginBits}) {
+        auto key = getRaySortKey(Vec3(0.7f, 0.2f, 0.9f), dir, bounds, bits);
+        nMismatches += int(key >> (3 * bits)) != octant;
+      }
+    }
+  }
+  rt_check(
+    nMismatches == 0, std::to_string(nMismatches) + " wrong octant bits");
+}
+
+/// Origin bits are Morton code of cell of origin in grid of 2^bits cells
+/// per axis (origins outside of bounds are clamped)
+void testMorton() {
+  Bounds3 bounds(Vec3(-4), Vec3(4));
+  const int bits = 3;
+  const std::uint32_t n = 1 << bits;
+  std::size_t nMismatches = 0;
+  for (std::uint32_t x = 0; x < n; ++x) {
+    for (std::uint32_t y = 0; y < n; ++y) {
+      for (std::uint32_t z = 0; z < n; ++z) {
+        std::uint32_t expected = 0;
+        for (int b = 0; b < bits; ++b) {
+          expected |= ((x >> b) & 1) << (3 * b);
+          expected |= ((y >> b) & 1) << (3 * b + 1);
+          expected |= ((z >> b) & 1) << (3 * b + 2);
+        }
+        // center of cell
+        auto origin = Vec3(-4) + (Vec3(x, y, z) + Vec3(0.5f)) * (8.f / n);
+        auto key = getRaySortKey(origin, Vec3(1), bounds, bits);
+        nMismatches += key != expected;
+      }
+    }
+  }
+  rt_check(
+    nMismatches == 0, std::to_string(nMismatches) + " wrong Morton codes");
+  rt_check(
+    getRaySortKey(Vec3(-9, -9, -9), Vec3(1), bounds, bits) == 0 &&
+      getRaySortKey(Vec3(9, 9, 9), Vec3(1), bounds, bits) == n * n * n - 1,
+    "origins outside of bounds are not clamped");
+}
+
+/// Radix sort agrees with std::stable_sort of lower bits of keys
+void testSortRayKeys() {
+  std::mt19937 rng(40);
+  std::uniform_int_distribution<std::uint32_t> dist;
+  for (std::size_t n : {0, 1, 5, 10000, 100003}) {
+    for (int nBits : {1, 3, 8, 13, 32}) {
+      for (std::size_t nThreads : {1, 4}) {
+        // few distinct lower bits, so equal keys are frequent
+        std::vector<Key> keys(n);
+        for (std::size_t i = 0; i < n; ++i)
+          keys[i] = {dist(rng) % 7 * 0x1234567u, std::uint32_t(i)};
+        auto mask = nBits == 32 ? ~0u : (1u << nBits) - 1;
+        auto expected = keys;
+        std::stable_sort(
+          expected.begin(), expected.end(), [&](const Key& a, const Key& b) {
+            return (a.first & mask) < (b.first & mask);
+          });
+        std::vector<Key> temp;
+        sortRayKeys(keys.data(), n, nBits, temp, nThreads);
+        rt_check(
+          keys == expected, "sortRayKeys of " + std::to_string(n) +
+                              " keys, " + std::to_string(nBits) + " bits, " +
+                              std::to_string(nThreads) + " threads");
+      }
+    }
+  }
+}
+
+/** \brief Render with WavefrontRenderer, recording rays traced for closest
+ * hits. Paths are not continued after the first bounce, so the first
+ * `nPaths` rays are camera rays and the others are sorted secondary rays.
+ */
+std::vector<Ray> render(
+  test_renderer::RecordingBVH& bvh,
+  const RaySortOptions& sort,
+  Image& img) {
+  bvh.rays.clear();
+  bvh.recording = true;
+  WavefrontRenderer<test_renderer::Kernels>(
+    nullptr, nullptr, 1, test_renderer::samplesPerPixel, 1, 1 << 20, sort)
+    .render(img);
+  bvh.recording = false;
+  return bvh.rays;
+}
+
+/// Check if rays are the same
+bool sameRay(const Ray& a, const Ray& b) {
+  return a.origin() == b.origin() && a.dir() == b.dir();
+}
+
+/// Sorting rays in batches keeps every ray in its batch, orders batches
+/// stably by key, and does not change the image
+void testBatches() {
+  auto bvh = test_renderer::createScene(3000, 1000, 41);
+  const std::size_t width = 24;
+  const std::size_t height = 16;
+  const auto nPaths = width * height * test_renderer::samplesPerPixel;
+  RaySortOptions unsorted;
+  unsorted.enabled = false;
+  Image expected{PixelLength(width), PixelLength(height)};
+  auto unsortedRays = render(*bvh, unsorted, expected);
+  rt_assert(unsortedRays.size() > nPaths + 100, "no secondary rays");
+  auto bounds = bvh->getBoundingBox();
+  auto getKey = [&](const Ray& ray) {
+    return getRaySortKey(ray.origin(), ray.dir(), bounds, unsorted.originBits);
+  };
+  auto isSorted = [&](const Ray* first, const Ray* last) {
+    return std::is_sorted(first, last, [&](const Ray& a, const Ray& b) {
+      return getKey(a) < getKey(b);
+    });
+  };
+  auto nSecondary = unsortedRays.size() - nPaths;
+  rt_check(
+    !isSorted(&unsortedRays[nPaths], &unsortedRays[nPaths] + nSecondary),
+    "secondary rays are sorted without sorting");
+
+  for (std::size_t batchSize : {1, 100, 1000, 0}) {
+    auto name = "batch size " + std::to_string(batchSize);
+    RaySortOptions sort;
+    sort.batchSize = batchSize;
+    Image img{PixelLength(width), PixelLength(height)};
+    auto rays = render(*bvh, sort, img);
+    rt_assert(rays.size() == unsortedRays.size(), name + ": number of rays");
+
+    std::size_t nMismatches = 0;
+    // camera rays are not sorted
+    for (std::size_t i = 0; i < nPaths; ++i)
+      nMismatches += !sameRay(rays[i], unsortedRays[i]);
+    auto size = batchSize ? batchSize : nSecondary;
+    for (std::size_t begin = 0; begin < nSecondary; begin += size) {
+      auto n = std::min(size, nSecondary - begin);
+      auto batch = &rays[nPaths + begin];
+      auto unsortedBatch = &unsortedRays[nPaths + begin];
+      nMismatches += !isSorted(batch, batch + n);
+      // stable sort of batch of unsorted rays
+      std::vector<Ray> expectedBatch(unsortedBatch, unsortedBatch + n);
+      std::stable_sort(
+        expectedBatch.begin(), expectedBatch.end(),
+        [&](const Ray& a, const Ray& b) { return getKey(a) < getKey(b); });
+      for (std::size_t i = 0; i < n; ++i)
+        nMismatches += !sameRay(batch[i], expectedBatch[i]);
+    }
+    rt_check(
+      nMismatches == 0,
+      name + ": " + std::to_string(nMismatches) + " rays out of order");
+    if (batchSize == 100) {
+      rt_check(
+        !isSorted(&rays[nPaths], &rays[nPaths] + nSecondary),
+        name + ": batches are sorted together");
+    }
+
+    std::size_t nPixels = 0;
+    for (std::size_t y = 0; y < height; ++y) {
+      for (std::size_t x = 0; x < width; ++x) {
+        auto& a = img(PixelIndex(x), PixelIndex(y));
+        auto& b = expected(PixelIndex(x), PixelIndex(y));
+        nPixels += a[0] != b[0] || a[1] != b[1] || a[2] != b[2];
+      }
+    }
+    rt_check(
+      nPixels == 0, name + ": " + std::to_string(nPixels) +
+                      " pixels differ from unsorted render");
+  }
+}
+
+int main() {
+  test::test_name = "Ray sorting";
+
+  testOctants();
+  testMorton();
+  testSortRayKeys();
+  testBatches();
+
+  test::summarize();
+  return test::messages.empty() ? 0 : 1;
+}
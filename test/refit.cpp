@@ -0,0 +1,116 @@
+#include "bvh.hpp"
+#include "test.hpp"
+#include "test_scene.hpp"
+
+#include <random>
+#include <string>
+
+using namespace naga::rt;
+
+/// Compare refitted BVH against fresh build and brute force
+void compare(
+  const BVHAccel& bvh,
+  const std::vector<std::shared_ptr<Primitive>>& primitives,
+  const std::vector<Ray>& rays,
+  const std::string& name) {
+  BVHAccel fresh(primitives, bvh.getOptions());
+  std::size_t nMismatches = 0;
+  for (auto& ray : rays) {
+    float_t t;
+    bool found = test_scene::intersect(primitives, ray, 0, 100, &t);
+    HitRecord hit0, hit1;
+    bool found0 = bvh.intersect(ray, 0, 100, &hit0);
+    bool found1 = fresh.intersect(ray, 0, 100, &hit1);
+    if (
+      !test_scene::sameHit(found, t, found0, hit0.t) ||
+      !test_scene::sameHit(found, t, found1, hit1.t))
+      ++nMismatches;
+    if (
+      bvh.intersectP(ray, 0, 100) !=
+      test_scene::intersectP(primitives, ray, 0, 100))
+      ++nMismatches;
+  }
+  rt_check(
+    nMismatches == 0,
+    name + ": " + std::to_string(nMismatches) + " mismatches");
+
+  // refitted bounds contain all primitives
+  bool contained = true;
+  for (auto& p : primitives) {
+    auto b = p->getBoundingBox();
+    auto r = bvh.getBoundingBox();
+    contained &= Bounds3::merge(r, b).min() == r.min() &&
+                 Bounds3::merge(r, b).max() == r.max();
+  }
+  rt_check(contained, name + ": bounds do not contain primitives");
+}
+
+/// Move spheres by random offsets of up to `distance`
+void move(
+  const std::vector<std::shared_ptr<Primitive>>& primitives,
+  const std::vector<Vec3>& centers,
+  float_t distance,
+  std::mt19937& rng) {
+  std::uniform_real_distribution<float_t> offset(-distance, distance);
+  for (std::size_t i = 0; i < primitives.size(); ++i) {
+    auto& sphere =
+      static_cast<test_scene::Sphere&>(*primitives[i]->getShape());
+    sphere.setCenter(
+      centers[i] + Vec3(offset(rng), offset(rng), offset(rng)));
+  }
+}
+
+int main() {
+  test::test_name = "BVHAccel::refit";
+
+  auto primitives = test_scene::randomSpheres(3000, 7);
+  std::vector<Vec3> centers;
+  for (auto& p : primitives)
+    centers.push_back(p->getBoundingBox().center());
+
+  std::mt19937 rng(8);
+  std::vector<Ray> rays;
+  for (auto i = 0; i < 1000; ++i)
+    rays.push_back(test_scene::randomRay(rng));
+
+  std::pair<BVHBuildMethod, std::string> methods[] = {
+    {BVHBuildMethod::SAH, "SAH"},
+    {BVHBuildMethod::HLBVH, "HLBVH"},
+    {BVHBuildMethod::SBVH, "SBVH"}};
+
+  for (auto& [method, name] : methods) {
+    move(primitives, centers, 0, rng);
+    BVHBuildOptions options;
+    options.method = method;
+    options.nThreads = 4;
+    BVHAccel bvh(primitives, options);
+
+    // small motion: refit only
+    move(primitives, centers, 0.05f, rng);
+    rt_check(bvh.refit() == 0, name + ": small motion rebuilds subtrees");
+    compare(bvh, primitives, rays, name + " (refit)");
+
+    // primitives scattered over the scene: degraded subtrees are rebuilt
+    move(primitives, centers, 10, rng);
+    rt_check(bvh.refit() > 0, name + ": no subtree rebuilt");
+    compare(bvh, primitives, rays, name + " (rebuild)");
+
+    // refit again after rebuild
+    move(primitives, centers, 10, rng);
+    bvh.refit();
+    compare(bvh, primitives, rays, name + " (refit after rebuild)");
+
+    // costs of rebuilt subtrees are their new baselines
+    rt_check(
+      bvh.refit() == 0, name + ": refit without motion rebuilds subtrees");
+  }
+
+  // quantized BVHs are left unchanged
+  BVHBuildOptions options;
+  options.encoding = BVHNodeEncoding::Quantized8;
+  BVHAccel quantized(primitives, options);
+  rt_check(quantized.refit() == 0, "quantized BVH is refitted");
+
+  test::summarize();
+  return test::messages.empty() ? 0 : 1;
+}
@@ -0,0 +1,168 @@
+#include "scene_file.hpp"
+#include "test.hpp"
+#include "test_scene.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
+
+using namespace naga::rt;
+
+/// Read file
+std::vector<char> readFile(const std::string& path) {
+  std::ifstream in(path, std::ios::binary);
+  return {std::istreambuf_iterator<char>(in), {}};
+}
+
+/// Write file
+void writeFile(const std::string& path, const std::vector<char>& data) {
+  std::ofstream out(path, std::ios::binary | std::ios::trunc);
+  out.write(data.data(), static_cast<std::streamsize>(data.size()));
+}
+
+/// Check if arrays have same bytes
+template <class T>
+bool sameBytes(ArrayView<const T> a, ArrayView<const T> b) {
+  if (a.size() != b.size()) return false;
+  return a.empty() ||
+         std::memcmp(a.data(), b.data(), a.size() * sizeof(T)) == 0;
+}
+
+int main() {
+  test::test_name = "scene file";
+
+  const std::string path = "test_scene_file.nscn";
+
+  // scene with normals, uvs, instance transform and spectra
+  auto mesh0 = test_scene::randomMesh(100, 12);
+  std::vector<std::uint32_t> indices = {0, 1, 2, 0, 2, 3};
+  std::vector<Vec3> positions = {
+    Vec3(0, 0, 0), Vec3(1, 0, 0), Vec3(1, 1, 0), Vec3(0, 1, 0)};
+  std::vector<Vec3> normals(4, Vec3(0, 0, 1));
+  std::vector<Vec2> uvs = {Vec2(0, 0), Vec2(1, 0), Vec2(1, 1), Vec2(0, 1)};
+  auto mesh1 = std::make_shared<TriangleMesh>(
+    Transform(), indices, positions, normals, uvs);
+  std::vector<Mat4> transforms = {Mat4(2)};
+  std::vector<RGBSpectrum> spectra = {RGBSpectrum(0.5f), RGBSpectrum(4)};
+  std::vector<ScenePrimitive> primitives = {
+    {0, ScenePrimitive::none, 0, ScenePrimitive::none}, {1, 0, 0, 1}};
+
+  SceneDescription scene;
+  scene.meshes = {mesh0, mesh1};
+  scene.transforms = transforms;
+  scene.primitives = primitives;
+  scene.spectra = spectra;
+  rt_assert(saveSceneFile(path, scene), "failed to save scene");
+
+  // round trip
+  std::string error;
+  rt_check(validateSceneFile(path, &error), "valid file: " + error);
+  auto loaded = loadSceneFile(path);
+  rt_assert(loaded, "failed to load scene");
+  rt_assert(loaded->meshes.size() == 2, "number of meshes");
+  bool same = true;
+  for (auto m = 0; m < 2; ++m) {
+    auto& a = *scene.meshes[m];
+    auto& b = *loaded->meshes[m];
+    same &= sameBytes(a.getIndices(), b.getIndices()) &&
+            sameBytes(a.getPositions(), b.getPositions()) &&
+            sameBytes(a.getNormals(), b.getNormals()) &&
+            sameBytes(a.getUVs(), b.getUVs());
+  }
+  same &= sameBytes(scene.transforms, loaded->transforms) &&
+          sameBytes(scene.primitives, loaded->primitives) &&
+          sameBytes(scene.spectra, loaded->spectra);
+  rt_check(same, "loaded scene differs");
+
+  // arrays are used in place, aligned for SIMD loads
+  auto address =
+    reinterpret_cast<std::uintptr_t>(loaded->meshes[0]->getPositions().data());
+  rt_check(address % cacheLineSize == 0, "positions are not aligned");
+
+  auto data = readFile(path);
+  loaded = nullptr;
+
+  // rejected on load: truncated file, other version, bad magic number
+  auto modified = data;
+  modified[8] ^= 0x40;
+  writeFile(path, modified);
+  rt_check(!loadSceneFile(path), "other version is loaded");
+  modified = data;
+  modified[0] = 'X';
+  writeFile(path, modified);
+  rt_check(!loadSceneFile(path), "bad magic number is loaded");
+  for (auto size : {std::size_t(64), data.size() - 8}) {
+    writeFile(path, std::vector<char>(data.begin(), data.begin() + size));
+    rt_check(
+      !loadSceneFile(path) && !validateSceneFile(path),
+      "truncated file to " + std::to_string(size) + " is accepted");
+  }
+
+  // rejected by validation: checksum, indices and references
+  modified = data;
+  modified[data.size() - 1] ^= 1;
+  writeFile(path, modified);
+  rt_check(
+    !validateSceneFile(path, &error) && error == "checksum mismatch",
+    "flipped bit: " + error);
+
+  // fix checksum of modified file by saving modified arrays instead
+  std::vector<std::uint32_t> badIndices = {0, 1, 2, 0, 2, 4};
+  auto badMesh = std::make_shared<TriangleMesh>(
+    Transform(), badIndices, positions, normals, uvs);
+  auto badScene = scene;
+  badScene.meshes = {mesh0, badMesh};
+  saveSceneFile(path, badScene);
+  rt_check(
+    !validateSceneFile(path, &error) &&
+      error == "mesh 1: vertex index out of range",
+    "index out of range: " + error);
+
+  auto badPrimitives = primitives;
+  badPrimitives[1].transform = 1;
+  badScene = scene;
+  badScene.primitives = badPrimitives;
+  saveSceneFile(path, badScene);
+  rt_check(
+    !validateSceneFile(path, &error) &&
+      error == "primitive 1: invalid reference",
+    "invalid reference: " + error);
+
+  // patched counts (header holds table of meshes at byte 40 as offset and
+  // count, table holds indices, positions, normals and uvs of each mesh as
+  // offset and count)
+  auto patch = [&](std::size_t offset, std::uint64_t value) {
+    modified = data;
+    std::memcpy(modified.data() + offset, &value, sizeof(value));
+    writeFile(path, modified);
+  };
+  std::uint64_t meshTable;
+  std::memcpy(&meshTable, data.data() + 40, sizeof(meshTable));
+  auto uvCount = meshTable + 64 + 3 * 16 + 8;
+  patch(uvCount, 3);
+  rt_check(
+    !loadSceneFile(path) && !validateSceneFile(path, &error) &&
+      error == "mesh 1: attribute count mismatch",
+    "attribute count: " + error);
+  patch(meshTable + 64 + 8, 5);
+  rt_check(
+    !loadSceneFile(path) && !validateSceneFile(path, &error) &&
+      error == "mesh 1: invalid number of indices",
+    "number of indices: " + error);
+  patch(uvCount, ~std::uint64_t(0) / 2);
+  rt_check(
+    !loadSceneFile(path) && !validateSceneFile(path, &error) &&
+      error == "mesh 1: array out of file",
+    "mesh array out of file: " + error);
+  patch(48, ~std::uint64_t(0) / 2);
+  rt_check(
+    !loadSceneFile(path) && !validateSceneFile(path, &error) &&
+      error == "section out of file",
+    "section out of file: " + error);
+
+  std::remove(path.c_str());
+  test::summarize();
+  return test::messages.empty() ? 0 : 1;
+}
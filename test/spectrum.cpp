@@ -0,0 +1,125 @@
+#include "spectrum.hpp"
+#include "test.hpp"
+
+#include <limits>
+#include <random>
+#include <string>
+
+using namespace naga::rt;
+
+/// Check if samples agree up to rounding (NaN agrees with NaN)
+template <size_t N>
+bool near(const CoefficientSpectrum<N>& s, const std::array<float_t, N>& r) {
+  for (size_t i = 0; i < N; ++i) {
+    if (std::isnan(s[i]) || std::isnan(r[i])) {
+      if (std::isnan(s[i]) != std::isnan(r[i])) return false;
+      continue;
+    }
+    auto scale = std::max<float_t>({1, std::abs(s[i]), std::abs(r[i])});
+    if (!(std::abs(s[i] - r[i]) <= 1e-6f * scale)) return false;
+  }
+  return true;
+}
+
+/// Create spectrum of random samples in [low, high]
+template <size_t N>
+CoefficientSpectrum<N>
+  randomSpectrum(std::mt19937& rng, float_t low, float_t high) {
+  std::uniform_real_distribution<float_t> dist(low, high);
+  CoefficientSpectrum<N> s;
+  for (size_t i = 0; i < N; ++i)
+    s[i] = dist(rng);
+  return s;
+}
+
+/// Compare expressions against scalar loops over samples
+template <size_t N>
+void testExpressions(std::mt19937& rng) {
+  auto name = "N = " + std::to_string(N);
+  auto a = randomSpectrum<N>(rng, 0, 4);
+  auto b = randomSpectrum<N>(rng, 0.5f, 2);
+  auto c = randomSpectrum<N>(rng, -2, 2);
+  auto d = randomSpectrum<N>(rng, -2, 2);
+  std::array<float_t, N> r;
+
+  CoefficientSpectrum<N> s = a * b + c * d;
+  for (size_t i = 0; i < N; ++i)
+    r[i] = a[i] * b[i] + c[i] * d[i];
+  rt_check(near(s, r), name + ": a * b + c * d");
+
+  s = (a - c) / b + 2.f;
+  for (size_t i = 0; i < N; ++i)
+    r[i] = (a[i] - c[i]) / b[i] + 2.f;
+  rt_check(near(s, r), name + ": (a - c) / b + 2");
+
+  s = 3.f - sqrt(a) * 0.5f / b;
+  for (size_t i = 0; i < N; ++i)
+    r[i] = 3.f - std::sqrt(a[i]) * 0.5f / b[i];
+  rt_check(near(s, r), name + ": 3 - sqrt(a) * 0.5 / b");
+
+  s = clamp(c * d, -0.5f, 1);
+  for (size_t i = 0; i < N; ++i)
+    r[i] = std::clamp(c[i] * d[i], -0.5f, 1.f);
+  rt_check(near(s, r), name + ": clamp(c * d)");
+
+  s = lerp(0.25f, a, c);
+  for (size_t i = 0; i < N; ++i)
+    r[i] = 0.75f * a[i] + 0.25f * c[i];
+  rt_check(near(s, r), name + ": lerp");
+
+  // compound assignment, and expressions referencing the assigned spectrum
+  s = a;
+  s += c * d;
+  s *= b;
+  s /= 2.f;
+  s = s * s + s;
+  for (size_t i = 0; i < N; ++i) {
+    r[i] = (a[i] + c[i] * d[i]) * b[i] / 2.f;
+    r[i] = r[i] * r[i] + r[i];
+  }
+  rt_check(near(s, r), name + ": compound assignment");
+
+  // NaN in every position is detected and kept by clamp, infinity is
+  // clamped
+  rt_check(!a.has_NaN() && !s.has_NaN(), name + ": NaN without NaN");
+  const auto nan = std::numeric_limits<float_t>::quiet_NaN();
+  const auto inf = std::numeric_limits<float_t>::infinity();
+  bool detected = true;
+  bool clamped = true;
+  for (size_t k = 0; k < N; ++k) {
+    auto e = c;
+    e[k] = nan;
+    if (N > 1) e[(k + 1) % N] = inf;
+    detected &= e.has_NaN() && CoefficientSpectrum<N>(e * a + 2.f).has_NaN();
+    CoefficientSpectrum<N> f = clamp(e, 0, 1);
+    for (size_t i = 0; i < N; ++i)
+      r[i] = std::clamp(e[i], float_t(0), float_t(1));
+    clamped &= near(f, r) && std::isnan(f[k]) && f.has_NaN();
+  }
+  rt_check(detected, name + ": NaN is not detected");
+  rt_check(clamped, name + ": clamp of NaN and infinity");
+}
+
+int main() {
+  test::test_name = "Spectrum";
+
+  std::mt19937 rng(23);
+  // sizes around packet widths, so every width and tail is used
+  testExpressions<1>(rng);
+  testExpressions<3>(rng);
+  testExpressions<4>(rng);
+  testExpressions<5>(rng);
+  testExpressions<8>(rng);
+  testExpressions<13>(rng);
+  testExpressions<16>(rng);
+  testExpressions<31>(rng);
+  testExpressions<60>(rng);
+
+  // sampled spectra evaluate expressions like coefficient spectra
+  SampledSpectrum<> x(0.5f);
+  SampledSpectrum<> y = x * x + 1.f;
+  rt_check(y == SampledSpectrum<>(1.25f), "SampledSpectrum expression");
+
+  test::summarize();
+  return test::messages.empty() ? 0 : 1;
+}
@@ -0,0 +1,227 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <vector>
+
+#include "bvh.hpp"
+#include "test_scene.hpp"
+#include "basic_renderer.hpp"
+#include "wavefront_renderer.hpp"
+
+/// \file Path tracing kernels of test scenes for renderer tests
+
+namespace naga::rt::test_renderer {
+
+  /// Samples per pixel of test renders
+  constexpr std::size_t samplesPerPixel = 4;
+  /// Max number of bounces of test renders
+  constexpr std::size_t maxDepth = 3;
+  /// Position of point light
+  const Vec3 lightPosition = Vec3(0, 30, -10);
+
+  /// Aggregate traced by kernels (Scene has no API in this tree, so kernels
+  /// ignore the scene they are created with)
+  inline std::shared_ptr<const Primitive>& aggregate() {
+    static std::shared_ptr<const Primitive> p;
+    return p;
+  }
+
+  /// Uniform random number in [0, 1) (xorshift64*)
+  inline float_t uniform(std::uint64_t* state) {
+    auto x = *state;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    *state = x;
+    return static_cast<float_t>((x * 0x2545f4914f6cdd1dull) >> 40) *
+           (1.f / (1 << 24));
+  }
+
+  /** \brief Kernels of a diffuse path tracer with one point light.
+   * Spheres and triangles have different albedo and material key.
+   */
+  class Kernels {
+  public:
+    /// Ctor
+    Kernels(
+      const std::shared_ptr<Scene>&,
+      const std::shared_ptr<Camera>&,
+      PixelLength width,
+      PixelLength height)
+      : m_width{static_cast<float_t>(width)}
+      , m_height{static_cast<float_t>(height)} {}
+
+    /// Get aggregate
+    const Primitive& getAggregate() const {
+      return *aggregate();
+    }
+    /// Generate jittered pinhole camera ray looking at [-10, 10]^3
+    Ray generateRay(PixelIndex x, PixelIndex y, std::uint64_t* rng) const {
+      auto u = (static_cast<float_t>(x) + uniform(rng)) / m_width * 2 - 1;
+      auto v = (static_cast<float_t>(y) + uniform(rng)) / m_height * 2 - 1;
+      auto aspect = m_width / m_height;
+      return Ray(Vec3(0, 0, -30), Vec3(0.5f * u * aspect, 0.5f * v, 1));
+    }
+    /// Get material key (1 for spheres, 0 for other shapes)
+    std::uint32_t getMaterialKey(const Interaction& isec) const {
+      return isSphere(std::get<SurfaceInteraction>(isec));
+    }
+    /// Shade hit (or escaped ray)
+    WavefrontShadeResult shade(
+      const Ray& ray,
+      const Interaction* isec,
+      std::uint32_t,
+      std::uint64_t* rng,
+      MemoryArena& arena) const {
+      WavefrontShadeResult r;
+      if (!isec) {
+        // sky
+        r.emitted = Vec3(0.2f, 0.3f, 0.4f) * (1 + ray.dir().y);
+        return r;
+      }
+      const auto& si = std::get<SurfaceInteraction>(*isec);
+      // albedo lives in arena like a BSDF would
+      auto albedo = arena.create<Vec3>(
+        isSphere(si) ? Vec3(0.8f, 0.3f, 0.2f) : Vec3(0.4f, 0.6f, 0.7f));
+      auto n = normalize(si.surfaceGeometry().normal);
+      if (dot(n, ray.dir()) > 0) n = -n;
+      auto p = si.pos() + 1e-3f * n;
+
+      // light sample
+      auto l = lightPosition - p;
+      auto dist = length(l);
+      auto cosine = dot(n, l) / dist;
+      if (cosine > 0) {
+        r.shadowRay = Ray(p, l, ray.time());
+        r.shadowTMax = dist * (1 - 1e-4f);
+        r.shadowRadiance = *albedo * (500 * cosine / (dist * dist));
+      }
+
+      // continue with probability 0.75 in random direction above surface
+      if (uniform(rng) < 0.75f) {
+        Vec3 d(
+          uniform(rng) * 2 - 1, uniform(rng) * 2 - 1, uniform(rng) * 2 - 1);
+        r.continues = true;
+        r.nextRay = Ray(p, n + d, ray.time());
+        r.throughputScale = *albedo / 0.75f;
+      }
+      return r;
+    }
+    /// Convert radiance to pixel
+    Pixel toPixel(const Vec3& radiance) const {
+      Pixel pixel;
+      for (auto c = 0; c < 3; ++c)
+        pixel[c] = static_cast<std::uint8_t>(
+          std::clamp<float_t>(radiance[c], 0, 1) * 255 + 0.5f);
+      return pixel;
+    }
+
+  private:
+    /// Check if interaction is on sphere
+    static bool isSphere(const SurfaceInteraction& si) {
+      return dynamic_cast<const test_scene::Sphere*>(si.shape()) != nullptr;
+    }
+
+    /// Image width
+    float_t m_width;
+    /// Image height
+    float_t m_height;
+  };
+
+  /** \brief Pixel renderer which traces paths of Kernels one by one.
+   * Paths start from the seeds of WavefrontRenderer, so both renderers
+   * render the same image.
+   */
+  class PixelRenderer {
+  public:
+    /// Ctor
+    PixelRenderer(
+      const std::shared_ptr<Scene>& scene,
+      const std::shared_ptr<Camera>& camera,
+      PixelLength width,
+      PixelLength height)
+      : m_kernels{scene, camera, width, height}
+      , m_width{static_cast<std::uint64_t>(width)} {}
+
+    /// Render pixel
+    Pixel render(PixelIndex x, PixelIndex y, MemoryArena& arena) const {
+      using Renderer = WavefrontRenderer<Kernels>;
+      constexpr auto inf = std::numeric_limits<float_t>::infinity();
+      const auto& aggregate = m_kernels.getAggregate();
+      auto pixel = static_cast<std::uint64_t>(y) * m_width +
+                   static_cast<std::uint64_t>(x);
+      Vec3 sum(0);
+      for (std::size_t s = 0; s < samplesPerPixel; ++s) {
+        auto rng = Renderer::seed(pixel * samplesPerPixel + s);
+        auto ray = m_kernels.generateRay(x, y, &rng);
+        Vec3 radiance(0);
+        Vec3 throughput(1);
+        for (std::uint32_t depth = 0;; ++depth) {
+          // rays are renormalized when loaded from queues of wavefront
+          ray = Ray(ray.origin(), ray.dir(), ray.time());
+          Interaction isec;
+          bool hit = aggregate.intersect(ray, 0, inf, &isec);
+          auto r =
+            m_kernels.shade(ray, hit ? &isec : nullptr, depth, &rng, arena);
+          arena.reset();
+          radiance += throughput * r.emitted;
+          if (r.shadowTMax > 0) {
+            auto shadowRay = Ray(
+              r.shadowRay.origin(), r.shadowRay.dir(), r.shadowRay.time());
+            if (!aggregate.intersectP(shadowRay, 0, r.shadowTMax))
+              radiance += throughput * r.shadowRadiance;
+          }
+          if (!r.continues || depth + 1 > maxDepth) break;
+          ray = r.nextRay;
+          throughput = throughput * r.throughputScale;
+        }
+        sum += radiance;
+      }
+      return m_kernels.toPixel(sum / static_cast<float_t>(samplesPerPixel));
+    }
+
+  private:
+    /// Kernels
+    Kernels m_kernels;
+    /// Image width
+    std::uint64_t m_width;
+  };
+
+  /** \brief BVH which records rays traced for closest hits, in order, while
+   * `recording` is set. Not thread-safe.
+   */
+  class RecordingBVH : public BVHAccel {
+  public:
+    using BVHAccel::BVHAccel;
+    using BVHAccel::intersect;
+
+    virtual bool intersect(
+      const Ray& ray,
+      float_t tMin,
+      float_t tMax,
+      Interaction* isec) const override {
+      if (recording) rays.push_back(ray);
+      return BVHAccel::intersect(ray, tMin, tMax, isec);
+    }
+
+    /// Record rays?
+    bool recording = false;
+    /// Recorded rays
+    mutable std::vector<Ray> rays;
+  };
+
+  /// Create scene of triangles and spheres, traced by kernels
+  inline std::shared_ptr<RecordingBVH> createScene(
+    std::size_t nTriangles, std::size_t nSpheres, std::uint32_t seed) {
+    auto primitives = test_scene::randomTriangles(nTriangles, seed);
+    auto spheres = test_scene::randomSpheres(nSpheres, seed + 1);
+    primitives.insert(primitives.end(), spheres.begin(), spheres.end());
+    auto bvh = std::make_shared<RecordingBVH>(std::move(primitives));
+    aggregate() = bvh;
+    return bvh;
+  }
+}
@@ -0,0 +1,304 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "primitive.hpp"
+#include "shape.hpp"
+#include "triangle.hpp"
+
+/// \file Random scenes and brute force reference for tests
+
+namespace naga::rt::test_scene {
+
+  /// Sphere shape (second shape type for mixed scenes)
+  class Sphere : public Shape {
+  public:
+    /// Ctor
+    Sphere(const Vec3& center, float_t radius)
+      : m_center{center}, m_radius{radius} {}
+
+    virtual bool intersect(
+      const Ray& ray,
+      float_t tMin,
+      float_t tMax,
+      Interaction* isec) const override {
+      float_t t;
+      if (!intersectT(ray, tMin, tMax, &t)) return false;
+      auto p = position(ray, t);
+      *isec = SurfaceInteraction(
+        t, p, Vec3(0), -ray.dir(), Vec2(0), Vec3(1, 0, 0), Vec3(0, 1, 0),
+        Vec3(0), Vec3(0), this);
+      return true;
+    }
+    virtual bool intersect(
+      const Ray& ray,
+      float_t tMin,
+      float_t tMax,
+      HitRecord* hit) const override {
+      float_t t;
+      if (!intersectT(ray, tMin, tMax, &t)) return false;
+      hit->t = t;
+      hit->uv = Vec2(0);
+      return true;
+    }
+    virtual bool
+      intersectP(const Ray& ray, float_t tMin, float_t tMax) const override {
+      float_t t;
+      return intersectT(ray, tMin, tMax, &t);
+    }
+    /// Find closest hit among spheres (non-virtual loop)
+    virtual bool intersectBatch(
+      ArrayView<const Shape* const> shapes,
+      const Ray& ray,
+      float_t tMin,
+      float_t tMax,
+      HitRecord* hit) const override {
+      bool found = false;
+      for (std::size_t i = 0; i < shapes.size(); ++i) {
+        float_t t;
+        if (static_cast<const Sphere*>(shapes[i])->intersectT(
+              ray, tMin, tMax, &t)) {
+          found = true;
+          tMax = t;
+          hit->t = t;
+          hit->uv = Vec2(0);
+          hit->primitive = static_cast<std::uint32_t>(i);
+        }
+      }
+      return found;
+    }
+    /// Check if any of spheres is hit (non-virtual loop)
+    virtual bool intersectBatchP(
+      ArrayView<const Shape* const> shapes,
+      const Ray& ray,
+      float_t tMin,
+      float_t tMax) const override {
+      for (auto shape : shapes) {
+        float_t t;
+        if (static_cast<const Sphere*>(shape)->intersectT(ray, tMin, tMax, &t))
+          return true;
+      }
+      return false;
+    }
+    virtual Bounds3 getBoundingBox() const override {
+      return {m_center - Vec3(m_radius), m_center + Vec3(m_radius)};
+    }
+
+    /// Move sphere (BVHs containing it should be refitted)
+    void setCenter(const Vec3& center) {
+      m_center = center;
+    }
+
+  private:
+    /// Find closest ray parameter in (tMin, tMax)
+    bool
+      intersectT(const Ray& ray, float_t tMin, float_t tMax, float_t* t) const {
+      Vec3 oc = ray.origin() - m_center;
+      float_t a = dot(ray.dir(), ray.dir());
+      float_t b = dot(oc, ray.dir());
+      float_t c = dot(oc, oc) - m_radius * m_radius;
+      float_t d = b * b - a * c;
+      if (a == 0 || d < 0) return false;
+      d = std::sqrt(d);
+      *t = (-b - d) / a;
+      if (*t > tMin && *t < tMax) return true;
+      *t = (-b + d) / a;
+      return *t > tMin && *t < tMax;
+    }
+
+    /// Center
+    Vec3 m_center;
+    /// Radius
+    float_t m_radius;
+  };
+
+  /** \brief Sphere which counts calls into its intersection kernels, one
+   * per shape or per batch (dispatches of BVH leaves). Spheres of distinct
+   * `Tag`s have distinct shape types. Counters are not thread-safe.
+   */
+  template <int Tag = 0>
+  class CountingSphere : public Sphere {
+  public:
+    using Sphere::Sphere;
+
+    virtual bool intersect(
+      const Ray& ray,
+      float_t tMin,
+      float_t tMax,
+      Interaction* isec) const override {
+      ++nCalls;
+      return Sphere::intersect(ray, tMin, tMax, isec);
+    }
+    virtual bool intersect(
+      const Ray& ray,
+      float_t tMin,
+      float_t tMax,
+      HitRecord* hit) const override {
+      ++nCalls;
+      return Sphere::intersect(ray, tMin, tMax, hit);
+    }
+    virtual bool
+      intersectP(const Ray& ray, float_t tMin, float_t tMax) const override {
+      ++nCalls;
+      return Sphere::intersectP(ray, tMin, tMax);
+    }
+    virtual bool intersectBatch(
+      ArrayView<const Shape* const> shapes,
+      const Ray& ray,
+      float_t tMin,
+      float_t tMax,
+      HitRecord* hit) const override {
+      ++nCalls;
+      batches.push_back(shapes);
+      return Sphere::intersectBatch(shapes, ray, tMin, tMax, hit);
+    }
+    virtual bool intersectBatchP(
+      ArrayView<const Shape* const> shapes,
+      const Ray& ray,
+      float_t tMin,
+      float_t tMax) const override {
+      ++nCalls;
+      batches.push_back(shapes);
+      return Sphere::intersectBatchP(shapes, ray, tMin, tMax);
+    }
+
+    /// Number of calls
+    static inline std::size_t nCalls = 0;
+    /// Shapes of batch calls
+    static inline std::vector<ArrayView<const Shape* const>> batches;
+  };
+
+  /// Wrap shape into primitive
+  inline std::shared_ptr<Primitive> makePrimitive(std::shared_ptr<Shape> s) {
+    return std::make_shared<GeometricPrimitive>(nullptr, nullptr, s);
+  }
+
+  /// Create mesh of `n` random triangles in [-10, 10]^3.
+  /// Every fourth triangle is long and thin, to exercise spatial splits.
+  inline std::shared_ptr<const TriangleMesh>
+    randomMesh(std::size_t n, std::uint32_t seed) {
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<float_t> pos(-10, 10);
+    std::uniform_real_distribution<float_t> offset(-1, 1);
+    std::vector<std::uint32_t> indices;
+    std::vector<Vec3> positions;
+    for (std::size_t i = 0; i < n; ++i) {
+      Vec3 a(pos(rng), pos(rng), pos(rng));
+      float_t size = i % 4 == 0 ? 10 : 0.5f;
+      Vec3 b = a + size * Vec3(offset(rng), offset(rng), offset(rng));
+      Vec3 c = a + 0.5f * Vec3(offset(rng), offset(rng), offset(rng));
+      for (auto p : {a, b, c}) {
+        indices.push_back(static_cast<std::uint32_t>(positions.size()));
+        positions.push_back(p);
+      }
+    }
+    return std::make_shared<TriangleMesh>(
+      Transform(), std::move(indices), std::move(positions));
+  }
+
+  /// Create primitives of `n` random triangles
+  inline std::vector<std::shared_ptr<Primitive>>
+    randomTriangles(std::size_t n, std::uint32_t seed) {
+    std::vector<std::shared_ptr<Primitive>> primitives;
+    for (auto& t : createTriangles(randomMesh(n, seed)))
+      primitives.push_back(makePrimitive(t));
+    return primitives;
+  }
+
+  /// Create primitives of `n` small random triangles in [-10, 10]^3 (long
+  /// triangles of randomTriangles() dominate traversal time of benchmarks)
+  inline std::vector<std::shared_ptr<Primitive>>
+    smallTriangles(std::size_t n, std::uint32_t seed) {
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<float_t> pos(-10, 10);
+    std::uniform_real_distribution<float_t> offset(-0.2f, 0.2f);
+    std::vector<std::uint32_t> indices;
+    std::vector<Vec3> positions;
+    for (std::size_t i = 0; i < 3 * n; ++i) {
+      if (i % 3 == 0) {
+        positions.emplace_back(pos(rng), pos(rng), pos(rng));
+      } else {
+        positions.push_back(
+          positions[i - i % 3] + Vec3(offset(rng), offset(rng), offset(rng)));
+      }
+      indices.push_back(static_cast<std::uint32_t>(i));
+    }
+    auto mesh = std::make_shared<TriangleMesh>(
+      Transform(), std::move(indices), std::move(positions));
+    std::vector<std::shared_ptr<Primitive>> primitives;
+    for (auto& t : createTriangles(mesh))
+      primitives.push_back(makePrimitive(t));
+    return primitives;
+  }
+
+  /// Create primitives of `n` random spheres
+  inline std::vector<std::shared_ptr<Primitive>>
+    randomSpheres(std::size_t n, std::uint32_t seed) {
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<float_t> pos(-10, 10);
+    std::uniform_real_distribution<float_t> radius(0.05f, 0.5f);
+    std::vector<std::shared_ptr<Primitive>> primitives;
+    for (std::size_t i = 0; i < n; ++i) {
+      Vec3 c(pos(rng), pos(rng), pos(rng));
+      primitives.push_back(
+        makePrimitive(std::make_shared<Sphere>(c, radius(rng))));
+    }
+    return primitives;
+  }
+
+  /** \brief Create random ray through [-10, 10]^3.
+   * Some rays have direction components of +0 or -0, which select the
+   * sign of infinite inverse directions.
+   */
+  inline Ray randomRay(std::mt19937& rng) {
+    std::uniform_real_distribution<float_t> pos(-12, 12);
+    std::uniform_int_distribution<int> axis(0, 7);
+    Vec3 o(pos(rng), pos(rng), pos(rng));
+    Vec3 d = Vec3(pos(rng), pos(rng), pos(rng)) - o;
+    auto a = axis(rng);
+    if (a < 3) d[a] = 0;
+    if (a >= 3 && a < 6) d[a - 3] = -0.f;
+    if (d == Vec3(0)) d.x = 1;
+    return Ray(o, d);
+  }
+
+  /// Find closest hit by testing every primitive
+  inline bool intersect(
+    const std::vector<std::shared_ptr<Primitive>>& primitives,
+    const Ray& ray,
+    float_t tMin,
+    float_t tMax,
+    float_t* t) {
+    bool found = false;
+    for (auto& p : primitives) {
+      Interaction isec;
+      if (p->intersect(ray, tMin, tMax, &isec)) {
+        found = true;
+        tMax = getRayParam(isec);
+      }
+    }
+    *t = tMax;
+    return found;
+  }
+
+  /// Check if ray hits any primitive by testing every primitive
+  inline bool intersectP(
+    const std::vector<std::shared_ptr<Primitive>>& primitives,
+    const Ray& ray,
+    float_t tMin,
+    float_t tMax) {
+    for (auto& p : primitives)
+      if (p->intersectP(ray, tMin, tMax)) return true;
+    return false;
+  }
+
+  /// Check if hit parameters agree
+  inline bool sameHit(bool hit0, float_t t0, bool hit1, float_t t1) {
+    if (hit0 != hit1) return false;
+    return !hit0 || std::abs(t0 - t1) <= 1e-4f * std::max<float_t>(1, t0);
+  }
+}
@@ -0,0 +1,178 @@
+#include "transform.hpp"
+#include "test.hpp"
+
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace naga::rt;
+
+/// Transform bounds by merging all 8 transformed corners
+Bounds3 transformCorners(const Mat4& m, const Bounds3& b) {
+  Bounds3 ret;
+  for (unsigned char i = 0; i < 8; ++i) {
+    auto p = m * Vec4(b.corner(i), 1);
+    auto q = Vec3(p) / p.w;
+    ret = i == 0 ? Bounds3(q) : Bounds3::merge(ret, q);
+  }
+  return ret;
+}
+
+/// Check if vectors agree up to rounding
+bool near(const Vec3& a, const Vec3& b) {
+  for (auto i = 0; i < 3; ++i) {
+    auto scale = std::max<float_t>({1, std::abs(a[i]), std::abs(b[i])});
+    if (!(std::abs(a[i] - b[i]) <= 1e-4f * scale)) return false;
+  }
+  return true;
+}
+
+/// Check if bounds agree up to rounding
+bool near(const Bounds3& a, const Bounds3& b) {
+  return near(a.min(), b.min()) && near(a.max(), b.max());
+}
+
+/// Create random affine matrix (scale, rotation and translation)
+Mat4 randomAffine(std::mt19937& rng) {
+  std::uniform_real_distribution<float_t> pos(-10, 10);
+  std::uniform_real_distribution<float_t> scale(0.1f, 4);
+  std::uniform_real_distribution<float_t> angle(-pi<float_t>, pi<float_t>);
+  Vec3 axis(pos(rng), pos(rng), pos(rng));
+  if (axis == Vec3(0)) axis.x = 1;
+  auto t = Transform::translate(Vec3(pos(rng), pos(rng), pos(rng)));
+  auto r = Transform::rotate(Radian(angle(rng)), glm::normalize(axis));
+  auto s = Transform::scale(Vec3(scale(rng), -scale(rng), scale(rng)));
+  return t.getMatrix() * r.getMatrix() * s.getMatrix();
+}
+
+/// Create random box in [-10, 10]^3, some of them flat
+Bounds3 randomBounds(std::mt19937& rng) {
+  std::uniform_real_distribution<float_t> pos(-10, 10);
+  Vec3 a(pos(rng), pos(rng), pos(rng));
+  Vec3 b(pos(rng), pos(rng), pos(rng));
+  if (rng() % 8 == 0) b.y = a.y;
+  return Bounds3(a, b);
+}
+
+/// Check bounds of single box by every variant
+void testBounds(const Mat4& m, const Bounds3& b, const std::string& name) {
+  auto expected = b.empty() ? b : transformCorners(m, b);
+  rt_check(near(transformBounds(m, b), expected), name + ": transformBounds");
+  rt_check(
+    near(Transform(m).transformBounds(b), expected),
+    name + ": Transform::transformBounds");
+  if (isAffine(m)) {
+    rt_check(
+      near(AffineTransform(Transform(m)).transformBounds(b), expected),
+      name + ": AffineTransform::transformBounds");
+  }
+}
+
+int main() {
+  test::test_name = "Transform";
+
+  std::mt19937 rng(16);
+
+  // perspective with w > 0 over [-10, 10]^3
+  Mat4 projective(1);
+  projective[2][3] = 0.05f;
+  projective[3][3] = 1;
+  rt_check(!isAffine(projective), "projective matrix is affine");
+
+  Bounds3 empty;
+  empty.setMin(Vec3(1));
+  empty.setMax(Vec3(-1));
+
+  std::vector<Mat4> matrices;
+  for (auto i = 0; i < 20; ++i)
+    matrices.push_back(randomAffine(rng));
+  matrices.push_back(projective);
+  matrices.push_back(projective * randomAffine(rng));
+
+  // single boxes
+  for (std::size_t i = 0; i < matrices.size(); ++i) {
+    auto name = (isAffine(matrices[i]) ? "affine " : "projective ") +
+                std::to_string(i);
+    for (auto j = 0; j < 20; ++j)
+      testBounds(matrices[i], randomBounds(rng), name);
+    testBounds(matrices[i], empty, name + " (empty)");
+    rt_check(
+      transformBounds(matrices[i], empty).min() == empty.min(),
+      name + ": empty bounds are changed");
+  }
+
+  // arrays, sizes around SIMD width, in place and one matrix per box
+  for (std::size_t n : {0, 1, 7, 8, 9, 33}) {
+    std::vector<Bounds3> bounds;
+    for (std::size_t i = 0; i < n; ++i)
+      bounds.push_back(i % 5 == 4 ? empty : randomBounds(rng));
+    for (auto& m : {matrices[0], projective}) {
+      auto name = std::string(isAffine(m) ? "affine" : "projective") +
+                  " array of " + std::to_string(n);
+      std::vector<Bounds3> out(n);
+      transformBounds(m, bounds, out);
+      auto inPlace = bounds;
+      transformBounds(m, inPlace, inPlace);
+      bool same = true;
+      for (std::size_t i = 0; i < n; ++i)
+        same &= near(out[i], transformBounds(m, bounds[i])) &&
+                near(inPlace[i], out[i]);
+      rt_check(same, name);
+    }
+    std::vector<Mat4> perBox;
+    for (std::size_t i = 0; i < n; ++i)
+      perBox.push_back(matrices[i % matrices.size()]);
+    std::vector<Bounds3> out(n);
+    transformBounds(perBox, bounds, out);
+    bool same = true;
+    for (std::size_t i = 0; i < n; ++i)
+      same &= near(out[i], transformBounds(perBox[i], bounds[i]));
+    rt_check(same, "matrix per box, array of " + std::to_string(n));
+  }
+
+  // affine transform of points, vectors and normals agrees with Transform
+  std::uniform_real_distribution<float_t> pos(-10, 10);
+  for (auto i = 0; i < 20; ++i) {
+    Transform t(matrices[i]);
+    AffineTransform a(t);
+    auto name = "affine " + std::to_string(i);
+    for (std::size_t n : {1, 7, 8, 9, 33}) {
+      std::vector<Vec3> points(n);
+      std::vector<float_t> x(n), y(n), z(n);
+      for (std::size_t k = 0; k < n; ++k) {
+        points[k] = Vec3(pos(rng), pos(rng), pos(rng));
+        x[k] = points[k].x;
+        y[k] = points[k].y;
+        z[k] = points[k].z;
+      }
+      std::vector<Vec3> outPoints(n), outNormals(n);
+      a.transformPoints(points, outPoints);
+      a.transformNormals(points, outNormals);
+      std::vector<float_t> px(n), py(n), pz(n);
+      a.transformPoints(x.data(), y.data(), z.data(), px.data(), py.data(),
+                        pz.data(), n);
+      // vectors in place
+      a.transformVectors(x.data(), y.data(), z.data(), x.data(), y.data(),
+                         z.data(), n);
+      bool same = true;
+      for (std::size_t k = 0; k < n; ++k) {
+        auto& p = points[k];
+        same &= near(a.transformPoint(p), t.transformPoint(p)) &&
+                near(a.transformVector(p), t.transformVector(p)) &&
+                near(a.transformNormal(p), t.transformNormal(p)) &&
+                near(outPoints[k], t.transformPoint(p)) &&
+                near(outNormals[k], t.transformNormal(p)) &&
+                near(Vec3(px[k], py[k], pz[k]), t.transformPoint(p)) &&
+                near(Vec3(x[k], y[k], z[k]), t.transformVector(p));
+      }
+      rt_check(same, name + ": points of " + std::to_string(n));
+    }
+    rt_check(
+      near(a.inverse().transformPoint(a.transformPoint(Vec3(1, 2, 3))),
+           Vec3(1, 2, 3)),
+      name + ": inverse");
+  }
+
+  test::summarize();
+  return test::messages.empty() ? 0 : 1;
+}
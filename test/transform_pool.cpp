@@ -0,0 +1,85 @@
+#include "transform_pool.hpp"
+#include "test.hpp"
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+using namespace naga::rt;
+
+/// Check if matrices have same bits
+bool sameBits(const Mat4& a, const Mat4& b) {
+  return std::memcmp(&a, &b, sizeof(Mat4)) == 0;
+}
+
+int main() {
+  test::test_name = "TransformPool";
+
+  // more matrices than one block holds
+  const std::size_t n = 3000;
+  std::vector<Mat4> matrices;
+  for (std::size_t i = 0; i < n; ++i)
+    matrices.push_back(
+      Transform::translate(Vec3(float_t(i), float_t(i % 7), 1)).getMatrix());
+
+  TransformPool pool;
+  std::vector<TransformPool::Handle> handles;
+  for (auto& m : matrices)
+    handles.push_back(pool.intern(m));
+  rt_check(pool.size() == n, "distinct matrices are merged");
+  rt_check(pool.getNumHits() == 0, "hits of distinct matrices");
+  const Transform* first = &pool.get(handles[0]);
+
+  // same matrices get same handles, by matrix or by transform
+  bool same = true;
+  for (std::size_t i = 0; i < n; ++i) {
+    same &= pool.intern(matrices[i]) == handles[i];
+    same &= pool.intern(Transform(matrices[i])) == handles[i];
+  }
+  rt_check(same, "same matrix gets other handle");
+  rt_check(pool.size() == n, "same matrices are added");
+  rt_check(pool.getNumHits() == 2 * n, "number of hits");
+
+  // interned transforms hold matrix and inverse
+  same = true;
+  for (std::size_t i = 0; i < n; ++i) {
+    auto& t = pool.get(handles[i]);
+    same &= sameBits(t.getMatrix(), matrices[i]) &&
+            sameBits(t.getInverseMatrix(), glm::inverse(matrices[i]));
+  }
+  rt_check(same, "interned transform differs");
+  rt_check(first == &pool.get(handles[0]), "transform moved by growth");
+
+  // inverse of interned transform is kept
+  Mat4 inverse(2);
+  auto h = pool.intern(Transform(Mat4(0.25f), inverse));
+  rt_check(
+    sameBits(pool.get(h).getInverseMatrix(), inverse),
+    "inverse of transform is recomputed");
+
+  // matrices are compared bitwise
+  Mat4 zero(1);
+  Mat4 negativeZero(1);
+  negativeZero[3][0] = -0.f;
+  rt_check(
+    pool.intern(zero) != pool.intern(negativeZero), "0 and -0 are merged");
+
+  // shared pointers keep storage alive
+  std::shared_ptr<const Transform> shared;
+  std::shared_ptr<const Mat4> matrix, inverseMatrix;
+  {
+    TransformPool local;
+    auto handle = local.intern(matrices[5]);
+    shared = local.share(handle);
+    matrix = local.shareMatrix(handle);
+    inverseMatrix = local.shareInverseMatrix(handle);
+  }
+  rt_check(
+    sameBits(shared->getMatrix(), matrices[5]) &&
+      sameBits(*matrix, matrices[5]) &&
+      sameBits(*inverseMatrix, glm::inverse(matrices[5])),
+    "shared transform after pool is destroyed");
+
+  test::summarize();
+  return test::messages.empty() ? 0 : 1;
+}
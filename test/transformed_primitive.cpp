@@ -0,0 +1,115 @@
+#include "bvh.hpp"
+#include "test.hpp"
+#include "test_scene.hpp"
+
+#include <cmath>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace naga::rt;
+
+/// Check if points agree (relative to their distance from origin)
+bool samePoint(const Vec3& a, const Vec3& b) {
+  return length(a - b) <= 1e-3f * std::max<float_t>(1, length(a));
+}
+
+/// Get normalized geometric normal of surface interaction
+Vec3 getNormal(const Interaction& isec) {
+  auto& si = std::get<SurfaceInteraction>(isec);
+  return normalize(si.surfaceGeometry().normal);
+}
+
+int main() {
+  test::test_name = "TransformedPrimitive";
+
+  auto mesh = test_scene::randomMesh(300, 50);
+  std::vector<std::shared_ptr<Primitive>> local;
+  for (auto& t : createTriangles(mesh))
+    local.push_back(test_scene::makePrimitive(t));
+  std::shared_ptr<Primitive> bvh = std::make_shared<BVHAccel>(local);
+
+  auto axis = normalize(Vec3(1, 2, 3));
+  std::pair<std::string, Transform> transforms[] = {
+    {"translated", Transform::translate(Vec3(1, -2, 0.5f))},
+    {"scaled",
+     Transform(
+       Transform::translate(Vec3(-1, 0, 2)).getMatrix() *
+       Transform::scale(Vec3(0.5f, 1.5f, 0.8f)).getMatrix())},
+    {"rotated",
+     Transform(
+       Transform::translate(Vec3(0, 1, -1)).getMatrix() *
+       Transform::rotate(Radian(0.7f), axis).getMatrix())},
+    {"rotated and scaled",
+     Transform(
+       Transform::rotate(Radian(-1.3f), axis).getMatrix() *
+       Transform::scale(Vec3(1.2f, 0.6f, 0.9f)).getMatrix())}};
+
+  std::mt19937 rng(51);
+  std::vector<Ray> rays;
+  for (auto i = 0; i < 3000; ++i)
+    rays.push_back(test_scene::randomRay(rng));
+
+  for (auto& [name, transform] : transforms) {
+    // instance, and its triangles transformed to world space
+    auto instanceToWorld = std::make_shared<const Transform>(transform);
+    TransformedPrimitive instance(bvh, instanceToWorld);
+    std::vector<Vec3> positions;
+    for (auto& p : mesh->getPositions())
+      positions.push_back(transform.transformPoint(p));
+    auto indices = mesh->getIndices();
+    auto worldMesh = std::make_shared<TriangleMesh>(
+      Transform(),
+      std::vector<std::uint32_t>(indices.begin(), indices.end()),
+      std::move(positions));
+    std::vector<std::shared_ptr<Primitive>> world;
+    for (auto& t : createTriangles(worldMesh))
+      world.push_back(test_scene::makePrimitive(t));
+
+    std::size_t nHits = 0, nMismatches = 0;
+    for (auto& ray : rays) {
+      float_t t;
+      bool hit = test_scene::intersect(world, ray, 0, 100, &t);
+      nHits += hit;
+
+      Interaction isec;
+      bool hit0 = instance.intersect(ray, 0, 100, &isec);
+      HitRecord record;
+      bool hit1 = instance.intersect(ray, 0, 100, &record);
+      if (
+        !test_scene::sameHit(hit, t, hit0, hit0 ? getRayParam(isec) : 0) ||
+        !test_scene::sameHit(hit, t, hit1, record.t)) {
+        ++nMismatches;
+        continue;
+      }
+
+      // occlusion before and after the closest hit
+      for (float_t tMax : {hit ? t * 0.99f : 100, hit ? t * 1.01f : 50}) {
+        nMismatches += instance.intersectP(ray, 0, tMax) !=
+                       test_scene::intersectP(world, ray, 0, tMax);
+      }
+      if (!hit) continue;
+
+      // position and normal of hit, from both paths
+      Interaction expected;
+      for (auto& p : world)
+        if (p->intersect(ray, 0, t * 1.0001f, &expected)) break;
+      auto p = position(ray, t);
+      auto n = getNormal(expected);
+      for (auto& found : {isec, instance.getInteraction(ray, record)}) {
+        auto& si = std::get<SurfaceInteraction>(found);
+        nMismatches +=
+          !samePoint(si.pos(), p) || dot(getNormal(found), n) < 0.999f;
+      }
+    }
+    rt_check(nHits > 100, name + ": too few hits");
+    rt_check(
+      nMismatches == 0,
+      name + ": " + std::to_string(nMismatches) + " mismatches of " +
+        std::to_string(nHits) + " hits");
+  }
+
+  test::summarize();
+  return test::messages.empty() ? 0 : 1;
+}
@@ -0,0 +1,176 @@
+#include "bvh.hpp"
+#include "test.hpp"
+#include "test_scene.hpp"
+
+#include <algorithm>
+#include <limits>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace naga::rt;
+
+/** \brief Create surface of cube [0, n]^3 of 2 triangles per unit square,
+ * wound outwards, so that all vertices and midpoints of edges are exact
+ */
+std::shared_ptr<TriangleMesh> latticeCube(int n, const Transform& transform) {
+  std::vector<Vec3> positions;
+  std::vector<std::uint32_t> indices;
+  for (auto axis = 0; axis < 3; ++axis) {
+    auto u = (axis + 1) % 3;
+    auto v = (axis + 2) % 3;
+    for (auto side = 0; side < 2; ++side) {
+      auto base = static_cast<std::uint32_t>(positions.size());
+      for (auto j = 0; j <= n; ++j) {
+        for (auto i = 0; i <= n; ++i) {
+          Vec3 p;
+          p[axis] = float_t(side * n);
+          p[u] = float_t(i);
+          p[v] = float_t(j);
+          positions.push_back(p);
+        }
+      }
+      auto index = [&](int i, int j) {
+        return base + static_cast<std::uint32_t>(j * (n + 1) + i);
+      };
+      for (auto j = 0; j < n; ++j) {
+        for (auto i = 0; i < n; ++i) {
+          std::uint32_t q[4] = {
+            index(i, j), index(i + 1, j), index(i + 1, j + 1),
+            index(i, j + 1)};
+          // u x v is +axis, so reverse winding of side 0
+          if (side == 0) std::swap(q[1], q[3]);
+          indices.insert(indices.end(), {q[0], q[1], q[2], q[0], q[2], q[3]});
+        }
+      }
+    }
+  }
+  // vertices of faces are duplicated, so weld them to share edges
+  std::vector<Vec3> welded;
+  for (auto& index : indices) {
+    auto p = positions[index];
+    auto it = std::find(welded.begin(), welded.end(), p);
+    index = static_cast<std::uint32_t>(it - welded.begin());
+    if (it == welded.end()) welded.push_back(p);
+  }
+  return std::make_shared<TriangleMesh>(
+    transform, std::move(indices), std::move(welded));
+}
+
+/// Get vertices and midpoints of edges of mesh
+std::vector<Vec3> getTargets(const TriangleMesh& mesh) {
+  auto positions = mesh.getPositions();
+  auto indices = mesh.getIndices();
+  std::vector<Vec3> targets(positions.begin(), positions.end());
+  for (std::size_t i = 0; i < indices.size(); i += 3) {
+    for (auto e = 0; e < 3; ++e) {
+      auto a = positions[indices[i + e]];
+      auto b = positions[indices[i + (e + 1) % 3]];
+      targets.push_back((a + b) * float_t(0.5f));
+    }
+  }
+  return targets;
+}
+
+/// Count hits of ray over all triangles
+std::size_t countHits(
+  const std::vector<std::shared_ptr<Triangle>>& triangles, const Ray& ray) {
+  WatertightRay wray(ray);
+  std::size_t n = 0;
+  for (auto& t : triangles)
+    n += t->intersectP(wray, 0, std::numeric_limits<float_t>::infinity());
+  return n;
+}
+
+/// Check if line through cube [0, n]^3 enters its interior (exactly, with
+/// small integer coordinates)
+bool crossesInterior(const Vec3& origin, const Vec3& dir, int n) {
+  double tNear = -std::numeric_limits<double>::infinity();
+  double tFar = std::numeric_limits<double>::infinity();
+  for (auto a = 0; a < 3; ++a) {
+    if (dir[a] == 0) {
+      if (!(origin[a] > 0 && origin[a] < n)) return false;
+      continue;
+    }
+    double t0 = (0 - double(origin[a])) / dir[a];
+    double t1 = (n - double(origin[a])) / dir[a];
+    tNear = std::max(tNear, std::min(t0, t1));
+    tFar = std::min(tFar, std::max(t0, t1));
+  }
+  return tNear < tFar;
+}
+
+int main() {
+  test::test_name = "Triangle (watertight)";
+
+  // rays in exact arithmetic: ray space coordinates of lattice points are
+  // exact, so rays through edges and vertices give edge functions of 0
+  const int n = 4;
+  auto cube = latticeCube(n, Transform());
+  auto triangles = createTriangles(cube);
+  const Vec3 dirs[] = {Vec3(0, 0, 1),  Vec3(1, 0, 0),   Vec3(0, -1, 0),
+                       Vec3(1, 0, 2),  Vec3(1, 1, 2),   Vec3(-1, 2, 4),
+                       Vec3(2, 2, 1),  Vec3(-4, 1, -2), Vec3(1, 1, 1),
+                       Vec3(1, -1, 0), Vec3(-2, 1, 1),  Vec3(1, 2, 4)};
+  std::size_t nRays = 0, nMisses = 0, nDoubleHits = 0;
+  for (auto& target : getTargets(*cube)) {
+    for (auto& dir : dirs) {
+      // origin outside of cube
+      Vec3 origin = target - float_t(16) * dir;
+      if (!crossesInterior(origin, dir, n)) continue;
+      // entry and exit
+      auto nHits = countHits(triangles, Ray(origin, dir));
+      nMisses += nHits < 2;
+      nDoubleHits += nHits > 2;
+      ++nRays;
+    }
+  }
+  rt_check(nRays > 1000, "too few rays through interior");
+  rt_check(
+    nMisses == 0 && nDoubleHits == 0,
+    "exact rays through edges and vertices: " + std::to_string(nMisses) +
+      " misses, " + std::to_string(nDoubleHits) + " double hits of " +
+      std::to_string(nRays));
+
+  // rotated and scaled cube, rays from outside through center
+  std::mt19937 rng(52);
+  std::uniform_real_distribution<float_t> jitter(-0.01f, 0.01f);
+  auto transform = Transform(
+    Transform::rotate(Radian(0.4f), normalize(Vec3(1, -2, 3))).getMatrix() *
+    Transform::scale(Vec3(0.3f, 0.7f, 1.1f)).getMatrix());
+  auto rotated = latticeCube(n, transform);
+  triangles = createTriangles(rotated);
+  auto center = transform.transformPoint(Vec3(float_t(n) / 2));
+  std::vector<std::shared_ptr<Primitive>> primitives;
+  for (auto& t : triangles)
+    primitives.push_back(test_scene::makePrimitive(t));
+  BVHBuildOptions options;
+  options.packTriangles = true;
+  BVHAccel bvh(primitives, options);
+  nRays = nMisses = nDoubleHits = 0;
+  std::size_t nBVHMisses = 0;
+  for (auto& target : getTargets(*rotated)) {
+    for (auto i = 0; i < 4; ++i) {
+      auto offset = target - center;
+      auto origin = center + float_t(3) * offset +
+                    Vec3(jitter(rng), jitter(rng), jitter(rng));
+      Ray ray(origin, target - origin);
+      auto nHits = countHits(triangles, ray);
+      nMisses += nHits < 2;
+      nDoubleHits += nHits > 2;
+      HitRecord hit;
+      nBVHMisses += !bvh.intersect(
+        ray, 0, std::numeric_limits<float_t>::infinity(), &hit);
+      ++nRays;
+    }
+  }
+  rt_check(
+    nMisses == 0 && nDoubleHits == 0 && nBVHMisses == 0,
+    "rays through edges and vertices of transformed cube: " +
+      std::to_string(nMisses) + " misses, " + std::to_string(nDoubleHits) +
+      " double hits, " + std::to_string(nBVHMisses) + " BVH misses of " +
+      std::to_string(nRays));
+
+  test::summarize();
+  return test::messages.empty() ? 0 : 1;
+}
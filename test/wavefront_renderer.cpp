@@ -0,0 +1,80 @@
+#include "test.hpp"
+#include "test_renderer.hpp"
+
+#include <set>
+#include <string>
+
+using namespace naga::rt;
+
+/// Get 24-bit color of pixel
+std::uint32_t getColor(Image& img, std::size_t x, std::size_t y) {
+  const auto& p = img(PixelIndex(x), PixelIndex(y));
+  return std::uint32_t(p[0]) << 16 | std::uint32_t(p[1]) << 8 | p[2];
+}
+
+/// Count pixels which differ
+std::size_t countMismatches(Image& a, Image& b) {
+  std::size_t n = 0;
+  for (std::size_t y = 0; y < std::size_t(a.height()); ++y)
+    for (std::size_t x = 0; x < std::size_t(a.width()); ++x)
+      n += getColor(a, x, y) != getColor(b, x, y);
+  return n;
+}
+
+int main() {
+  test::test_name = "WavefrontRenderer";
+
+  using test_renderer::maxDepth;
+  using test_renderer::samplesPerPixel;
+  test_renderer::createScene(3000, 1000, 30);
+  const std::size_t width = 32;
+  const std::size_t height = 24;
+
+  // reference: paths traced one by one
+  Image expected{PixelLength(width), PixelLength(height)};
+  BasicRenderer<test_renderer::PixelRenderer>(nullptr, nullptr, 4, 4, 4)
+    .render(expected);
+  // most pixels see lit surfaces, so the image has many distinct pixels
+  std::set<std::uint32_t> colors;
+  for (std::size_t y = 0; y < height; ++y)
+    for (std::size_t x = 0; x < width; ++x)
+      colors.insert(getColor(expected, x, y));
+  rt_assert(colors.size() > width * height / 4, "image is not rendered");
+
+  // waves smaller than image, one path per wave, and whole image per wave,
+  // with ray sorting on and off
+  struct Case {
+    std::string name;
+    std::size_t nThreads;
+    std::size_t waveSize;
+    RaySortOptions sort;
+  };
+  RaySortOptions unsorted;
+  unsorted.enabled = false;
+  RaySortOptions smallBatches;
+  smallBatches.batchSize = 7;
+  RaySortOptions wholeQueue;
+  wholeQueue.batchSize = 0;
+  Case cases[] = {
+    {"1 thread", 1, 1 << 20, {}},
+    {"4 threads", 4, 1 << 20, {}},
+    {"small waves", 4, 100, {}},
+    {"one pixel per wave", 3, samplesPerPixel, {}},
+    {"unsorted", 4, 1000, unsorted},
+    {"small sort batches", 4, 1000, smallBatches},
+    {"sort whole queue", 4, 1000, wholeQueue}};
+  for (auto& c : cases) {
+    Image img{PixelLength(width), PixelLength(height)};
+    WavefrontRenderer<test_renderer::Kernels>(
+      nullptr, nullptr, c.nThreads, samplesPerPixel, maxDepth, c.waveSize,
+      c.sort)
+      .render(img);
+    auto n = countMismatches(img, expected);
+    rt_check(
+      n == 0, c.name + ": " + std::to_string(n) + " pixels differ from "
+                "BasicRenderer");
+  }
+
+  test::summarize();
+  return test::messages.empty() ? 0 : 1;
+}
@@ -0,0 +1,81 @@
+#include "wide_bvh.hpp"
+#include "test.hpp"
+#include "test_scene.hpp"
+
+#include <random>
+#include <string>
+
+using namespace naga::rt;
+
+/// Compare wide BVH against binary BVH it was collapsed from
+template <std::size_t Width>
+void compare(
+  const BVHAccel& bvh, const std::vector<Ray>& rays, const std::string& name) {
+  WideBVHAccel<Width> wide(bvh);
+  rt_check(
+    wide.getBoundingBox().min() == bvh.getBoundingBox().min() &&
+      wide.getBoundingBox().max() == bvh.getBoundingBox().max(),
+    name + ": bounds");
+
+  std::size_t nMismatches = 0;
+  for (auto& ray : rays) {
+    HitRecord hit0, hit1;
+    bool found0 = bvh.intersect(ray, 0, 100, &hit0);
+    bool found1 = wide.intersect(ray, 0, 100, &hit1);
+    if (!test_scene::sameHit(found0, hit0.t, found1, hit1.t)) ++nMismatches;
+
+    Interaction isec0, isec1;
+    found0 = bvh.intersect(ray, 0, 100, &isec0);
+    found1 = wide.intersect(ray, 0, 100, &isec1);
+    if (
+      found0 != found1 ||
+      (found0 && getRayParam(isec0) != getRayParam(isec1)))
+      ++nMismatches;
+
+    for (float_t tMax : {found0 ? hit0.t * 0.5f : 100, float_t(100)}) {
+      if (bvh.intersectP(ray, 0, tMax) != wide.intersectP(ray, 0, tMax))
+        ++nMismatches;
+    }
+  }
+  rt_check(
+    nMismatches == 0,
+    name + ": " + std::to_string(nMismatches) + " mismatches");
+}
+
+int main() {
+  test::test_name = "WideBVHAccel";
+
+  auto primitives = test_scene::randomTriangles(1500, 3);
+  auto spheres = test_scene::randomSpheres(500, 4);
+  primitives.insert(primitives.end(), spheres.begin(), spheres.end());
+  auto few = test_scene::randomSpheres(3, 5);
+
+  std::mt19937 rng(6);
+  std::vector<Ray> rays;
+  for (auto i = 0; i < 2000; ++i)
+    rays.push_back(test_scene::randomRay(rng));
+
+  std::pair<BVHBuildMethod, std::string> methods[] = {
+    {BVHBuildMethod::SAH, "SAH"},
+    {BVHBuildMethod::HLBVH, "HLBVH"},
+    {BVHBuildMethod::SBVH, "SBVH"}};
+
+  for (auto& [method, name] : methods) {
+    BVHBuildOptions options;
+    options.method = method;
+    BVHAccel bvh(primitives, options);
+    compare<4>(bvh, rays, name + "/4");
+    compare<8>(bvh, rays, name + "/8");
+
+    // root is a leaf
+    BVHAccel single(few, options);
+    compare<4>(single, rays, name + "/4 (single leaf)");
+    compare<8>(single, rays, name + "/8 (single leaf)");
+
+    BVHAccel empty({}, options);
+    compare<4>(empty, rays, name + "/4 (empty)");
+  }
+
+  test::summarize();
+  return test::messages.empty() ? 0 : 1;
+}